@@ -0,0 +1,412 @@
+#pragma once
+
+// Helpers shared by the hub benchmarks. Each benchmark is a standalone program built from
+// CENTRAL_HUB, e.g.  g++ -O2 -pthread -I. -o reactor_bench bench/reactor_bench.cpp
+
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "io_backend.h"
+
+inline uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// User + system CPU consumed by the calling process, in nanoseconds
+inline uint64_t process_cpu_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+inline void raise_fd_limit() {
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+}
+
+// Bind a loopback listener on an ephemeral port and return it, filling in the port
+inline int bench_listen(uint16_t &port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        perror("bind/listen");
+        exit(EXIT_FAILURE);
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(fd, (struct sockaddr *)&addr, &len);
+    port = ntohs(addr.sin_port);
+    return fd;
+}
+
+struct BenchPacket{
+    int pkt_type;
+    float temperature;
+};
+
+struct BenchCommand{
+    int pkt_type;
+    float temperature;
+    int motor_pos;
+};
+
+static uint64_t bench_expected_packets;
+static int bench_report_fd;
+
+// What a forked benchmark server reports back to the driver when it exits
+struct ServerReport{
+    uint64_t packets;
+    uint64_t cpu_ns;
+    long max_rss_kb;
+};
+
+inline void send_report(int pipe_fd, uint64_t packets) {
+    ServerReport report;
+    report.packets = packets;
+    report.cpu_ns = process_cpu_ns();
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    report.max_rss_kb = usage.ru_maxrss;
+    if (write(pipe_fd, &report, sizeof(report)) != (ssize_t)sizeof(report)) {
+        perror("report pipe");
+    }
+}
+
+// Client side of the vent protocol: N sockets driven from one epoll set
+class VentSwarm{
+    public:
+        std::vector<int> fds;
+        int epoll_fd;
+
+        VentSwarm() : epoll_fd(epoll_create1(0)) {}
+        ~VentSwarm() {
+            for (size_t i = 0; i < fds.size(); i++) {
+                close(fds[i]);
+            }
+            close(epoll_fd);
+        }
+
+        // Connect count sockets and wait for every one of them to be established
+        bool connect_all(uint16_t port, size_t count) {
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = htons(port);
+            size_t pending = 0;
+            for (size_t i = 0; i < count; i++) {
+                int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+                if (fd < 0) {
+                    perror("client socket");
+                    return false;
+                }
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+                    perror("connect");
+                    close(fd);
+                    return false;
+                }
+                epoll_event ev = {};
+                ev.events = EPOLLOUT | EPOLLONESHOT;
+                ev.data.u64 = fds.size();
+                epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+                fds.push_back(fd);
+                pending++;
+            }
+            epoll_event events[256];
+            while (pending > 0) {
+                int n = epoll_wait(epoll_fd, events, 256, 5000);
+                if (n <= 0) {
+                    fprintf(stderr, "connect timed out with %zu pending\n", pending);
+                    return false;
+                }
+                pending -= n;
+            }
+            for (size_t i = 0; i < fds.size(); i++) {
+                epoll_event ev = {};
+                ev.events = EPOLLIN;
+                ev.data.u64 = i;
+                epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fds[i], &ev);
+            }
+            return true;
+        }
+
+        // Send one frame on every socket, then wait until reply_len bytes came back on each
+        bool round_trip(const void *frame, size_t len, size_t reply_len) {
+            for (size_t i = 0; i < fds.size(); i++) {
+                if (send(fds[i], frame, len, MSG_NOSIGNAL) != (ssize_t)len) {
+                    perror("client send");
+                    return false;
+                }
+            }
+            std::vector<size_t> got(fds.size(), 0);
+            size_t done = 0;
+            epoll_event events[256];
+            char buffer[256];
+            while (done < fds.size()) {
+                int n = epoll_wait(epoll_fd, events, 256, 5000);
+                if (n <= 0) {
+                    fprintf(stderr, "round trip timed out, %zu/%zu replied\n", done, fds.size());
+                    return false;
+                }
+                for (int e = 0; e < n; e++) {
+                    size_t i = events[e].data.u64;
+                    ssize_t r = recv(fds[i], buffer, sizeof(buffer), 0);
+                    if (r == 0) {
+                        fprintf(stderr, "server closed vent %zu\n", i);
+                        return false;
+                    }
+                    if (r < 0) {
+                        continue;
+                    }
+                    size_t before = got[i];
+                    got[i] += r;
+                    if (before < reply_len && got[i] >= reply_len) {
+                        done++;
+                    }
+                }
+            }
+            return true;
+        }
+};
+
+// Server side for backend benchmarks: answers every packet with one command
+class EchoHandler : public ConnectionHandler{
+    public:
+        IoBackend *backend;
+        uint64_t packets;
+
+        EchoHandler() : backend(NULL), packets(0) {}
+
+        bool on_open(Connection &conn) { return true; }
+
+        void on_data(Connection &conn, const char *data, size_t len) {
+            BenchCommand command = {0x2, 0.0f, 5};
+            backend->send(conn, &command, sizeof(command));
+            packets++;
+            if (packets == bench_expected_packets) {
+                // Completion backends only hand sends to the kernel on flush
+                backend->flush();
+                send_report(bench_report_fd, packets);
+                _exit(0);
+            }
+        }
+
+        void on_close(Connection &conn) {}
+};
+
+// Fork a server running serve(listen_fd), drive it from a VentSwarm and print one result line.
+// The server must exit through send_report() once bench_expected_packets have arrived.
+inline void run_server_model(const char *model, void (*serve)(int), size_t connections, size_t rounds) {
+    uint16_t port;
+    int server_fd = bench_listen(port);
+    int pipe_fds[2];
+    if (pipe(pipe_fds) < 0) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+    bench_expected_packets = (uint64_t)connections * (rounds + 1);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(pipe_fds[0]);
+        bench_report_fd = pipe_fds[1];
+        serve(server_fd);
+        _exit(1);
+    }
+    close(pipe_fds[1]);
+    close(server_fd);
+
+    BenchPacket packet = {0x1, 22.5f};
+    VentSwarm swarm;
+
+    // Connection phase: a vent only counts once the server has answered its first packet
+    uint64_t start = now_ns();
+    if (!swarm.connect_all(port, connections) ||
+        !swarm.round_trip(&packet, sizeof(packet), sizeof(BenchCommand))) {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        exit(EXIT_FAILURE);
+    }
+    uint64_t connected = now_ns();
+
+    for (size_t r = 0; r < rounds; r++) {
+        if (!swarm.round_trip(&packet, sizeof(packet), sizeof(BenchCommand))) {
+            kill(pid, SIGKILL);
+            waitpid(pid, NULL, 0);
+            exit(EXIT_FAILURE);
+        }
+    }
+    uint64_t finished = now_ns();
+
+    ServerReport report;
+    if (read(pipe_fds[0], &report, sizeof(report)) != (ssize_t)sizeof(report)) {
+        fprintf(stderr, "%s: server did not report\n", model);
+        exit(EXIT_FAILURE);
+    }
+    waitpid(pid, NULL, 0);
+    close(pipe_fds[0]);
+
+    double connect_s = (connected - start) / 1e9;
+    double steady_s = (finished - connected) / 1e9;
+    printf("%-9s vents=%-6zu conn/s=%-10.0f pkt/s=%-10.0f cpu/pkt=%-8.0fns server_rss=%ldKB\n",
+           model, connections, connections / connect_s,
+           (double)connections * rounds / steady_s,
+           (double)report.cpu_ns / report.packets, report.max_rss_kb);
+}
+
+// Log-linear latency histogram: 8 sub-buckets per power of two, so any recorded value is
+// reported within 12.5%. Not thread-safe; give each thread its own and merge().
+class LatencyHistogram{
+    public:
+        LatencyHistogram() : total(0), max_ns(0) { memset(counts, 0, sizeof(counts)); }
+
+        void record(uint64_t ns) {
+            counts[bucket(ns)]++;
+            total++;
+            max_ns = ns > max_ns ? ns : max_ns;
+        }
+
+        void merge(const LatencyHistogram &other) {
+            for (int i = 0; i < BUCKETS; i++) {
+                counts[i] += other.counts[i];
+            }
+            total += other.total;
+            max_ns = other.max_ns > max_ns ? other.max_ns : max_ns;
+        }
+
+        // Upper bound of the bucket holding the q-th quantile, q in [0, 1]
+        uint64_t percentile(double q) const {
+            uint64_t rank = (uint64_t)(q * total);
+            uint64_t seen = 0;
+            for (int i = 0; i < BUCKETS; i++) {
+                seen += counts[i];
+                if (seen > rank) {
+                    uint64_t upper = upper_bound(i);
+                    return upper < max_ns ? upper : max_ns;
+                }
+            }
+            return max_ns;
+        }
+
+        uint64_t count() const { return total; }
+        uint64_t max() const { return max_ns; }
+
+        void print(const char *label) const {
+            printf("%-10s n=%-9lu p50=%-7lu p90=%-7lu p99=%-7lu p99.9=%-8lu max=%lu ns\n", label,
+                   (unsigned long)total, (unsigned long)percentile(0.5), (unsigned long)percentile(0.9),
+                   (unsigned long)percentile(0.99), (unsigned long)percentile(0.999), (unsigned long)max_ns);
+        }
+
+    private:
+        enum { SUB = 8, BUCKETS = 64 * SUB };
+
+        static int bucket(uint64_t ns) {
+            if (ns < SUB) {
+                return (int)ns;
+            }
+            int msb = 63 - __builtin_clzll(ns);
+            return (msb - 2) * SUB + (int)((ns >> (msb - 3)) & (SUB - 1));
+        }
+
+        static uint64_t upper_bound(int b) {
+            if (b < SUB) {
+                return (uint64_t)b;
+            }
+            int msb = b / SUB + 2;
+            uint64_t base = 1ull << msb;
+            return base + ((uint64_t)(b % SUB + 1) << (msb - 3)) - 1;
+        }
+
+        uint64_t counts[BUCKETS];
+        uint64_t total;
+        uint64_t max_ns;
+};
+
+// ---- driving a real hub binary ----
+
+inline int connect_local(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// The hub's whole metrics page, empty if the endpoint is not up
+inline std::string scrape_page(uint16_t port) {
+    std::string page;
+    int fd = connect_local(port);
+    if (fd < 0) {
+        return page;
+    }
+    const char *request = "GET /metrics HTTP/1.0\r\n\r\n";
+    send(fd, request, strlen(request), MSG_NOSIGNAL);
+    char buffer[65536];
+    ssize_t n;
+    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        page.append(buffer, n);
+    }
+    close(fd);
+    return page;
+}
+
+// Value of one series (name plus any labels) on a scraped page, or -1 if it is not there
+inline double page_value(const std::string &page, const std::string &series) {
+    std::string key = "\n" + series + " ";
+    size_t at = page.find(key);
+    return at == std::string::npos ? -1 : atof(page.c_str() + at + key.size());
+}
+
+// User + system CPU consumed by another process so far
+inline uint64_t process_cpu_ns(pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return 0;
+    }
+    unsigned long utime = 0, stime = 0;
+    // Fields 14 and 15; the command name in field 2 has no spaces for the hub
+    if (fscanf(f, "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2) {
+        utime = stime = 0;
+    }
+    fclose(f);
+    return (uint64_t)(utime + stime) * 1000000000ull / sysconf(_SC_CLK_TCK);
+}
@@ -0,0 +1,267 @@
+// Vents reconnecting nonstop: does the hub's memory stay flat?
+//
+//   g++ -O2 -pthread -I. -o churn_bench bench/churn_bench.cpp
+//   ./churn_bench [--rate=1000] [--duration=3600] [--report=60] [--vents=1000] [--steady=100] [--io-uring]
+//
+// A backend runs in this process on its own thread, with a handler that does what the
+// hub's does per connection: reassemble frames, decode each reading and answer it with a
+// cover. --steady vents connect once and stay. The churn thread then opens --rate new
+// connections a second, each from one of --vents loopback addresses in turn, sends one
+// reading, waits for the cover and closes, for --duration seconds.
+//
+// Every --report seconds it prints the resident set, the heap in use and free inside it
+// (mallinfo2), operator new calls per connection churned and still outstanding, and the
+// backend's connection objects open and allocated. With connections pooled, RSS and heap
+// should level off within the first report and allocations per connection stay near the
+// handful the send path makes.
+
+#include <malloc.h>
+#include <atomic>
+#include <new>
+#include <thread>
+#include "bench_common.h"
+#include "io_uring_backend.h"
+#include "packet.h"
+
+static std::atomic<uint64_t> heap_allocs(0);
+static std::atomic<uint64_t> heap_frees(0);
+
+void *operator new(size_t size) {
+    heap_allocs.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size > 0 ? size : 1);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    if (p != NULL) {
+        heap_frees.fetch_add(1, std::memory_order_relaxed);
+        free(p);
+    }
+}
+
+void operator delete(void *p, size_t size) noexcept {
+    (void)size;
+    operator delete(p);
+}
+
+// The hub's per-connection work without its control loop: every reading gets a cover
+class ChurnHandler : public ConnectionHandler{
+    public:
+        IoBackend *backend;
+        std::atomic<uint64_t> opened;
+        std::atomic<uint64_t> readings;
+
+        ChurnHandler() : backend(NULL), opened(0), readings(0) {}
+
+        bool on_open(Connection &conn) {
+            conn.vent_num = ntohl(conn.peer.sin_addr.s_addr) & 0xffff;
+            opened.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        void on_data(Connection &conn, const char *data, size_t len) {
+            bool ok = conn.decoder.feed(data, len, [this, &conn](const char *payload, size_t payload_len) {
+                Packet reading;
+                if (!parse_packet(payload, payload_len, reading)) {
+                    return;
+                }
+                Packet command;
+                command.pkt_type = 2;
+                command.temperature = 23.0f;
+                command.motor_pos = reading.temperature < 23.0f ? 10 : 0;
+                char frame[FRAME_HEADER_SIZE + sizeof(Packet)];
+                size_t frame_len = encode_frame(frame, &command, sizeof(command));
+                backend->send_batched(conn, frame, frame_len);
+                readings.fetch_add(1, std::memory_order_relaxed);
+            });
+            backend->flush();
+            if (!ok) {
+                backend->close(conn);
+            }
+        }
+
+        void on_close(Connection &conn) { (void)conn; }
+};
+
+// Connect from 127.3.x.y, so reconnects of one vent share its address as a real vent's do
+static int connect_vent(uint16_t port, unsigned vent) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl((127u << 24) | (3u << 16) | (1 + vent));
+    local.sin_port = 0;
+    struct timeval timeout = {2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&local, sizeof(local)) < 0 ||
+        connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// One reading out and its cover back
+static bool exchange(int fd, float temperature) {
+    Packet reading;
+    reading.pkt_type = 1;
+    reading.temperature = temperature;
+    reading.motor_pos = 0;
+    char frame[FRAME_HEADER_SIZE + sizeof(Packet)];
+    size_t frame_len = encode_frame(frame, &reading, sizeof(reading));
+    if (send(fd, frame, frame_len, MSG_NOSIGNAL) != (ssize_t)frame_len) {
+        return false;
+    }
+    size_t got = 0;
+    while (got < frame_len) {
+        ssize_t n = recv(fd, frame + got, frame_len - got, 0);
+        if (n <= 0) {
+            return false;
+        }
+        got += n;
+    }
+    return true;
+}
+
+static long rss_kb() {
+    long pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f != NULL) {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(f);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+int main(int argc, char **argv) {
+    double rate = 1000;
+    double duration = 3600;
+    double report = 60;
+    unsigned vent_count = 1000;
+    unsigned steady = 100;
+    bool want_uring = false;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--rate=", 7) == 0) {
+            rate = atof(argv[i] + 7);
+        } else if (strncmp(argv[i], "--duration=", 11) == 0) {
+            duration = atof(argv[i] + 11);
+        } else if (strncmp(argv[i], "--report=", 9) == 0) {
+            report = atof(argv[i] + 9);
+        } else if (strncmp(argv[i], "--vents=", 8) == 0) {
+            vent_count = (unsigned)atoi(argv[i] + 8);
+        } else if (strncmp(argv[i], "--steady=", 9) == 0) {
+            steady = (unsigned)atoi(argv[i] + 9);
+        } else if (strcmp(argv[i], "--io-uring") == 0) {
+            want_uring = true;
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (vent_count < 1 || vent_count > 60000 || rate <= 0 || report <= 0) {
+        fprintf(stderr, "need 1-60000 vents and a positive rate and report period\n");
+        return EXIT_FAILURE;
+    }
+    raise_fd_limit();
+    signal(SIGPIPE, SIG_IGN);
+
+    uint16_t port = 0;
+    int server_fd = bench_listen(port);
+    ChurnHandler handler;
+    IoBackend *backend = create_backend(handler, want_uring);
+    handler.backend = backend;
+    backend->listen(server_fd);
+    std::thread server([backend]() { backend->run(); });
+    printf("backend %s, %.0f connections/s for %.0f s, %u vent addresses, %u steady\n",
+           backend->name(), rate, duration, vent_count, steady);
+
+    // Steady vents take the top addresses so churned ones never collide with them
+    std::vector<int> held;
+    for (unsigned v = 0; v < steady; v++) {
+        int fd = connect_vent(port, 60000 + v);
+        if (fd < 0 || !exchange(fd, 22.0f)) {
+            fprintf(stderr, "steady vent %u failed: %s\n", v, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        held.push_back(fd);
+    }
+
+    uint64_t churned = 0, failed = 0, last_churned = 0;
+    uint64_t last_allocs = heap_allocs.load();
+    long first_rss = 0, peak_rss = 0;
+    uint64_t start = now_ns();
+    uint64_t interval = (uint64_t)(1e9 / rate);
+    uint64_t next_report = start + (uint64_t)(report * 1e9);
+    uint64_t end = start + (uint64_t)(duration * 1e9);
+    uint64_t due = start;
+    while (due < end) {
+        uint64_t now = now_ns();
+        if (now < due) {
+            struct timespec ts = {0, (long)(due - now)};
+            nanosleep(&ts, NULL);
+            now = due;
+        }
+        int fd = connect_vent(port, (unsigned)(churned % vent_count));
+        if (fd >= 0 && exchange(fd, 20.0f + (churned % 60) * 0.1f)) {
+            churned++;
+        } else {
+            failed++;
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        due += interval;
+
+        if (now >= next_report || due >= end) {
+            // Let the server finish the closes already in flight before sampling
+            usleep(20000);
+            uint64_t allocs = heap_allocs.load(std::memory_order_relaxed);
+            uint64_t frees = heap_frees.load(std::memory_order_relaxed);
+            struct mallinfo2 heap = mallinfo2();
+            long rss = rss_kb();
+            if (first_rss == 0) {
+                first_rss = rss;
+            }
+            peak_rss = rss > peak_rss ? rss : peak_rss;
+            uint64_t delta = churned - last_churned;
+            printf("t=%6.0fs  churned %9llu  lag %5.0f ms  rss %7ld kB  heap used %6zu kB free %6zu kB  "
+                   "allocs/conn %5.2f  outstanding %7llu  conns open %5zu slots %5zu  failed %llu\n",
+                   (now - start) / 1e9, (unsigned long long)churned,
+                   now > due ? (now - due) / 1e6 : 0.0, rss, heap.uordblks / 1024, heap.fordblks / 1024,
+                   delta > 0 ? (double)(allocs - last_allocs) / delta : 0.0,
+                   (unsigned long long)(allocs - frees), backend->connections_open(),
+                   backend->connection_slots(), (unsigned long long)failed);
+            fflush(stdout);
+            last_churned = churned;
+            last_allocs = allocs;
+            next_report += (uint64_t)(report * 1e9);
+        }
+    }
+
+    double elapsed = (now_ns() - start) / 1e9;
+    printf("churned %llu connections in %.0f s (%.0f/s), %llu failed; rss %ld kB at the first report, "
+           "%ld kB peak, %ld kB at the end\n",
+           (unsigned long long)churned, elapsed, churned / elapsed, (unsigned long long)failed,
+           first_rss, peak_rss, rss_kb());
+    for (size_t i = 0; i < held.size(); i++) {
+        close(held[i]);
+    }
+    backend->stop();
+    server.join();
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,208 @@
+// Command latency through the hub's per-vent command scheduler.
+//
+//   g++ -O2 -pthread -DHLOG_LEVEL=HLOG_LEVEL_INFO -o hub_info main.cpp
+//   g++ -O2 -pthread -I. -o command_bench bench/command_bench.cpp
+//   ./command_bench [--vents=1000] [--seconds=10] [--gaps=0,500] ./hub_info
+//
+// Starts the hub once per gap with --hysteresis --command-gap=G, --no-log and --no-snapshot,
+// then runs every vent as its own little state machine from one epoll loop: send a reading
+// that flips the hysteresis cover, wait for the command, think for a random 0..2G ms, repeat.
+// Latency is reading sent to command received. Readings sent at least G after the vent's
+// previous command should go out on the next control tick ("free"); the rest are held by the
+// scheduler until the gap has run out ("held"), so their latency includes the wait. The
+// smallest spacing seen between two commands to one vent checks the gap is kept, less a 10 ms
+// timer tick and however late this process got round to reading them. Most of the free latency is the 100 ms control tick, which batches the
+// controller pass; it is reported so a regression in the scheduler shows up above it.
+
+#include "bench_common.h"
+
+#define HUB_PORT 8080
+#define HUB_METRICS_PORT 9464
+#define COMMAND_FRAME 16           // length header + type, temperature, motor position
+#define LOST_MS 5000
+
+struct BenchVent{
+    uint64_t sent_ns;              // 0 while not waiting for a command
+    uint64_t next_send_ns;
+    uint64_t last_command_ns;
+    bool free;                     // sent at least a gap after the previous command
+    bool high;
+    size_t got;                    // bytes towards the current command frame
+};
+
+static uint64_t rng_state = 88172645463325252ull;
+
+static uint64_t next_random() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static void run_gap(const char *binary, unsigned gap_ms, size_t count, double seconds) {
+    char dir[] = "/tmp/command_bench.XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        exit(EXIT_FAILURE);
+    }
+    char gap_arg[32];
+    snprintf(gap_arg, sizeof(gap_arg), "--command-gap=%u", gap_ms);
+    pid_t hub = fork();
+    if (hub == 0) {
+        if (chdir(dir) < 0) {
+            _exit(1);
+        }
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        execl(binary, binary, "--hysteresis", gap_arg, "--no-log", "--no-snapshot", (char *)NULL);
+        _exit(127);
+    }
+    uint64_t deadline = now_ns() + 5000000000ull;
+    while (page_value(scrape_page(HUB_METRICS_PORT), "hub_packets_total") < 0) {
+        if (now_ns() > deadline) {
+            fprintf(stderr, "gap=%u: hub did not come up\n", gap_ms);
+            kill(hub, SIGKILL);
+            waitpid(hub, NULL, 0);
+            return;
+        }
+        usleep(10000);
+    }
+
+    VentSwarm swarm;
+    if (!swarm.connect_all(HUB_PORT, count)) {
+        kill(hub, SIGKILL);
+        waitpid(hub, NULL, 0);
+        return;
+    }
+    for (size_t i = 0; i < swarm.fds.size(); i++) {
+        fcntl(swarm.fds[i], F_SETFL, fcntl(swarm.fds[i], F_GETFL) | O_NONBLOCK);
+    }
+
+    char frames[2][64];
+    size_t frame_len = 0;
+    for (int h = 0; h < 2; h++) {
+        BenchPacket packet = {0x1, h ? 28.0f : 18.0f};
+        frame_len = encode_frame(frames[h], &packet, sizeof(packet));
+    }
+
+    // Spread the first readings over one gap so the vents do not move in lockstep
+    std::vector<BenchVent> vents(count);
+    uint64_t start = now_ns();
+    uint64_t gap_ns = (uint64_t)gap_ms * 1000000ull;
+    for (size_t i = 0; i < count; i++) {
+        vents[i].sent_ns = 0;
+        vents[i].next_send_ns = start + (gap_ns ? next_random() % gap_ns : 0);
+        vents[i].last_command_ns = 0;
+        vents[i].free = true;
+        vents[i].high = false;      // the first reading is 28 C, which moves the cover off COVER_MIN
+        vents[i].got = 0;
+    }
+
+    LatencyHistogram free_latency, held_latency;
+    uint64_t min_spacing = ~0ull;
+    uint64_t lost = 0;
+    uint64_t end = start + (uint64_t)(seconds * 1e9);
+    epoll_event events[256];
+    char buffer[256];
+    while (1) {
+        uint64_t now = now_ns();
+        if (now >= end) {
+            break;
+        }
+        for (size_t i = 0; i < count; i++) {
+            BenchVent &vent = vents[i];
+            if (vent.sent_ns != 0 && now - vent.sent_ns > LOST_MS * 1000000ull) {
+                lost++;
+                vent.sent_ns = 0;
+                vent.next_send_ns = now;
+            }
+            if (vent.sent_ns == 0 && now >= vent.next_send_ns) {
+                vent.high = !vent.high;
+                if (send(swarm.fds[i], frames[vent.high], frame_len, MSG_NOSIGNAL) == (ssize_t)frame_len) {
+                    vent.sent_ns = now;
+                    vent.free = vent.last_command_ns == 0 || now - vent.last_command_ns >= gap_ns;
+                }
+            }
+        }
+        int n = epoll_wait(swarm.epoll_fd, events, 256, 1);
+        now = now_ns();
+        for (int e = 0; e < n; e++) {
+            size_t i = events[e].data.u64;
+            BenchVent &vent = vents[i];
+            ssize_t r;
+            while ((r = recv(swarm.fds[i], buffer, sizeof(buffer), 0)) > 0) {
+                vent.got += r;
+            }
+            while (vent.got >= COMMAND_FRAME) {
+                vent.got -= COMMAND_FRAME;
+                if (vent.last_command_ns != 0 && now - vent.last_command_ns < min_spacing) {
+                    min_spacing = now - vent.last_command_ns;
+                }
+                vent.last_command_ns = now;
+                if (vent.sent_ns != 0) {
+                    (vent.free ? free_latency : held_latency).record(now - vent.sent_ns);
+                    vent.sent_ns = 0;
+                    vent.next_send_ns = now + (gap_ns ? next_random() % (2 * gap_ns) : 0);
+                }
+            }
+        }
+    }
+    std::string page = scrape_page(HUB_METRICS_PORT);
+    kill(hub, SIGKILL);
+    waitpid(hub, NULL, 0);
+    rmdir(dir);
+
+    printf("gap=%u ms, %zu vents, %.0f s: %llu commands, %llu lost, smallest spacing to one vent %.1f ms, "
+           "hub held=%.0f superseded=%.0f\n", gap_ms, count, seconds,
+           (unsigned long long)(free_latency.count() + held_latency.count()), (unsigned long long)lost,
+           min_spacing == ~0ull ? 0.0 : min_spacing / 1e6, page_value(page, "hub_commands_held_total"),
+           page_value(page, "hub_commands_superseded_total"));
+    printf("  free  n=%-7llu p50=%7.1f ms  p99=%7.1f ms  max=%7.1f ms\n", (unsigned long long)free_latency.count(),
+           free_latency.percentile(0.5) / 1e6, free_latency.percentile(0.99) / 1e6, free_latency.max() / 1e6);
+    if (held_latency.count() > 0) {
+        printf("  held  n=%-7llu p50=%7.1f ms  p99=%7.1f ms  max=%7.1f ms\n", (unsigned long long)held_latency.count(),
+               held_latency.percentile(0.5) / 1e6, held_latency.percentile(0.99) / 1e6, held_latency.max() / 1e6);
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t count = 1000;
+    double seconds = 10.0;
+    std::vector<unsigned> gaps;
+    const char *binary = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--vents=", 8) == 0) {
+            count = strtoul(argv[i] + 8, NULL, 10);
+        } else if (strncmp(argv[i], "--seconds=", 10) == 0) {
+            seconds = atof(argv[i] + 10);
+        } else if (strncmp(argv[i], "--gaps=", 7) == 0) {
+            char *p = argv[i] + 7;
+            while (*p != '\0') {
+                char *next;
+                unsigned gap = (unsigned)strtoul(p, &next, 10);
+                if (next == p) {
+                    break;
+                }
+                gaps.push_back(gap);
+                p = *next == ',' ? next + 1 : next;
+            }
+        } else {
+            binary = argv[i];
+        }
+    }
+    if (binary == NULL) {
+        fprintf(stderr, "usage: %s [--vents=N] [--seconds=S] [--gaps=0,500] hub_binary\n", argv[0]);
+        return 1;
+    }
+    if (gaps.empty()) {
+        gaps.push_back(0);
+        gaps.push_back(500);
+    }
+    signal(SIGPIPE, SIG_IGN);
+    raise_fd_limit();
+    for (size_t g = 0; g < gaps.size(); g++) {
+        run_gap(binary, gaps[g], count, seconds);
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+// Scalar per-packet update_cover() versus ControlEngine's batched tick.
+//
+//   g++ -O3 -march=native -I. -o control_bench bench/control_bench.cpp
+//   ./control_bench [ticks=200]
+//
+// Every vent reports once per tick. The scalar path runs update_cover() (or the hysteresis
+// rule) once per reading, as the hub used to do per packet; the batched path stores the
+// readings and runs one ControlEngine::tick(). Half the vents use hysteresis in both paths.
+
+#include <random>
+#include <vector>
+#include "bench_common.h"
+#include "control_engine.h"
+
+struct Result{
+    double ns_per_vent;
+    size_t moves;
+};
+
+static Result run_scalar(size_t vents, size_t ticks, const std::vector<float> &readings) {
+    PidGains gains;
+    std::vector<PidState> state(vents);
+    std::vector<int> cover(vents, COVER_MIN);
+    size_t moves = 0;
+    uint64_t start = now_ns();
+    for (size_t t = 0; t < ticks; t++) {
+        const float *reading = &readings[(t % 64) * vents];
+        for (size_t v = 0; v < vents; v++) {
+            int next = (v & 1) ? hysteresis_cover(reading[v], 23.0f, cover[v])
+                               : update_cover(state[v], gains, reading[v], 23.0f);
+            if (next != cover[v]) {
+                cover[v] = next;
+                moves++;
+            }
+        }
+    }
+    Result r;
+    r.ns_per_vent = (double)(now_ns() - start) / (ticks * vents);
+    r.moves = moves;
+    return r;
+}
+
+static Result run_batched(size_t vents, size_t ticks, const std::vector<float> &readings) {
+    ControlEngine engine;
+    for (size_t v = 0; v < vents; v++) {
+        engine.add_vent(23.0f, (v & 1) ? CONTROL_HYSTERESIS : CONTROL_PID);
+    }
+    std::vector<uint32_t> changed;
+    changed.reserve(vents);
+    size_t moves = 0;
+    uint64_t start = now_ns();
+    for (size_t t = 0; t < ticks; t++) {
+        const float *reading = &readings[(t % 64) * vents];
+        for (size_t v = 0; v < vents; v++) {
+            engine.set_temperature(v, reading[v]);
+        }
+        changed.clear();
+        engine.tick(changed);
+        moves += changed.size();
+    }
+    Result r;
+    r.ns_per_vent = (double)(now_ns() - start) / (ticks * vents);
+    r.moves = moves;
+    return r;
+}
+
+int main(int argc, char **argv) {
+    size_t ticks = argc > 1 ? strtoul(argv[1], NULL, 10) : 200;
+    size_t sizes[] = {10, 1000, 10000, 50000};
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<float> temp(20.0f, 26.0f);
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t vents = sizes[s];
+        size_t rounds = ticks * (50000 / vents > 0 ? 50000 / vents : 1);
+        if (rounds > 100000) {
+            rounds = 100000;
+        }
+        std::vector<float> readings(64 * vents);
+        for (size_t i = 0; i < readings.size(); i++) {
+            readings[i] = temp(gen);
+        }
+        Result scalar = run_scalar(vents, rounds, readings);
+        Result batched = run_batched(vents, rounds, readings);
+        // Moves differ by a handful at most: the scalar path is double precision
+        printf("vents=%-6zu scalar=%6.2f ns/vent  batched=%6.2f ns/vent  speedup=%.1fx  moves %zu vs %zu\n",
+               vents, scalar.ns_per_vent, batched.ns_per_vent, scalar.ns_per_vent / batched.ns_per_vent,
+               scalar.moves, batched.moves);
+    }
+    return 0;
+}
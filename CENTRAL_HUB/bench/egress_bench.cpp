@@ -0,0 +1,242 @@
+// Whole-house setpoint change: per-command send() versus CommandEgress.
+//
+//   g++ -O2 -pthread -I. -o egress_bench bench/egress_bench.cpp
+//   ./egress_bench [bursts=50] [steps=3]
+//
+// Each burst moves every vent's cover `steps` times before the I/O thread gets to run, the
+// way a setpoint ramp does. per-command hands each position to the backend as it is posted,
+// as the hub did before (one send() each on epoll). egress coalesces to the latest position
+// per vent and flushes the tick in one pass. latency is from the start of the burst until a
+// vent has its final position; io-cpu is the I/O thread's CPU time per burst spent handing
+// commands to the backend. On io_uring per-command leaves submission to the loop's own
+// io_uring_enter, so its io-cpu misses that part.
+
+#include <pthread.h>
+#include <thread>
+#include "bench_common.h"
+#include "egress.h"
+#include "io_uring_backend.h"
+
+struct WireCommand{
+    int pkt_type;
+    float temperature;
+    int motor_pos;
+};
+
+#define WIRE_FRAME (FRAME_HEADER_SIZE + sizeof(WireCommand))
+
+// By vent index; written and read on the I/O thread only
+static std::vector<Connection *> vent_conns;
+
+static size_t encode_command(Vent &vent, int motor_pos, char *out) {
+    WireCommand command = {0x2, vent.desired_temperature.load(), motor_pos};
+    return encode_frame(out, &command, sizeof(command));
+}
+
+class BenchEgress : public CommandEgress{
+    public:
+        uint64_t cpu_ns;
+
+        BenchEgress(VentRegistry &registry) : CommandEgress(registry), cpu_ns(0) {}
+
+        size_t encode(Vent &vent, int motor_pos, char *out) { return encode_command(vent, motor_pos, out); }
+
+        Connection *connection(uint32_t index) { return vent_conns[index]; }
+
+        void on_ring() {
+            uint64_t start = thread_cpu_ns();
+            CommandEgress::on_ring();
+            cpu_ns += thread_cpu_ns() - start;
+        }
+
+        static uint64_t thread_cpu_ns() {
+            struct timespec ts;
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+            return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+        }
+};
+
+// The pre-egress path: every posted command is queued and sent on its own
+class PerCommand : public Doorbell{
+    public:
+        struct Item{
+            uint32_t vent;
+            int motor_pos;
+        };
+        VentRegistry &registry;
+        IoBackend *backend;
+        MpscQueue<Item> queue;
+        uint64_t sent;
+        uint64_t cpu_ns;
+
+        PerCommand(VentRegistry &r) : registry(r), backend(NULL), queue(EGRESS_QUEUE_SIZE), sent(0), cpu_ns(0) {}
+
+        void post(Vent &vent, int motor_pos) {
+            Item item = {vent.index, motor_pos};
+            while (!queue.try_push(item)) {
+                ring();
+                sched_yield();
+            }
+        }
+
+        void on_ring() {
+            uint64_t start = BenchEgress::thread_cpu_ns();
+            Item item;
+            char frame[EGRESS_MAX_FRAME];
+            while (queue.try_pop(item)) {
+                Connection *conn = vent_conns[item.vent];
+                if (conn != NULL) {
+                    size_t len = encode_command(registry.at(item.vent), item.motor_pos, frame);
+                    sent += backend->send(*conn, frame, len);
+                }
+            }
+            cpu_ns += BenchEgress::thread_cpu_ns() - start;
+        }
+};
+
+class RegisterHandler : public ConnectionHandler{
+    public:
+        VentRegistry &registry;
+        std::atomic<size_t> connected;
+        unsigned next_id;
+
+        RegisterHandler(VentRegistry &r) : registry(r), connected(0), next_id(0) {}
+
+        bool on_open(Connection &conn) {
+            Vent *vent = registry.add(next_id++);
+            conn.vent_num = vent->index;
+            if (vent_conns.size() <= vent->index) {
+                vent_conns.resize(vent->index + 1, NULL);
+            }
+            vent_conns[vent->index] = &conn;
+            connected.fetch_add(1);
+            return true;
+        }
+        void on_data(Connection &conn, const char *data, size_t len) {}
+        void on_close(Connection &conn) { vent_conns[conn.vent_num] = NULL; }
+};
+
+// Wait until every vent has received expected_bytes since the burst started
+static bool collect(VentSwarm &swarm, size_t expected_bytes, uint64_t start, LatencyHistogram &latency) {
+    std::vector<size_t> got(swarm.fds.size(), 0);
+    size_t done = 0;
+    epoll_event events[256];
+    char buffer[4096];
+    while (done < swarm.fds.size()) {
+        int n = epoll_wait(swarm.epoll_fd, events, 256, 5000);
+        if (n <= 0) {
+            fprintf(stderr, "burst timed out, %zu/%zu vents done\n", done, swarm.fds.size());
+            return false;
+        }
+        for (int e = 0; e < n; e++) {
+            size_t i = events[e].data.u64;
+            while (1) {
+                ssize_t r = recv(swarm.fds[i], buffer, sizeof(buffer), MSG_DONTWAIT);
+                if (r <= 0) {
+                    break;
+                }
+                size_t before = got[i];
+                got[i] += r;
+                if (before < expected_bytes && got[i] >= expected_bytes) {
+                    latency.record(now_ns() - start);
+                    done++;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+template <class Egress>
+static void run(const char *label, bool uring, size_t vents, size_t bursts, size_t steps) {
+    VentRegistry registry;
+    RegisterHandler handler(registry);
+    IoBackend *backend = create_backend(handler, uring);
+    if (uring && strcmp(backend->name(), "io_uring") != 0) {
+        delete backend;
+        return;
+    }
+    Egress egress(registry);
+    uint16_t port;
+    int listen_fd = bench_listen(port);
+    backend->listen(listen_fd);
+    egress.backend = backend;
+    egress.start(backend->reactor());
+    std::thread io([backend]() { backend->run(); });
+
+    VentSwarm swarm;
+    if (!swarm.connect_all(port, vents)) {
+        exit(EXIT_FAILURE);
+    }
+    while (handler.connected.load() < vents) {
+        sched_yield();
+    }
+
+    LatencyHistogram latency;
+    uint64_t total_ns = 0;
+    size_t per_burst = (Egress::COALESCES ? 1 : steps) * WIRE_FRAME;
+    for (size_t b = 0; b < bursts; b++) {
+        uint64_t start = now_ns();
+        for (size_t s = 0; s < steps; s++) {
+            for (size_t v = 0; v < vents; v++) {
+                egress.post(registry.at((uint32_t)v), (int)((b + s) % 10));
+            }
+        }
+        egress.commit();
+        if (!collect(swarm, per_burst, start, latency)) {
+            exit(EXIT_FAILURE);
+        }
+        total_ns += now_ns() - start;
+    }
+
+    backend->stop();
+    io.join();
+    printf("%-11s %-8s vents=%-5zu burst=%8.0f us  frames/burst=%-6lu io-cpu/burst=%7.0f us  ",
+           label, backend->name(), vents, total_ns / 1e3 / bursts,
+           (unsigned long)(egress.sent / bursts), egress.cpu_ns / 1e3 / bursts);
+    printf("latency p50=%lu p99=%lu max=%lu us\n", (unsigned long)latency.percentile(0.5) / 1000,
+           (unsigned long)latency.percentile(0.99) / 1000, (unsigned long)latency.max() / 1000);
+    // Backends do not own their connections' lifetimes past run(); close the sockets so
+    // the next run has descriptors to spare
+    for (size_t v = 0; v < vent_conns.size(); v++) {
+        if (vent_conns[v] != NULL) {
+            close(vent_conns[v]->fd);
+        }
+    }
+    vent_conns.clear();
+    delete backend;
+    close(listen_fd);
+}
+
+// Expose what run() needs from each egress under one spelling
+class CoalescingEgress : public BenchEgress{
+    public:
+        enum { COALESCES = 1 };
+        IoBackend *backend;
+        CoalescingEgress(VentRegistry &r) : BenchEgress(r), backend(NULL) {}
+        bool start(Reactor &loop) {
+            attach(backend);
+            return BenchEgress::start(loop);
+        }
+};
+
+class LegacyEgress : public PerCommand{
+    public:
+        enum { COALESCES = 0 };
+        LegacyEgress(VentRegistry &r) : PerCommand(r) {}
+        void commit() { ring(); }
+};
+
+int main(int argc, char **argv) {
+    size_t bursts = argc > 1 ? strtoul(argv[1], NULL, 10) : 50;
+    size_t steps = argc > 2 ? strtoul(argv[2], NULL, 10) : 3;
+    raise_fd_limit();
+    size_t sizes[] = {100, 1000, 5000};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (int uring = 0; uring < 2; uring++) {
+            run<LegacyEgress>("per-command", uring, sizes[s], bursts, steps);
+            run<CoalescingEgress>("egress", uring, sizes[s], bursts, steps);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,313 @@
+// Fan-out of vent updates to 1000 phone and dashboard subscribers.
+//
+//   g++ -O2 -pthread -I. -o fanout_bench bench/fanout_bench.cpp
+//   ./fanout_bench [subscribers=1000] [vents=200] [ticks=600]
+//
+// A house of `vents` vents reporting once a second, so a tenth of them publish a temperature
+// update every 100 ms control tick. Of the subscribers, half want every vent, 40% want a
+// room of 10 vents, and 10% want every vent but are slow: they ask for 20 datagrams a second,
+// well under the house's update rate.
+//
+// Part 1 has no sockets. SubscriberRegistry (one encoded, ref-counted buffer per update,
+// bounded queues, conflation) is raced against the obvious design: format a copy for each
+// subscriber into an unbounded per-subscriber queue, and let slow subscribers take their 20
+// a second from the front. Reported: CPU per tick, buffers/bytes held, the deepest slow
+// queue, and how stale a slow subscriber's view of the house is at the end.
+//
+// Part 2 is the real gateway: every subscriber is a UDP socket on its own 127.0.x.y:3001
+// that subscribes with a type 4 datagram; each tick publishes and flushes through sendmmsg().
+// The subscribers' sockets are drained between ticks, outside the timing.
+
+#include <math.h>
+#include <deque>
+#include <string>
+#include "bench_common.h"
+#include "phone_gateway.h"
+
+#define BENCH_GATEWAY_PORT 15011
+#define TICK_MS 100
+#define ROOM_VENTS 10
+#define SLOW_RATE 20
+#define CATCH_UP_TICKS 200         // quiet ticks at the end; a slow subscriber needs 100 for 200 vents
+
+class QuietGateway : public PhoneGateway{
+    public:
+        void on_setup(const char *name, size_t len) {}
+        void on_setpoint(uint32_t vent, float celsius) {}
+        void on_position(uint32_t vent, float percent) {}
+        void on_zone_setpoint(const char *zone, size_t len, float celsius) {}
+        void on_malformed(uint32_t type, const char *value, size_t len) {}
+};
+
+enum SubscriberKind{ WANTS_ALL, WANTS_ROOM, SLOW };
+
+static SubscriberKind kind_of(size_t i) {
+    size_t m = i % 10;
+    return m < 5 ? WANTS_ALL : (m < 9 ? WANTS_ROOM : SLOW);
+}
+
+static struct sockaddr_in client_addr(size_t i) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(0x7f000000u | (uint32_t)(i + 2));   // 127.0.0.2 and up
+    addr.sin_port = htons(PHONE_REPLY_PORT);
+    return addr;
+}
+
+// The temperature a vent reports on a tick; every tick's value differs so staleness shows
+static float reading(uint32_t vent, uint64_t tick) {
+    return 20.0f + (float)((vent * 7 + tick) % 100) / 10.0f;
+}
+
+// ---- part 1 ----
+
+// "<vent>.<celsius>" -> celsius; buffers are not terminated
+static float value_of(const UpdateBuffer *buffer) {
+    char text[UPDATE_MAX_BYTES];
+    memcpy(text, buffer->data + 4, buffer->len - 4);
+    text[buffer->len - 4] = '\0';
+    const char *dot = strchr(text, '.');
+    return dot == NULL ? 0.0f : (float)atof(dot + 1);
+}
+
+static void shared_buffers(size_t count, uint32_t vents, uint64_t ticks) {
+    SubscriberRegistry registry;
+    std::vector<uint32_t> list;
+    for (size_t i = 0; i < count; i++) {
+        SubscriberKind kind = kind_of(i);
+        list.clear();
+        if (kind == WANTS_ROOM) {
+            uint32_t room = (uint32_t)(i % (vents / ROOM_VENTS));
+            for (uint32_t v = 0; v < ROOM_VENTS; v++) {
+                list.push_back(room * ROOM_VENTS + v);
+            }
+        }
+        registry.subscribe(client_addr(i), kind != WANTS_ROOM, list, kind == SLOW ? SLOW_RATE : SUBSCRIBER_RATE);
+    }
+
+    // What the slow subscribers end up believing, vent by vent
+    std::vector<std::vector<float> > seen(count);
+    std::vector<float> truth(vents, 0.0f);
+    UpdateBuffer *out[PHONE_SEND_BATCH];
+    const struct sockaddr_in *to[PHONE_SEND_BATCH];
+    uint64_t delivered = 0, cpu = 0;
+    size_t deepest = 0;
+    uint32_t next_vent = 0;
+    for (uint64_t t = 0; t < ticks + CATCH_UP_TICKS; t++) {
+        uint64_t start = process_cpu_ns();
+        // The last CATCH_UP_TICKS publish nothing, so slow subscribers can catch up
+        for (uint32_t r = 0; t < ticks && r < vents / 10; r++) {
+            uint32_t vent = next_vent;
+            next_vent = (next_vent + 1) % vents;
+            float value = reading(vent, t);
+            UpdateBuffer *buffer = registry.encode_buffer();
+            buffer->data[0] = PHONE_TYPE_TEMPERATURE;
+            buffer->data[1] = buffer->data[2] = buffer->data[3] = 0;
+            buffer->len = (uint16_t)(4 + snprintf(buffer->data + 4, UPDATE_MAX_BYTES - 4, "%u.%.1f", vent, value));
+            buffer->vent = vent;
+            buffer->kind = PHONE_TYPE_TEMPERATURE - 1;
+            registry.publish(buffer);
+            truth[vent] = value;
+        }
+        registry.begin(t * TICK_MS);
+        unsigned n;
+        while ((n = registry.collect(out, to, PHONE_SEND_BATCH)) > 0) {
+            for (unsigned i = 0; i < n; i++) {
+                size_t s = (ntohl(to[i]->sin_addr.s_addr) & 0xffffff) - 2;
+                if (kind_of(s) == SLOW) {
+                    if (seen[s].size() < vents) {
+                        seen[s].resize(vents, 0.0f);
+                    }
+                    seen[s][out[i]->vent] = value_of(out[i]);
+                }
+            }
+            registry.sent(out, n);
+            delivered += n;
+        }
+        cpu += t < ticks ? process_cpu_ns() - start : 0;
+        const std::vector<Subscriber *> &subs = registry.all_subscribers();
+        for (size_t i = 0; i < subs.size(); i++) {
+            deepest = subs[i]->queued() > deepest ? subs[i]->queued() : deepest;
+        }
+    }
+    size_t stale = 0, slow = 0;
+    for (size_t s = 0; s < count; s++) {
+        if (kind_of(s) != SLOW) {
+            continue;
+        }
+        slow++;
+        for (uint32_t v = 0; v < vents; v++) {
+            stale += seen[s].size() < vents || fabsf(seen[s][v] - truth[v]) > 0.05f;
+        }
+    }
+    printf("shared   %7.1f us CPU/tick  %9llu datagrams  %6llu conflated  deepest queue %3zu  "
+           "buffers %zu (%zu KB)  stale at end %zu / %zu\n", cpu / 1e3 / ticks, (unsigned long long)delivered,
+           (unsigned long long)registry.conflated.load(), deepest, registry.buffers().allocated(),
+           registry.buffers().allocated() * sizeof(UpdateBuffer) / 1024, stale, slow * vents);
+}
+
+// Every subscriber gets its own formatted copy in an unbounded queue
+static void per_subscriber_copies(size_t count, uint32_t vents, uint64_t ticks) {
+    struct Client{
+        SubscriberKind kind;
+        uint32_t first, last;
+        std::deque<std::string> queue;
+        double tokens;
+        std::vector<float> seen;
+    };
+    std::vector<Client> clients(count);
+    for (size_t i = 0; i < count; i++) {
+        clients[i].kind = kind_of(i);
+        uint32_t room = (uint32_t)(i % (vents / ROOM_VENTS));
+        clients[i].first = clients[i].kind == WANTS_ROOM ? room * ROOM_VENTS : 0;
+        clients[i].last = clients[i].kind == WANTS_ROOM ? room * ROOM_VENTS + ROOM_VENTS - 1 : vents - 1;
+        clients[i].tokens = 0;
+        clients[i].seen.resize(vents, 0.0f);
+    }
+    std::vector<float> truth(vents, 0.0f);
+    uint64_t delivered = 0, cpu = 0;
+    size_t deepest = 0, bytes = 0;
+    uint32_t next_vent = 0;
+    char packet[UPDATE_MAX_BYTES];
+    for (uint64_t t = 0; t < ticks + CATCH_UP_TICKS; t++) {
+        uint64_t start = process_cpu_ns();
+        for (uint32_t r = 0; t < ticks && r < vents / 10; r++) {
+            uint32_t vent = next_vent;
+            next_vent = (next_vent + 1) % vents;
+            float value = reading(vent, t);
+            truth[vent] = value;
+            for (size_t i = 0; i < count; i++) {
+                if (vent < clients[i].first || vent > clients[i].last) {
+                    continue;
+                }
+                int len = snprintf(packet, sizeof(packet), "%u.%.1f", vent, value);
+                clients[i].queue.push_back(std::string(packet, len));
+            }
+        }
+        for (size_t i = 0; i < count; i++) {
+            Client &client = clients[i];
+            client.tokens += client.kind == SLOW ? SLOW_RATE * TICK_MS / 1000.0 : 1e9;
+            while (client.tokens >= 1.0 && !client.queue.empty()) {
+                if (client.kind == SLOW) {
+                    const std::string &m = client.queue.front();
+                    size_t dot = m.find('.');
+                    client.seen[atoi(m.c_str())] = (float)atof(m.c_str() + dot + 1);
+                }
+                client.queue.pop_front();
+                client.tokens -= 1.0;
+                delivered++;
+            }
+            if (client.kind != SLOW) {
+                client.tokens = 0;
+            }
+        }
+        cpu += t < ticks ? process_cpu_ns() - start : 0;
+        for (size_t i = 0; i < count; i++) {
+            deepest = clients[i].queue.size() > deepest ? clients[i].queue.size() : deepest;
+        }
+    }
+    size_t stale = 0, slow = 0;
+    for (size_t i = 0; i < count; i++) {
+        bytes += clients[i].queue.size() * (sizeof(std::string) + 16);
+        if (clients[i].kind != SLOW) {
+            continue;
+        }
+        slow++;
+        for (uint32_t v = 0; v < vents; v++) {
+            stale += fabsf(clients[i].seen[v] - truth[v]) > 0.05f;
+        }
+    }
+    printf("copies   %7.1f us CPU/tick  %9llu datagrams  %6s conflated  deepest queue %3zu  "
+           "still queued %zu KB          stale at end %zu / %zu\n", cpu / 1e3 / ticks,
+           (unsigned long long)delivered, "-", deepest, bytes / 1024, stale, slow * vents);
+}
+
+// ---- part 2 ----
+
+static void over_sockets(size_t count, uint32_t vents, uint64_t ticks) {
+    Reactor loop;
+    QuietGateway gateway;
+    if (!gateway.start(loop, BENCH_GATEWAY_PORT)) {
+        return;
+    }
+    struct sockaddr_in gateway_addr;
+    memset(&gateway_addr, 0, sizeof(gateway_addr));
+    gateway_addr.sin_family = AF_INET;
+    gateway_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    gateway_addr.sin_port = htons(BENCH_GATEWAY_PORT);
+
+    std::vector<int> fds(count);
+    char spec[UPDATE_MAX_BYTES];
+    for (size_t i = 0; i < count; i++) {
+        fds[i] = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        struct sockaddr_in addr = client_addr(i);
+        if (bind(fds[i], (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            perror("bind subscriber");
+            exit(EXIT_FAILURE);
+        }
+        SubscriberKind kind = kind_of(i);
+        spec[0] = PHONE_TYPE_SUBSCRIBE;
+        spec[1] = spec[2] = spec[3] = 0;
+        int len;
+        if (kind == WANTS_ROOM) {
+            uint32_t room = (uint32_t)(i % (vents / ROOM_VENTS));
+            len = snprintf(spec + 4, sizeof(spec) - 4, "%u-%u", room * ROOM_VENTS, room * ROOM_VENTS + ROOM_VENTS - 1);
+        } else {
+            len = snprintf(spec + 4, sizeof(spec) - 4, "*@%u", kind == SLOW ? SLOW_RATE : SUBSCRIBER_RATE);
+        }
+        sendto(fds[i], spec, 4 + len, 0, (struct sockaddr *)&gateway_addr, sizeof(gateway_addr));
+        if (i % PHONE_RECV_BATCH == PHONE_RECV_BATCH - 1) {
+            gateway.handle_event(EPOLLIN);
+        }
+    }
+    gateway.handle_event(EPOLLIN);
+    printf("sockets  %zu subscribed, ", gateway.subscribers.size());
+
+    char buffer[PHONE_MAX_DATAGRAM];
+    uint64_t cpu = 0, received = 0;
+    uint64_t calls = gateway.syscalls.load(), sent = gateway.sent.load();
+    uint32_t next_vent = 0;
+    uint64_t wall = now_ns();
+    for (uint64_t t = 0; t < ticks; t++) {
+        uint64_t start = process_cpu_ns();
+        for (uint32_t r = 0; r < vents / 10; r++) {
+            uint32_t vent = next_vent;
+            next_vent = (next_vent + 1) % vents;
+            gateway.publish(vent, PHONE_TYPE_TEMPERATURE, "%u.%.1f", vent, reading(vent, t));
+        }
+        gateway.flush();
+        cpu += process_cpu_ns() - start;
+        for (size_t i = 0; i < count; i++) {
+            while (recv(fds[i], buffer, sizeof(buffer), 0) > 0) {
+                received++;
+            }
+        }
+        // Real ticks, so the gateway's rate limits see real time pass
+        uint64_t next = wall + (t + 1) * (uint64_t)TICK_MS * 1000000ull;
+        uint64_t now = now_ns();
+        if (now < next) {
+            usleep((next - now) / 1000);
+        }
+    }
+    uint64_t datagrams = gateway.sent.load() - sent;
+    printf("%.1f us CPU/tick, %llu datagrams (%.0f/s of hub CPU), %.1f sendmmsg/tick, %llu received, "
+           "%llu dropped, %llu conflated\n", cpu / 1e3 / ticks, (unsigned long long)datagrams,
+           datagrams / (cpu / 1e9), (double)(gateway.syscalls.load() - calls) / ticks, (unsigned long long)received,
+           (unsigned long long)gateway.dropped.load(), (unsigned long long)gateway.subscribers.conflated.load());
+    for (size_t i = 0; i < count; i++) {
+        close(fds[i]);
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000;
+    uint32_t vents = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 200;
+    uint64_t ticks = argc > 3 ? strtoull(argv[3], NULL, 10) : 600;
+    raise_fd_limit();
+    printf("%zu subscribers, %u vents, %llu ticks of %d ms\n", count, vents, (unsigned long long)ticks, TICK_MS);
+    shared_buffers(count, vents, ticks);
+    per_subscriber_copies(count, vents, ticks);
+    over_sockets(count, vents, ticks / 10);
+    return 0;
+}
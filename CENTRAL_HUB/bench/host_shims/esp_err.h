@@ -0,0 +1,2 @@
+// Host stand-in for the ESP-IDF header of this name; see esp_host.h
+#include "esp_host.h"
@@ -0,0 +1,295 @@
+// Host implementations of the FreeRTOS and ESP-IDF calls declared in esp_host.h
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include "esp_host.h"
+
+#define ESP_HOST_LOG_LINE_MAX 256
+
+uint64_t esp_host_log_lines = 0;
+uint32_t esp_host_ledc_duty = 0;
+int esp_host_adc_raw = 0;
+
+static uint32_t ledc_pending_duty = 0;
+
+// Absolute CLOCK_REALTIME deadline ticks (milliseconds) from now
+static void deadline_after(TickType_t ticks, struct timespec *deadline) {
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += ticks / 1000;
+    deadline->tv_nsec += (long)(ticks % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+// Wait on cond until ready() or the ticks run out. Called with lock held.
+static int wait_until(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t ticks,
+                      int (*ready)(void *), void *arg) {
+    struct timespec deadline;
+    if (ticks != portMAX_DELAY) {
+        deadline_after(ticks, &deadline);
+    }
+    while (!ready(arg)) {
+        if (ticks == 0) {
+            return 0;
+        }
+        if (ticks == portMAX_DELAY) {
+            pthread_cond_wait(cond, lock);
+        } else if (pthread_cond_timedwait(cond, lock, &deadline) == ETIMEDOUT) {
+            return ready(arg);
+        }
+    }
+    return 1;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    struct timespec ts;
+    ts.tv_sec = ticks / 1000;
+    ts.tv_nsec = (long)(ticks % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+}
+
+struct TaskStart{
+    TaskFunction_t entry;
+    void *arg;
+};
+
+static void *task_main(void *p) {
+    struct TaskStart start = *(struct TaskStart *)p;
+    free(p);
+    start.entry(start.arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t entry, const char *name, uint32_t stack, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle) {
+    (void)name;
+    (void)stack;
+    (void)priority;
+    struct TaskStart *start = malloc(sizeof(*start));
+    start->entry = entry;
+    start->arg = arg;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, task_main, start) != 0) {
+        free(start);
+        return pdFALSE;
+    }
+    pthread_detach(thread);
+    if (handle != NULL) {
+        *handle = NULL;
+    }
+    return pdPASS;
+}
+
+struct EspHostSemaphore{
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    UBaseType_t count;
+    UBaseType_t max_count;
+};
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count) {
+    SemaphoreHandle_t sem = malloc(sizeof(*sem));
+    pthread_mutex_init(&sem->lock, NULL);
+    pthread_cond_init(&sem->changed, NULL);
+    sem->count = initial_count;
+    sem->max_count = max_count;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+static int semaphore_ready(void *p) {
+    return ((SemaphoreHandle_t)p)->count > 0;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+    pthread_mutex_lock(&sem->lock);
+    int taken = wait_until(&sem->changed, &sem->lock, ticks, semaphore_ready, sem);
+    if (taken) {
+        sem->count--;
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return taken ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    pthread_mutex_lock(&sem->lock);
+    int given = sem->count < sem->max_count;
+    if (given) {
+        sem->count++;
+        pthread_cond_signal(&sem->changed);
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return given ? pdTRUE : pdFALSE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+    pthread_cond_destroy(&sem->changed);
+    pthread_mutex_destroy(&sem->lock);
+    free(sem);
+}
+
+struct EspHostQueue{
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    unsigned char *items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    QueueHandle_t queue = malloc(sizeof(*queue));
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->changed, NULL);
+    queue->items = malloc((size_t)length * item_size);
+    queue->length = length;
+    queue->item_size = item_size;
+    queue->head = 0;
+    queue->count = 0;
+    return queue;
+}
+
+static int queue_has_room(void *p) {
+    QueueHandle_t queue = p;
+    return queue->count < queue->length;
+}
+
+static int queue_has_item(void *p) {
+    return ((QueueHandle_t)p)->count > 0;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+    pthread_mutex_lock(&queue->lock);
+    int sent = wait_until(&queue->changed, &queue->lock, ticks, queue_has_room, queue);
+    if (sent) {
+        UBaseType_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(queue->items + (size_t)tail * queue->item_size, item, queue->item_size);
+        queue->count++;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return sent ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken) {
+    if (woken != NULL) {
+        *woken = pdFALSE;
+    }
+    return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+    pthread_mutex_lock(&queue->lock);
+    int received = wait_until(&queue->changed, &queue->lock, ticks, queue_has_item, queue);
+    if (received) {
+        memcpy(item, queue->items + (size_t)queue->head * queue->item_size, queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return received ? pdTRUE : pdFALSE;
+}
+
+void esp_host_log(const char *tag, const char *format, ...) {
+    static char line[ESP_HOST_LOG_LINE_MAX];
+    int n = snprintf(line, sizeof(line), "I (%s) ", tag);
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line + n, sizeof(line) - n, format, args);
+    va_end(args);
+    esp_host_log_lines++;
+}
+
+int64_t esp_timer_get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *config) {
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *config) {
+    ledc_pending_duty = config->duty;
+    esp_host_ledc_duty = config->duty;
+    return ESP_OK;
+}
+
+esp_err_t ledc_fade_func_install(int intr_alloc_flags) {
+    (void)intr_alloc_flags;
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty) {
+    (void)mode;
+    (void)channel;
+    ledc_pending_duty = duty;
+    return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t mode, ledc_channel_t channel) {
+    (void)mode;
+    (void)channel;
+    esp_host_ledc_duty = ledc_pending_duty;
+    return ESP_OK;
+}
+
+esp_err_t gpio_config(const gpio_config_t *config) {
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags) {
+    (void)intr_alloc_flags;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t handler, void *arg) {
+    (void)gpio_num;
+    (void)handler;
+    (void)arg;
+    return ESP_OK;
+}
+
+// Buttons are pulled up, so released
+int gpio_get_level(gpio_num_t gpio_num) {
+    (void)gpio_num;
+    return 1;
+}
+
+esp_err_t adc1_config_width(adc_bits_width_t width) {
+    (void)width;
+    return ESP_OK;
+}
+
+esp_err_t adc1_config_channel_atten(adc1_channel_t channel, adc_atten_t atten) {
+    (void)channel;
+    (void)atten;
+    return ESP_OK;
+}
+
+int adc1_get_raw(adc1_channel_t channel) {
+    (void)channel;
+    return esp_host_adc_raw;
+}
+
+esp_adc_cal_value_t esp_adc_cal_characterize(adc_unit_t unit, adc_atten_t atten, adc_bits_width_t width,
+                                             uint32_t default_vref, esp_adc_cal_characteristics_t *chars) {
+    chars->adc_num = unit;
+    chars->atten = atten;
+    chars->bit_width = width;
+    chars->vref = default_vref;
+    return 0;
+}
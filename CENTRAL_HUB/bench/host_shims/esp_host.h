@@ -0,0 +1,183 @@
+#pragma once
+
+// Just enough of FreeRTOS and ESP-IDF to compile the vent and sensor firmware on the host,
+// for micro_bench. Every header the firmware includes (freertos/semphr.h, driver/ledc.h,
+// esp_log.h, ...) is a one-line file in this directory that includes this one.
+//
+// The calls stay out of line in esp_host.c, as they are in the IDF, so a firmware function
+// still pays for a call where it would on the device. Semaphores and queues really block;
+// peripherals are stubs that only remember what they were last told. ESP_LOGE/W/I format
+// into a scratch buffer, which costs what the device spends before its UART does, not the
+// UART itself. ESP_LOGD/V compile out, as at the IDF's default log level.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// sdkconfig.h
+#define CONFIG_IDF_TARGET "host"
+#define CONFIG_GPIO_INPUT_34 34
+
+// esp_err.h
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+#define IRAM_ATTR
+
+// FreeRTOS
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void (*TaskFunction_t)(void *);
+typedef void *TaskHandle_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define portMAX_DELAY ((TickType_t)0xffffffffu)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portYIELD_FROM_ISR() do {} while (0)
+#define tskIDLE_PRIORITY 0
+
+void vTaskDelay(TickType_t ticks);
+BaseType_t xTaskCreate(TaskFunction_t entry, const char *name, uint32_t stack, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle);
+
+// Counting semaphores; a mutex is one with a single token
+typedef struct EspHostSemaphore *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+
+typedef struct EspHostQueue *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks);
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks);
+
+// esp_log.h
+void esp_host_log(const char *tag, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+#define ESP_LOGE(tag, format, ...) esp_host_log(tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) esp_host_log(tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) esp_host_log(tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) do {} while (0)
+#define ESP_LOGV(tag, format, ...) do {} while (0)
+
+extern uint64_t esp_host_log_lines;    // ESP_LOGE/W/I calls so far
+
+// esp_timer.h
+int64_t esp_timer_get_time(void);
+
+// driver/ledc.h
+typedef int ledc_mode_t;
+typedef int ledc_channel_t;
+typedef int ledc_timer_t;
+typedef int ledc_timer_bit_t;
+typedef int ledc_clk_cfg_t;
+typedef int ledc_intr_type_t;
+
+#define LEDC_HIGH_SPEED_MODE 0
+#define LEDC_LOW_SPEED_MODE 1
+#define LEDC_CHANNEL_0 0
+#define LEDC_TIMER_0 0
+#define LEDC_TIMER_12_BIT 12
+#define LEDC_AUTO_CLK 0
+#define LEDC_INTR_DISABLE 0
+
+typedef struct {
+    ledc_mode_t speed_mode;
+    ledc_timer_bit_t duty_resolution;
+    ledc_timer_t timer_num;
+    uint32_t freq_hz;
+    ledc_clk_cfg_t clk_cfg;
+} ledc_timer_config_t;
+
+typedef struct {
+    int gpio_num;
+    ledc_mode_t speed_mode;
+    ledc_channel_t channel;
+    ledc_intr_type_t intr_type;
+    ledc_timer_t timer_sel;
+    uint32_t duty;
+    int hpoint;
+} ledc_channel_config_t;
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *config);
+esp_err_t ledc_channel_config(const ledc_channel_config_t *config);
+esp_err_t ledc_fade_func_install(int intr_alloc_flags);
+esp_err_t ledc_set_duty(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty);
+esp_err_t ledc_update_duty(ledc_mode_t mode, ledc_channel_t channel);
+
+extern uint32_t esp_host_ledc_duty;    // last duty latched by ledc_update_duty()
+
+// driver/gpio.h
+typedef int gpio_num_t;
+typedef void (*gpio_isr_t)(void *);
+
+#define GPIO_NUM_5 5
+#define GPIO_NUM_18 18
+#define GPIO_MODE_INPUT 1
+#define GPIO_PULLUP_ENABLE 1
+#define GPIO_PULLDOWN_DISABLE 0
+#define GPIO_INTR_ANYEDGE 3
+#define ESP_INTR_FLAG_LEVEL1 (1 << 1)
+
+typedef struct {
+    uint64_t pin_bit_mask;
+    int mode;
+    int pull_up_en;
+    int pull_down_en;
+    int intr_type;
+} gpio_config_t;
+
+esp_err_t gpio_config(const gpio_config_t *config);
+esp_err_t gpio_install_isr_service(int intr_alloc_flags);
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t handler, void *arg);
+int gpio_get_level(gpio_num_t gpio_num);
+
+// driver/adc.h and esp_adc_cal.h
+typedef int adc_unit_t;
+typedef int adc_channel_t;
+typedef int adc1_channel_t;
+typedef int adc_bits_width_t;
+typedef int adc_atten_t;
+
+#define ADC_UNIT_1 1
+#define ADC_CHANNEL_4 4
+#define ADC1_CHANNEL_4 4
+#define ADC_WIDTH_BIT_12 3
+#define ADC_ATTEN_DB_11 3
+
+typedef struct {
+    adc_unit_t adc_num;
+    adc_atten_t atten;
+    adc_bits_width_t bit_width;
+    uint32_t vref;
+} esp_adc_cal_characteristics_t;
+
+typedef int esp_adc_cal_value_t;
+
+esp_err_t adc1_config_width(adc_bits_width_t width);
+esp_err_t adc1_config_channel_atten(adc1_channel_t channel, adc_atten_t atten);
+int adc1_get_raw(adc1_channel_t channel);
+esp_adc_cal_value_t esp_adc_cal_characterize(adc_unit_t unit, adc_atten_t atten, adc_bits_width_t width,
+                                             uint32_t default_vref, esp_adc_cal_characteristics_t *chars);
+
+extern int esp_host_adc_raw;           // what adc1_get_raw() returns next
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,152 @@
+// Hub packets/sec with console logging on and off.
+//
+//   g++ -O2 -pthread -o hub main.cpp
+//   g++ -O2 -pthread -DHLOG_LEVEL=HLOG_LEVEL_INFO -o hub_info main.cpp
+//   g++ -O2 -pthread -DHLOG_LEVEL=HLOG_LEVEL_NONE -o hub_off main.cpp
+//   g++ -O2 -pthread -I. -o hub_log_bench bench/hub_log_bench.cpp
+//   ./hub_log_bench [--vents=50] [--seconds=3] debug=./hub info=./hub_info off=./hub_off
+//
+// Runs each hub binary in turn on port 8080, stdout redirected to a file, with --no-log and
+// --no-snapshot so only console logging differs. A swarm of vents sends readings as fast as
+// the hub takes them, draining the replies. The rate is the hub's own hub_packets_total,
+// read from its metrics endpoint at the start and end of the window; cpu/pkt is the hub
+// process' CPU time over the same window. Lines the async logger dropped because a ring was
+// full come from hub_log_dropped_total. Any hub binary with the metrics endpoint works, so a
+// build from before the logger can be compared too.
+
+#include <sys/stat.h>
+#include "bench_common.h"
+
+#define HUB_PORT 8080
+#define HUB_METRICS_PORT 9464
+#define FRAMES_PER_SEND 32
+
+// A metric from the hub's endpoint, or -1 if the hub is not up or does not export it
+static double scrape(const char *metric) {
+    return page_value(scrape_page(HUB_METRICS_PORT), metric);
+}
+
+static void run_hub(const char *label, const char *binary, size_t vents, double seconds) {
+    char dir[] = "/tmp/hub_log_bench.XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        exit(EXIT_FAILURE);
+    }
+    std::string out_path = std::string(dir) + "/stdout.txt";
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (chdir(dir) < 0) {
+            _exit(1);
+        }
+        int out = open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(out, STDOUT_FILENO);
+        dup2(out, STDERR_FILENO);
+        execl(binary, binary, "--no-log", "--no-snapshot", (char *)NULL);
+        _exit(127);
+    }
+
+    // Wait for both listeners
+    uint64_t deadline = now_ns() + 5000000000ull;
+    while (scrape("hub_packets_total") < 0) {
+        if (now_ns() > deadline) {
+            fprintf(stderr, "%s: hub did not come up\n", label);
+            kill(pid, SIGKILL);
+            waitpid(pid, NULL, 0);
+            return;
+        }
+        usleep(10000);
+    }
+
+    VentSwarm swarm;
+    if (!swarm.connect_all(HUB_PORT, vents)) {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        return;
+    }
+    for (size_t i = 0; i < swarm.fds.size(); i++) {
+        fcntl(swarm.fds[i], F_SETFL, fcntl(swarm.fds[i], F_GETFL) | O_NONBLOCK);
+    }
+
+    // FRAMES_PER_SEND framed readings per send(), temperatures varying so covers move
+    std::vector<char> batch[4];
+    for (int b = 0; b < 4; b++) {
+        for (int f = 0; f < FRAMES_PER_SEND; f++) {
+            BenchPacket packet = {0x1, 18.0f + b * 2.0f + f * 0.05f};
+            char frame[64];
+            size_t len = encode_frame(frame, &packet, sizeof(packet));
+            batch[b].insert(batch[b].end(), frame, frame + len);
+        }
+    }
+
+    char sink[65536];
+    double start_packets = 0;
+    uint64_t start_ns = 0;
+    uint64_t start_cpu = 0;
+    uint64_t begin = now_ns();
+    uint64_t warmup = begin + 500000000ull;
+    uint64_t end = warmup + (uint64_t)(seconds * 1e9);
+    size_t round = 0;
+    while (1) {
+        uint64_t now = now_ns();
+        if (start_ns == 0 && now >= warmup) {
+            start_packets = scrape("hub_packets_total");
+            start_cpu = process_cpu_ns(pid);
+            start_ns = now_ns();
+        }
+        if (now >= end) {
+            break;
+        }
+        const std::vector<char> &frames = batch[round++ & 3];
+        for (size_t i = 0; i < swarm.fds.size(); i++) {
+            send(swarm.fds[i], frames.data(), frames.size(), MSG_NOSIGNAL);
+            while (recv(swarm.fds[i], sink, sizeof(sink), 0) > 0) {
+            }
+        }
+    }
+    double end_packets = scrape("hub_packets_total");
+    double dropped = scrape("hub_log_dropped_total");
+    uint64_t end_cpu = process_cpu_ns(pid);
+    double window = (now_ns() - start_ns) / 1e9;
+    double packets = end_packets - start_packets;
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    struct stat st;
+    long out_bytes = stat(out_path.c_str(), &st) == 0 ? (long)st.st_size : 0;
+    unlink(out_path.c_str());
+    rmdir(dir);
+
+    printf("%-8s vents=%-4zu pkt/s=%-10.0f cpu/pkt=%-6.0f ns  stdout=%.1f MB", label, vents,
+           packets / window, packets > 0 ? (end_cpu - start_cpu) / packets : 0.0, out_bytes / 1e6);
+    if (dropped >= 0) {
+        printf("  log lines dropped=%.0f", dropped);
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv) {
+    size_t vents = 50;
+    double seconds = 3.0;
+    std::vector<std::pair<std::string, std::string> > hubs;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--vents=", 8) == 0) {
+            vents = strtoul(argv[i] + 8, NULL, 10);
+        } else if (strncmp(argv[i], "--seconds=", 10) == 0) {
+            seconds = atof(argv[i] + 10);
+        } else if (strchr(argv[i], '=') != NULL) {
+            std::string arg = argv[i];
+            size_t eq = arg.find('=');
+            hubs.push_back(std::make_pair(arg.substr(0, eq), arg.substr(eq + 1)));
+        }
+    }
+    if (hubs.empty()) {
+        fprintf(stderr, "usage: %s [--vents=N] [--seconds=S] label=hub_binary ...\n", argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    raise_fd_limit();
+    for (size_t h = 0; h < hubs.size(); h++) {
+        run_hub(hubs[h].first.c_str(), hubs[h].second.c_str(), vents, seconds);
+    }
+    return 0;
+}
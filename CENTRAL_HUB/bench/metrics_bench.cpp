@@ -0,0 +1,120 @@
+// Cost of recording into the hub's metrics on the hot path.
+//
+//   g++ -O2 -pthread -I. -o metrics_bench bench/metrics_bench.cpp
+//   ./metrics_bench [records=20000000] [max_threads=4]
+//
+// Times MetricHistogram::record() and MetricCounter::add() in a tight loop over latencies
+// spread from tens of nanoseconds to milliseconds, alone and with up to max_threads threads
+// recording into the same metrics at once. Times are per-thread CPU time, so they hold on
+// fewer cores than threads. "shared fetch_add" is the same histogram with one set of buckets
+// bumped with atomic increments by every thread, for comparison. Budget is 50 ns per
+// recording. "clock read" is the CLOCK_MONOTONIC read the hub takes once per recv() and
+// once per drain; it depends on the machine's clocksource, so it is reported apart from the
+// budget. Also reports how long rendering a scrape takes.
+
+#include <thread>
+#include "bench_common.h"
+#include "metrics.h"
+#include "telemetry_queue.h"
+
+#define BUDGET_NS 50.0
+
+// Latency-like values: mostly small, with a long tail
+static void make_values(std::vector<uint64_t> &values) {
+    uint64_t x = 88172645463325252ull;
+    for (size_t i = 0; i < values.size(); i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        values[i] = (x & 0xfff) << ((x >> 12) % 12);
+    }
+}
+
+// One set of atomic buckets for every thread, the obvious alternative
+class SharedHistogram{
+    public:
+        SharedHistogram() {
+            for (int b = 0; b < METRICS_BUCKETS; b++) {
+                counts[b].store(0);
+            }
+            sum.store(0);
+            count.store(0);
+        }
+        void record(uint64_t ns) {
+            counts[MetricHistogram::bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+            sum.fetch_add(ns, std::memory_order_relaxed);
+            count.fetch_add(1, std::memory_order_relaxed);
+        }
+        std::atomic<uint64_t> counts[METRICS_BUCKETS];
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> count;
+};
+
+static uint64_t thread_cpu_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// ns per call with `threads` threads each making `records` calls of op(value)
+template <class F>
+static double time_threads(size_t threads, size_t records, const std::vector<uint64_t> &values, F op) {
+    std::vector<std::thread> workers;
+    std::atomic<uint64_t> busy_ns(0);
+    for (size_t t = 0; t < threads; t++) {
+        workers.push_back(std::thread([&, t]() {
+            size_t mask = values.size() - 1;
+            uint64_t start = thread_cpu_ns();
+            for (size_t i = 0; i < records; i++) {
+                op(values[(i + t * 7919) & mask]);
+            }
+            busy_ns.fetch_add(thread_cpu_ns() - start);
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); t++) {
+        workers[t].join();
+    }
+    return (double)busy_ns.load() / threads / records;
+}
+
+static void report(const char *label, size_t threads, double ns) {
+    printf("%-17s threads=%zu  %6.1f ns/record  %s\n", label, threads, ns, ns < BUDGET_NS ? "within budget" : "OVER BUDGET");
+}
+
+int main(int argc, char **argv) {
+    size_t records = argc > 1 ? strtoul(argv[1], NULL, 10) : 20000000;
+    size_t max_threads = argc > 2 ? strtoul(argv[2], NULL, 10) : 4;
+    std::vector<uint64_t> values(1 << 16);
+    make_values(values);
+
+    MetricsRegistry registry;
+    MetricHistogram &histogram = registry.histogram("bench_latency_seconds", "bench");
+    MetricCounter &counter = registry.counter("bench_packets_total", "bench");
+    SharedHistogram shared;
+
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        size_t per_thread = records / threads;
+        report("histogram", threads, time_threads(threads, per_thread, values, [&](uint64_t v) {
+            histogram.record(v);
+        }));
+        report("counter", threads, time_threads(threads, per_thread, values, [&](uint64_t v) {
+            counter.add();
+        }));
+        report("shared fetch_add", threads, time_threads(threads, per_thread, values, [&](uint64_t v) {
+            shared.record(v);
+        }));
+    }
+
+    std::atomic<uint64_t> sink(0);
+    double clock_ns = time_threads(1, records / 10, values, [&](uint64_t v) {
+        sink.store(telemetry_clock_ns(), std::memory_order_relaxed);
+    });
+    printf("clock read        threads=1  %6.1f ns\n", clock_ns);
+
+    uint64_t start = now_ns();
+    std::string page = registry.render();
+    printf("scrape: %zu bytes rendered in %.1f us\n", page.size(), (now_ns() - start) / 1e3);
+    printf("p50=%llu ns p99=%llu ns over %llu recordings\n", (unsigned long long)histogram.percentile(0.5),
+           (unsigned long long)histogram.percentile(0.99), (unsigned long long)counter.value());
+    return 0;
+}
@@ -0,0 +1,243 @@
+// Per-call cost of the hub's and the firmware's per-reading hot paths, as JSON.
+//
+//   g++ -O2 -pthread -I. -Ibench/host_shims -o micro_bench -x c bench/micro_firmware.c -x c++ bench/micro_bench.cpp
+//   ./micro_bench [--filter=text] [--samples=15] [--min-time-ms=20] [--baseline=old.json] [--threshold=15]
+//
+// Hub: parse_packet() on one de-framed reading, the scalar update_cover() PID step, and
+// VentRegistry::find() among 10k vents. Firmware (micro_firmware.c, built as C against
+// host_shims): insert_temp(), adc_to_temperature() (adcToVoltage, the padding, voltageToADC
+// and ADC_TO_TEMP_LUT), set_motor_position() down to the LEDC, and a sensor
+// ring_buffer_write() plus ring_buffer_read(). Firmware times are host times: they rank
+// changes to the code, not what the ESP32 will take.
+//
+// Each benchmark is timed on the thread's CPU clock, in batches whose size (a power of two)
+// is doubled until a batch takes --min-time-ms; ns_per_op is the median of --samples
+// batches, with the fastest and slowest alongside to show the spread. Benchmarks are printed
+// in a fixed order, one per line, with fixed precision and nothing run-specific, so two runs
+// compare line by line. --baseline reads an earlier run's output and exits 1 if any median
+// grew by more than --threshold percent; on a shared one-CPU box run to run noise reaches
+// about 10%.
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "bench_common.h"
+#include "packet.h"
+#include "control_engine.h"
+#include "vent_registry.h"
+
+#define LOOKUP_VENTS 10000
+
+extern "C" {
+double fw_insert_temp(uint64_t n);
+double fw_adc_to_temperature(uint64_t n);
+double fw_set_motor_position(uint64_t n);
+double fw_ring_buffer_write_read(uint64_t n);
+}
+
+// 64 readings as a vent frames them: pkt_type 1, a temperature and its cover
+static double hub_parse_packet(uint64_t n) {
+    static char payloads[64][sizeof(Packet)];
+    static bool ready = false;
+    if (!ready) {
+        for (int k = 0; k < 64; k++) {
+            Packet p;
+            p.pkt_type = 1;
+            p.temperature = 20.0f + k * 0.1f;
+            p.motor_pos = k % 11;
+            memcpy(payloads[k], &p, sizeof(p));
+        }
+        ready = true;
+    }
+    double sum = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        Packet data;
+        if (parse_packet(payloads[i & 63], sizeof(Packet), data)) {
+            sum += data.temperature + data.motor_pos;
+        }
+    }
+    return sum;
+}
+
+// 1024 vents' PID memory, each stepped in turn around a 23 C setpoint
+static double hub_update_cover(uint64_t n) {
+    static PidState state[1024];
+    static float temps[1024];
+    static bool ready = false;
+    if (!ready) {
+        std::mt19937 gen(3);
+        std::uniform_real_distribution<float> temp(20.0f, 26.0f);
+        for (int k = 0; k < 1024; k++) {
+            temps[k] = temp(gen);
+        }
+        ready = true;
+    }
+    PidGains gains;
+    double sum = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        sum += update_cover(state[i & 1023], gains, temps[i & 1023], 23.0f);
+    }
+    return sum;
+}
+
+// Vents keyed by random IPv4 addresses, looked up in a shuffled order
+static double hub_vent_find(uint64_t n) {
+    static VentRegistry registry;
+    static std::vector<unsigned> ids;
+    if (ids.empty()) {
+        std::mt19937 gen(5);
+        while (registry.size() < LOOKUP_VENTS) {
+            unsigned id = gen();
+            if (registry.find(id) == NULL) {
+                registry.add(id);
+                ids.push_back(id);
+            }
+        }
+        std::shuffle(ids.begin(), ids.end(), gen);
+    }
+    double sum = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        Vent *v = registry.find(ids[i % LOOKUP_VENTS]);
+        sum += v->index;
+    }
+    return sum;
+}
+
+struct MicroBench{
+    const char *name;
+    double (*run)(uint64_t n);
+};
+
+static const MicroBench benches[] = {
+    {"hub/parse_packet", hub_parse_packet},
+    {"hub/update_cover", hub_update_cover},
+    {"hub/vent_find_10k", hub_vent_find},
+    {"vent/insert_temp", fw_insert_temp},
+    {"vent/adc_to_temperature", fw_adc_to_temperature},
+    {"vent/set_motor_position", fw_set_motor_position},
+    {"sensor/ring_buffer_write_read", fw_ring_buffer_write_read},
+};
+
+struct MicroResult{
+    uint64_t iterations;
+    double median;
+    double min;
+    double max;
+};
+
+static volatile double sink;
+
+// CPU time rather than wall time, so a batch that gets preempted is not charged for it
+static uint64_t thread_cpu_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t time_batch(const MicroBench &b, uint64_t n) {
+    uint64_t start = thread_cpu_ns();
+    sink = sink + b.run(n);
+    return thread_cpu_ns() - start;
+}
+
+static MicroResult measure(const MicroBench &b, int samples, uint64_t min_ns) {
+    uint64_t n = 1;
+    while (time_batch(b, n) < min_ns && n < (1ull << 40)) {
+        n *= 2;
+    }
+    std::vector<double> per_op;
+    for (int s = 0; s < samples; s++) {
+        per_op.push_back((double)time_batch(b, n) / n);
+    }
+    std::sort(per_op.begin(), per_op.end());
+    MicroResult r;
+    r.iterations = n;
+    r.median = per_op[per_op.size() / 2];
+    r.min = per_op.front();
+    r.max = per_op.back();
+    return r;
+}
+
+// ns_per_op by name from an earlier run's output, which has one benchmark per line
+static std::map<std::string, double> read_baseline(const char *path) {
+    std::map<std::string, double> medians;
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char name[128];
+        double median;
+        const char *at = strstr(line, "\"name\": \"");
+        const char *value = strstr(line, "\"ns_per_op\": ");
+        if (at != NULL && value != NULL && sscanf(at, "\"name\": \"%127[^\"]\"", name) == 1 &&
+            sscanf(value, "\"ns_per_op\": %lf", &median) == 1) {
+            medians[name] = median;
+        }
+    }
+    fclose(f);
+    return medians;
+}
+
+int main(int argc, char **argv) {
+    const char *filter = "";
+    const char *baseline = NULL;
+    int samples = 15;
+    uint64_t min_ms = 20;
+    double threshold = 15;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--filter=", 9) == 0) {
+            filter = argv[i] + 9;
+        } else if (strncmp(argv[i], "--samples=", 10) == 0) {
+            samples = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--min-time-ms=", 14) == 0) {
+            min_ms = strtoull(argv[i] + 14, NULL, 10);
+        } else if (strncmp(argv[i], "--baseline=", 11) == 0) {
+            baseline = argv[i] + 11;
+        } else if (strncmp(argv[i], "--threshold=", 12) == 0) {
+            threshold = atof(argv[i] + 12);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (samples < 1) {
+        samples = 1;
+    }
+
+    std::map<std::string, double> before;
+    if (baseline != NULL) {
+        before = read_baseline(baseline);
+    }
+
+    printf("{\n  \"schema\": 1,\n  \"compiler\": \"%s\",\n  \"benchmarks\": [", __VERSION__);
+    const char *separator = "\n";
+    int regressions = 0;
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        const MicroBench &b = benches[i];
+        if (strstr(b.name, filter) == NULL) {
+            continue;
+        }
+        MicroResult r = measure(b, samples, min_ms * 1000000ull);
+        printf("%s    {\"name\": \"%s\", \"iterations\": %llu, \"samples\": %d, \"ns_per_op\": %.3f, "
+               "\"min_ns_per_op\": %.3f, \"max_ns_per_op\": %.3f}",
+               separator, b.name, (unsigned long long)r.iterations, samples, r.median, r.min, r.max);
+        fflush(stdout);
+        separator = ",\n";
+
+        std::map<std::string, double>::const_iterator old = before.find(b.name);
+        if (old != before.end() && old->second > 0) {
+            double change = (r.median / old->second - 1) * 100;
+            bool slower = change > threshold;
+            regressions += slower;
+            fprintf(stderr, "%-30s %9.3f -> %9.3f ns/op  %+6.1f%%%s\n", b.name, old->second, r.median,
+                    change, slower ? "  REGRESSION" : "");
+        }
+    }
+    printf("\n  ]\n}\n");
+    return regressions > 0 ? 1 : 0;
+}
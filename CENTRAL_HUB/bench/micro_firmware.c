@@ -0,0 +1,58 @@
+// The vent and sensor firmware paths micro_bench.cpp times, compiled for the host. Like
+// VentCoverFirmware.c this is a unity build that #includes the firmware sources unchanged;
+// host_shims stands in for FreeRTOS and ESP-IDF. Each function runs its path n times and
+// returns a value built from every result, so the compiler cannot drop any of them.
+
+// Pointers are 32 bits on the ESP32; motor.c passes GPIO numbers through a void *
+#pragma GCC diagnostic ignored "-Wpointer-to-int-cast"
+
+#include "host_shims/esp_host.c"
+#include "../../VENT_FIRMWARE/main/threads/motor.c"
+#include "../../VENT_FIRMWARE/main/threads/temperature_sense.c"
+#include "../../SENSOR_FIRMWARE/main/utils/RingBuffer.c"
+
+// A new reading into the vent's five-sample average
+double fw_insert_temp(uint64_t n) {
+    double sum = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        insert_temp(&temp_data, 20.0f + (float)(i & 15) * 0.25f);
+        sum += temp_data.latest_avg_temp;
+    }
+    return sum;
+}
+
+// Raw ADC readings scattered over the whole 12-bit range, so the lookups are not sequential
+double fw_adc_to_temperature(uint64_t n) {
+    double sum = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        uint32_t raw_adc = ((uint32_t)i * 2654435761u) >> 20;
+        sum += adc_to_temperature(raw_adc);
+    }
+    return sum;
+}
+
+// Every position from closed to open in turn, each one latched into the LEDC
+double fw_set_motor_position(uint64_t n) {
+    double sum = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        set_motor_position((int)(i % 101));
+        sum += esp_host_ledc_duty;
+    }
+    return sum;
+}
+
+// One write and one read: the sensor's buffer never fills, so neither blocks
+double fw_ring_buffer_write_read(uint64_t n) {
+    static RingBuffer rb;
+    static int ready = 0;
+    if (!ready) {
+        ring_buffer_init(&rb);
+        ready = 1;
+    }
+    double sum = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        ring_buffer_write(&rb, (float)(i & 63));
+        sum += ring_buffer_read(&rb);
+    }
+    return sum;
+}
@@ -0,0 +1,284 @@
+// PID against MPC (mpc.h) on simulated rooms, and the MPC's cost per control tick.
+//
+//   g++ -O2 -pthread -I. -o mpc_bench bench/mpc_bench.cpp
+//   ./mpc_bench [rooms=200] [hours=6]
+//
+// Each room is one vent on a heating duct, simulated in 1 s steps:
+//
+//     dT/dt = (outside - T) / loss + flow * cover/10 * (supply - T)
+//
+// with the cover acting after a duct dead time of 10-45 s, loss 30-90 minutes and a flow
+// that would hold the room at 26-34 C fully open. Not the model the MPC fits: flow times
+// (supply - T) is bilinear, so its learned gain and time constant are only local. Readings
+// carry 0.02 C of noise and arrive once a second per vent; ControlEngine ticks every 100 ms
+// as in the hub, and every cover change counts as a motor move.
+//
+// The run starts cold (17 C) towards 21 C, steps to 23 C at 40% of the run and back to 21 C
+// at 70%, when the outside also drops from 5 C to -5 C. Settling is the time until a room
+// stays within 0.5 C of the setpoint for the rest of that segment; overshoot is the
+// furthest past the setpoint in the direction of travel.
+//
+// Part 2 times ControlEngine::tick() for 1k to 50k vents reporting once a second, all PID
+// against all MPC with trusted models, warmed up on a linear room each.
+
+#include <algorithm>
+#include "bench_common.h"
+#include "control_engine.h"
+
+#define SIM_TICKS_PER_SECOND 10
+#define SETTLE_BAND 0.5f
+
+static uint64_t rng_state = 88172645463325252ull;
+
+static inline uint64_t next_random() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static inline float uniform(float lo, float hi) {
+    return lo + (hi - lo) * (float)(next_random() >> 40) / (float)(1 << 24);
+}
+
+// Sum of uniforms, near enough to normal for sensor noise
+static inline float noise(float sigma) {
+    float s = 0;
+    for (int i = 0; i < 4; i++) {
+        s += uniform(-1.0f, 1.0f);
+    }
+    return s * sigma * 0.866f;
+}
+
+struct Room{
+    float temperature;
+    float loss;             // s
+    float flow;             // 1/s fully open
+    int dead;               // s
+    std::vector<float> duct;  // covers on their way, one per second
+    size_t head;
+
+    Room() : temperature(17.0f), loss(0), flow(0), dead(0), head(0) {}
+
+    void init() {
+        loss = uniform(1800.0f, 5400.0f);
+        float open_steady = uniform(26.0f, 34.0f);
+        // open_steady = (outside/loss + flow supply) / (1/loss + flow) at 5 C outside, 45 C supply
+        flow = (open_steady - 5.0f) / (loss * (45.0f - open_steady));
+        dead = 10 + (int)(next_random() % 36);
+        duct.assign(dead, 0.0f);
+        temperature = 17.0f;
+        head = 0;
+    }
+
+    void step(float cover, float outside) {
+        float arriving = duct[head];
+        duct[head] = cover;
+        head = (head + 1) % duct.size();
+        float open = arriving / COVER_MAX;
+        temperature += (outside - temperature) / loss + flow * open * (45.0f - temperature);
+    }
+};
+
+struct Segment{
+    size_t start, end;      // seconds
+    float setpoint;
+};
+
+struct Quality{
+    std::vector<double> settle_s;   // per room per segment; -1 if never
+    std::vector<double> overshoot;
+    double moves;
+    double abs_error;               // mean |T - setpoint| after the first segment
+    double ticks_ns;
+    size_t ticks;
+};
+
+static Quality run(int mode, size_t rooms, size_t seconds, const std::vector<Segment> &segments, uint64_t seed) {
+    rng_state = seed;
+    std::vector<Room> house(rooms);
+    for (size_t r = 0; r < rooms; r++) {
+        house[r].init();
+    }
+    ControlEngine engine;
+    for (size_t r = 0; r < rooms; r++) {
+        engine.add_vent(segments[0].setpoint, mode);
+    }
+    std::vector<uint32_t> changed;
+    Quality q;
+    q.settle_s.assign(rooms * segments.size(), -1.0);
+    q.overshoot.assign(rooms * segments.size(), 0.0);
+    q.moves = 0;
+    q.abs_error = 0;
+    q.ticks_ns = 0;
+    q.ticks = 0;
+    std::vector<size_t> last_outside(rooms * segments.size(), 0);
+    size_t error_samples = 0;
+
+    size_t seg = 0;
+    for (size_t s = 0; s < seconds; s++) {
+        if (s >= segments[seg].end) {
+            seg++;
+            for (size_t r = 0; r < rooms; r++) {
+                engine.set_desired(r, segments[seg].setpoint);
+            }
+        }
+        const Segment &now = segments[seg];
+        float outside = seg == 2 ? -5.0f : 5.0f;
+        float from = seg == 0 ? 17.0f : segments[seg - 1].setpoint;
+        float direction = now.setpoint > from ? 1.0f : -1.0f;
+        for (size_t r = 0; r < rooms; r++) {
+            Room &room = house[r];
+            room.step((float)engine.get_cover(r), outside);
+            float t = room.temperature;
+            size_t slot = r * segments.size() + seg;
+            float past = (t - now.setpoint) * direction;
+            q.overshoot[slot] = std::max(q.overshoot[slot], (double)past);
+            if (fabsf(t - now.setpoint) > SETTLE_BAND) {
+                last_outside[slot] = s + 1;
+            }
+            if (seg > 0 || s >= segments[0].end / 2) {
+                q.abs_error += fabsf(t - now.setpoint);
+                error_samples++;
+            }
+        }
+        // Readings once a second, spread over the ticks by vent
+        for (int tick = 0; tick < SIM_TICKS_PER_SECOND; tick++) {
+            for (size_t r = tick; r < rooms; r += SIM_TICKS_PER_SECOND) {
+                engine.set_temperature(r, house[r].temperature + noise(0.02f));
+            }
+            changed.clear();
+            uint64_t start = now_ns();
+            engine.tick(changed);
+            q.ticks_ns += now_ns() - start;
+            q.ticks++;
+            q.moves += changed.size();
+        }
+    }
+    for (size_t r = 0; r < rooms; r++) {
+        for (size_t g = 0; g < segments.size(); g++) {
+            size_t slot = r * segments.size() + g;
+            if (last_outside[slot] < segments[g].end) {
+                q.settle_s[slot] = (double)(last_outside[slot] - segments[g].start);
+            }
+        }
+    }
+    q.abs_error /= error_samples;
+    q.moves /= rooms * (seconds / 3600.0);
+    return q;
+}
+
+static double percentile(std::vector<double> v, double p) {
+    std::sort(v.begin(), v.end());
+    return v[(size_t)(p * (v.size() - 1))];
+}
+
+static void report(const char *name, const Quality &q, size_t rooms, const std::vector<Segment> &segments) {
+    printf("%-4s moves/room/h %6.1f  mean |error| %.2f C  tick %.2f us\n", name, q.moves, q.abs_error,
+           q.ticks_ns / 1e3 / q.ticks);
+    for (size_t g = 0; g < segments.size(); g++) {
+        std::vector<double> settle, over;
+        size_t never = 0;
+        for (size_t r = 0; r < rooms; r++) {
+            double s = q.settle_s[r * segments.size() + g];
+            if (s < 0) {
+                never++;
+            } else {
+                settle.push_back(s / 60.0);
+            }
+            over.push_back(q.overshoot[r * segments.size() + g]);
+        }
+        printf("     %5.1f C: settled p50 %6.1f min  p90 %6.1f min  never %3zu | overshoot p50 %.2f C  p90 %.2f C\n",
+               segments[g].setpoint, settle.empty() ? NAN : percentile(settle, 0.5),
+               settle.empty() ? NAN : percentile(settle, 0.9), never, percentile(over, 0.5), percentile(over, 0.9));
+    }
+}
+
+// ---- part 2: tick cost ----
+
+// y' = a y + b u + c per second, enough to warm an MPC model up
+struct LinearRoom{
+    float t, a, b, c;
+};
+
+static void tick_cost(size_t vents) {
+    const size_t warm_seconds = (MPC_WARMUP_SAMPLES + 30) * MPC_PERIOD_TICKS / SIM_TICKS_PER_SECOND;
+    const size_t timed_seconds = 2 * MPC_PERIOD_TICKS / SIM_TICKS_PER_SECOND;
+    double per_tick[2] = {0, 0};
+    double p99[2] = {0, 0};
+    size_t planned = 0;
+    for (int m = 0; m < 2; m++) {
+        rng_state = 12345;
+        ControlEngine engine;
+        std::vector<LinearRoom> rooms(vents);
+        for (size_t v = 0; v < vents; v++) {
+            float loss = uniform(600.0f, 1800.0f);
+            rooms[v].a = 1.0f - 1.0f / loss;
+            rooms[v].b = uniform(1.0f, 2.5f) / loss;
+            rooms[v].c = 15.0f / loss;
+            rooms[v].t = 18.0f;
+            engine.add_vent(21.0f, m == 0 ? CONTROL_PID : CONTROL_MPC);
+        }
+        std::vector<uint32_t> changed;
+        std::vector<double> timed;
+        for (size_t s = 0; s < warm_seconds + timed_seconds; s++) {
+            for (size_t v = 0; v < vents; v++) {
+                LinearRoom &r = rooms[v];
+                r.t = r.a * r.t + r.b * engine.get_cover(v) + r.c;
+            }
+            for (int tick = 0; tick < SIM_TICKS_PER_SECOND; tick++) {
+                for (size_t v = tick; v < vents; v += SIM_TICKS_PER_SECOND) {
+                    engine.set_temperature(v, rooms[v].t + noise(0.02f));
+                }
+                changed.clear();
+                uint64_t start = now_ns();
+                engine.tick(changed);
+                uint64_t took = now_ns() - start;
+                if (s >= warm_seconds) {
+                    timed.push_back((double)took);
+                }
+            }
+        }
+        double total = 0;
+        for (size_t t = 0; t < timed.size(); t++) {
+            total += timed[t];
+        }
+        per_tick[m] = total / timed.size();
+        p99[m] = percentile(timed, 0.99);
+        if (m == 1) {
+            for (size_t v = 0; v < vents; v++) {
+                planned += engine.model(v)->trusted;
+            }
+        }
+    }
+    printf("%6zu vents  PID %8.1f us/tick (p99 %7.1f) | MPC %8.1f us/tick (p99 %7.1f), %5zu solves/tick, "
+           "%zu/%zu models trusted\n", vents, per_tick[0] / 1e3, p99[0] / 1e3, per_tick[1] / 1e3,
+           p99[1] / 1e3, (vents + MPC_PERIOD_TICKS - 1) / MPC_PERIOD_TICKS, planned, vents);
+}
+
+int main(int argc, char **argv) {
+    size_t rooms = argc > 1 ? strtoul(argv[1], NULL, 10) : 200;
+    double hours = argc > 2 ? atof(argv[2]) : 6;
+    size_t seconds = (size_t)(hours * 3600);
+
+    std::vector<Segment> segments;
+    Segment first = {0, seconds * 4 / 10, 21.0f};
+    Segment second = {first.end, seconds * 7 / 10, 23.0f};
+    Segment third = {second.end, seconds, 21.0f};
+    segments.push_back(first);
+    segments.push_back(second);
+    segments.push_back(third);
+
+    printf("%zu rooms, %.1f h; setpoints 21, 23, 21 C (outside 5 C, then -5 C)\n", rooms, hours);
+    Quality pid = run(CONTROL_PID, rooms, seconds, segments, 42);
+    report("PID", pid, rooms, segments);
+    Quality mpc = run(CONTROL_MPC, rooms, seconds, segments, 42);
+    report("MPC", mpc, rooms, segments);
+
+    printf("\nControlEngine::tick(), every vent reporting once a second:\n");
+    size_t sizes[] = {1000, 10000, 50000};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        tick_cost(sizes[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,228 @@
+// Phone datagram throughput: one system call per datagram against recvmmsg()/sendmmsg().
+//
+//   g++ -O2 -pthread -I. -o phone_bench bench/phone_bench.cpp
+//   ./phone_bench [rounds=2000]
+//
+// Runs in-process over loopback, with the phone played by a socket bound to 127.0.0.1:3001
+// (so stop anything else listening there first). Each round is one batch of datagrams,
+// sized like a tick's worth of updates for a house of that many vents.
+//
+// hub -> phone: a temperature update per vent. "sendto" formats and sends each one; the
+// batched side is PhoneGateway::publish() for each plus one flush(), with the phone
+// subscribed at a rate that never holds it back. The phone drains its socket between
+// rounds, outside the timing.
+//
+// phone -> hub: the phone queues a setpoint per vent, then the hub drains them. "recvfrom"
+// reads and parses one at a time until EAGAIN; the batched side is PhoneGateway's
+// handle_event(), recvmmsg() PHONE_RECV_BATCH at a time. Reported as datagrams per second
+// of the hub side's time, plus system calls per round.
+
+#include "bench_common.h"
+#include "phone_gateway.h"
+
+#define BENCH_GATEWAY_PORT 15001
+
+class CountingGateway : public PhoneGateway{
+    public:
+        uint64_t setpoints;
+        CountingGateway() : setpoints(0) {}
+        void on_setup(const char *name, size_t len) {}
+        void on_setpoint(uint32_t vent, float celsius) { setpoints++; }
+        void on_position(uint32_t vent, float percent) {}
+        void on_zone_setpoint(const char *zone, size_t len, float celsius) {}
+        void on_malformed(uint32_t type, const char *value, size_t len) {}
+};
+
+static int udp_socket(uint32_t ip, uint16_t port) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    // Big enough for the largest round; SO_RCVBUFFORCE works as root past rmem_max
+    int bytes = 16 << 20;
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &bytes, sizeof(bytes)) < 0) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes));
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(ip);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+static struct sockaddr_in loopback(uint16_t port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    return addr;
+}
+
+// Empties a socket without timing it; returns datagrams read
+static size_t drain(int fd) {
+    static char buffers[64][PHONE_MAX_DATAGRAM];
+    struct iovec iov[64];
+    struct mmsghdr msgs[64];
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < 64; i++) {
+        iov[i].iov_base = buffers[i];
+        iov[i].iov_len = PHONE_MAX_DATAGRAM;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    size_t total = 0;
+    int n;
+    while ((n = recvmmsg(fd, msgs, 64, MSG_DONTWAIT, NULL)) > 0) {
+        total += n;
+    }
+    return total;
+}
+
+static size_t encode(char *out, uint32_t type, uint32_t vent, float value) {
+    out[0] = (char)type;
+    out[1] = out[2] = out[3] = 0;
+    return 4 + snprintf(out + 4, UPDATE_MAX_BYTES - 4, "%u.%.1f", vent, value);
+}
+
+static void hub_to_phone(CountingGateway &gateway, int phone_fd, size_t vents, size_t rounds) {
+    int plain = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in phone = loopback(PHONE_REPLY_PORT);
+    char packet[UPDATE_MAX_BYTES];
+
+    uint64_t elapsed = 0, delivered = 0;
+    for (size_t r = 0; r < rounds; r++) {
+        uint64_t start = now_ns();
+        for (size_t v = 0; v < vents; v++) {
+            size_t len = encode(packet, PHONE_TYPE_TEMPERATURE, (uint32_t)v, 21.5f);
+            sendto(plain, packet, len, 0, (struct sockaddr *)&phone, sizeof(phone));
+        }
+        elapsed += now_ns() - start;
+        delivered += drain(phone_fd);
+    }
+    double plain_rate = rounds * vents / (elapsed / 1e9);
+    size_t plain_delivered = delivered;
+    close(plain);
+
+    uint64_t calls = gateway.syscalls.load();
+    elapsed = delivered = 0;
+    for (size_t r = 0; r < rounds; r++) {
+        uint64_t start = now_ns();
+        for (size_t v = 0; v < vents; v++) {
+            gateway.publish((uint32_t)v, PHONE_TYPE_TEMPERATURE, "%u.%.1f", (unsigned)v, 21.5f);
+        }
+        gateway.flush();
+        elapsed += now_ns() - start;
+        delivered += drain(phone_fd);
+    }
+    double batch_rate = rounds * vents / (elapsed / 1e9);
+    printf("hub->phone vents=%-5zu sendto %9.0f dgram/s  %5zu calls/round | sendmmsg %9.0f dgram/s  %5.1f calls/round  "
+           "x%.2f  (lost %zu / %zu)\n", vents, plain_rate, vents, batch_rate,
+           (double)(gateway.syscalls.load() - calls) / rounds, batch_rate / plain_rate,
+           rounds * vents - plain_delivered, rounds * vents - delivered);
+}
+
+static void phone_to_hub(CountingGateway &gateway, int phone_fd, size_t vents, size_t rounds) {
+    // The phone's side queues every round in one sendmmsg(), untimed
+    std::vector<char> buffers(vents * UPDATE_MAX_BYTES);
+    std::vector<struct iovec> iov(vents);
+    std::vector<struct mmsghdr> msgs(vents);
+    struct sockaddr_in plain_addr = loopback(BENCH_GATEWAY_PORT + 1);
+    struct sockaddr_in gateway_addr = loopback(BENCH_GATEWAY_PORT);
+    for (size_t v = 0; v < vents; v++) {
+        iov[v].iov_base = &buffers[v * UPDATE_MAX_BYTES];
+        iov[v].iov_len = encode(&buffers[v * UPDATE_MAX_BYTES], PHONE_TYPE_TEMPERATURE, (uint32_t)v, 22.5f);
+        memset(&msgs[v], 0, sizeof(msgs[v]));
+        msgs[v].msg_hdr.msg_iov = &iov[v];
+        msgs[v].msg_hdr.msg_iovlen = 1;
+        msgs[v].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    }
+    int plain = udp_socket(INADDR_LOOPBACK, BENCH_GATEWAY_PORT + 1);
+
+    auto queue_round = [&](struct sockaddr_in *to) {
+        for (size_t v = 0; v < vents; v++) {
+            msgs[v].msg_hdr.msg_name = to;
+        }
+        size_t done = 0;
+        while (done < vents) {
+            int n = sendmmsg(phone_fd, &msgs[done], vents - done, 0);
+            if (n <= 0) {
+                break;
+            }
+            done += n;
+        }
+    };
+
+    uint64_t elapsed = 0, parsed = 0, calls = 0;
+    char buffer[PHONE_MAX_DATAGRAM];
+    for (size_t r = 0; r < rounds; r++) {
+        queue_round(&plain_addr);
+        uint64_t start = now_ns();
+        while (1) {
+            struct sockaddr_in from;
+            socklen_t from_len = sizeof(from);
+            ssize_t n = recvfrom(plain, buffer, sizeof(buffer), 0, (struct sockaddr *)&from, &from_len);
+            calls++;
+            if (n < 0) {
+                break;
+            }
+            uint32_t vent;
+            float celsius;
+            if (n >= 4 && phone_parse_vent_value(buffer + 4, buffer + n, vent, celsius)) {
+                parsed++;
+            }
+        }
+        elapsed += now_ns() - start;
+    }
+    double plain_rate = parsed / (elapsed / 1e9);
+    double plain_calls = (double)calls / rounds;
+    close(plain);
+
+    uint64_t before = gateway.setpoints;
+    calls = gateway.syscalls.load();
+    elapsed = 0;
+    for (size_t r = 0; r < rounds; r++) {
+        queue_round(&gateway_addr);
+        uint64_t start = now_ns();
+        gateway.handle_event(EPOLLIN);
+        elapsed += now_ns() - start;
+    }
+    double batch_rate = (gateway.setpoints - before) / (elapsed / 1e9);
+    printf("phone->hub vents=%-5zu recvfrom %7.0f dgram/s  %5.0f calls/round | recvmmsg %7.0f dgram/s  %5.1f calls/round  "
+           "x%.2f  (parsed %llu / %zu)\n", vents, plain_rate, plain_calls, batch_rate,
+           (double)(gateway.syscalls.load() - calls) / rounds, batch_rate / plain_rate,
+           (unsigned long long)(gateway.setpoints - before), rounds * vents);
+}
+
+int main(int argc, char **argv) {
+    size_t rounds = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000;
+    int phone_fd = udp_socket(INADDR_LOOPBACK, PHONE_REPLY_PORT);
+    Reactor loop;
+    CountingGateway gateway;
+    if (!gateway.start(loop, BENCH_GATEWAY_PORT)) {
+        return 1;
+    }
+    // Subscribe the phone to everything, unthrottled
+    struct sockaddr_in gateway_addr = loopback(BENCH_GATEWAY_PORT);
+    char hello[UPDATE_MAX_BYTES];
+    size_t hello_len = 4 + snprintf(hello + 4, sizeof(hello) - 4, "*@100000000");
+    hello[0] = PHONE_TYPE_SUBSCRIBE;
+    hello[1] = hello[2] = hello[3] = 0;
+    sendto(phone_fd, hello, hello_len, 0, (struct sockaddr *)&gateway_addr, sizeof(gateway_addr));
+    gateway.handle_event(EPOLLIN);
+    if (!gateway.has_phone()) {
+        fprintf(stderr, "gateway never heard from the phone\n");
+        return 1;
+    }
+
+    size_t houses[] = {1, 16, 64, 256, 1024};
+    for (size_t i = 0; i < sizeof(houses) / sizeof(houses[0]); i++) {
+        hub_to_phone(gateway, phone_fd, houses[i], rounds / (1 + houses[i] / 64));
+    }
+    for (size_t i = 0; i < sizeof(houses) / sizeof(houses[0]); i++) {
+        phone_to_hub(gateway, phone_fd, houses[i], rounds / (1 + houses[i] / 64));
+    }
+    return 0;
+}
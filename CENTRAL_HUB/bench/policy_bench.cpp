@@ -0,0 +1,153 @@
+// ControlEngine's per-mode kernels against a controller object per vent behind a virtual call.
+//
+//   g++ -O3 -march=native -I. -o policy_bench bench/policy_bench.cpp
+//   ./policy_bench [ticks=200]
+//
+// The baseline is the usual object-oriented shape: each vent owns a heap-allocated
+// controller with its own memory and cover, and every reading goes through a virtual
+// update(). Its bodies are the same policy step() the engine inlines, so both make exactly
+// the same decisions and only dispatch and layout differ. The engine instead picks the law
+// once per run of vents in a mode and runs control_group_step<Policy>() over the columns.
+//
+// Every vent reports once per tick. Mixes: all PID; the four laws in equal shares with vents
+// assigned at random, which leaves the virtual call's target unpredictable; and the same
+// shares in blocks of vents, which the branch predictor can follow.
+
+#include <random>
+#include <vector>
+#include "bench_common.h"
+#include "control_engine.h"
+
+class VentController{
+    public:
+        virtual ~VentController() {}
+        // The cover after a reading
+        virtual int update(float t, float d) = 0;
+};
+
+template <class Policy>
+class PolicyController : public VentController{
+    public:
+        explicit PolicyController(const Policy &p) : policy(p), integral(0), previous(0), cover(COVER_MIN) {}
+
+        int update(float t, float d) {
+            float next = policy.step(t, d, cover, 1.0f, integral, previous);
+            cover = (float)(int)next;
+            return (int)cover;
+        }
+
+    private:
+        Policy policy;
+        float integral;
+        float previous;
+        float cover;
+};
+
+static VentController *make_controller(int mode, const ControlEngine &engine) {
+    switch (mode) {
+    case CONTROL_HYSTERESIS:
+        return new PolicyController<HysteresisPolicy>(engine.hysteresis);
+    case CONTROL_BANG_BANG:
+        return new PolicyController<BangBangPolicy>(engine.bang_bang);
+    case CONTROL_SCHEDULED_PID:
+        return new PolicyController<ScheduledPidPolicy>(engine.scheduled_pid);
+    default:
+        return new PolicyController<PidPolicy>(engine.pid);
+    }
+}
+
+struct Result{
+    double ns_per_vent;
+    size_t moves;
+};
+
+static Result run_virtual(const std::vector<int> &modes, size_t ticks, const std::vector<float> &readings) {
+    size_t vents = modes.size();
+    ControlEngine defaults;
+    std::vector<VentController *> controllers(vents);
+    for (size_t v = 0; v < vents; v++) {
+        controllers[v] = make_controller(modes[v], defaults);
+    }
+    std::vector<int> cover(vents, COVER_MIN);
+    size_t moves = 0;
+    uint64_t start = now_ns();
+    for (size_t t = 0; t < ticks; t++) {
+        const float *reading = &readings[(t % 64) * vents];
+        for (size_t v = 0; v < vents; v++) {
+            int next = controllers[v]->update(reading[v], 23.0f);
+            moves += next != cover[v];
+            cover[v] = next;
+        }
+    }
+    Result r;
+    r.ns_per_vent = (double)(now_ns() - start) / (ticks * vents);
+    r.moves = moves;
+    for (size_t v = 0; v < vents; v++) {
+        delete controllers[v];
+    }
+    return r;
+}
+
+static Result run_engine(const std::vector<int> &modes, size_t ticks, const std::vector<float> &readings) {
+    size_t vents = modes.size();
+    ControlEngine engine;
+    for (size_t v = 0; v < vents; v++) {
+        engine.add_vent(23.0f, modes[v]);
+    }
+    std::vector<uint32_t> changed;
+    changed.reserve(vents);
+    size_t moves = 0;
+    uint64_t start = now_ns();
+    for (size_t t = 0; t < ticks; t++) {
+        const float *reading = &readings[(t % 64) * vents];
+        for (size_t v = 0; v < vents; v++) {
+            engine.set_temperature(v, reading[v]);
+        }
+        changed.clear();
+        engine.tick(changed);
+        moves += changed.size();
+    }
+    Result r;
+    r.ns_per_vent = (double)(now_ns() - start) / (ticks * vents);
+    r.moves = moves;
+    return r;
+}
+
+int main(int argc, char **argv) {
+    size_t ticks = argc > 1 ? strtoul(argv[1], NULL, 10) : 200;
+    size_t sizes[] = {100, 1000, 10000, 50000};
+    const int laws[] = {CONTROL_PID, CONTROL_HYSTERESIS, CONTROL_BANG_BANG, CONTROL_SCHEDULED_PID};
+    const char *mixes[] = {"all PID", "4 laws, random", "4 laws, blocks"};
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<float> temp(20.0f, 26.0f);
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t vents = sizes[s];
+        size_t rounds = ticks * (50000 / vents > 0 ? 50000 / vents : 1);
+        if (rounds > 100000) {
+            rounds = 100000;
+        }
+        std::vector<float> readings(64 * vents);
+        for (size_t i = 0; i < readings.size(); i++) {
+            readings[i] = temp(gen);
+        }
+        for (int mix = 0; mix < 3; mix++) {
+            std::vector<int> modes(vents);
+            for (size_t v = 0; v < vents; v++) {
+                if (mix == 0) {
+                    modes[v] = CONTROL_PID;
+                } else if (mix == 1) {
+                    modes[v] = laws[gen() % 4];
+                } else {
+                    modes[v] = laws[v * 4 / vents];
+                }
+            }
+            Result virt = run_virtual(modes, rounds, readings);
+            Result engine = run_engine(modes, rounds, readings);
+            printf("vents=%-6zu %-15s virtual=%6.2f ns/vent  engine=%6.2f ns/vent  speedup=%.1fx  moves %zu vs %zu\n",
+                   vents, mixes[mix], virt.ns_per_vent, engine.ns_per_vent, virt.ns_per_vent / engine.ns_per_vent,
+                   virt.moves, engine.moves);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+// TelemetryQueue enqueue and dequeue latency under each overflow policy.
+//
+//   g++ -O2 -pthread -I. -o queue_bench bench/queue_bench.cpp
+//   ./queue_bench [max_producers=4] [readings_per_producer=1000000]
+//
+// Producers stand in for I/O threads publishing readings for 1000 vents; one consumer
+// drains continuously like the control thread does when rung. enqueue is the time spent
+// inside publish(); dequeue is how long a reading sat in the queue before the consumer saw
+// it. Both include one clock_gettime (~20 ns). The small-ring runs use a 256-entry queue so
+// the overflow policies actually engage. With fewer cores than threads the dequeue tail is
+// the scheduler's time slice, not the queue.
+
+#include <pthread.h>
+#include <thread>
+#include "bench_common.h"
+#include "telemetry_queue.h"
+
+#define BENCH_VENTS 1000
+
+static const char *policy_name(int policy) {
+    switch (policy) {
+        case OVERFLOW_DROP_OLDEST_PER_VENT: return "drop-oldest";
+        case OVERFLOW_BLOCK: return "block";
+        default: return "count-drop";
+    }
+}
+
+static void run(VentRegistry &registry, int policy, size_t capacity, int producers, size_t per_producer) {
+    TelemetryQueue queue(registry, policy, capacity);
+    std::atomic<int> running(producers);
+    std::vector<LatencyHistogram> enqueue(producers);
+    LatencyHistogram dequeue;
+    size_t consumed = 0;
+
+    std::thread consumer([&]() {
+        while (1) {
+            int still = running.load(std::memory_order_acquire);
+            size_t n = queue.drain([&](const TelemetryEvent &event) {
+                dequeue.record(now_ns() - event.enqueued_ns);
+            });
+            consumed += n;
+            if (n == 0 && still == 0) {
+                break;
+            }
+            if (n == 0) {
+                sched_yield();
+            }
+        }
+    });
+
+    uint64_t start = now_ns();
+    std::vector<std::thread> pool;
+    for (int p = 0; p < producers; p++) {
+        pool.push_back(std::thread([&, p]() {
+            LatencyHistogram &hist = enqueue[p];
+            for (size_t i = 0; i < per_producer; i++) {
+                Vent &vent = registry.at((uint32_t)((i * 7 + p * 131) % BENCH_VENTS));
+                float temperature = 20.0f + (float)(i & 15) * 0.25f;
+                uint64_t before = now_ns();
+                vent.temperature.store(temperature, std::memory_order_relaxed);
+                queue.publish(vent, temperature);
+                hist.record(now_ns() - before);
+            }
+            running.fetch_sub(1, std::memory_order_release);
+        }));
+    }
+    for (size_t p = 0; p < pool.size(); p++) {
+        pool[p].join();
+    }
+    consumer.join();
+    double secs = (now_ns() - start) / 1e9;
+
+    LatencyHistogram all;
+    for (int p = 0; p < producers; p++) {
+        all.merge(enqueue[p]);
+    }
+    printf("policy=%-11s ring=%-6zu producers=%d  %.1f M readings/s  consumed=%zu dropped=%lu superseded=%lu blocked=%lu\n",
+           policy_name(policy), capacity, producers, producers * per_producer / secs / 1e6,
+           consumed, (unsigned long)queue.dropped.load(), (unsigned long)queue.superseded.load(),
+           (unsigned long)queue.blocked.load());
+    all.print("  enqueue");
+    dequeue.print("  dequeue");
+}
+
+int main(int argc, char **argv) {
+    int max_producers = argc > 1 ? atoi(argv[1]) : 4;
+    size_t per_producer = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+
+    VentRegistry registry;
+    for (unsigned v = 0; v < BENCH_VENTS; v++) {
+        registry.add(v);
+    }
+
+    int policies[] = {OVERFLOW_DROP_OLDEST_PER_VENT, OVERFLOW_BLOCK, OVERFLOW_COUNT_AND_DROP};
+    size_t rings[] = {TELEMETRY_QUEUE_SIZE, 256};
+    for (size_t r = 0; r < sizeof(rings) / sizeof(rings[0]); r++) {
+        for (size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); p++) {
+            for (int producers = 1; producers <= max_producers; producers *= 2) {
+                run(registry, policies[p], rings[r], producers, per_producer);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,71 @@
+// Thread-per-vent (the original hub model) versus the epoll reactor.
+//
+//   g++ -O2 -pthread -I. -o reactor_bench bench/reactor_bench.cpp
+//   ./reactor_bench [connections=1000] [rounds=50]
+//
+// Each model runs in a forked server process. The driver connects every vent, then runs
+// lockstep rounds where each vent sends one temperature packet and waits for its command.
+// Server CPU per packet is measured inside the server process, so the driver's own cost
+// is excluded.
+
+#include <pthread.h>
+#include <atomic>
+#include "bench_common.h"
+
+// ---- today's model: one blocking thread per accepted socket ----
+
+static std::atomic<uint64_t> threaded_packets(0);
+
+static void* threaded_recv(void *args) {
+    int sockfd = (int)(intptr_t)args;
+    char buffer[1024];
+    while (1) {
+        ssize_t n = recv(sockfd, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            close(sockfd);
+            return NULL;
+        }
+        BenchCommand command = {0x2, 0.0f, 5};
+        send(sockfd, &command, sizeof(command), MSG_NOSIGNAL);
+        if (threaded_packets.fetch_add(1) + 1 == bench_expected_packets) {
+            send_report(bench_report_fd, bench_expected_packets);
+            _exit(0);
+        }
+    }
+}
+
+static void run_threaded_server(int server_fd) {
+    while (1) {
+        int fd = accept(server_fd, NULL, NULL);
+        if (fd < 0) {
+            perror("accept");
+            _exit(1);
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        pthread_t thread;
+        pthread_create(&thread, NULL, threaded_recv, (void *)(intptr_t)fd);
+        pthread_detach(thread);
+    }
+}
+
+// ---- reactor model ----
+
+static void run_epoll_server(int server_fd) {
+    EchoHandler handler;
+    EpollBackend backend(handler);
+    handler.backend = &backend;
+    backend.listen(server_fd);
+    backend.run();
+}
+
+int main(int argc, char **argv) {
+    size_t connections = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000;
+    size_t rounds = argc > 2 ? strtoul(argv[2], NULL, 10) : 50;
+    raise_fd_limit();
+    signal(SIGPIPE, SIG_IGN);
+
+    run_server_model("threaded", run_threaded_server, connections, rounds);
+    run_server_model("epoll", run_epoll_server, connections, rounds);
+    return 0;
+}
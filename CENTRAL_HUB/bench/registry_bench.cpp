@@ -0,0 +1,110 @@
+// VentRegistry lookup and update throughput at 10, 1k and 100k vents.
+//
+//   g++ -O3 -pthread -I. -o registry_bench bench/registry_bench.cpp
+//   ./registry_bench [threads=4]
+//
+// find: lookup by vent ID. update: lookup plus the temperature/cover stores the receive path
+// does per packet. by-name: lookup by BLE name. Each is run on one thread and then on
+// several threads at once to show readers do not contend. A mutex-guarded unordered_map is
+// measured alongside as the obvious alternative.
+
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <mutex>
+#include "bench_common.h"
+#include "vent_registry.h"
+
+#define OPS_PER_THREAD 4000000
+
+struct LockedMap{
+    std::mutex lock;
+    std::unordered_map<unsigned, Vent *> map;
+};
+
+static std::vector<unsigned> make_keys(size_t vents, std::mt19937 &gen) {
+    std::uniform_int_distribution<size_t> pick(0, vents - 1);
+    std::vector<unsigned> keys(1 << 16);
+    for (size_t i = 0; i < keys.size(); i++) {
+        keys[i] = (unsigned)(pick(gen) * 7 + 3);
+    }
+    return keys;
+}
+
+template <class F>
+static double run_threads(int threads, F body) {
+    std::vector<std::thread> pool;
+    uint64_t start = now_ns();
+    for (int t = 0; t < threads; t++) {
+        pool.push_back(std::thread(body, t));
+    }
+    for (size_t t = 0; t < pool.size(); t++) {
+        pool[t].join();
+    }
+    double secs = (now_ns() - start) / 1e9;
+    return (double)threads * OPS_PER_THREAD / secs / 1e6;
+}
+
+int main(int argc, char **argv) {
+    int threads = argc > 1 ? atoi(argv[1]) : 4;
+    size_t sizes[] = {10, 1000, 100000};
+    std::mt19937 gen(11);
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t vents = sizes[s];
+        VentRegistry registry;
+        LockedMap locked;
+        std::vector<std::string> names;
+        for (size_t v = 0; v < vents; v++) {
+            char name[32];
+            snprintf(name, sizeof(name), "BLE-Server%zu", v);
+            names.push_back(name);
+            Vent *vent = registry.add((unsigned)(v * 7 + 3), name);
+            locked.map[vent->ID] = vent;
+        }
+        std::vector<unsigned> keys = make_keys(vents, gen);
+        volatile uintptr_t sink = 0;
+
+        for (int pass = 0; pass < 2; pass++) {
+            int n = pass == 0 ? 1 : threads;
+
+            double find = run_threads(n, [&](int t) {
+                uintptr_t acc = 0;
+                for (size_t i = 0; i < OPS_PER_THREAD; i++) {
+                    acc += (uintptr_t)registry.find(keys[(i + t * 977) & 0xffff]);
+                }
+                sink = acc;
+            });
+
+            double update = run_threads(n, [&](int t) {
+                for (size_t i = 0; i < OPS_PER_THREAD; i++) {
+                    Vent *vent = registry.find(keys[(i + t * 977) & 0xffff]);
+                    vent->temperature.store((float)(i & 31), std::memory_order_relaxed);
+                    vent->cover.store(i & 7, std::memory_order_relaxed);
+                }
+            });
+
+            double by_name = run_threads(n, [&](int t) {
+                uintptr_t acc = 0;
+                for (size_t i = 0; i < OPS_PER_THREAD / 4; i++) {
+                    const std::string &name = names[(keys[(i + t * 977) & 0xffff] - 3) / 7];
+                    acc += (uintptr_t)registry.find_by_name(name.data(), name.size());
+                }
+                sink = acc;
+            }) / 4;
+
+            double baseline = run_threads(n, [&](int t) {
+                for (size_t i = 0; i < OPS_PER_THREAD; i++) {
+                    std::lock_guard<std::mutex> guard(locked.lock);
+                    Vent *vent = locked.map[keys[(i + t * 977) & 0xffff]];
+                    vent->temperature.store((float)(i & 31), std::memory_order_relaxed);
+                }
+            });
+
+            printf("vents=%-7zu threads=%d  find=%7.1f Mops/s  update=%7.1f Mops/s  by-name=%6.1f Mops/s  "
+                   "mutex+unordered_map update=%6.1f Mops/s\n",
+                   vents, n, find, update, by_name, baseline);
+        }
+    }
+    return 0;
+}
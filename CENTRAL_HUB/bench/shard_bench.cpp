@@ -0,0 +1,198 @@
+// Hub connection and packet rates from 1 to 16 SO_REUSEPORT reactors.
+//
+//   g++ -O2 -pthread -DHLOG_LEVEL=HLOG_LEVEL_INFO -o hub_info main.cpp
+//   g++ -O2 -pthread -I. -o shard_bench bench/shard_bench.cpp
+//   ./shard_bench [--vents=1000] [--clients=4] [--seconds=3] [--max-reactors=16] [--pin] ./hub_info
+//
+// For each reactor count the hub is started on port 8080 with --reactors=N (and --cpus=0-K
+// with --pin, K the last online CPU), --no-log and --no-snapshot. --clients forked client
+// processes each connect their share of the vents at once; conn/s is the number of vents
+// over the time until every client is connected. Then every vent sends framed readings as
+// fast as the hub takes them, and pkt/s is the hub's own hub_packets_total over the window.
+// The spread columns are the fewest and most vents any one reactor accepted, from
+// hub_reactor_connections_total, so an uneven SO_REUSEPORT hash shows up next to the rate.
+// Scaling needs as many idle cores as reactors plus clients; on fewer cores the extra
+// reactors only share the same CPU and the numbers say so.
+
+#include "bench_common.h"
+
+#define HUB_PORT 8080
+#define HUB_METRICS_PORT 9464
+#define FRAMES_PER_SEND 32
+
+// Client process: connect, report in, wait for the go byte, then send until killed
+static void run_client(size_t vents, int ready_fd, int go_fd) {
+    VentSwarm swarm;
+    if (!swarm.connect_all(HUB_PORT, vents)) {
+        _exit(1);
+    }
+    char byte = 1;
+    if (write(ready_fd, &byte, 1) != 1 || read(go_fd, &byte, 1) != 1) {
+        _exit(1);
+    }
+    for (size_t i = 0; i < swarm.fds.size(); i++) {
+        fcntl(swarm.fds[i], F_SETFL, fcntl(swarm.fds[i], F_GETFL) | O_NONBLOCK);
+    }
+
+    std::vector<char> batch[4];
+    for (int b = 0; b < 4; b++) {
+        for (int f = 0; f < FRAMES_PER_SEND; f++) {
+            BenchPacket packet = {0x1, 18.0f + b * 2.0f + f * 0.05f};
+            char frame[64];
+            size_t len = encode_frame(frame, &packet, sizeof(packet));
+            batch[b].insert(batch[b].end(), frame, frame + len);
+        }
+    }
+    char sink[65536];
+    for (size_t round = 0;; round++) {
+        const std::vector<char> &frames = batch[round & 3];
+        for (size_t i = 0; i < swarm.fds.size(); i++) {
+            send(swarm.fds[i], frames.data(), frames.size(), MSG_NOSIGNAL);
+            while (recv(swarm.fds[i], sink, sizeof(sink), 0) > 0) {
+            }
+        }
+    }
+}
+
+static void stop(pid_t pid) {
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+}
+
+static void run_reactors(const char *binary, int reactors, bool pin, size_t vents, size_t clients, double seconds) {
+    char dir[] = "/tmp/shard_bench.XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        exit(EXIT_FAILURE);
+    }
+    char reactors_arg[32];
+    char cpus_arg[32];
+    snprintf(reactors_arg, sizeof(reactors_arg), "--reactors=%d", reactors);
+    snprintf(cpus_arg, sizeof(cpus_arg), "--cpus=0-%ld", sysconf(_SC_NPROCESSORS_ONLN) - 1);
+    pid_t hub = fork();
+    if (hub == 0) {
+        if (chdir(dir) < 0) {
+            _exit(1);
+        }
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        execl(binary, binary, reactors_arg, "--no-log", "--no-snapshot", pin ? cpus_arg : (char *)NULL, (char *)NULL);
+        _exit(127);
+    }
+    uint64_t deadline = now_ns() + 5000000000ull;
+    while (page_value(scrape_page(HUB_METRICS_PORT), "hub_packets_total") < 0) {
+        if (now_ns() > deadline) {
+            fprintf(stderr, "reactors=%d: hub did not come up\n", reactors);
+            stop(hub);
+            return;
+        }
+        usleep(10000);
+    }
+
+    // Connection phase
+    int ready[2], go[2];
+    if (pipe(ready) < 0 || pipe(go) < 0) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+    std::vector<pid_t> pids;
+    uint64_t start = now_ns();
+    for (size_t c = 0; c < clients; c++) {
+        size_t share = vents / clients + (c < vents % clients ? 1 : 0);
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(ready[0]);
+            close(go[1]);
+            run_client(share, ready[1], go[0]);
+        }
+        pids.push_back(pid);
+    }
+    close(ready[1]);
+    close(go[0]);
+    size_t connected = 0;
+    char byte;
+    while (connected < clients && read(ready[0], &byte, 1) == 1) {
+        connected++;
+    }
+    double connect_s = (now_ns() - start) / 1e9;
+
+    // Packet phase
+    double packets = 0, window = 0;
+    uint64_t cpu = 0;
+    std::string page;
+    if (connected == clients) {
+        for (size_t c = 0; c < clients; c++) {
+            if (write(go[1], &byte, 1) != 1) {
+                perror("go pipe");
+            }
+        }
+        usleep(500000);
+        double start_packets = page_value(scrape_page(HUB_METRICS_PORT), "hub_packets_total");
+        uint64_t start_cpu = process_cpu_ns(hub);
+        uint64_t window_start = now_ns();
+        usleep((useconds_t)(seconds * 1e6));
+        page = scrape_page(HUB_METRICS_PORT);
+        packets = page_value(page, "hub_packets_total") - start_packets;
+        cpu = process_cpu_ns(hub) - start_cpu;
+        window = (now_ns() - window_start) / 1e9;
+    } else {
+        fprintf(stderr, "reactors=%d: only %zu/%zu clients connected\n", reactors, connected, clients);
+    }
+    for (size_t c = 0; c < pids.size(); c++) {
+        stop(pids[c]);
+    }
+    stop(hub);
+    close(ready[0]);
+    close(go[1]);
+    rmdir(dir);
+    if (window == 0) {
+        return;
+    }
+
+    double fewest = -1, most = 0;
+    for (int r = 0; r < reactors; r++) {
+        char series[96];
+        snprintf(series, sizeof(series), "hub_reactor_connections_total{reactor=\"%d\"}", r);
+        double accepted = page_value(page, series);
+        fewest = fewest < 0 || accepted < fewest ? accepted : fewest;
+        most = accepted > most ? accepted : most;
+    }
+    printf("reactors=%-3d vents=%-6zu conn/s=%-9.0f pkt/s=%-10.0f cpu/pkt=%-6.0f ns  vents/reactor=%.0f..%.0f\n",
+           reactors, vents, vents / connect_s, packets / window, packets > 0 ? cpu / packets : 0.0, fewest, most);
+}
+
+int main(int argc, char **argv) {
+    size_t vents = 1000;
+    size_t clients = 4;
+    double seconds = 3.0;
+    int max_reactors = 16;
+    bool pin = false;
+    const char *binary = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--vents=", 8) == 0) {
+            vents = strtoul(argv[i] + 8, NULL, 10);
+        } else if (strncmp(argv[i], "--clients=", 10) == 0) {
+            clients = strtoul(argv[i] + 10, NULL, 10);
+        } else if (strncmp(argv[i], "--seconds=", 10) == 0) {
+            seconds = atof(argv[i] + 10);
+        } else if (strncmp(argv[i], "--max-reactors=", 15) == 0) {
+            max_reactors = atoi(argv[i] + 15);
+        } else if (strcmp(argv[i], "--pin") == 0) {
+            pin = true;
+        } else {
+            binary = argv[i];
+        }
+    }
+    if (binary == NULL || clients == 0 || vents < clients) {
+        fprintf(stderr, "usage: %s [--vents=N] [--clients=N] [--seconds=S] [--max-reactors=N] [--pin] hub_binary\n", argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    raise_fd_limit();
+    printf("%ld online CPU(s)\n", sysconf(_SC_NPROCESSORS_ONLN));
+    for (int reactors = 1; reactors <= max_reactors; reactors *= 2) {
+        run_reactors(binary, reactors, pin, vents, clients, seconds);
+    }
+    return 0;
+}
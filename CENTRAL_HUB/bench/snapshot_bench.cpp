@@ -0,0 +1,115 @@
+// Snapshot capture cost and warm-restart time with 10k vents.
+//
+//   g++ -O2 -msse4.2 -pthread -I. -o snapshot_bench bench/snapshot_bench.cpp
+//   ./snapshot_bench [vents=10000] [path=/tmp/snapshot_bench.bin]
+//
+// Builds a registry and engine with every vent mid-way through control (non-zero PID memory,
+// covers spread over the range), then times what the control thread spends capturing a
+// snapshot, how long the writer thread takes to make it durable, and how long a restarted
+// hub takes to map the file and rebuild registry and engine from it. Restore is timed with
+// the file in the page cache and again after asking the kernel to drop it. Finally checks
+// that every restored vent matches the original.
+
+#include "bench_common.h"
+#include "snapshot.h"
+
+#define RESTORE_RUNS 20
+
+static void build(VentRegistry &registry, ControlEngine &engine, uint32_t vents) {
+    for (uint32_t v = 0; v < vents; v++) {
+        // Real vents are keyed by IPv4 address
+        Vent *vent = registry.add(0xC0A80000u + v);
+        float desired = 20.0f + (v % 7) * 0.5f;
+        vent->desired_temperature.store(desired);
+        engine.add_vent(desired, CONTROL_PID);
+        engine.restore(v, desired + (v % 11) * 0.1f - 0.5f, (float)(v % 13) * 0.37f,
+                       (float)(v % 5) * 0.1f, (int)(v % (COVER_MAX + 1)));
+    }
+}
+
+static bool same(const VentRegistry &a, const ControlEngine &ea, const VentRegistry &b,
+                 const ControlEngine &eb) {
+    if (a.size() != b.size() || ea.size() != eb.size()) {
+        return false;
+    }
+    for (uint32_t i = 0; i < ea.size(); i++) {
+        if (a.at(i).ID != b.at(i).ID || ea.get_cover(i) != eb.get_cover(i) ||
+            ea.get_desired(i) != eb.get_desired(i) || ea.get_integral(i) != eb.get_integral(i) ||
+            ea.get_previous_error(i) != eb.get_previous_error(i) ||
+            ea.get_temperature(i) != eb.get_temperature(i) || b.find(a.at(i).ID) != &b.at(i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static double median(std::vector<double> v) {
+    std::sort(v.begin(), v.end());
+    return v[v.size() / 2];
+}
+
+// Restart: map, validate, rebuild. Returns milliseconds.
+static double restore_once(const char *path, bool drop_cache, VentRegistry &registry, ControlEngine &engine) {
+    if (drop_cache) {
+        int fd = open(path, O_RDONLY);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+    uint64_t start = now_ns();
+    SnapshotImage image;
+    if (!image.open(path)) {
+        fprintf(stderr, "snapshot failed validation\n");
+        exit(EXIT_FAILURE);
+    }
+    snapshot_restore(image, registry, engine, CONTROL_PID);
+    return (now_ns() - start) / 1e6;
+}
+
+int main(int argc, char **argv) {
+    uint32_t vents = argc > 1 ? (uint32_t)atoi(argv[1]) : 10000;
+    const char *path = argc > 2 ? argv[2] : "/tmp/snapshot_bench.bin";
+    unlink(path);
+
+    VentRegistry registry;
+    ControlEngine engine;
+    build(registry, engine, vents);
+
+    SnapshotWriter writer;
+    writer.start(path);
+    std::vector<double> capture_us;
+    std::vector<double> write_ms;
+    for (int run = 0; run < RESTORE_RUNS; run++) {
+        uint64_t start = now_ns();
+        snapshot_capture(registry, engine, writer.staging());
+        uint64_t captured = now_ns();
+        writer.publish();
+        while (writer.busy()) {
+            usleep(100);
+        }
+        capture_us.push_back((captured - start) / 1e3);
+        write_ms.push_back((now_ns() - captured) / 1e6);
+    }
+    writer.stop();
+    struct stat st;
+    stat(path, &st);
+    printf("vents=%u  snapshot=%lld bytes (%.1f per vent)\n", vents, (long long)st.st_size,
+           (double)st.st_size / vents);
+    printf("capture (control thread): median %.0f us\n", median(capture_us));
+    printf("write+fdatasync+rename (writer thread): median %.2f ms\n", median(write_ms));
+
+    bool ok = true;
+    for (int cold = 0; cold < 2; cold++) {
+        std::vector<double> restore_ms;
+        for (int run = 0; run < RESTORE_RUNS; run++) {
+            VentRegistry restored;
+            ControlEngine restored_engine;
+            restore_ms.push_back(restore_once(path, cold != 0, restored, restored_engine));
+            ok = ok && same(registry, engine, restored, restored_engine);
+        }
+        printf("restore, %s: median %.2f ms, worst %.2f ms\n", cold ? "page cache dropped" : "page cache warm  ",
+               median(restore_ms), *std::max_element(restore_ms.begin(), restore_ms.end()));
+    }
+    printf("round trip: %s\n", ok ? "ok" : "MISMATCH");
+    unlink(path);
+    return ok ? 0 : 1;
+}
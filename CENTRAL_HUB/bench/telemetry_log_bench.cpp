@@ -0,0 +1,164 @@
+// TelemetryLog append rate and time-to-ready on a 1 GB log.
+//
+//   g++ -O2 -msse4.2 -pthread -I. -o telemetry_log_bench bench/telemetry_log_bench.cpp
+//   ./telemetry_log_bench [dir=/tmp/telemetry_log_bench] [megabytes=1024]
+//
+// Writes telemetry records for 1000 vents, committing once per 1000 records (one control
+// tick) and checkpointing the vents' state every 500 ticks, until the log holds the
+// requested size. The baseline writes the same records with one write() each and an
+// fdatasync() per tick. Then reopens the log twice: from the newest checkpoint, as the hub
+// does, and replaying every record. Finally tears the last record and checks that replay
+// stops just before it.
+
+#include <sys/stat.h>
+#include "bench_common.h"
+#include "telemetry_log.h"
+
+#define BENCH_VENTS 1000
+#define TICKS_PER_CHECKPOINT 500
+
+static void remove_log(const std::string &dir) {
+    DIR *d = opendir(dir.c_str());
+    if (d == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (entry->d_name[0] != '.') {
+            unlink((dir + "/" + entry->d_name).c_str());
+        }
+    }
+    closedir(d);
+    rmdir(dir.c_str());
+}
+
+static double write_baseline(const std::string &dir, uint64_t records) {
+    mkdir(dir.c_str(), 0755);
+    std::string path = dir + "/baseline.log";
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0) {
+        perror("baseline open");
+        exit(EXIT_FAILURE);
+    }
+    char record[sizeof(LogRecordHeader) + sizeof(LogTelemetry)];
+    memset(record, 0, sizeof(record));
+    uint64_t start = now_ns();
+    for (uint64_t i = 0; i < records; i++) {
+        LogTelemetry t = {(uint32_t)(i % BENCH_VENTS), 21.0f + (i & 15) * 0.1f};
+        memcpy(record + sizeof(LogRecordHeader), &t, sizeof(t));
+        if (write(fd, record, sizeof(record)) != (ssize_t)sizeof(record)) {
+            perror("baseline write");
+            exit(EXIT_FAILURE);
+        }
+        if ((i + 1) % BENCH_VENTS == 0) {
+            fdatasync(fd);
+        }
+    }
+    double secs = (now_ns() - start) / 1e9;
+    close(fd);
+    unlink(path.c_str());
+    return records / secs;
+}
+
+int main(int argc, char **argv) {
+    std::string dir = argc > 1 ? argv[1] : "/tmp/telemetry_log_bench";
+    uint64_t megabytes = argc > 2 ? strtoull(argv[2], NULL, 10) : 1024;
+    uint64_t target = megabytes << 20;
+    remove_log(dir);
+
+    std::vector<LogVentState> state(BENCH_VENTS);
+    uint64_t records = 0;
+    uint64_t bytes = 0;
+    uint64_t start = now_ns();
+    {
+        TelemetryLog log;
+        if (!log.open(dir.c_str(), [](const LogRecord &) {})) {
+            return 1;
+        }
+        uint64_t tick = 0;
+        while (bytes < target) {
+            for (uint32_t v = 0; v < BENCH_VENTS; v++) {
+                LogTelemetry t = {v, 21.0f + (float)((tick + v) & 31) * 0.1f};
+                log.append(LOG_TELEMETRY, &t, sizeof(t));
+                state[v].temperature = t.temperature;
+            }
+            records += BENCH_VENTS;
+            bytes += BENCH_VENTS * log_record_size(sizeof(LogTelemetry));
+            if (++tick % TICKS_PER_CHECKPOINT == 0) {
+                log.checkpoint(state.data(), (uint32_t)(state.size() * sizeof(LogVentState)));
+                records++;
+                bytes += log_record_size((uint32_t)(state.size() * sizeof(LogVentState)));
+            }
+            log.commit();
+        }
+    }
+    double write_s = (now_ns() - start) / 1e9;
+    printf("log:      %llu records, %.0f MB in %.2f s = %.2f M records/s (incl. final sync)\n",
+           (unsigned long long)records, bytes / 1e6, write_s, records / write_s / 1e6);
+
+    uint64_t baseline_records = records < 2000000 ? records : 2000000;
+    double baseline = write_baseline(dir + "-baseline", baseline_records);
+    rmdir((dir + "-baseline").c_str());
+    printf("baseline: write() per record + fdatasync per tick = %.2f M records/s\n", baseline / 1e6);
+
+    for (int full = 0; full < 2; full++) {
+        uint64_t telemetry = 0;
+        start = now_ns();
+        TelemetryLog log;
+        log.open(dir.c_str(), [&telemetry](const LogRecord &record) {
+            telemetry += record.type == LOG_TELEMETRY;
+        }, full != 0);
+        double ready_ms = (now_ns() - start) / 1e6;
+        printf("%s: ready in %.1f ms, %llu records (%.0f MB) replayed, last seq %llu\n",
+               full ? "full replay    " : "from checkpoint", ready_ms,
+               (unsigned long long)log.records_replayed, log.bytes_replayed / 1e6,
+               (unsigned long long)log.last_seq());
+    }
+
+    // Tear the final record: every segment after a reopen starts fresh, so find the newest
+    // segment with data and flip a byte in its last record
+    uint64_t before_seq = 0;
+    {
+        TelemetryLog log;
+        log.open(dir.c_str(), [](const LogRecord &) {});
+        LogTelemetry t = {1, 22.0f};
+        log.append(LOG_TELEMETRY, &t, sizeof(t));
+        log.append(LOG_TELEMETRY, &t, sizeof(t));
+        log.commit();
+        before_seq = log.last_seq();
+    }
+    std::vector<std::string> names;
+    DIR *d = opendir(dir.c_str());
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (strncmp(entry->d_name, "seg-", 4) == 0) {
+            names.push_back(entry->d_name);
+        }
+    }
+    closedir(d);
+    std::sort(names.begin(), names.end());
+    bool torn = false;
+    for (size_t i = names.size(); i > 0 && !torn; i--) {
+        int fd = open((dir + "/" + names[i - 1]).c_str(), O_RDWR);
+        LogSegmentHeader header;
+        if (pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) && header.magic == LOG_MAGIC) {
+            // The two records just written are the only ones in this segment
+            off_t last = LOG_HEADER_SIZE + log_record_size(sizeof(LogTelemetry)) + sizeof(LogRecordHeader);
+            char byte = 0x55;
+            torn = pwrite(fd, &byte, 1, last) == 1;
+        }
+        close(fd);
+    }
+    uint64_t after_seq = 0;
+    {
+        TelemetryLog log;
+        log.open(dir.c_str(), [](const LogRecord &) {});
+        after_seq = log.last_seq();
+    }
+    bool ok = torn && after_seq == before_seq - 1;
+    printf("torn tail: replay ends at seq %llu, expected %llu: %s\n", (unsigned long long)after_seq,
+           (unsigned long long)(before_seq - 1), ok ? "ok" : "MISMATCH");
+
+    remove_log(dir);
+    return ok ? 0 : 1;
+}
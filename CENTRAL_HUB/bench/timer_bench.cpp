@@ -0,0 +1,230 @@
+// Timer churn: the hub's timer wheel against a sorted map and against polling.
+//
+//   g++ -O2 -pthread -I. -o timer_bench bench/timer_bench.cpp
+//   ./timer_bench [vents=100000] [seconds=60]
+//
+// Part 1 times schedule (re-arming an armed timer, the common case), cancel and
+// schedule-after-cancel with 1k to 1M timers armed, so O(1) shows as a flat column. The
+// std::multimap alternative keeps an iterator per timer and is O(log n).
+//
+// Part 2 replays `seconds` of hub time at 10 ms ticks for `vents` vents the way the control
+// thread uses them: every vent reports once a second and pushes its 15 s silence timeout
+// back, 1% of vents never report and fall into backoff re-checks, and every reading also
+// re-arms a 30 s heartbeat. The polling model is the phone app's: scan every vent's
+// last-seen time each 100 ms. Reported as CPU per second of hub time.
+
+#include <deque>
+#include <map>
+#include "bench_common.h"
+#include "timer_wheel.h"
+
+#define TICK_MS 10
+#define SILENT_TICKS (15000 / TICK_MS)
+#define HEARTBEAT_TICKS (30000 / TICK_MS)
+#define POLL_TICKS (100 / TICK_MS)
+
+static uint64_t rng_state = 88172645463325252ull;
+
+static inline uint64_t next_random() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+class CountingTimer : public WheelTimer{
+    public:
+        uint64_t *fired;
+        CountingTimer() : fired(NULL) {}
+        void on_timer() { (*fired)++; }
+};
+
+// ---- part 1: per-operation cost ----
+
+typedef std::multimap<uint64_t, uint32_t> TimerMap;
+
+static void per_op(size_t timers, size_t ops) {
+    uint64_t fired = 0;
+    std::vector<CountingTimer> wheel_timers(timers);
+    TimerWheel wheel;
+    for (size_t i = 0; i < timers; i++) {
+        wheel_timers[i].fired = &fired;
+        wheel.schedule(wheel_timers[i], 1 + next_random() % 100000);
+    }
+    std::vector<uint32_t> order(ops);
+    std::vector<uint64_t> delays(ops);
+    for (size_t i = 0; i < ops; i++) {
+        order[i] = (uint32_t)(next_random() % timers);
+        delays[i] = 1 + next_random() % 100000;
+    }
+
+    uint64_t start = process_cpu_ns();
+    for (size_t i = 0; i < ops; i++) {
+        wheel.schedule(wheel_timers[order[i]], delays[i]);
+    }
+    double wheel_rearm = (double)(process_cpu_ns() - start) / ops;
+    start = process_cpu_ns();
+    for (size_t i = 0; i < ops; i++) {
+        wheel.cancel(wheel_timers[order[i]]);
+        wheel.schedule(wheel_timers[order[i]], delays[i]);
+    }
+    double wheel_cycle = (double)(process_cpu_ns() - start) / ops;
+
+    TimerMap map;
+    std::vector<TimerMap::iterator> where(timers);
+    for (size_t i = 0; i < timers; i++) {
+        where[i] = map.insert(std::make_pair(1 + next_random() % 100000, (uint32_t)i));
+    }
+    start = process_cpu_ns();
+    for (size_t i = 0; i < ops; i++) {
+        uint32_t t = order[i];
+        map.erase(where[t]);
+        where[t] = map.insert(std::make_pair(delays[i], t));
+    }
+    double map_rearm = (double)(process_cpu_ns() - start) / ops;
+
+    printf("timers=%-8zu wheel re-arm=%5.1f ns  wheel cancel+schedule=%5.1f ns  multimap re-arm=%6.1f ns\n",
+           timers, wheel_rearm, wheel_cycle, map_rearm);
+}
+
+// ---- part 2: a simulated hub ----
+
+struct SimVent{
+    CountingTimer silence;
+    CountingTimer heartbeat;
+};
+
+// What the silence timer does when it fires: back off and look again later
+class RecheckTimer : public WheelTimer{
+    public:
+        TimerWheel *wheel;
+        Backoff backoff;
+        uint64_t *fired;
+        RecheckTimer(uint64_t seed) : wheel(NULL), backoff(5000, 300000, seed), fired(NULL) {}
+        void on_timer() {
+            (*fired)++;
+            wheel->schedule(*this, backoff.next_ms() / TICK_MS);
+        }
+};
+
+static void simulate_wheel(size_t vents, uint64_t seconds) {
+    uint64_t fired = 0;
+    TimerWheel wheel;
+    std::vector<SimVent> live(vents - vents / 100);
+    std::deque<RecheckTimer> dead;
+    for (size_t i = 0; i < live.size(); i++) {
+        live[i].silence.fired = live[i].heartbeat.fired = &fired;
+        wheel.schedule(live[i].silence, SILENT_TICKS);
+        wheel.schedule(live[i].heartbeat, HEARTBEAT_TICKS);
+    }
+    for (size_t i = 0; i < vents / 100; i++) {
+        dead.emplace_back(i + 1);
+        dead.back().wheel = &wheel;
+        dead.back().fired = &fired;
+        wheel.schedule(dead.back(), SILENT_TICKS);
+    }
+
+    // Each live vent reports once per second, so 1/100 of them per 10 ms tick
+    uint64_t ticks = seconds * 1000 / TICK_MS;
+    size_t per_tick = live.size() / (1000 / TICK_MS);
+    size_t next_vent = 0;
+    uint64_t start = process_cpu_ns();
+    for (uint64_t t = 1; t <= ticks; t++) {
+        for (size_t r = 0; r < per_tick; r++) {
+            SimVent &vent = live[next_vent];
+            next_vent = next_vent + 1 == live.size() ? 0 : next_vent + 1;
+            wheel.schedule(vent.silence, SILENT_TICKS);
+            wheel.schedule(vent.heartbeat, HEARTBEAT_TICKS);
+        }
+        wheel.advance(t);
+    }
+    uint64_t cpu = process_cpu_ns() - start;
+    double ops = (double)ticks * per_tick * 2;
+    printf("wheel     vents=%-8zu %8.2f ms CPU per hub second  %5.1f ns per re-arm  %llu timers fired\n",
+           vents, cpu / 1e6 / seconds, cpu / ops, (unsigned long long)fired);
+}
+
+static void simulate_map(size_t vents, uint64_t seconds) {
+    // Same workload on a multimap: erase + insert per re-arm, pop from the front when due
+    TimerMap map;
+    size_t live = vents - vents / 100;
+    std::vector<TimerMap::iterator> silence(live), heartbeat(live);
+    for (size_t i = 0; i < live; i++) {
+        silence[i] = map.insert(std::make_pair((uint64_t)SILENT_TICKS, (uint32_t)i));
+        heartbeat[i] = map.insert(std::make_pair((uint64_t)HEARTBEAT_TICKS, (uint32_t)i));
+    }
+    std::vector<Backoff> backoff;
+    for (size_t i = 0; i < vents / 100; i++) {
+        backoff.push_back(Backoff(5000, 300000, i + 1));
+        map.insert(std::make_pair((uint64_t)SILENT_TICKS, (uint32_t)(live + i)));
+    }
+    uint64_t ticks = seconds * 1000 / TICK_MS;
+    size_t per_tick = live / (1000 / TICK_MS);
+    size_t next_vent = 0;
+    uint64_t fired = 0;
+    uint64_t start = process_cpu_ns();
+    for (uint64_t t = 1; t <= ticks; t++) {
+        for (size_t r = 0; r < per_tick; r++) {
+            map.erase(silence[next_vent]);
+            silence[next_vent] = map.insert(std::make_pair(t + SILENT_TICKS, (uint32_t)next_vent));
+            map.erase(heartbeat[next_vent]);
+            heartbeat[next_vent] = map.insert(std::make_pair(t + HEARTBEAT_TICKS, (uint32_t)next_vent));
+            next_vent = next_vent + 1 == live ? 0 : next_vent + 1;
+        }
+        while (!map.empty() && map.begin()->first <= t) {
+            uint32_t id = map.begin()->second;
+            map.erase(map.begin());
+            fired++;
+            if (id >= live) {
+                map.insert(std::make_pair(t + backoff[id - live].next_ms() / TICK_MS, id));
+            }
+        }
+    }
+    uint64_t cpu = process_cpu_ns() - start;
+    double ops = (double)ticks * per_tick * 2;
+    printf("multimap  vents=%-8zu %8.2f ms CPU per hub second  %5.1f ns per re-arm  %llu timers fired\n",
+           vents, cpu / 1e6 / seconds, cpu / ops, (unsigned long long)fired);
+}
+
+static void simulate_polling(size_t vents, uint64_t seconds) {
+    // Readings only stamp a time; a scan every 100 ms looks at every vent
+    std::vector<uint64_t> last_seen(vents, 0);
+    std::vector<uint64_t> last_command(vents, 0);
+    size_t live = vents - vents / 100;
+    uint64_t ticks = seconds * 1000 / TICK_MS;
+    size_t per_tick = live / (1000 / TICK_MS);
+    size_t next_vent = 0;
+    uint64_t due = 0;
+    uint64_t start = process_cpu_ns();
+    for (uint64_t t = 1; t <= ticks; t++) {
+        for (size_t r = 0; r < per_tick; r++) {
+            last_seen[next_vent] = t;
+            next_vent = next_vent + 1 == live ? 0 : next_vent + 1;
+        }
+        if (t % POLL_TICKS == 0) {
+            for (size_t v = 0; v < vents; v++) {
+                if (t - last_seen[v] >= SILENT_TICKS || t - last_command[v] >= HEARTBEAT_TICKS) {
+                    due++;
+                    last_command[v] = t;
+                }
+            }
+        }
+    }
+    uint64_t cpu = process_cpu_ns() - start;
+    printf("polling   vents=%-8zu %8.2f ms CPU per hub second  (%llu due found)\n", vents, cpu / 1e6 / seconds,
+           (unsigned long long)due);
+}
+
+int main(int argc, char **argv) {
+    size_t vents = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    uint64_t seconds = argc > 2 ? strtoull(argv[2], NULL, 10) : 60;
+
+    for (size_t timers = 1000; timers <= 1000000; timers *= 10) {
+        per_op(timers, 2000000);
+    }
+    printf("\n%llu s of hub time, 10 ms ticks, readings at 1 Hz per vent:\n", (unsigned long long)seconds);
+    simulate_wheel(vents, seconds);
+    simulate_map(vents, seconds);
+    simulate_polling(vents, seconds);
+    return 0;
+}
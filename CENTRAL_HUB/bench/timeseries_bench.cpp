@@ -0,0 +1,137 @@
+// TimeSeriesStore footprint and scan speed.
+//
+//   g++ -O2 -I. -o timeseries_bench bench/timeseries_bench.cpp
+//   ./timeseries_bench [vents=300] [days=7]
+//
+// Every vent reports once a second (with the odd late or missing report) a temperature
+// drifting through the day, and its cover moves a few times an hour. "steady" has no
+// sensor noise beyond the 0.1 degree quantisation; "noisy" adds 0.05 degree of it, so the
+// reading flickers between neighbouring steps. Prints bytes per sample, the footprint
+// extrapolated to 90 days, append cost, and scan throughput for a full-history scan and for
+// one-hour windows. Also checks that samples scan back within the deadband, that NaN is
+// refused, and that a wall clock stepped back cuts the history rather than the new samples.
+
+#include <random>
+#include "bench_common.h"
+#include "timeseries.h"
+
+struct Profile{
+    const char *name;
+    float noise;     // sensor noise, degrees (1 sigma)
+};
+
+// Readings as the hub would see them: a daily swing per room plus sensor noise, the odd
+// late or missing report, and a cover move now and then
+static void fill(TimeSeriesStore &store, uint32_t vents, int64_t epoch, int64_t seconds, float sigma) {
+    std::mt19937 gen(3);
+    std::normal_distribution<float> noise(0.0f, sigma > 0.0f ? sigma : 1e-9f);
+    std::uniform_int_distribution<int> jitter(0, 999);
+    std::vector<int> cover(vents, 0);
+    for (int64_t s = 0; s < seconds; s++) {
+        float daily = 1.5f * sinf((float)s * 2.0f * 3.14159265f / 86400.0f);
+        for (uint32_t v = 0; v < vents; v++) {
+            int roll = jitter(gen);
+            if (roll == 0) {
+                continue;                                  // dropped report
+            }
+            int64_t ts = epoch + s + (roll == 1 ? 1 : 0);  // late report
+            float t = 21.0f + (v % 5) * 0.5f + daily + noise(gen);
+            if (roll == 2 && (s % 60) == 0) {
+                cover[v] = (cover[v] + 3) % 11;
+            }
+            store.append(v, ts, t, cover[v]);
+        }
+    }
+}
+
+static void run_profile(const Profile &profile, uint32_t vents, int64_t days, std::mt19937 &gen) {
+    int64_t seconds = days * 86400;
+    int64_t epoch = 1700000000;
+    TimeSeriesStore store;
+    uint64_t start = now_ns();
+    fill(store, vents, epoch, seconds, profile.noise);
+    double append_ns = (double)(now_ns() - start) / store.sample_count();
+
+    double bytes_per_sample = (double)store.bytes_used() / store.sample_count();
+    printf("%-6s vents=%u days=%lld samples=%llu  used=%.1f MB  %.3f bytes/sample (raw 16)  append=%.1f ns/sample\n",
+           profile.name, vents, (long long)days, (unsigned long long)store.sample_count(),
+           store.bytes_used() / 1e6, bytes_per_sample, append_ns);
+    printf("       extrapolated to 90 days: %.0f MB, capped at %.0f MB; %llu chunks evicted\n",
+           bytes_per_sample * vents * 86400.0 * 90 / 1e6, (double)vents * TSDB_VENT_MAX_BYTES / 1e6,
+           (unsigned long long)store.chunks_evicted());
+
+    // Full-history scan of every vent
+    double sum = 0.0;
+    start = now_ns();
+    size_t visited = 0;
+    for (uint32_t v = 0; v < vents; v++) {
+        visited += store.scan(v, epoch, epoch + seconds + 2, [&sum](const TimeSample &sample) {
+            sum += sample.temperature;
+        });
+    }
+    double full_s = (now_ns() - start) / 1e9;
+    printf("       full scan: %zu samples in %.2f s = %.1f M samples/s (mean %.2f C)\n", visited, full_s,
+           visited / full_s / 1e6, sum / visited);
+
+    // One-hour windows at random offsets
+    std::uniform_int_distribution<int64_t> offset(0, seconds - 3600);
+    size_t queries = 10000;
+    visited = 0;
+    start = now_ns();
+    for (size_t q = 0; q < queries; q++) {
+        int64_t from = epoch + offset(gen);
+        visited += store.scan((uint32_t)(q % vents), from, from + 3600, [&sum](const TimeSample &sample) {
+            sum += sample.temperature;
+        });
+    }
+    double window_us = (now_ns() - start) / 1e3 / queries;
+    printf("       1 h window: %.1f us/query, %.0f samples/query\n", window_us, (double)visited / queries);
+}
+
+int main(int argc, char **argv) {
+    uint32_t vents = argc > 1 ? (uint32_t)atoi(argv[1]) : 300;
+    int64_t days = argc > 2 ? atoi(argv[2]) : 7;
+    std::mt19937 gen(5);
+
+    Profile profiles[] = {{"steady", 0.0f}, {"noisy", 0.05f}};
+    for (size_t p = 0; p < sizeof(profiles) / sizeof(profiles[0]); p++) {
+        run_profile(profiles[p], vents, days, gen);
+    }
+
+    // Round trip check on a fresh store
+    std::normal_distribution<float> noise(0.0f, 0.05f);
+    TimeSeriesStore check;
+    std::vector<TimeSample> written;
+    for (int64_t s = 0; s < 20000; s++) {
+        TimeSample sample;
+        sample.timestamp = 1700000000 + s * 2 + (s % 7 == 0 ? 1 : 0);
+        sample.temperature = 15.0f + 10.0f * sinf((float)s / 300.0f) + noise(gen) * (s % 500 == 0 ? 100 : 1);
+        sample.cover = (int)(s / 1000) % 11;
+        check.append(0, sample.timestamp, sample.temperature, sample.cover);
+        written.push_back(sample);
+    }
+    size_t i = 0;
+    bool ok = true;
+    check.scan(0, 0, INT64_MAX, [&](const TimeSample &sample) {
+        const TimeSample &w = written[i++];
+        if (sample.timestamp != w.timestamp || sample.cover != w.cover ||
+            fabsf(sample.temperature - w.temperature) > TSDB_TEMP_RESOLUTION * TSDB_TEMP_DEADBAND + 1e-4f) {
+            ok = false;
+        }
+    });
+    ok = ok && i == written.size();
+    printf("round trip: %s\n", ok ? "ok" : "MISMATCH");
+
+    // NaN is refused; a second back is absorbed; an hour back drops the hour ahead of it
+    bool clock_ok = !check.append(0, 1700050000, NAN, 0) && check.append(0, 1700039999, 20.0f, 0);
+    int64_t rewound = written.back().timestamp - 3600;
+    clock_ok = clock_ok && check.append(0, rewound, 20.0f, 0) && check.append(0, rewound + 1, 20.0f, 0);
+    int64_t last = 0;
+    size_t kept = check.scan(0, 0, INT64_MAX, [&](const TimeSample &sample) {
+        clock_ok = clock_ok && sample.timestamp >= last;
+        last = sample.timestamp;
+    });
+    clock_ok = clock_ok && last == rewound + 1 && kept < written.size() && check.clock_rewinds() == 1;
+    printf("clock step back: %s (%zu samples kept)\n", clock_ok ? "ok" : "MISMATCH", kept);
+    return ok && clock_ok ? 0 : 1;
+}
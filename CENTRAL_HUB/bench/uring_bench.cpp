@@ -0,0 +1,38 @@
+// epoll backend versus the io_uring backend, same handler and same driver.
+//
+//   g++ -O2 -pthread -I. -o uring_bench bench/uring_bench.cpp
+//   ./uring_bench [connections=1000] [rounds=50]
+//
+// Prints packets/sec and server CPU per packet for each backend. When the kernel refuses
+// io_uring the second line reports the epoll fallback instead.
+
+#include "bench_common.h"
+#include "io_uring_backend.h"
+
+static void run_backend(int server_fd, bool want_uring) {
+    EchoHandler handler;
+    IoBackend *backend = create_backend(handler, want_uring);
+    handler.backend = backend;
+    fprintf(stderr, "server backend: %s\n", backend->name());
+    backend->listen(server_fd);
+    backend->run();
+}
+
+static void run_epoll_server(int server_fd) {
+    run_backend(server_fd, false);
+}
+
+static void run_uring_server(int server_fd) {
+    run_backend(server_fd, true);
+}
+
+int main(int argc, char **argv) {
+    size_t connections = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000;
+    size_t rounds = argc > 2 ? strtoul(argv[2], NULL, 10) : 50;
+    raise_fd_limit();
+    signal(SIGPIPE, SIG_IGN);
+
+    run_server_model("epoll", run_epoll_server, connections, rounds);
+    run_server_model("io_uring", run_uring_server, connections, rounds);
+    return 0;
+}
@@ -0,0 +1,309 @@
+// Zone aggregates: incremental ZoneTree against recomputing from every vent.
+//
+//   g++ -O2 -pthread -I. -o zone_bench bench/zone_bench.cpp
+//   ./zone_bench [vents=50000] [rooms=5000] [floors=50] [seconds=60]
+//
+// The house is split evenly into floors, floors into rooms and rooms into vents. Readings
+// are a random walk on a random vent, with a cover change for one reading in five, and the
+// control tick is 100 ms.
+//
+// Part 1 is the cost of one reading folded into its room, floor and house, with every vent
+// reporting once a second.
+//
+// Part 2 replays `seconds` of ticks with vents reporting every 1, 10 and 60 s. After each
+// tick, every zone is read: every room, floor and the house. "incremental" folds each
+// reading as it arrives and repairs stale extremes on read. "recompute" rebuilds every zone
+// from the vent columns each tick, which is what the phone app would do with the per-vent
+// list; it wins only when most vents report within a tick and every zone is read.
+//
+// Part 3 times zone setpoints at each level, which touch every vent below the zone.
+//
+// Finally, every zone's incremental read is checked against the recomputed one.
+
+#include "bench_common.h"
+#include "zones.h"
+
+#define TICKS_PER_SECOND 10
+
+static uint64_t rng_state = 88172645463325252ull;
+
+static inline uint64_t next_random() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static inline float uniform(float lo, float hi) {
+    return lo + (hi - lo) * (float)(next_random() >> 40) / (float)(1 << 24);
+}
+
+struct Layout{
+    size_t vents, rooms, floors;
+    std::vector<uint32_t> room_zone;    // by room
+    std::vector<uint32_t> floor_zone;   // by floor
+    std::vector<uint32_t> all_zones;    // every zone, for reads
+
+    uint32_t room_of(size_t vent) const { return (uint32_t)(vent * rooms / vents); }
+    uint32_t floor_of(size_t room) const { return (uint32_t)(room * floors / rooms); }
+};
+
+// Current state of every vent, as the control thread would hold it
+struct Columns{
+    std::vector<float> temperature;
+    std::vector<float> desired;
+    std::vector<float> open;
+};
+
+struct Totals{
+    uint32_t vents, reporting;
+    double temperature, error, abs_error, area, open_area;
+    float minimum, maximum;
+
+    Totals() : vents(0), reporting(0), temperature(0), error(0), abs_error(0), area(0), open_area(0),
+               minimum(INFINITY), maximum(-INFINITY) {}
+
+    void add_vent(float t, float d, float o) {
+        vents++;
+        reporting++;
+        temperature += t;
+        error += t - d;
+        abs_error += fabs(t - d);
+        area += ZONE_DEFAULT_AREA;
+        open_area += o * ZONE_DEFAULT_AREA;
+        minimum = t < minimum ? t : minimum;
+        maximum = t > maximum ? t : maximum;
+    }
+
+    void add(const Totals &o) {
+        vents += o.vents;
+        reporting += o.reporting;
+        temperature += o.temperature;
+        error += o.error;
+        abs_error += o.abs_error;
+        area += o.area;
+        open_area += o.open_area;
+        minimum = o.minimum < minimum ? o.minimum : minimum;
+        maximum = o.maximum > maximum ? o.maximum : maximum;
+    }
+};
+
+// Every zone from scratch: rooms from vents, floors from rooms, the house from floors
+static void recompute(const Layout &layout, const Columns &c, std::vector<Totals> &rooms,
+                      std::vector<Totals> &floors, Totals &house) {
+    rooms.assign(layout.rooms, Totals());
+    floors.assign(layout.floors, Totals());
+    house = Totals();
+    for (size_t v = 0; v < layout.vents; v++) {
+        rooms[layout.room_of(v)].add_vent(c.temperature[v], c.desired[v], c.open[v]);
+    }
+    for (size_t r = 0; r < layout.rooms; r++) {
+        floors[layout.floor_of(r)].add(rooms[r]);
+    }
+    for (size_t f = 0; f < layout.floors; f++) {
+        house.add(floors[f]);
+    }
+}
+
+static Layout build(ZoneTree &tree, Columns &c, size_t vents, size_t rooms, size_t floors) {
+    Layout layout;
+    layout.vents = vents;
+    layout.rooms = rooms;
+    layout.floors = floors;
+    layout.all_zones.push_back(ZONE_HOUSE);
+    for (size_t f = 0; f < floors; f++) {
+        char name[32];
+        snprintf(name, sizeof(name), "floor%zu", f);
+        layout.floor_zone.push_back(tree.add_zone(name, ZONE_HOUSE));
+        layout.all_zones.push_back(layout.floor_zone.back());
+    }
+    for (size_t r = 0; r < rooms; r++) {
+        char name[32];
+        snprintf(name, sizeof(name), "room%zu", r);
+        layout.room_zone.push_back(tree.add_zone(name, layout.floor_zone[layout.floor_of(r)]));
+        layout.all_zones.push_back(layout.room_zone.back());
+    }
+    c.temperature.resize(vents);
+    c.desired.resize(vents);
+    c.open.resize(vents);
+    for (size_t v = 0; v < vents; v++) {
+        tree.assign((uint32_t)v, layout.room_zone[layout.room_of(v)]);
+        c.temperature[v] = uniform(18.0f, 28.0f);
+        c.desired[v] = 23.0f;
+        c.open[v] = (float)(next_random() % 11) / 10.0f;
+        tree.set_desired((uint32_t)v, c.desired[v]);
+        tree.set_open((uint32_t)v, c.open[v]);
+        tree.set_temperature((uint32_t)v, c.temperature[v]);
+    }
+    return layout;
+}
+
+// One tick's readings: a random walk per vent, a cover change for one in five
+struct Reading{
+    uint32_t vent;
+    float temperature;
+    float open;     // negative when the cover did not move
+};
+
+static void next_tick(const Layout &layout, Columns &c, std::vector<Reading> &tick, size_t readings) {
+    tick.resize(readings);
+    for (size_t i = 0; i < tick.size(); i++) {
+        uint32_t v = (uint32_t)(next_random() % layout.vents);
+        float t = c.temperature[v] + uniform(-0.2f, 0.2f);
+        t = t < 10.0f ? 10.0f : (t > 35.0f ? 35.0f : t);
+        tick[i].vent = v;
+        tick[i].temperature = c.temperature[v] = t;
+        tick[i].open = next_random() % 5 == 0 ? (float)(next_random() % 11) / 10.0f : -1.0f;
+        if (tick[i].open >= 0.0f) {
+            c.open[v] = tick[i].open;
+        }
+    }
+}
+
+static double sink = 0;
+
+int main(int argc, char **argv) {
+    size_t vents = argc > 1 ? strtoul(argv[1], NULL, 10) : 50000;
+    size_t rooms = argc > 2 ? strtoul(argv[2], NULL, 10) : 5000;
+    size_t floors = argc > 3 ? strtoul(argv[3], NULL, 10) : 50;
+    size_t seconds = argc > 4 ? strtoul(argv[4], NULL, 10) : 60;
+
+    ZoneTree tree;
+    Columns columns;
+    uint64_t start = now_ns();
+    Layout layout = build(tree, columns, vents, rooms, floors);
+    printf("%zu vents, %zu rooms, %zu floors, %zu zones: built in %.1f ms\n", vents, rooms, floors,
+           tree.size(), (now_ns() - start) / 1e6);
+
+    // ---- part 1: one reading ----
+    std::vector<Reading> tick;
+    size_t samples = 0;
+    uint64_t elapsed = 0;
+    for (int round = 0; round < 20; round++) {
+        next_tick(layout, columns, tick, vents / TICKS_PER_SECOND);
+        start = now_ns();
+        for (size_t i = 0; i < tick.size(); i++) {
+            tree.set_temperature(tick[i].vent, tick[i].temperature);
+        }
+        elapsed += now_ns() - start;
+        samples += tick.size();
+        for (size_t i = 0; i < tick.size(); i++) {
+            if (tick[i].open >= 0.0f) {
+                tree.set_open(tick[i].vent, tick[i].open);
+            }
+        }
+    }
+    printf("one reading into room, floor and house: %.1f ns (%.1f M readings/s)\n",
+           (double)elapsed / samples, samples / (elapsed / 1e3));
+
+    // ---- part 2: ticks with every zone read ----
+    size_t ticks = seconds * TICKS_PER_SECOND;
+    std::vector<Totals> room_totals, floor_totals;
+    Totals house;
+    // Vents reporting every 1, 10 and 60 s
+    size_t periods[] = {1, 10, 60};
+    double recompute_us = 0;
+    printf("\n%zu ticks, all %zu zones read after each:\n", ticks, layout.all_zones.size());
+    for (size_t p = 0; p < sizeof(periods) / sizeof(periods[0]); p++) {
+        size_t readings = vents / (TICKS_PER_SECOND * periods[p]);
+        uint64_t fold_ns = 0, read_ns = 0, recompute_ns = 0;
+        for (size_t t = 0; t < ticks; t++) {
+            next_tick(layout, columns, tick, readings);
+
+            start = now_ns();
+            for (size_t i = 0; i < tick.size(); i++) {
+                tree.set_temperature(tick[i].vent, tick[i].temperature);
+                if (tick[i].open >= 0.0f) {
+                    tree.set_open(tick[i].vent, tick[i].open);
+                }
+            }
+            uint64_t folded = now_ns();
+            for (size_t z = 0; z < layout.all_zones.size(); z++) {
+                ZoneStats stats = tree.read(layout.all_zones[z]);
+                sink += stats.average + stats.minimum + stats.maximum + stats.open_fraction;
+            }
+            uint64_t read = now_ns();
+            fold_ns += folded - start;
+            read_ns += read - folded;
+
+            start = now_ns();
+            recompute(layout, columns, room_totals, floor_totals, house);
+            for (size_t r = 0; r < rooms; r++) {
+                sink += room_totals[r].temperature / room_totals[r].reporting + room_totals[r].minimum +
+                        room_totals[r].maximum + room_totals[r].open_area / room_totals[r].area;
+            }
+            recompute_ns += now_ns() - start;
+        }
+        recompute_us += recompute_ns / 1e3 / ticks / (sizeof(periods) / sizeof(periods[0]));
+        printf("  every %2zu s, %5zu readings/tick: incremental %7.1f us/tick (fold %6.1f, read %6.1f) | "
+               "recompute %7.1f us/tick  x%.1f\n", periods[p], readings, (fold_ns + read_ns) / 1e3 / ticks,
+               fold_ns / 1e3 / ticks, read_ns / 1e3 / ticks, recompute_ns / 1e3 / ticks,
+               (double)recompute_ns / (fold_ns + read_ns));
+    }
+
+    // Current after every reading, as the phone's overview screen sees it: one fold against
+    // rebuilding the lot
+    printf("  every zone current after each reading: incremental %.0f ns/reading | recompute %.0f us/reading\n",
+           (double)elapsed / samples, recompute_us);
+
+    // ---- part 3: zone setpoints ----
+    std::vector<uint32_t> changed;
+    struct { const char *level; uint32_t zone; } targets[] = {
+        {"room", layout.room_zone[rooms / 2]},
+        {"floor", layout.floor_zone[floors / 2]},
+        {"house", ZONE_HOUSE},
+    };
+    printf("\nzone setpoint:\n");
+    for (size_t i = 0; i < 3; i++) {
+        int repeats = i == 0 ? 10000 : (i == 1 ? 1000 : 20);
+        start = now_ns();
+        for (int r = 0; r < repeats; r++) {
+            changed.clear();
+            tree.set_setpoint(targets[i].zone, 21.0f + (r & 3), changed);
+        }
+        double us = (now_ns() - start) / 1e3 / repeats;
+        printf("  %-6s %6zu vents  %9.2f us  (%.1f ns/vent)\n", targets[i].level, changed.size(), us,
+               us * 1e3 / changed.size());
+    }
+    changed.clear();
+    tree.set_setpoint(ZONE_HOUSE, 22.0f, changed);
+    for (size_t v = 0; v < vents; v++) {
+        columns.desired[v] = 22.0f;
+    }
+    changed.clear();
+    tree.set_setpoint(layout.room_zone[0], 24.0f, changed);
+    for (size_t i = 0; i < changed.size(); i++) {
+        columns.desired[changed[i]] = 24.0f;
+    }
+
+    // ---- check ----
+    recompute(layout, columns, room_totals, floor_totals, house);
+    size_t wrong = 0;
+    double worst = 0;
+    auto compare = [&](uint32_t zone, const Totals &expect) {
+        ZoneStats got = tree.read(zone);
+        double diffs[] = {
+            fabs(got.average - expect.temperature / expect.reporting),
+            fabs(got.error - expect.error / expect.reporting),
+            fabs(got.abs_error - expect.abs_error / expect.reporting),
+            fabs(got.open_fraction - expect.open_area / expect.area),
+        };
+        bool bad = got.vents != expect.vents || got.reporting != expect.reporting ||
+                   got.minimum != expect.minimum || got.maximum != expect.maximum;
+        for (size_t i = 0; i < 4; i++) {
+            worst = diffs[i] > worst ? diffs[i] : worst;
+            bad |= diffs[i] > 1e-3;
+        }
+        wrong += bad;
+    };
+    for (size_t r = 0; r < rooms; r++) {
+        compare(layout.room_zone[r], room_totals[r]);
+    }
+    for (size_t f = 0; f < floors; f++) {
+        compare(layout.floor_zone[f], floor_totals[f]);
+    }
+    compare(ZONE_HOUSE, house);
+    printf("\ncheck: %zu of %zu zones differ from a recompute, largest difference %.2g (sink %g)\n", wrong,
+           layout.all_zones.size(), worst, sink);
+    return wrong == 0 ? 0 : 1;
+}
@@ -1,69 +1,571 @@
-#include <iostream>
+// Open-loop load generator for the hub: thousands of vent connections, readings at a fixed
+// aggregate rate whatever the hub does, and the latency from each reading to the command
+// it causes.
+//
+//   g++ -O2 -o client client.cpp
+//   ./hub --no-log --no-snapshot --command-gap=0 &
+//   ./client [--connections=1000] [--rate=5000] [--duration=30] [--warmup=5] [--drain=2]
+//            [--setpoint=23] [--hysteresis] [--host=127.0.0.1] [--source=127.2.0.0/16] [--seed=N]
+//
+// Reading i is due at start + i / rate on connection i % connections, so each connection
+// sends every connections / rate seconds. A reading is sent when it is due, or as soon as
+// the loop gets to it if it is late, and never waits for a reply: a slow hub cannot slow
+// the offered load down.
+//
+// Latency is measured from when the reading was due, not from when it went out. Measuring
+// from the send would hide exactly the stalls that matter: while the loop (or the socket)
+// is held up, the readings it should have sent are not being timed at all, so the
+// percentiles come out as if the stall never happened (coordinated omission). Both are
+// reported; the gap between them is how much the generator itself fell behind. Readings
+// still unanswered after the drain count at the time waited so far, a lower bound. A reading
+// the socket cannot take at once waits in the connection's output buffer for EPOLLOUT, and
+// one for a connection the hub has closed is never sent; both are still timed from due.
+//
+// The hub only answers a reading that changes a vent's cover, so readings alternate between
+// setpoint - 5 C and setpoint + 5 C (plus up to 0.5 C of jitter). Under PID, bang-bang or
+// scheduled PID the cold reading opens the vent (motor_pos above 5) and the hot one closes it;
+// --hysteresis expects the reverse. Each command is matched to the oldest unanswered reading
+// on its connection that asked for that position; older readings asking for the other one
+// were superseded, either evaluated in the same control tick (latest wins) or replaced in
+// the hub's per-vent command mailbox. Two readings sent less than a hub tick apart can also
+// cancel out without any command (the second puts the cover back where it was), so such a
+// pair is skipped when a later reading could have been the one answered. Keep each
+// connection's interval above the hub's 100 ms tick and its --command-gap (500 ms by
+// default), or most readings will be superseded and the rest will carry the pacing delay.
+//
+// Every connection binds its own source address from --source (source_range.h), so the hub
+// registers each as a separate vent and a rerun finds the same ones. Against a hub on
+// loopback that defaults to 127.2.0.0/16. Against a remote hub give a range of addresses
+// this machine owns; without one every connection shares the machine's address, which only
+// a hub run without --one-vent-per-address tells apart, and the run says so.
+
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
 #include <stdio.h>
-#include <sys/socket.h>
-#include <arpa/inet.h>
-#include <unistd.h>
+#include <stdlib.h>
 #include <string.h>
-#include <random>
-
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "framing.h"
+#include "source_range.h"
 
 #define PORT 8080
+#define READING_PACKET 1
+#define CONTROL_PACKET 2
+#define COVER_OPEN 10
+#define LOAD_SOURCE_DEFAULT "127.2.0.0/16"
+#define LOAD_SWING 5.0f                 // C either side of the setpoint
+#define LOAD_EVENTS 256
+#define LOAD_SEND_BATCH 1024            // due readings sent between socket polls
+#define HUB_TICK_NS 100000000ull        // CONTROL_TICK_MS in main.cpp
+#define HISTOGRAM_SUB_BITS 5            // 32 sub-buckets per power of two: ~3% resolution
+#define HISTOGRAM_BANDS 40
+
 using namespace std;
 
-// Function to generate a random float between min and max (inclusive)
+// One generator for the whole run, seeded once
+static std::mt19937 rng;
+
+// Random float between min and max (inclusive)
 float randomFloat(float min, float max) {
-    std::random_device rd;
-    std::mt19937 gen(rd());
     std::uniform_real_distribution<float> dis(min, max);
-    return dis(gen);
+    return dis(rng);
 }
 
 class Packet{
     public:
         int pkt_type;
         float temperature;
-        // unsigned int motor_pos;
+        int motor_pos;
+};
 
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Log-linear histogram of nanoseconds: each power of two split into 2^HISTOGRAM_SUB_BITS
+// buckets, so any percentile is within about 3% from a microsecond to minutes
+class Histogram{
+    public:
+        Histogram() : total(0), max_ns(0) { memset(counts, 0, sizeof(counts)); }
+
+        void record(uint64_t ns) {
+            counts[bucket(ns)]++;
+            total++;
+            max_ns = ns > max_ns ? ns : max_ns;
+        }
+
+        // Upper bound of the bucket holding the q-th quantile
+        uint64_t percentile(double q) const {
+            uint64_t rank = (uint64_t)(q * total);
+            uint64_t seen = 0;
+            for (size_t i = 0; i < BUCKETS; i++) {
+                seen += counts[i];
+                if (seen > rank) {
+                    uint64_t upper = upper_bound(i);
+                    return upper < max_ns ? upper : max_ns;
+                }
+            }
+            return max_ns;
+        }
+
+        uint64_t count() const { return total; }
+
+        void print(const char *label) const {
+            printf("%-16s n=%-9llu p50=%8.2f p90=%8.2f p99=%8.2f p99.9=%8.2f p99.99=%8.2f max=%8.2f ms\n",
+                   label, (unsigned long long)total, percentile(0.5) / 1e6, percentile(0.9) / 1e6,
+                   percentile(0.99) / 1e6, percentile(0.999) / 1e6, percentile(0.9999) / 1e6, max_ns / 1e6);
+        }
+
+    private:
+        static const size_t SUB = 1u << HISTOGRAM_SUB_BITS;
+        static const size_t BUCKETS = HISTOGRAM_BANDS * SUB;
+
+        static size_t bucket(uint64_t ns) {
+            if (ns < SUB) {
+                return (size_t)ns;
+            }
+            int band = 63 - __builtin_clzll(ns) - HISTOGRAM_SUB_BITS + 1;
+            size_t i = band * SUB + (size_t)((ns >> (band - 1)) - SUB);
+            return i < BUCKETS ? i : BUCKETS - 1;
+        }
+
+        static uint64_t upper_bound(size_t i) {
+            size_t band = i / SUB;
+            uint64_t sub = i % SUB;
+            if (band == 0) {
+                return sub;
+            }
+            return ((SUB + sub + 1) << (band - 1)) - 1;
+        }
+
+        uint64_t counts[BUCKETS];
+        uint64_t total;
+        uint64_t max_ns;
 };
 
-int main(int argc, char const *argv[]) {
-    int sock = 0, valread;
-    struct sockaddr_in serv_addr;
-    // char *hello = "Hello from client";
-    Packet data;
-    data.pkt_type = 1;
-    data.temperature = 22.0;
-    
-
-    char buffer[1024] = {0};
-    if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-        perror("Socket creation error");
-        return -1;
-    }
+struct Settings{
+    size_t connections;
+    double rate;
+    double duration;
+    double warmup;
+    double drain;
+    float setpoint;
+    bool hysteresis;
+    const char *host;
+    SourceRange source;     // count 0: connections share this machine's address
+    unsigned seed;
+};
+
+// A reading waiting for its command
+struct Outstanding{
+    uint64_t due_ns;
+    uint64_t sent_ns;
+    bool cold;
+    bool timed;         // due after the warm-up
+};
+
+struct Vent{
+    int fd;
+    FrameDecoder decoder;
+    std::deque<Outstanding> waiting;
+    std::string out;        // readings the socket has not taken yet
+    bool writing;           // waiting for EPOLLOUT
+    bool closed;
+    bool cold_next;
+};
+
+class LoadGenerator{
+    public:
+        explicit LoadGenerator(const Settings &settings)
+            : settings(settings), epoll_fd(epoll_create1(0)), sent(0), send_failures(0), replies(0),
+              superseded(0), unmatched(0), unanswered(0), worst_behind_ns(0), start_ns(0) {}
+
+        ~LoadGenerator() {
+            for (size_t i = 0; i < vents.size(); i++) {
+                close(vents[i].fd);
+            }
+            close(epoll_fd);
+        }
+
+        bool connect_all() {
+            struct sockaddr_in hub;
+            memset(&hub, 0, sizeof(hub));
+            hub.sin_family = AF_INET;
+            hub.sin_port = htons(PORT);
+            if (inet_pton(AF_INET, settings.host, &hub.sin_addr) != 1) {
+                fprintf(stderr, "Invalid address %s\n", settings.host);
+                return false;
+            }
+            vents.resize(settings.connections);
+            size_t pending = 0;
+            for (size_t i = 0; i < vents.size(); i++) {
+                int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+                if (fd < 0) {
+                    perror("Socket creation error");
+                    return false;
+                }
+                vents[i].fd = fd;
+                vents[i].writing = false;
+                vents[i].closed = false;
+                vents[i].cold_next = true;
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                struct sockaddr_in source;
+                memset(&source, 0, sizeof(source));
+                source.sin_family = AF_INET;
+                source.sin_addr.s_addr = htonl(source_address(settings.source, i));
+                if (settings.source.count > 0 && bind(fd, (struct sockaddr *)&source, sizeof(source)) < 0) {
+                    fprintf(stderr, "Cannot bind source %s: %s\n", inet_ntoa(source.sin_addr), strerror(errno));
+                    return false;
+                }
+                if (connect(fd, (struct sockaddr *)&hub, sizeof(hub)) < 0 && errno != EINPROGRESS) {
+                    perror("Connection Failed");
+                    return false;
+                }
+                epoll_event ev = {};
+                ev.events = EPOLLOUT | EPOLLONESHOT;
+                ev.data.u64 = i;
+                epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+                pending++;
+            }
+            epoll_event ready[LOAD_EVENTS];
+            while (pending > 0) {
+                int n = epoll_wait(epoll_fd, ready, LOAD_EVENTS, 5000);
+                if (n <= 0) {
+                    fprintf(stderr, "Connecting timed out with %zu pending\n", pending);
+                    return false;
+                }
+                for (int e = 0; e < n; e++) {
+                    int err = 0;
+                    socklen_t len = sizeof(err);
+                    getsockopt(vents[ready[e].data.u64].fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                    if (err != 0) {
+                        fprintf(stderr, "Connection Failed: %s\n", strerror(err));
+                        return false;
+                    }
+                }
+                pending -= n;
+            }
+            for (size_t i = 0; i < vents.size(); i++) {
+                epoll_event ev = {};
+                ev.events = EPOLLIN;
+                ev.data.u64 = i;
+                epoll_ctl(epoll_fd, EPOLL_CTL_MOD, vents[i].fd, &ev);
+            }
+            return true;
+        }
+
+        void run() {
+            const double interval_ns = 1e9 / settings.rate;
+            const uint64_t total = (uint64_t)(settings.duration * settings.rate);
+            const uint64_t warmup_ns = (uint64_t)(settings.warmup * 1e9);
+            start_ns = now_ns();
+            uint64_t next = 0;
+            while (next < total) {
+                uint64_t now = now_ns();
+                uint64_t due = start_ns + (uint64_t)(next * interval_ns);
+                if (due > now) {
+                    // epoll_wait() only takes milliseconds; a reading sent up to 1 ms late
+                    // still counts that lateness, since it is timed from due
+                    poll((int)((due - now) / 1000000));
+                    continue;
+                }
+                for (int batch = 0; batch < LOAD_SEND_BATCH && next < total; batch++) {
+                    due = start_ns + (uint64_t)(next * interval_ns);
+                    if (due > now) {
+                        break;
+                    }
+                    worst_behind_ns = std::max(worst_behind_ns, now - due);
+                    send_reading(next % vents.size(), due, due - start_ns >= warmup_ns);
+                    next++;
+                }
+                poll(0);
+            }
+            uint64_t end = now_ns();
+            send_end_ns = end;
+            uint64_t drain_until = end + (uint64_t)(settings.drain * 1e9);
+            while (now_ns() < drain_until) {
+                poll(10);
+            }
+            finish_ns = now_ns();
+            // Never answered: waited at least until now
+            for (size_t i = 0; i < vents.size(); i++) {
+                std::deque<Outstanding> &w = vents[i].waiting;
+                for (size_t k = 0; k < w.size(); k++) {
+                    if (cancelled(w, k)) {
+                        superseded += w[k].timed + w[k + 1].timed;
+                        k++;
+                    } else if (w[k].timed) {
+                        corrected.record(finish_ns - w[k].due_ns);
+                        unanswered++;
+                    }
+                }
+            }
+        }
+
+        void report() const {
+            double seconds = (send_end_ns - start_ns) / 1e9;
+            printf("%zu connections, offered %.0f readings/s for %.1f s (%.1f s warm-up), %.0f ms between "
+                   "readings per connection\n", vents.size(), settings.rate, settings.duration,
+                   settings.warmup, vents.size() / settings.rate * 1e3);
+            if (settings.source.count == 0 && vents.size() > 1) {
+                printf("WARNING: every connection came from one source address; meaningless against a hub "
+                       "with --one-vent-per-address\n");
+            }
+            printf("sent %llu (%.0f/s, %llu failed), commands %llu (%.0f/s); fell behind schedule by at most "
+                   "%.2f ms\n", (unsigned long long)sent, sent / seconds, (unsigned long long)send_failures,
+                   (unsigned long long)replies, replies / seconds, worst_behind_ns / 1e6);
+            printf("superseded %llu, unanswered %llu, commands matching no reading %llu\n",
+                   (unsigned long long)superseded, (unsigned long long)unanswered, (unsigned long long)unmatched);
+            corrected.print("from due");
+            uncorrected.print("from send");
+        }
+
+    private:
+        // Every reading is outstanding from its due time on, whether the socket takes it now,
+        // later, or never
+        void send_reading(size_t index, uint64_t due, bool timed) {
+            Vent &v = vents[index];
+            Packet data;
+            data.pkt_type = READING_PACKET;
+            float swing = LOAD_SWING + randomFloat(0.0f, 0.5f);
+            data.temperature = v.cold_next ? settings.setpoint - swing : settings.setpoint + swing;
+            data.motor_pos = 0;
+            char frame[FRAME_HEADER_SIZE + sizeof(data)];
+            size_t len = encode_frame(frame, &data, sizeof(data));
+            Outstanding o = {due, now_ns(), v.cold_next, timed};
+            v.waiting.push_back(o);
+            v.cold_next = !v.cold_next;
+            if (!v.closed) {
+                v.out.append(frame, len);
+            }
+            if (!v.closed && flush(index)) {
+                sent++;
+            } else {
+                send_failures++;
+            }
+        }
+
+        // Write out what the connection has queued. Whatever the socket will not take now
+        // waits for EPOLLOUT. Returns false if the connection is gone.
+        bool flush(size_t index) {
+            Vent &v = vents[index];
+            while (!v.out.empty()) {
+                ssize_t n = send(v.fd, v.out.data(), v.out.size(), MSG_NOSIGNAL);
+                if (n > 0) {
+                    v.out.erase(0, (size_t)n);
+                } else if (n < 0 && errno == EINTR) {
+                    continue;
+                } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    watch(index, true);
+                    return true;
+                } else {
+                    shut(index);
+                    return false;
+                }
+            }
+            watch(index, false);
+            return true;
+        }
 
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(PORT);
+        void watch(size_t index, bool writing) {
+            Vent &v = vents[index];
+            if (v.writing == writing) {
+                return;
+            }
+            v.writing = writing;
+            epoll_event ev = {};
+            ev.events = EPOLLIN | (writing ? EPOLLOUT : 0);
+            ev.data.u64 = index;
+            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, v.fd, &ev);
+        }
 
-    // Convert IPv4 and IPv6 addresses from text to binary form
-    if (inet_pton(AF_INET, "127.0.0.1", &serv_addr.sin_addr) <= 0) {
-        perror("Invalid address/ Address not supported");
-        return -1;
+        // Stop using a connection; its readings from now on count as failed sends
+        void shut(size_t index) {
+            Vent &v = vents[index];
+            v.closed = true;
+            v.out.clear();
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, v.fd, NULL);
+        }
+
+        void poll(int timeout_ms) {
+            epoll_event ready[LOAD_EVENTS];
+            int n = epoll_wait(epoll_fd, ready, LOAD_EVENTS, timeout_ms);
+            char buffer[4096];
+            for (int e = 0; e < n; e++) {
+                size_t index = (size_t)ready[e].data.u64;
+                Vent &v = vents[index];
+                if ((ready[e].events & EPOLLOUT) && !flush(index)) {
+                    fprintf(stderr, "Send failed on a connection: %s\n", strerror(errno));
+                    continue;
+                }
+                ssize_t got;
+                while ((got = recv(v.fd, buffer, sizeof(buffer), 0)) > 0) {
+                    uint64_t now = now_ns();
+                    v.decoder.feed(buffer, (size_t)got, [&](const char *payload, size_t len) {
+                        Packet command;
+                        if (len >= sizeof(command)) {
+                            memcpy(&command, payload, sizeof(command));
+                            if (command.pkt_type == CONTROL_PACKET) {
+                                answer(v, command.motor_pos, now);
+                            }
+                        }
+                    });
+                }
+                if (got == 0 && !v.closed) {
+                    fprintf(stderr, "Hub closed a connection\n");
+                    shut(index);
+                }
+            }
+        }
+
+        // Reading k and the next one were sent within a tick and may have met in it
+        static bool cancelled(const std::deque<Outstanding> &w, size_t k) {
+            return k + 1 < w.size() && w[k + 1].sent_ns - w[k].sent_ns < HUB_TICK_NS;
+        }
+
+        // The oldest reading that asked for this position, passing over pairs that may have
+        // cancelled out if a later reading asked for it too; any older one asked for the other
+        void answer(Vent &v, int motor_pos, uint64_t now) {
+            replies++;
+            bool opened = motor_pos * 2 > COVER_OPEN;
+            bool cold = settings.hysteresis ? !opened : opened;
+            size_t match = v.waiting.size();
+            for (size_t k = v.waiting.size(); k-- > 0;) {
+                if (v.waiting[k].cold != cold) {
+                    continue;
+                }
+                if (match < v.waiting.size() && cancelled(v.waiting, k)) {
+                    break;
+                }
+                match = k;
+            }
+            if (match == v.waiting.size()) {
+                unmatched++;
+                return;
+            }
+            for (size_t k = 0; k < match; k++) {
+                superseded += v.waiting.front().timed;
+                v.waiting.pop_front();
+            }
+            const Outstanding &o = v.waiting.front();
+            if (o.timed) {
+                corrected.record(now - o.due_ns);
+                uncorrected.record(now - o.sent_ns);
+            }
+            v.waiting.pop_front();
+        }
+
+        Settings settings;
+        int epoll_fd;
+        std::vector<Vent> vents;
+        Histogram corrected;
+        Histogram uncorrected;
+        uint64_t sent;
+        uint64_t send_failures;
+        uint64_t replies;
+        uint64_t superseded;
+        uint64_t unmatched;
+        uint64_t unanswered;
+        uint64_t worst_behind_ns;
+        uint64_t start_ns;
+        uint64_t send_end_ns;
+        uint64_t finish_ns;
+};
+
+int main(int argc, char const *argv[]) {
+    Settings settings;
+    settings.connections = 1000;
+    settings.rate = 5000;
+    settings.duration = 30;
+    settings.warmup = 5;
+    settings.drain = 2;
+    settings.setpoint = 23.0f;
+    settings.hysteresis = false;
+    settings.host = "127.0.0.1";
+    const char *source = NULL;
+    settings.seed = std::random_device()();
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--connections=", 14) == 0) {
+            settings.connections = strtoul(argv[i] + 14, NULL, 10);
+        } else if (strncmp(argv[i], "--rate=", 7) == 0) {
+            settings.rate = atof(argv[i] + 7);
+        } else if (strncmp(argv[i], "--duration=", 11) == 0) {
+            settings.duration = atof(argv[i] + 11);
+        } else if (strncmp(argv[i], "--warmup=", 9) == 0) {
+            settings.warmup = atof(argv[i] + 9);
+        } else if (strncmp(argv[i], "--drain=", 8) == 0) {
+            settings.drain = atof(argv[i] + 8);
+        } else if (strncmp(argv[i], "--setpoint=", 11) == 0) {
+            settings.setpoint = (float)atof(argv[i] + 11);
+        } else if (strcmp(argv[i], "--hysteresis") == 0) {
+            settings.hysteresis = true;
+        } else if (strncmp(argv[i], "--host=", 7) == 0) {
+            settings.host = argv[i] + 7;
+        } else if (strncmp(argv[i], "--source=", 9) == 0) {
+            source = argv[i] + 9;
+        } else if (strncmp(argv[i], "--seed=", 7) == 0) {
+            settings.seed = (unsigned)strtoul(argv[i] + 7, NULL, 10);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
     }
+    if (settings.connections == 0 || settings.connections > 0xfffe || settings.rate <= 0 ||
+        settings.duration <= settings.warmup) {
+        fprintf(stderr, "--connections must be 1 to 65534, --rate positive, --duration above --warmup\n");
+        return 1;
+    }
+    struct in_addr hub_addr;
+    bool loopback = inet_pton(AF_INET, settings.host, &hub_addr) == 1 && (ntohl(hub_addr.s_addr) >> 24) == 127;
+    settings.source.base = 0;
+    settings.source.count = 0;
+    if (source == NULL && loopback) {
+        source = LOAD_SOURCE_DEFAULT;
+    }
+    if (source != NULL && !parse_source_range(source, settings.source)) {
+        fprintf(stderr, "--source takes a range like 10.0.0.0/24\n");
+        return 1;
+    }
+    if (source != NULL && settings.connections > settings.source.count) {
+        fprintf(stderr, "--source %s has %u addresses for %zu connections\n", source, settings.source.count,
+                settings.connections);
+        return 1;
+    }
+    if (source == NULL && settings.connections > 1) {
+        fprintf(stderr, "WARNING: all %zu connections share this machine's address. A hub run with "
+                "--one-vent-per-address sees one vent that keeps reconnecting and the figures mean nothing; "
+                "give --source with a range of local addresses to bind one per connection.\n",
+                settings.connections);
+    }
+    rng.seed(settings.seed);
 
-    // std::cout << "Waiting to connect" << std::endl;
-    if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
-        perror("Connection Failed");
-        return -1;
+    // One socket per connection
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
     }
 
-    for(int i = 0; i < 25; i++){
-        data.temperature = randomFloat(20.0, 25.0);
-        
-        cout << "Send: " << send(sock, &data, sizeof(data), 0) << endl;
-        
-        valread = read(sock, buffer, 1024);
-        
-        cout << "Recv: " << valread << endl;
+    LoadGenerator load(settings);
+    if (!load.connect_all()) {
+        return 1;
     }
+    load.run();
+    load.report();
     return 0;
-}
\ No newline at end of file
+}
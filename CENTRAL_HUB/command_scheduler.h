@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include "timer_wheel.h"
+
+// Pacing of cover commands, per vent, on the control thread.
+//
+// Every vent has a one-slot mailbox. submit() sends straight away when the vent's last
+// command is at least gap_ms old; otherwise the cover waits in the mailbox and a newer one
+// overwrites it (latest wins), and the mailbox's timer sends whatever is there the moment the
+// gap runs out. Nothing polls and nothing waits on a vent: a held vent is a timer on the
+// wheel, so vents never queue behind each other.
+//
+// Subclasses supply dispatch(), which hands one command to the I/O side, and flush(), called
+// after a timer has dispatched outside a batch.
+class CommandScheduler{
+    public:
+        std::atomic<uint64_t> held;         // commands that had to wait out the gap
+        std::atomic<uint64_t> superseded;   // covers replaced in a mailbox before being sent
+
+        CommandScheduler(LoopTimers &loop, unsigned gap_ms)
+            : held(0), superseded(0), loop(loop), gap_ms(gap_ms) {}
+        virtual ~CommandScheduler() {
+            for (size_t i = 0; i < mailboxes.size(); i++) {
+                loop.cancel(mailboxes[i]);
+            }
+        }
+
+        void set_gap(unsigned ms) { gap_ms = ms; }
+        unsigned gap() const { return gap_ms; }
+
+        // True if the command went out now, false if it is waiting in the mailbox
+        bool submit(uint32_t vent, int cover) {
+            Mailbox &box = mailbox(vent);
+            if (box.armed()) {
+                box.cover = cover;
+                bump(superseded);
+                return false;
+            }
+            uint64_t now = loop.now_ms();
+            if (box.last_sent_ms != ~0ull && now - box.last_sent_ms < gap_ms) {
+                box.cover = cover;
+                loop.schedule(box, gap_ms - (now - box.last_sent_ms));
+                bump(held);
+                return false;
+            }
+            send(box, cover);
+            return true;
+        }
+
+        // A command is waiting for the vent's gap to run out
+        bool waiting(uint32_t vent) const { return vent < mailboxes.size() && mailboxes[vent].armed(); }
+
+        // Milliseconds since the vent's last command, ~0 if it never had one
+        uint64_t since_last(uint32_t vent) const {
+            if (vent >= mailboxes.size() || mailboxes[vent].last_sent_ms == ~0ull) {
+                return ~0ull;
+            }
+            return loop.now_ms() - mailboxes[vent].last_sent_ms;
+        }
+
+        virtual void dispatch(uint32_t vent, int cover) = 0;
+        virtual void flush() = 0;
+
+    private:
+        class Mailbox : public WheelTimer{
+            public:
+                CommandScheduler *owner;
+                uint32_t vent;
+                int cover;
+                uint64_t last_sent_ms;   // ~0 before the first command
+
+                Mailbox(CommandScheduler *owner, uint32_t vent)
+                    : owner(owner), vent(vent), cover(0), last_sent_ms(~0ull) {}
+
+                void on_timer() {
+                    owner->send(*this, cover);
+                    owner->flush();
+                }
+        };
+
+        Mailbox &mailbox(uint32_t vent) {
+            while (mailboxes.size() <= vent) {
+                mailboxes.emplace_back(this, (uint32_t)mailboxes.size());
+            }
+            return mailboxes[vent];
+        }
+
+        void send(Mailbox &box, int cover) {
+            box.last_sent_ms = loop.now_ms();
+            dispatch(box.vent, cover);
+        }
+
+        static void bump(std::atomic<uint64_t> &counter) {
+            counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        LoopTimers &loop;
+        unsigned gap_ms;
+        std::deque<Mailbox> mailboxes;   // a deque so growing it never moves a linked timer
+
+        CommandScheduler(const CommandScheduler &);
+        CommandScheduler &operator=(const CommandScheduler &);
+};
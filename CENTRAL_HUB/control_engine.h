@@ -0,0 +1,386 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "control_policy.h"
+#include "mpc.h"
+
+#define CONTROL_PID 0
+#define CONTROL_HYSTERESIS 1
+#define CONTROL_MPC 2           // mpc.h; PID until the vent's room model is trusted
+#define CONTROL_BANG_BANG 3
+#define CONTROL_SCHEDULED_PID 4
+#define CONTROL_MODES 5
+
+#define CONTROL_ALIGN 64
+
+// Controller memory for one vent when driven through the scalar path
+struct PidState{
+    double integral;
+    double previous_error;
+
+    PidState() : integral(0), previous_error(0) {}
+};
+
+// The original per-packet PID step, with its state passed in rather than shared by every
+// vent. Kept as the scalar reference the batched kernel is measured against.
+inline int update_cover(PidState &state, const PidGains &gains, float curr_temp, float desired_temp){
+    double error = desired_temp - curr_temp;
+
+    // Proportional term
+    double proportional = gains.Kp * error;
+
+    // Integral term
+    state.integral += error;
+    double integral_term = gains.Ki * state.integral;
+
+    // Derivative term
+    double derivative = gains.Kd * (error - state.previous_error);
+    state.previous_error = error;
+
+    // Calculate PID output
+    double output = proportional + integral_term + derivative;
+
+    // Limit the output to the range [COVER_MIN, COVER_MAX]
+    if (output > COVER_MAX) {
+        output = COVER_MAX;
+    } else if (output < COVER_MIN) {
+        output = COVER_MIN;
+    }
+
+    return output;
+}
+
+// Same rule as compute_hysteresis_position() in test_connection.py, on the hub's 0-10 scale
+inline int hysteresis_cover(float curr_temp, float desired_temp, int current_cover){
+    if (curr_temp > desired_temp + HYSTERESIS_THRESHOLD_HIGH) {
+        return COVER_MAX;
+    } else if (curr_temp < desired_temp - HYSTERESIS_THRESHOLD_LOW) {
+        return COVER_MIN;
+    }
+    return current_cover;
+}
+
+// Growable float column aligned for vector loads
+class AlignedColumn{
+    public:
+        AlignedColumn() : data(NULL), capacity(0) {}
+        ~AlignedColumn() { free(data); }
+
+        void reserve(size_t n, float fill) {
+            if (n <= capacity) {
+                return;
+            }
+            size_t bytes = ((n * sizeof(float) + CONTROL_ALIGN - 1) / CONTROL_ALIGN) * CONTROL_ALIGN;
+            float *grown = (float *)aligned_alloc(CONTROL_ALIGN, bytes);
+            if (data != NULL) {
+                memcpy(grown, data, capacity * sizeof(float));
+                free(data);
+            }
+            for (size_t i = capacity; i < bytes / sizeof(float); i++) {
+                grown[i] = fill;
+            }
+            data = grown;
+            capacity = bytes / sizeof(float);
+        }
+
+        float *data;
+        size_t capacity;
+
+    private:
+        AlignedColumn(const AlignedColumn &);
+        AlignedColumn &operator=(const AlignedColumn &);
+};
+
+// Controller state for every vent, one column per field. Telemetry only writes the latest
+// reading; tick() then runs each mode's control law over its vents in one branch-free pass
+// that the compiler vectorises, samples and plans this tick's share of the MPC vents, and
+// reports which vents need a new cover position.
+//
+// Columns are kept in slot order, with the vents of each mode in one contiguous run of
+// slots: the law is chosen once per run, and the kernel for it is instantiated from its
+// policy type, so no vent pays for a mode it is not in. Callers only see vent indices;
+// slot_of and vent_of map between the two, and a vent changing mode moves across the runs
+// in between by swapping with their edge slots.
+class ControlEngine{
+    public:
+        PidPolicy pid;              // also the fallback for MPC vents without a trusted model
+        HysteresisPolicy hysteresis;
+        BangBangPolicy bang_bang;
+        ScheduledPidPolicy scheduled_pid;
+        uint64_t mpc_solves;        // models that chose a cover, for benchmarks and metrics
+        uint64_t mpc_samples;
+
+        ControlEngine() : mpc_solves(0), mpc_samples(0), count(0), ticks(0) {
+            AlignedColumn *all[] = {&temperature, &desired, &integral, &previous_error, &cover,
+                                    &fresh, &planned, &heard, &applied, &next_cover};
+            columns.assign(all, all + sizeof(all) / sizeof(all[0]));
+            for (int m = 0; m < CONTROL_MODES; m++) {
+                run_end[m] = 0;
+            }
+        }
+
+        // Returns the vent's index
+        uint32_t add_vent(float desired_temperature, int mode) {
+            uint32_t index = count++;
+            if (count > temperature.capacity) {
+                size_t grow = count < 64 ? 64 : count * 2;
+                for (size_t k = 0; k < columns.size(); k++) {
+                    columns[k]->reserve(grow, 0.0f);
+                }
+            }
+            // Starts in the last run's final slot, then moves to its own
+            uint32_t slot = index;
+            for (size_t k = 0; k < columns.size(); k++) {
+                columns[k]->data[slot] = 0.0f;
+            }
+            desired.data[slot] = desired_temperature;
+            cover.data[slot] = COVER_MIN;
+            slot_of.push_back(slot);
+            vent_of.push_back(index);
+            modes.push_back(CONTROL_MODES - 1);
+            run_end[CONTROL_MODES - 1] = count;
+            set_mode(index, mode);
+            return index;
+        }
+
+        // Latest reading wins if several arrive within one tick
+        void set_temperature(uint32_t index, float t) {
+            uint32_t s = slot_of[index];
+            temperature.data[s] = t;
+            fresh.data[s] = 1.0f;
+            heard.data[s] = 1.0f;
+        }
+
+        // A reading for a vent whose cover the user is holding: kept, not evaluated
+        void observe(uint32_t index, float t) { temperature.data[slot_of[index]] = t; }
+
+        void set_desired(uint32_t index, float t) { desired.data[slot_of[index]] = t; }
+
+        // Controller memory means different things to different laws, so it starts over
+        void set_mode(uint32_t index, int mode) {
+            if (modes[index] != mode) {
+                move(index, mode);
+                uint32_t s = slot_of[index];
+                integral.data[s] = 0.0f;
+                previous_error.data[s] = 0.0f;
+            }
+            planned.data[slot_of[index]] = 0.0f;
+            if (mode == CONTROL_MPC) {
+                if (models.size() < count) {
+                    models.resize(count);
+                }
+                models[index].reset();
+            }
+        }
+
+        // Drop accumulated PID memory, e.g. when a vent reconnects. An MPC vent keeps its
+        // room model but starts a new sample.
+        void reset(uint32_t index) {
+            uint32_t s = slot_of[index];
+            integral.data[s] = 0.0f;
+            previous_error.data[s] = 0.0f;
+            fresh.data[s] = 0.0f;
+            heard.data[s] = 0.0f;
+            if (index < models.size()) {
+                models[index].last_y = NAN;
+            }
+        }
+
+        // Reload a vent's controller memory from a snapshot. The vent is not evaluated again
+        // until a fresh reading arrives.
+        void restore(uint32_t index, float t, float integ, float prev, int c) {
+            uint32_t s = slot_of[index];
+            temperature.data[s] = t;
+            integral.data[s] = integ;
+            previous_error.data[s] = prev;
+            cover.data[s] = (float)c;
+            fresh.data[s] = 0.0f;
+        }
+
+        float get_integral(uint32_t index) const { return integral.data[slot_of[index]]; }
+        float get_previous_error(uint32_t index) const { return previous_error.data[slot_of[index]]; }
+        int get_mode(uint32_t index) const { return modes[index]; }
+
+        // NULL unless the vent is under MPC
+        const MpcModel *model(uint32_t index) const {
+            return modes[index] == CONTROL_MPC ? &models[index] : NULL;
+        }
+
+        int get_cover(uint32_t index) const { return (int)cover.data[slot_of[index]]; }
+        void set_cover(uint32_t index, int c) { cover.data[slot_of[index]] = (float)c; }
+        float get_temperature(uint32_t index) const { return temperature.data[slot_of[index]]; }
+        float get_desired(uint32_t index) const { return desired.data[slot_of[index]]; }
+        uint32_t size() const { return count; }
+
+        // Vents in the mode, for benchmarks and metrics
+        uint32_t vents_in(int mode) const { return run_end[mode] - run_begin(mode); }
+
+        // Evaluate every vent with a reading since the last tick. Indices whose cover position
+        // changed are appended to changed.
+        void tick(std::vector<uint32_t> &changed) {
+            step();
+            if (!models.empty()) {
+                plan(ticks % MPC_PERIOD_TICKS);
+            }
+            collect(changed);
+            ticks++;
+        }
+
+        // Every mode's run through its own kernel. Vents without a fresh reading pass through
+        // unchanged.
+        void step() {
+            for (int m = 0; m < CONTROL_MODES; m++) {
+                uint32_t begin = run_begin(m), end = run_end[m];
+                if (begin == end) {
+                    continue;
+                }
+                switch (m) {
+                case CONTROL_HYSTERESIS:
+                    run(hysteresis, begin, end);
+                    break;
+                case CONTROL_BANG_BANG:
+                    run(bang_bang, begin, end);
+                    break;
+                case CONTROL_SCHEDULED_PID:
+                    run(scheduled_pid, begin, end);
+                    break;
+                default:
+                    run(pid, begin, end);
+                    break;
+                }
+            }
+        }
+
+        // The MPC vents sampled on this tick: every MPC_PERIOD_TICKS-th vent from phase. Each
+        // one that reported since its last sample refits its model and, if the model is
+        // trusted, replaces next_cover with the cover it plans to hold. A vent that missed a
+        // sample starts a new one, since its mean cover and previous temperature no longer
+        // line up.
+        void plan(uint32_t phase) {
+            float *a = applied.data;
+            for (size_t i = phase; i < count && i < models.size(); i += MPC_PERIOD_TICKS) {
+                if (modes[i] != CONTROL_MPC) {
+                    continue;
+                }
+                MpcModel &m = models[i];
+                uint32_t s = slot_of[i];
+                if (heard.data[s] < 0.5f) {
+                    m.last_y = NAN;
+                    planned.data[s] = 0.0f;
+                    a[s] = 0.0f;
+                    continue;
+                }
+                heard.data[s] = 0.0f;
+                mpc_observe(m, temperature.data[s], a[s] / MPC_PERIOD_TICKS);
+                a[s] = 0.0f;
+                mpc_samples++;
+                bool was_planned = planned.data[s] > 0.5f;
+                planned.data[s] = m.trusted ? 1.0f : 0.0f;
+                if (!m.trusted) {
+                    if (was_planned) {
+                        // Back to PID, from a clean start
+                        integral.data[s] = 0.0f;
+                        previous_error.data[s] = 0.0f;
+                    }
+                    continue;
+                }
+                next_cover.data[s] = (float)mpc_solve(m, temperature.data[s], desired.data[s],
+                                                      (int)cover.data[s], COVER_MIN, COVER_MAX);
+                mpc_solves++;
+            }
+        }
+
+        // Branch-free so the ~50% unpredictable "did it move" test costs no mispredicts
+        void collect(std::vector<uint32_t> &changed) {
+            float *c = cover.data;
+            const float *next = next_cover.data;
+            float *f = fresh.data;
+            float *a = applied.data;
+            const uint32_t *vent = vent_of.data();
+            size_t base = changed.size();
+            changed.resize(base + count);
+            uint32_t *out = changed.data() + base;
+            size_t n = 0;
+            for (size_t s = 0; s < count; s++) {
+                // Truncate like the scalar path. Kept out of step(): a float to int
+                // conversion there stops GCC from vectorising the loop.
+                float position = (float)(int)next[s];
+                out[n] = vent[s];
+                n += position != c[s];
+                c[s] = position;
+                f[s] = 0.0f;
+                // The cover an MPC vent's next sample was given, summed over the period
+                a[s] += position;
+            }
+            changed.resize(base + n);
+        }
+
+    private:
+        uint32_t run_begin(int mode) const { return mode == 0 ? 0 : run_end[mode - 1]; }
+
+        template <class Policy>
+        void run(const Policy &policy, uint32_t begin, uint32_t end) {
+            control_group_step(policy, end - begin, temperature.data + begin, desired.data + begin,
+                               fresh.data + begin, planned.data + begin, integral.data + begin,
+                               previous_error.data + begin, cover.data + begin,
+                               next_cover.data + begin);
+        }
+
+        // Walk the vent run by run to its new mode's, swapping with the edge slot of each
+        // run it crosses and moving that run's boundary past it
+        void move(uint32_t index, int mode) {
+            int m = modes[index];
+            while (m < mode) {
+                uint32_t edge = run_end[m] - 1;
+                swap_slots(slot_of[index], edge);
+                run_end[m]--;
+                m++;
+            }
+            while (m > mode) {
+                uint32_t edge = run_begin(m);
+                swap_slots(slot_of[index], edge);
+                run_end[m - 1]++;
+                m--;
+            }
+            modes[index] = mode;
+        }
+
+        void swap_slots(uint32_t a, uint32_t b) {
+            if (a == b) {
+                return;
+            }
+            for (size_t k = 0; k < columns.size(); k++) {
+                float *data = columns[k]->data;
+                float held = data[a];
+                data[a] = data[b];
+                data[b] = held;
+            }
+            uint32_t va = vent_of[a], vb = vent_of[b];
+            vent_of[a] = vb;
+            vent_of[b] = va;
+            slot_of[va] = b;
+            slot_of[vb] = a;
+        }
+
+        uint32_t count;
+        uint64_t ticks;
+        AlignedColumn temperature;
+        AlignedColumn desired;
+        AlignedColumn integral;
+        AlignedColumn previous_error;
+        AlignedColumn cover;
+        AlignedColumn fresh;
+        AlignedColumn planned;      // MPC vent whose cover comes from its model
+        AlignedColumn heard;        // reading since the vent's last MPC sample
+        AlignedColumn applied;      // cover summed over ticks since the last MPC sample
+        AlignedColumn next_cover;
+        std::vector<AlignedColumn *> columns;   // all of the above, for growing and swapping
+        std::vector<uint32_t> slot_of;          // by vent
+        std::vector<uint32_t> vent_of;          // by slot
+        std::vector<int> modes;                 // by vent
+        uint32_t run_end[CONTROL_MODES];        // slots of mode m are [run_end[m - 1], run_end[m])
+        std::vector<MpcModel> models;           // by vent, once any vent uses MPC
+};
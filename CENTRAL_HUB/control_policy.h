@@ -0,0 +1,144 @@
+#pragma once
+
+#include <stddef.h>
+
+// Cover positions the hub sends as motor_pos
+#define COVER_MIN 0
+#define COVER_MAX 10
+
+// Hysteresis band, same meaning as HYSTERESIS_THRESHOLD_* in test_connection.py
+#define HYSTERESIS_THRESHOLD_HIGH 1.0f
+#define HYSTERESIS_THRESHOLD_LOW 0.5f
+
+#define BANG_BANG_DEADBAND 0.5f
+
+// Gain-scheduled PID: the gentle set applies within SCHEDULE_NEAR_ERROR of the setpoint,
+// the aggressive one beyond SCHEDULE_FAR_ERROR, blended linearly in between
+#define SCHEDULE_NEAR_ERROR 0.5f
+#define SCHEDULE_FAR_ERROR 2.0f
+
+struct PidGains{
+    float Kp;  // Proportional gain
+    float Ki;  // Integral gain
+    float Kd;  // Derivative gain
+
+    PidGains() : Kp(1.5f), Ki(0.5f), Kd(0.05f) {}
+    PidGains(float p, float i, float d) : Kp(p), Ki(i), Kd(d) {}
+};
+
+// Control laws for ControlEngine. Each one is a value type whose step() works out one vent's
+// next cover from its temperature t, setpoint d and current cover hold. integral and
+// previous are the vent's controller memory, to be advanced only when live is 1 (a fresh
+// reading, not overridden by an MPC plan). Every step() is written with conditional
+// expressions only, so control_group_step() inlines it and still vectorises.
+
+// The hub's PID, heating sense: opens when the room is below the setpoint
+struct PidPolicy{
+    PidGains gains;
+
+    float step(float t, float d, float hold, float live, float &integral, float &previous) const {
+        (void)hold;
+        float error = d - t;
+        float new_integral = integral + live * error;
+        float output = gains.Kp * error + gains.Ki * new_integral + gains.Kd * (error - previous);
+        output = output > (float)COVER_MAX ? (float)COVER_MAX : output;
+        output = output < (float)COVER_MIN ? (float)COVER_MIN : output;
+        integral = new_integral;
+        float last = previous;
+        previous = live > 0.5f ? error : last;
+        return output;
+    }
+};
+
+// compute_hysteresis_position() from test_connection.py: fully open above the band, closed
+// below it, hold inside
+struct HysteresisPolicy{
+    float high;
+    float low;
+
+    HysteresisPolicy() : high(HYSTERESIS_THRESHOLD_HIGH), low(HYSTERESIS_THRESHOLD_LOW) {}
+
+    float step(float t, float d, float hold, float live, float &integral, float &previous) const {
+        (void)live;
+        (void)integral;
+        (void)previous;
+        float band = t > d + high ? (float)COVER_MAX : hold;
+        return t < d - low ? (float)COVER_MIN : band;
+    }
+};
+
+// On/off with a symmetric deadband, in the PID's sense: fully open below the band, closed
+// above it, hold inside. Two motor moves per cycle at most, for vents whose motors should
+// not hunt.
+struct BangBangPolicy{
+    float deadband;
+
+    BangBangPolicy() : deadband(BANG_BANG_DEADBAND) {}
+
+    float step(float t, float d, float hold, float live, float &integral, float &previous) const {
+        (void)live;
+        (void)integral;
+        (void)previous;
+        float chosen = t < d - deadband ? (float)COVER_MAX : hold;
+        return t > d + deadband ? (float)COVER_MIN : chosen;
+    }
+};
+
+// PID whose gains are scheduled on |error|: aggressive far from the setpoint, where a slow
+// approach wastes time, and gentle near it, where a hot loop hunts. The integral memory
+// holds the sum of Ki * error rather than of error, so changing Ki along the schedule does
+// not kick the output.
+struct ScheduledPidPolicy{
+    PidGains near;
+    PidGains far;
+    float near_error;
+    float far_error;
+
+    ScheduledPidPolicy()
+        : near(1.0f, 0.2f, 0.05f), far(3.0f, 0.5f, 0.05f),
+          near_error(SCHEDULE_NEAR_ERROR), far_error(SCHEDULE_FAR_ERROR) {}
+
+    float step(float t, float d, float hold, float live, float &integral, float &previous) const {
+        (void)hold;
+        float error = d - t;
+        float magnitude = error < 0.0f ? -error : error;
+        float w = (magnitude - near_error) / (far_error - near_error);
+        w = w < 0.0f ? 0.0f : w;
+        w = w > 1.0f ? 1.0f : w;
+        float Kp = near.Kp + w * (far.Kp - near.Kp);
+        float Ki = near.Ki + w * (far.Ki - near.Ki);
+        float Kd = near.Kd + w * (far.Kd - near.Kd);
+        float new_integral = integral + live * Ki * error;
+        float output = Kp * error + new_integral + Kd * (error - previous);
+        output = output > (float)COVER_MAX ? (float)COVER_MAX : output;
+        output = output < (float)COVER_MIN ? (float)COVER_MIN : output;
+        integral = new_integral;
+        float last = previous;
+        previous = live > 0.5f ? error : last;
+        return output;
+    }
+};
+
+// One policy over n vents in one branch-free pass, the policy chosen at compile time so its
+// step() inlines into the loop. A fresh value of 0 leaves the vent's state and position
+// untouched, and so does a planned value of 1 (an MPC vent whose cover comes from its model).
+template <class Policy>
+inline void control_group_step(const Policy &policy, size_t n,
+                               const float * __restrict t, const float * __restrict d,
+                               const float * __restrict f, const float * __restrict p,
+                               float * __restrict integ, float * __restrict prev,
+                               const float * __restrict c, float * __restrict next) {
+    // A copy, so the parameters stay in registers rather than being reloaded each vent
+    const Policy local = policy;
+    for (size_t i = 0; i < n; i++) {
+        float live = f[i] * (1.0f - p[i]);
+        float hold = c[i];
+        float integral = integ[i];
+        float previous = prev[i];
+        float chosen = local.step(t[i], d[i], hold, live, integral, previous);
+        integ[i] = integral;
+        prev[i] = previous;
+        chosen = p[i] > 0.5f ? hold : chosen;
+        next[i] = f[i] > 0.5f ? chosen : hold;
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <sched.h>
+#include <atomic>
+#include "io_backend.h"
+#include "mpsc_queue.h"
+#include "reactor.h"
+#include "vent_registry.h"
+
+#define EGRESS_QUEUE_SIZE 65536
+#define EGRESS_MAX_FRAME 64
+
+// Cover commands on their way from the control thread to the vents.
+//
+// The control thread post()s a position per vent and commit()s once per tick. The position
+// lives in the vent's registry slot and only the vent index is queued, once, until the I/O
+// thread picks it up, so a command superseded before it hits the wire is simply never sent
+// (latest wins). The I/O thread then encodes every queued command, hands them all to the
+// backend with send_batched() and flushes once: one send per socket on epoll, one
+// io_uring_enter for the whole tick on io_uring.
+//
+// Subclasses supply the wire format through encode().
+class CommandEgress : public Doorbell{
+    public:
+        std::atomic<uint64_t> coalesced;   // commands replaced by a newer one before sending
+        uint64_t sent;                     // frames handed to the backend
+        uint64_t flushes;
+
+        CommandEgress(VentRegistry &registry, size_t capacity = EGRESS_QUEUE_SIZE)
+            : coalesced(0), sent(0), flushes(0), registry(registry), queue(capacity),
+              backend(NULL), posted(false) {}
+
+        void attach(IoBackend *io) { backend = io; }
+
+        // Control thread
+        void post(Vent &vent, int motor_pos) {
+            vent.cover.store(motor_pos, std::memory_order_relaxed);
+            if (vent.command_queued.exchange(true, std::memory_order_acq_rel)) {
+                coalesced.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            // At most one entry per vent, so a full ring only means the I/O thread is behind
+            while (!queue.try_push(vent.index)) {
+                ring();
+                sched_yield();
+            }
+            posted = true;
+        }
+
+        // Control thread, once per tick: wake the I/O thread if anything was posted
+        void commit() {
+            if (posted) {
+                posted = false;
+                ring();
+            }
+        }
+
+        // I/O thread
+        void on_ring() {
+            uint32_t index;
+            char frame[EGRESS_MAX_FRAME];
+            size_t batch = 0;
+            while (queue.try_pop(index)) {
+                Vent &vent = registry.at(index);
+                // Clear first: a position posted after this is queued afresh rather than lost
+                vent.command_queued.exchange(false, std::memory_order_acq_rel);
+                int motor_pos = (int)vent.cover.load(std::memory_order_relaxed);
+                Connection *conn = connection(index);
+                if (conn == NULL) {
+                    continue;
+                }
+                size_t len = encode(vent, motor_pos, frame);
+                bool queued = backend->send_batched(*conn, frame, len);
+                sent += queued;
+                batch++;
+                on_sent(vent, motor_pos, queued ? len : 0);
+            }
+            if (batch > 0) {
+                backend->flush();
+                flushes++;
+            }
+        }
+
+        // I/O thread: the vent's connection on this egress' backend, or NULL if it has none
+        virtual Connection *connection(uint32_t index) = 0;
+
+        // Vents with a command waiting for the I/O thread
+        size_t pending() const { return queue.size(); }
+
+        // Write the framed command for vent into out (EGRESS_MAX_FRAME bytes); return its length
+        virtual size_t encode(Vent &vent, int motor_pos, char *out) = 0;
+
+        // Called for every command handed to the backend; bytes is 0 if the send failed
+        virtual void on_sent(Vent &vent, int motor_pos, size_t bytes) {}
+
+    private:
+        VentRegistry &registry;
+        MpscQueue<uint32_t> queue;
+        IoBackend *backend;
+        bool posted;
+};
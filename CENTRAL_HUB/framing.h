@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+
+// Vent TCP framing: every message is a little-endian uint32 payload length followed by
+// the payload (a Packet). TCP is a byte stream, so one recv() can end mid-frame or hold
+// dozens of frames; FrameDecoder turns whatever arrives back into whole payloads.
+#define FRAME_HEADER_SIZE 4
+#define FRAME_MAX_PAYLOAD 1024
+
+inline uint32_t frame_read_len(const char *p) {
+    const unsigned char *b = (const unsigned char *)p;
+    return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+inline void frame_write_len(char *p, uint32_t len) {
+    p[0] = (char)(len & 0xff);
+    p[1] = (char)((len >> 8) & 0xff);
+    p[2] = (char)((len >> 16) & 0xff);
+    p[3] = (char)((len >> 24) & 0xff);
+}
+
+// Write header + payload into out, which must hold FRAME_HEADER_SIZE + len bytes.
+// Returns the number of bytes written.
+inline size_t encode_frame(char *out, const void *payload, uint32_t len) {
+    frame_write_len(out, len);
+    memcpy(out + FRAME_HEADER_SIZE, payload, len);
+    return FRAME_HEADER_SIZE + len;
+}
+
+// Per-connection reassembly. Frames that sit wholly inside a recv() chunk are handed to the
+// callback as pointers into that chunk, with no copy. Only a frame cut off by the end of a
+// chunk is stashed here, so the stash never holds more than one frame and never wraps.
+class FrameDecoder{
+    public:
+        FrameDecoder() : stash_len(0), broken(false) {}
+
+        // Calls on_frame(payload, len) for every complete frame in data, in order. Payload
+        // pointers are only valid during the call. Returns false once the stream carries a
+        // frame longer than FRAME_MAX_PAYLOAD; the connection should then be dropped.
+        template <class F>
+        bool feed(const char *data, size_t len, F &&on_frame) {
+            if (broken) {
+                return false;
+            }
+
+            // Finish the frame left over from the previous chunk first
+            if (stash_len > 0) {
+                size_t used = complete_stash(data, len, on_frame);
+                if (broken) {
+                    return false;
+                }
+                data += used;
+                len -= used;
+            }
+
+            while (len >= FRAME_HEADER_SIZE) {
+                uint32_t payload_len = frame_read_len(data);
+                if (payload_len > FRAME_MAX_PAYLOAD) {
+                    broken = true;
+                    return false;
+                }
+                size_t frame_len = FRAME_HEADER_SIZE + payload_len;
+                if (len < frame_len) {
+                    break;
+                }
+                on_frame(data + FRAME_HEADER_SIZE, (size_t)payload_len);
+                data += frame_len;
+                len -= frame_len;
+            }
+
+            if (len > 0) {
+                memcpy(stash, data, len);
+                stash_len = len;
+            }
+            return true;
+        }
+
+        // Bytes of an unfinished frame carried over to the next chunk
+        size_t pending() const { return stash_len; }
+
+        void reset() {
+            stash_len = 0;
+            broken = false;
+        }
+
+    private:
+        template <class F>
+        size_t complete_stash(const char *data, size_t len, F &on_frame) {
+            size_t used = 0;
+            if (stash_len < FRAME_HEADER_SIZE) {
+                size_t take = FRAME_HEADER_SIZE - stash_len;
+                if (take > len) {
+                    take = len;
+                }
+                memcpy(stash + stash_len, data, take);
+                stash_len += take;
+                used += take;
+                if (stash_len < FRAME_HEADER_SIZE) {
+                    return used;
+                }
+            }
+
+            uint32_t payload_len = frame_read_len(stash);
+            if (payload_len > FRAME_MAX_PAYLOAD) {
+                broken = true;
+                return used;
+            }
+            size_t frame_len = FRAME_HEADER_SIZE + payload_len;
+            size_t take = frame_len - stash_len;
+            if (take > len - used) {
+                take = len - used;
+            }
+            memcpy(stash + stash_len, data + used, take);
+            stash_len += take;
+            used += take;
+            if (stash_len == frame_len) {
+                stash_len = 0;
+                on_frame(stash + FRAME_HEADER_SIZE, (size_t)payload_len);
+            }
+            return used;
+        }
+
+        char stash[FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD];
+        size_t stash_len;
+        bool broken;
+};
@@ -0,0 +1,340 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "reactor.h"
+#include "framing.h"
+#include "slab_pool.h"
+
+#define RECV_CHUNK 4096
+#define SPARE_BUFFER_MAX 4096   // outgoing buffers larger than this are freed on close
+
+// One accepted vent socket. Backends extend this with their own bookkeeping.
+class Connection{
+    public:
+        int fd;
+        unsigned vent_num;
+        struct sockaddr_in peer;
+        FrameDecoder decoder;
+
+        Connection() : fd(-1), vent_num(0) {
+            memset(&peer, 0, sizeof(peer));
+        }
+        virtual ~Connection() {}
+};
+
+// Outgoing byte buffers kept from closed connections for the ones that replace them, so a
+// reconnecting vent's first command reuses memory rather than allocating. Loop thread only.
+class BufferShelf{
+    public:
+        // Leaves buffer empty, its memory kept here unless it grew past SPARE_BUFFER_MAX
+        void put(std::string &buffer) {
+            if (buffer.capacity() > SPARE_BUFFER_MAX) {
+                std::string().swap(buffer);
+                return;
+            }
+            buffer.clear();
+            spare.push_back(std::string());
+            spare.back().swap(buffer);
+        }
+
+        // buffer must be empty
+        void take(std::string &buffer) {
+            if (!spare.empty()) {
+                buffer.swap(spare.back());
+                spare.pop_back();
+            }
+        }
+
+    private:
+        std::vector<std::string> spare;
+};
+
+// What the hub implements. All callbacks run on the backend's loop thread.
+class ConnectionHandler{
+    public:
+        virtual ~ConnectionHandler() {}
+
+        // Return false to refuse the connection; the backend closes it
+        virtual bool on_open(Connection &conn) = 0;
+
+        // Bytes as they arrive off the socket, with no framing applied
+        virtual void on_data(Connection &conn, const char *data, size_t len) = 0;
+
+        virtual void on_close(Connection &conn) = 0;
+};
+
+// Owns the listening socket and every vent socket, and drives the handler
+class IoBackend{
+    public:
+        virtual ~IoBackend() {}
+        virtual const char *name() const = 0;
+
+        // Start accepting on an already bound and listening socket
+        virtual bool listen(int server_fd) = 0;
+
+        // Queue len bytes for the connection. Never blocks.
+        virtual bool send(Connection &conn, const void *data, size_t len) = 0;
+
+        // Like send(), but the bytes may wait for flush() so that everything batched for one
+        // connection leaves in a single syscall. Call flush() before returning to the loop.
+        virtual bool send_batched(Connection &conn, const void *data, size_t len) {
+            return send(conn, data, len);
+        }
+
+        // Push out anything queued by send() or send_batched(). Backends that submit sends
+        // one at a time can ignore this.
+        virtual void flush() {}
+
+        virtual void close(Connection &conn) = 0;
+
+        // Connection objects open, and allocated in all (open or pooled for reuse)
+        virtual size_t connections_open() const = 0;
+        virtual size_t connection_slots() const = 0;
+
+        // Loop used for timers and auxiliary descriptors
+        virtual Reactor &reactor() = 0;
+
+        virtual void run() = 0;
+        virtual void stop() = 0;
+};
+
+inline bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) {
+        return false;
+    }
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+class EpollBackend;
+
+class EpollConnection : public Connection, public EventHandler{
+    public:
+        EpollBackend *backend;
+        std::string pending_out;
+        bool closed;
+        bool dirty;                 // on the flush list
+
+        EpollConnection(EpollBackend *owner) : backend(owner), closed(false), dirty(false) {}
+        void handle_event(uint32_t events);
+
+        // Back to the backend's pool rather than the heap
+        void release();
+};
+
+class EpollBackend : public IoBackend{
+    public:
+        EpollBackend(ConnectionHandler &h) : handler(h), listener(this) {}
+
+        const char *name() const { return "epoll"; }
+
+        bool listen(int server_fd) {
+            if (!set_nonblocking(server_fd)) {
+                perror("fcntl");
+                return false;
+            }
+            listener.fd = server_fd;
+            return loop.add(server_fd, &listener, EPOLLIN);
+        }
+
+        bool send(Connection &c, const void *data, size_t len) {
+            EpollConnection &conn = static_cast<EpollConnection &>(c);
+            if (conn.closed) {
+                return false;
+            }
+            // Keep ordering behind anything still waiting for EPOLLOUT
+            if (!conn.pending_out.empty()) {
+                conn.pending_out.append((const char *)data, len);
+                return true;
+            }
+            ssize_t sent = ::send(conn.fd, data, len, MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    close(conn);
+                    return false;
+                }
+                sent = 0;
+            }
+            if ((size_t)sent < len) {
+                conn.pending_out.append((const char *)data + sent, len - sent);
+                loop.modify(conn.fd, &conn, EPOLLIN | EPOLLOUT | EPOLLRDHUP);
+            }
+            return true;
+        }
+
+        bool send_batched(Connection &c, const void *data, size_t len) {
+            EpollConnection &conn = static_cast<EpollConnection &>(c);
+            if (conn.closed) {
+                return false;
+            }
+            // Bytes already waiting for EPOLLOUT go out with the next write_pending()
+            bool idle = conn.pending_out.empty();
+            conn.pending_out.append((const char *)data, len);
+            if (idle && !conn.dirty) {
+                conn.dirty = true;
+                dirty.push_back(&conn);
+            }
+            return true;
+        }
+
+        // One send() per batched connection; whatever the socket will not take waits for
+        // EPOLLOUT
+        void flush() {
+            for (size_t i = 0; i < dirty.size(); i++) {
+                EpollConnection &conn = *dirty[i];
+                conn.dirty = false;
+                if (conn.closed || conn.pending_out.empty()) {
+                    continue;
+                }
+                ssize_t sent = ::send(conn.fd, conn.pending_out.data(), conn.pending_out.size(), MSG_NOSIGNAL);
+                if (sent < 0) {
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        close(conn);
+                        continue;
+                    }
+                    sent = 0;
+                }
+                conn.pending_out.erase(0, sent);
+                if (!conn.pending_out.empty()) {
+                    loop.modify(conn.fd, &conn, EPOLLIN | EPOLLOUT | EPOLLRDHUP);
+                }
+            }
+            dirty.clear();
+        }
+
+        void close(Connection &c) {
+            EpollConnection &conn = static_cast<EpollConnection &>(c);
+            if (conn.closed) {
+                return;
+            }
+            conn.closed = true;
+            handler.on_close(conn);
+            loop.remove(conn.fd);
+            ::close(conn.fd);
+            conn.fd = -1;
+            loop.retire(&conn);
+        }
+
+        size_t connections_open() const { return pool.live(); }
+        size_t connection_slots() const { return pool.capacity(); }
+
+        Reactor &reactor() { return loop; }
+
+        void run() { loop.run(); }
+        void stop() { loop.stop(); }
+
+        void accept_all() {
+            while (1) {
+                struct sockaddr_in addr;
+                socklen_t addrlen = sizeof(addr);
+                int fd = accept4(listener.fd, (struct sockaddr *)&addr, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0) {
+                    if (errno == EINTR || errno == ECONNABORTED) {
+                        continue;
+                    }
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        perror("accept");
+                    }
+                    return;
+                }
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+                EpollConnection *conn = pool.create(this);
+                buffers.take(conn->pending_out);
+                conn->fd = fd;
+                conn->peer = addr;
+                if (!handler.on_open(*conn)) {
+                    ::close(fd);
+                    pool.destroy(conn);
+                    continue;
+                }
+                if (!loop.add(fd, conn, EPOLLIN | EPOLLRDHUP)) {
+                    handler.on_close(*conn);
+                    ::close(fd);
+                    pool.destroy(conn);
+                }
+            }
+        }
+
+        void read_all(EpollConnection &conn) {
+            char buffer[RECV_CHUNK];
+            while (!conn.closed) {
+                ssize_t n = recv(conn.fd, buffer, sizeof(buffer), 0);
+                if (n > 0) {
+                    handler.on_data(conn, buffer, n);
+                    continue;
+                }
+                if (n == 0) {
+                    close(conn);
+                } else if (errno == EINTR) {
+                    continue;
+                } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    perror("recv failed");
+                    close(conn);
+                }
+                return;
+            }
+        }
+
+        void release(EpollConnection &conn) {
+            buffers.put(conn.pending_out);
+            pool.destroy(&conn);
+        }
+
+        void write_pending(EpollConnection &conn) {
+            while (!conn.pending_out.empty()) {
+                ssize_t sent = ::send(conn.fd, conn.pending_out.data(), conn.pending_out.size(), MSG_NOSIGNAL);
+                if (sent < 0) {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        return;
+                    }
+                    close(conn);
+                    return;
+                }
+                conn.pending_out.erase(0, sent);
+            }
+            loop.modify(conn.fd, &conn, EPOLLIN | EPOLLRDHUP);
+        }
+
+    private:
+        class Listener : public EventHandler{
+            public:
+                int fd;
+                EpollBackend *backend;
+                Listener(EpollBackend *owner) : fd(-1), backend(owner) {}
+                void handle_event(uint32_t events) { backend->accept_all(); }
+                void release() {}
+        };
+
+        ConnectionHandler &handler;
+        SlabPool<EpollConnection> pool;     // before loop, which releases into it as it goes
+        BufferShelf buffers;
+        Reactor loop;
+        Listener listener;
+        std::vector<EpollConnection *> dirty;
+};
+
+inline void EpollConnection::release() {
+    backend->release(*this);
+}
+
+inline void EpollConnection::handle_event(uint32_t events) {
+    if (closed) {
+        return;
+    }
+    if (events & EPOLLOUT) {
+        backend->write_pending(*this);
+    }
+    // Drain before honouring a hangup so the last packets are not lost
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        backend->read_all(*this);
+    }
+}
@@ -0,0 +1,491 @@
+#pragma once
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <vector>
+#include "io_backend.h"
+
+#define URING_ENTRIES 1024
+#define URING_BUF_COUNT 4096       // must be a power of two
+#define URING_BUF_SIZE 2048
+#define URING_BUF_GROUP 0
+
+// Completion tags live in the low bits of user_data; every tagged object is 8-byte aligned
+#define URING_OP_ACCEPT 1
+#define URING_OP_RECV 2
+#define URING_OP_SEND 3
+#define URING_OP_POLL 4
+#define URING_OP_MASK 7ull
+
+inline int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+inline int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+inline int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+class UringConnection : public Connection{
+    public:
+        std::string pending_out;    // queued by send(), not yet submitted
+        std::string inflight_out;   // owned by the kernel until its SEND completes
+        size_t inflight_off;
+        unsigned refs;              // submitted operations still owed a final CQE
+        bool closed;
+        bool dirty;                 // on the flush list
+
+        UringConnection() : inflight_off(0), refs(0), closed(false), dirty(false) {}
+};
+
+// Completion-based backend: one multishot accept, one multishot recv per vent fed from a
+// provided buffer ring, and sends batched into a single io_uring_enter per loop iteration.
+// The epoll Reactor is still available for timers and other descriptors; its fd is polled
+// through the ring.
+class IoUringBackend : public IoBackend{
+    public:
+        IoUringBackend(ConnectionHandler &h)
+            : handler(h), ring_fd(-1), ring_ptr(NULL), ring_size(0), sqes(NULL),
+              buf_ring(NULL), buf_base(NULL), listen_fd(-1), to_submit(0), running(false) {}
+
+        ~IoUringBackend() {
+            if (ring_fd >= 0) {
+                ::close(ring_fd);
+            }
+            if (sqes != NULL) {
+                munmap(sqes, sq_entries * sizeof(struct io_uring_sqe));
+            }
+            if (ring_ptr != NULL) {
+                munmap(ring_ptr, ring_size);
+            }
+            if (buf_ring != NULL) {
+                munmap(buf_ring, URING_BUF_COUNT * sizeof(struct io_uring_buf));
+            }
+            if (buf_base != NULL) {
+                munmap(buf_base, (size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+            }
+        }
+
+        // Returns false, with errno set, when the kernel lacks io_uring or any feature
+        // this backend relies on. The caller should fall back to epoll.
+        bool init() {
+            struct io_uring_params params;
+            memset(&params, 0, sizeof(params));
+            params.flags = IORING_SETUP_COOP_TASKRUN;
+            ring_fd = sys_io_uring_setup(URING_ENTRIES, &params);
+            if (ring_fd < 0 && errno == EINVAL) {
+                memset(&params, 0, sizeof(params));
+                ring_fd = sys_io_uring_setup(URING_ENTRIES, &params);
+            }
+            if (ring_fd < 0) {
+                return false;
+            }
+            if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP)) {
+                errno = ENOTSUP;
+                return false;
+            }
+
+            size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+            ring_size = sq_size > cq_size ? sq_size : cq_size;
+            ring_ptr = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+            if (ring_ptr == MAP_FAILED) {
+                ring_ptr = NULL;
+                return false;
+            }
+            sq_entries = params.sq_entries;
+            sqes = (struct io_uring_sqe *)mmap(NULL, sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                                               MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+            if (sqes == MAP_FAILED) {
+                sqes = NULL;
+                return false;
+            }
+
+            char *base = (char *)ring_ptr;
+            sq_head = (unsigned *)(base + params.sq_off.head);
+            sq_tail = (unsigned *)(base + params.sq_off.tail);
+            sq_mask = *(unsigned *)(base + params.sq_off.ring_mask);
+            sq_array = (unsigned *)(base + params.sq_off.array);
+            cq_head = (unsigned *)(base + params.cq_off.head);
+            cq_tail = (unsigned *)(base + params.cq_off.tail);
+            cq_mask = *(unsigned *)(base + params.cq_off.ring_mask);
+            cqes = (struct io_uring_cqe *)(base + params.cq_off.cqes);
+            local_sq_tail = *sq_tail;
+
+            return setup_buffer_ring();
+        }
+
+        const char *name() const { return "io_uring"; }
+
+        size_t connections_open() const { return pool.live(); }
+        size_t connection_slots() const { return pool.capacity(); }
+
+        bool listen(int server_fd) {
+            listen_fd = server_fd;
+            arm_accept();
+            return true;
+        }
+
+        bool send(Connection &c, const void *data, size_t len) {
+            UringConnection &conn = static_cast<UringConnection &>(c);
+            if (conn.closed) {
+                return false;
+            }
+            conn.pending_out.append((const char *)data, len);
+            if (!conn.dirty) {
+                conn.dirty = true;
+                dirty.push_back(&conn);
+            }
+            return true;
+        }
+
+        // Submit queued sends right away. The loop itself does not call this: it folds the
+        // submission into the io_uring_enter that also waits for completions.
+        void flush() {
+            prepare_sends();
+            if (to_submit > 0) {
+                int ret = sys_io_uring_enter(ring_fd, to_submit, 0, 0);
+                if (ret > 0) {
+                    to_submit -= (unsigned)ret < to_submit ? (unsigned)ret : to_submit;
+                }
+            }
+        }
+
+        // Turn every connection's queued bytes into one SEND SQE each
+        void prepare_sends() {
+            for (size_t i = 0; i < dirty.size(); i++) {
+                UringConnection *conn = dirty[i];
+                if (!conn->closed && conn->inflight_out.empty() && !conn->pending_out.empty()) {
+                    conn->inflight_out.swap(conn->pending_out);
+                    conn->inflight_off = 0;
+                    arm_send(*conn);
+                }
+                conn->dirty = false;
+                maybe_release(*conn);
+            }
+            dirty.clear();
+        }
+
+        void close(Connection &c) {
+            UringConnection &conn = static_cast<UringConnection &>(c);
+            if (conn.closed) {
+                return;
+            }
+            conn.closed = true;
+            handler.on_close(conn);
+            // Ends the multishot recv and fails any send in flight; the fd itself is closed
+            // once the last of those completions is reaped
+            shutdown(conn.fd, SHUT_RDWR);
+            maybe_release(conn);
+        }
+
+        Reactor &reactor() { return loop; }
+
+        void run() {
+            running = true;
+            arm_poll();
+            while (running) {
+                prepare_sends();
+                int ret = sys_io_uring_enter(ring_fd, to_submit, 1, IORING_ENTER_GETEVENTS);
+                if (ret < 0) {
+                    if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                        perror("io_uring_enter");
+                        return;
+                    }
+                } else {
+                    to_submit -= (unsigned)ret < to_submit ? (unsigned)ret : to_submit;
+                }
+                reap();
+            }
+        }
+
+        void stop() {
+            running = false;
+            loop.wakeup();
+        }
+
+    private:
+        bool setup_buffer_ring() {
+            buf_ring = (struct io_uring_buf_ring *)mmap(NULL, URING_BUF_COUNT * sizeof(struct io_uring_buf),
+                                                        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (buf_ring == MAP_FAILED) {
+                buf_ring = NULL;
+                return false;
+            }
+            buf_base = (char *)mmap(NULL, (size_t)URING_BUF_COUNT * URING_BUF_SIZE, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (buf_base == MAP_FAILED) {
+                buf_base = NULL;
+                return false;
+            }
+
+            struct io_uring_buf_reg reg;
+            memset(&reg, 0, sizeof(reg));
+            reg.ring_addr = (uint64_t)(uintptr_t)buf_ring;
+            reg.ring_entries = URING_BUF_COUNT;
+            reg.bgid = URING_BUF_GROUP;
+            if (sys_io_uring_register(ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+                return false;
+            }
+
+            buf_tail = 0;
+            for (unsigned bid = 0; bid < URING_BUF_COUNT; bid++) {
+                recycle_buffer(bid);
+            }
+            publish_buffers();
+            return true;
+        }
+
+        void recycle_buffer(unsigned bid) {
+            // Index the ring as a plain array: in C++ the kernel header's flexible-array
+            // wrapper adds a byte of padding and shifts bufs[] by eight
+            struct io_uring_buf *buf = (struct io_uring_buf *)buf_ring + (buf_tail & (URING_BUF_COUNT - 1));
+            buf->addr = (uint64_t)(uintptr_t)(buf_base + (size_t)bid * URING_BUF_SIZE);
+            buf->len = URING_BUF_SIZE;
+            buf->bid = bid;
+            buf_tail++;
+        }
+
+        void publish_buffers() {
+            // The ring tail overlays the resv field of the first entry
+            __atomic_store_n(&((struct io_uring_buf *)buf_ring)->resv, buf_tail, __ATOMIC_RELEASE);
+        }
+
+        struct io_uring_sqe *get_sqe() {
+            unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+            if (local_sq_tail - head >= sq_entries) {
+                // Ring full: hand what we have to the kernel without waiting
+                int ret = sys_io_uring_enter(ring_fd, to_submit, 0, 0);
+                if (ret > 0) {
+                    to_submit -= (unsigned)ret < to_submit ? (unsigned)ret : to_submit;
+                }
+                head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+                if (local_sq_tail - head >= sq_entries) {
+                    return NULL;
+                }
+            }
+            unsigned index = local_sq_tail & sq_mask;
+            struct io_uring_sqe *sqe = &sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sq_array[index] = index;
+            local_sq_tail++;
+            __atomic_store_n(sq_tail, local_sq_tail, __ATOMIC_RELEASE);
+            to_submit++;
+            return sqe;
+        }
+
+        void arm_accept() {
+            struct io_uring_sqe *sqe = get_sqe();
+            if (sqe == NULL) {
+                return;
+            }
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->fd = listen_fd;
+            sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+            sqe->accept_flags = SOCK_CLOEXEC;
+            sqe->user_data = (uint64_t)(uintptr_t)this | URING_OP_ACCEPT;
+        }
+
+        void arm_poll() {
+            struct io_uring_sqe *sqe = get_sqe();
+            if (sqe == NULL) {
+                return;
+            }
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = loop.fd();
+            sqe->poll32_events = POLLIN;
+            sqe->user_data = (uint64_t)(uintptr_t)this | URING_OP_POLL;
+        }
+
+        bool arm_recv(UringConnection &conn) {
+            struct io_uring_sqe *sqe = get_sqe();
+            if (sqe == NULL) {
+                return false;
+            }
+            sqe->opcode = IORING_OP_RECV;
+            sqe->fd = conn.fd;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = URING_BUF_GROUP;
+            sqe->user_data = (uint64_t)(uintptr_t)&conn | URING_OP_RECV;
+            conn.refs++;
+            return true;
+        }
+
+        void arm_send(UringConnection &conn) {
+            struct io_uring_sqe *sqe = get_sqe();
+            if (sqe == NULL) {
+                close(conn);
+                return;
+            }
+            sqe->opcode = IORING_OP_SEND;
+            sqe->fd = conn.fd;
+            sqe->addr = (uint64_t)(uintptr_t)(conn.inflight_out.data() + conn.inflight_off);
+            sqe->len = conn.inflight_out.size() - conn.inflight_off;
+            sqe->msg_flags = MSG_NOSIGNAL;
+            sqe->user_data = (uint64_t)(uintptr_t)&conn | URING_OP_SEND;
+            conn.refs++;
+        }
+
+        void maybe_release(UringConnection &conn) {
+            if (conn.closed && conn.refs == 0 && !conn.dirty) {
+                ::close(conn.fd);
+                buffers.put(conn.pending_out);
+                buffers.put(conn.inflight_out);
+                pool.destroy(&conn);
+            }
+        }
+
+        void reap() {
+            bool buffers_returned = false;
+            unsigned head = *cq_head;
+            while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+                struct io_uring_cqe cqe = cqes[head & cq_mask];
+                head++;
+                // Release the slot before dispatching; handlers may queue more work
+                __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+                switch (cqe.user_data & URING_OP_MASK) {
+                    case URING_OP_ACCEPT:
+                        on_accept(cqe);
+                        break;
+                    case URING_OP_RECV:
+                        buffers_returned |= on_recv(cqe);
+                        break;
+                    case URING_OP_SEND:
+                        on_send(cqe);
+                        break;
+                    case URING_OP_POLL:
+                        loop.run_once(0);
+                        if (running) {
+                            arm_poll();
+                        }
+                        break;
+                }
+            }
+            if (buffers_returned) {
+                publish_buffers();
+            }
+        }
+
+        void on_accept(const struct io_uring_cqe &cqe) {
+            if (cqe.res >= 0) {
+                int fd = cqe.res;
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+                UringConnection *conn = pool.create();
+                buffers.take(conn->pending_out);
+                buffers.take(conn->inflight_out);
+                conn->fd = fd;
+                socklen_t len = sizeof(conn->peer);
+                getpeername(fd, (struct sockaddr *)&conn->peer, &len);
+                if (!handler.on_open(*conn)) {
+                    ::close(fd);
+                    pool.destroy(conn);
+                } else if (!arm_recv(*conn)) {
+                    handler.on_close(*conn);
+                    ::close(fd);
+                    pool.destroy(conn);
+                }
+            } else if (cqe.res != -EAGAIN && cqe.res != -ECONNABORTED && cqe.res != -EINTR) {
+                fprintf(stderr, "accept: %s\n", strerror(-cqe.res));
+            }
+            if (!(cqe.flags & IORING_CQE_F_MORE) && running) {
+                arm_accept();
+            }
+        }
+
+        bool on_recv(const struct io_uring_cqe &cqe) {
+            UringConnection &conn = *(UringConnection *)(uintptr_t)(cqe.user_data & ~URING_OP_MASK);
+            bool returned = false;
+            if (cqe.flags & IORING_CQE_F_BUFFER) {
+                unsigned bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+                if (cqe.res > 0 && !conn.closed) {
+                    handler.on_data(conn, buf_base + (size_t)bid * URING_BUF_SIZE, cqe.res);
+                }
+                recycle_buffer(bid);
+                returned = true;
+            }
+            if (cqe.res == 0 || (cqe.res < 0 && cqe.res != -ENOBUFS)) {
+                close(conn);
+            }
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                conn.refs--;
+                // The kernel stops a multishot recv when it runs out of buffers
+                if (!conn.closed && !arm_recv(conn)) {
+                    close(conn);
+                }
+            }
+            maybe_release(conn);
+            return returned;
+        }
+
+        void on_send(const struct io_uring_cqe &cqe) {
+            UringConnection &conn = *(UringConnection *)(uintptr_t)(cqe.user_data & ~URING_OP_MASK);
+            conn.refs--;
+            if (cqe.res < 0) {
+                close(conn);
+            } else if (!conn.closed) {
+                conn.inflight_off += cqe.res;
+                if (conn.inflight_off < conn.inflight_out.size()) {
+                    arm_send(conn);
+                } else {
+                    conn.inflight_out.clear();
+                    conn.inflight_off = 0;
+                    if (!conn.pending_out.empty() && !conn.dirty) {
+                        conn.dirty = true;
+                        dirty.push_back(&conn);
+                    }
+                }
+            }
+            maybe_release(conn);
+        }
+
+        ConnectionHandler &handler;
+        SlabPool<UringConnection> pool;
+        BufferShelf buffers;
+        Reactor loop;
+
+        int ring_fd;
+        void *ring_ptr;
+        size_t ring_size;
+        struct io_uring_sqe *sqes;
+        unsigned sq_entries;
+        unsigned *sq_head;
+        unsigned *sq_tail;
+        unsigned sq_mask;
+        unsigned *sq_array;
+        unsigned local_sq_tail;
+        unsigned *cq_head;
+        unsigned *cq_tail;
+        unsigned cq_mask;
+        struct io_uring_cqe *cqes;
+
+        struct io_uring_buf_ring *buf_ring;
+        char *buf_base;
+        unsigned short buf_tail;
+
+        int listen_fd;
+        unsigned to_submit;
+        std::atomic<bool> running;
+        std::vector<UringConnection *> dirty;
+};
+
+// io_uring when requested and the running kernel supports it, epoll otherwise
+inline IoBackend *create_backend(ConnectionHandler &handler, bool want_uring) {
+    if (want_uring) {
+        IoUringBackend *uring = new IoUringBackend(handler);
+        if (uring->init()) {
+            return uring;
+        }
+        fprintf(stderr, "io_uring unavailable (%s), falling back to epoll\n", strerror(errno));
+        delete uring;
+    }
+    return new EpollBackend(handler);
+}
@@ -0,0 +1,395 @@
+#pragma once
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Asynchronous console logging for the hub.
+//
+// HLOG_INFO("Temp recvd: %.2f", t) copies the format pointer and the raw arguments into a
+// ring owned by the calling thread and returns; nothing is formatted and no lock is taken.
+// A background thread drains every ring, formats the records printf-style and writes each
+// batch with one write(). A thread whose ring is full drops the record and counts it rather
+// than wait. Records from one thread come out in order; lines from different threads may
+// interleave differently than they were logged.
+//
+// The format must be a string literal (only its pointer is kept). Arguments may be integers,
+// floating point, C strings or std::string; strings are copied, up to HLOG_MAX_STRING bytes.
+//
+// Levels below HLOG_LEVEL compile to nothing; their arguments are type-checked but not
+// evaluated:
+//   g++ -DHLOG_LEVEL=HLOG_LEVEL_INFO ...     per-packet lines off
+//   g++ -DHLOG_LEVEL=HLOG_LEVEL_NONE ...     no logging at all
+#define HLOG_LEVEL_DEBUG 0
+#define HLOG_LEVEL_INFO 1
+#define HLOG_LEVEL_WARN 2
+#define HLOG_LEVEL_ERROR 3
+#define HLOG_LEVEL_NONE 4
+
+#ifndef HLOG_LEVEL
+#define HLOG_LEVEL HLOG_LEVEL_DEBUG
+#endif
+
+#define HLOG_RING_BYTES (1u << 20)     // per logging thread
+#define HLOG_MAX_STRING 255
+#define HLOG_IDLE_US 2000              // formatter sleep when every ring is empty
+
+// Stands in for a compiled-out call, inside sizeof only
+template <class... Args>
+inline int hlog_discard(const char *format, const Args &... args) { return 0; }
+
+#if HLOG_LEVEL <= HLOG_LEVEL_DEBUG
+#define HLOG_DEBUG(...) hub_logger().log(HLOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define HLOG_DEBUG(...) ((void)sizeof(hlog_discard(__VA_ARGS__)))
+#endif
+#if HLOG_LEVEL <= HLOG_LEVEL_INFO
+#define HLOG_INFO(...) hub_logger().log(HLOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define HLOG_INFO(...) ((void)sizeof(hlog_discard(__VA_ARGS__)))
+#endif
+#if HLOG_LEVEL <= HLOG_LEVEL_WARN
+#define HLOG_WARN(...) hub_logger().log(HLOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define HLOG_WARN(...) ((void)sizeof(hlog_discard(__VA_ARGS__)))
+#endif
+#if HLOG_LEVEL <= HLOG_LEVEL_ERROR
+#define HLOG_ERROR(...) hub_logger().log(HLOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define HLOG_ERROR(...) ((void)sizeof(hlog_discard(__VA_ARGS__)))
+#endif
+
+// Argument tags in a record
+#define HLOG_ARG_INT 'i'
+#define HLOG_ARG_UINT 'u'
+#define HLOG_ARG_DOUBLE 'd'
+#define HLOG_ARG_STRING 's'
+#define HLOG_PADDING 0xff
+
+struct LogEntryHeader{
+    uint32_t size;             // whole record, padded to 8 bytes
+    uint8_t level;             // HLOG_PADDING: filler up to the end of the ring
+    uint8_t nargs;
+    uint16_t reserved;
+    const char *format;
+};
+
+// Single-producer, single-consumer byte ring. Records never wrap: one that does not fit
+// before the end is preceded by a padding record and written at the start.
+class LogRing{
+    public:
+        std::atomic<uint64_t> dropped;
+
+        LogRing() : dropped(0), head(0), tail(0), reserved_to(0) {
+            buffer = new char[HLOG_RING_BYTES];
+        }
+        ~LogRing() { delete[] buffer; }
+
+        // Producer: space for size bytes (a multiple of 8), or NULL if the ring is full
+        char *reserve(uint32_t size) {
+            uint64_t pos = tail.load(std::memory_order_relaxed);
+            uint32_t offset = (uint32_t)(pos & (HLOG_RING_BYTES - 1));
+            uint32_t contiguous = HLOG_RING_BYTES - offset;
+            uint64_t need = contiguous < size ? (uint64_t)contiguous + size : size;
+            if (pos + need - head.load(std::memory_order_acquire) > HLOG_RING_BYTES) {
+                return NULL;
+            }
+            if (contiguous < size) {
+                LogEntryHeader *pad = (LogEntryHeader *)(buffer + offset);
+                pad->size = contiguous;
+                pad->level = HLOG_PADDING;
+                offset = 0;
+            }
+            reserved_to = pos + need;
+            return buffer + offset;
+        }
+
+        // Producer: publish the record reserve() returned
+        void commit() { tail.store(reserved_to, std::memory_order_release); }
+
+        // Consumer: hand every published record to on_record(const LogEntryHeader &)
+        template <class F>
+        size_t drain(F on_record) {
+            uint64_t pos = head.load(std::memory_order_relaxed);
+            uint64_t end = tail.load(std::memory_order_acquire);
+            size_t n = 0;
+            while (pos < end) {
+                const LogEntryHeader *entry = (const LogEntryHeader *)(buffer + (pos & (HLOG_RING_BYTES - 1)));
+                if (entry->level != HLOG_PADDING) {
+                    on_record(*entry);
+                    n++;
+                }
+                pos += entry->size;
+            }
+            head.store(pos, std::memory_order_release);
+            return n;
+        }
+
+    private:
+        char *buffer;
+        alignas(64) std::atomic<uint64_t> head;
+        alignas(64) std::atomic<uint64_t> tail;
+        uint64_t reserved_to;
+
+        LogRing(const LogRing &);
+        LogRing &operator=(const LogRing &);
+};
+
+class AsyncLogger{
+    public:
+        AsyncLogger() : fd(STDOUT_FILENO), running(false) {}
+        ~AsyncLogger() {
+            stop();
+            for (size_t i = 0; i < rings.size(); i++) {
+                delete rings[i];
+            }
+        }
+
+        // Start the formatter thread, writing to out_fd. Records logged before this wait.
+        void start(int out_fd = STDOUT_FILENO) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (running.load()) {
+                return;
+            }
+            fd = out_fd;
+            running.store(true);
+            formatter = std::thread(&AsyncLogger::format_loop, this);
+        }
+
+        // Write out everything logged so far and stop the formatter
+        void stop() {
+            if (!running.exchange(false)) {
+                return;
+            }
+            formatter.join();
+            flush_all();
+        }
+
+        // Records lost to full rings, all threads
+        uint64_t dropped() {
+            std::lock_guard<std::mutex> guard(lock);
+            uint64_t total = 0;
+            for (size_t i = 0; i < rings.size(); i++) {
+                total += rings[i]->dropped.load(std::memory_order_relaxed);
+            }
+            return total;
+        }
+
+        template <class... Args>
+        void log(int level, const char *format, const Args &... args) {
+            uint32_t size = (uint32_t)(sizeof(LogEntryHeader) + (0 + ... + arg_size(args)));
+            size = (size + 7) & ~7u;
+            LogRing &ring = thread_ring();
+            char *out = ring.reserve(size);
+            if (out == NULL) {
+                ring.dropped.store(ring.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return;
+            }
+            LogEntryHeader *entry = (LogEntryHeader *)out;
+            entry->size = size;
+            entry->level = (uint8_t)level;
+            entry->nargs = (uint8_t)sizeof...(args);
+            entry->format = format;
+            char *p = out + sizeof(LogEntryHeader);
+            (put_arg(p, args), ...);
+            (void)p;
+            ring.commit();
+        }
+
+    private:
+        template <class T>
+        static size_t arg_size(const T &value) {
+            static_assert(std::is_arithmetic<T>::value, "HLOG arguments are numbers or strings");
+            return 1 + 8;
+        }
+        static size_t arg_size(const char *value) { return 2 + string_len(value); }
+        static size_t arg_size(char *value) { return 2 + string_len(value); }
+        static size_t arg_size(const std::string &value) { return 2 + clamp_len(value.size()); }
+
+        // Not strnlen(): GCC warns when it can see a shorter literal behind the pointer
+        static size_t string_len(const char *value) {
+            if (value == NULL) {
+                return 6;
+            }
+            size_t len = 0;
+            while (len < HLOG_MAX_STRING && value[len] != '\0') {
+                len++;
+            }
+            return len;
+        }
+        static size_t clamp_len(size_t len) { return len < HLOG_MAX_STRING ? len : HLOG_MAX_STRING; }
+
+        template <class T>
+        static void put_arg(char *&p, const T &value) {
+            if (std::is_floating_point<T>::value) {
+                double v = (double)value;
+                *p++ = HLOG_ARG_DOUBLE;
+                memcpy(p, &v, 8);
+            } else if (std::is_signed<T>::value) {
+                int64_t v = (int64_t)value;
+                *p++ = HLOG_ARG_INT;
+                memcpy(p, &v, 8);
+            } else {
+                uint64_t v = (uint64_t)value;
+                *p++ = HLOG_ARG_UINT;
+                memcpy(p, &v, 8);
+            }
+            p += 8;
+        }
+        static void put_arg(char *&p, const char *value) {
+            put_string(p, value == NULL ? "(null)" : value, string_len(value));
+        }
+        static void put_arg(char *&p, char *value) { put_arg(p, (const char *)value); }
+        static void put_arg(char *&p, const std::string &value) {
+            put_string(p, value.data(), clamp_len(value.size()));
+        }
+        static void put_string(char *&p, const char *value, size_t len) {
+            *p++ = HLOG_ARG_STRING;
+            *p++ = (char)len;
+            memcpy(p, value, len);
+            p += len;
+        }
+
+        LogRing &thread_ring() {
+            static thread_local LogRing *ring = NULL;
+            if (ring == NULL) {
+                ring = new LogRing();
+                std::lock_guard<std::mutex> guard(lock);
+                rings.push_back(ring);
+            }
+            return *ring;
+        }
+
+        void format_loop() {
+            while (running.load()) {
+                if (flush_all() == 0) {
+                    usleep(HLOG_IDLE_US);
+                }
+            }
+        }
+
+        // Formatter thread, or the stopping thread once the formatter is gone
+        size_t flush_all() {
+            std::vector<LogRing *> current;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                current = rings;
+            }
+            size_t n = 0;
+            for (size_t i = 0; i < current.size(); i++) {
+                n += current[i]->drain([this](const LogEntryHeader &entry) { format(entry, text); });
+                if (text.size() > HLOG_RING_BYTES / 4) {
+                    write_text();
+                }
+            }
+            write_text();
+            return n;
+        }
+
+        void write_text() {
+            size_t done = 0;
+            while (done < text.size()) {
+                ssize_t n = write(fd, text.data() + done, text.size() - done);
+                if (n <= 0) {
+                    break;
+                }
+                done += n;
+            }
+            text.clear();
+        }
+
+        // printf semantics, one conversion per stored argument. Length modifiers in the
+        // format are ignored: integers are always formatted from 64 bits.
+        static void format(const LogEntryHeader &entry, std::string &out) {
+            const char *args = (const char *)(&entry + 1);
+            int remaining = entry.nargs;
+            const char *f = entry.format;
+            char spec[32];
+            char piece[512];
+            while (*f != '\0') {
+                if (*f != '%') {
+                    const char *next = strchr(f, '%');
+                    size_t len = next == NULL ? strlen(f) : (size_t)(next - f);
+                    out.append(f, len);
+                    f += len;
+                    continue;
+                }
+                if (f[1] == '%') {
+                    out += '%';
+                    f += 2;
+                    continue;
+                }
+                // Copy flags, width and precision; drop length modifiers
+                size_t s = 0;
+                spec[s++] = *f++;
+                while (*f != '\0' && strchr("-+ #0123456789.", *f) != NULL && s < sizeof(spec) - 4) {
+                    spec[s++] = *f++;
+                }
+                while (*f != '\0' && strchr("hlLqjzt", *f) != NULL) {
+                    f++;
+                }
+                char conversion = *f;
+                if (conversion == '\0') {
+                    break;
+                }
+                f++;
+                if (remaining == 0) {
+                    continue;
+                }
+                remaining--;
+                char tag = *args++;
+                if (tag == HLOG_ARG_STRING) {
+                    size_t len = (unsigned char)*args++;
+                    out.append(args, len);
+                    args += len;
+                    continue;
+                }
+                int64_t i;
+                double d;
+                memcpy(&i, args, 8);
+                memcpy(&d, args, 8);
+                args += 8;
+                if (strchr("eEfFgGaA", conversion) != NULL) {
+                    spec[s++] = conversion;
+                    spec[s] = '\0';
+                    snprintf(piece, sizeof(piece), spec, tag == HLOG_ARG_DOUBLE ? d : (double)i);
+                } else if (conversion == 'c') {
+                    spec[s++] = 'c';
+                    spec[s] = '\0';
+                    snprintf(piece, sizeof(piece), spec, (int)i);
+                } else if (tag == HLOG_ARG_DOUBLE) {
+                    spec[s++] = 'g';
+                    spec[s] = '\0';
+                    snprintf(piece, sizeof(piece), spec, d);
+                } else {
+                    spec[s++] = 'l';
+                    spec[s++] = 'l';
+                    spec[s++] = strchr("diouxX", conversion) != NULL ? conversion : (tag == HLOG_ARG_INT ? 'd' : 'u');
+                    spec[s] = '\0';
+                    snprintf(piece, sizeof(piece), spec, (long long)i);
+                }
+                out += piece;
+            }
+            out += '\n';
+        }
+
+        int fd;
+        std::atomic<bool> running;
+        std::mutex lock;
+        std::vector<LogRing *> rings;
+        std::string text;
+        std::thread formatter;
+};
+
+inline AsyncLogger &hub_logger() {
+    static AsyncLogger logger;
+    return logger;
+}
@@ -1,4 +1,4 @@
-#include <iostream>
+#include <string>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <unistd.h>
@@ -8,215 +8,1150 @@
 #include <netinet/tcp.h>
 #include <fcntl.h>
 #include <pthread.h> 
-#include <queue> 
+#include "io_backend.h"
+#include "io_uring_backend.h"
+#include "control_engine.h"
+#include "vent_registry.h"
+#include "telemetry_queue.h"
+#include "egress.h"
+#include "timeseries.h"
+#include "telemetry_log.h"
+#include "snapshot.h"
+#include "metrics.h"
+#include "logger.h"
+#include "sharding.h"
+#include "timer_wheel.h"
+#include "command_scheduler.h"
+#include "phone_gateway.h"
+#include "zones.h"
+#include "packet.h"
+#include <math.h>
+#include <deque>
 
-unsigned int vent_ID = 0;
+// Vents are keyed by their IPv4 address, so a vent keeps its registry slot and controller
+// state across reconnects and hub restarts. A second connection from an address whose vent
+// is still connected (vents behind NAT or a bridge, simulators and load tools) is a new
+// vent, with the next ID below VENT_ADDRESS_MIN; 0.0.0.0/8 is never a source address.
+// Where every vent has an address of its own, as on the hub's access point,
+// --one-vent-per-address instead lets a vent that reconnects before its old connection is
+// noticed as dead take over its slot, and the old connection is closed.
+#define VENT_ADDRESS_MIN (1u << 24)
+#define TAKEOVER_QUEUE_SIZE 1024
+std::atomic<unsigned int> vent_ID(1);
+bool one_vent_per_address = false;
 using namespace std;
 #define PORT 8080
 #define IP_ADDR "192.168.1.1"
 #define DATA_PACKET 0x1
 #define CONTROL_PACKET 0x2
-#define NUM_VENTS 10;
 #define DESIRED_TEMP 23.0
+#define CONTROL_TICK_MS 100
+#define HISTORY_DAYS 90             // unless a vent fills TSDB_VENT_MAX_BYTES sooner
+#define HISTORY_PRUNE_TICKS 36000   // hourly
+#define LOG_CHECKPOINT_TICKS 3000   // every 5 minutes
+#define LOG_KEEP_SEGMENTS 32        // 2 GB of log
+#define SNAPSHOT_TICKS 50           // every 5 seconds
+#define TIMER_TICK_MS 10
+#define VENT_SILENT_MS 15000        // vents report about once a second
+#define VENT_RECHECK_MS 5000        // then a silent vent is re-checked after ~5, 10, 20 s...
+#define VENT_RECHECK_MAX_MS 300000  // ...up to every 5 minutes
+#define COMMAND_MIN_GAP_MS 500      // per vent unless --command-gap, as the app paces send_vent_position
+#define HEARTBEAT_MS 30000          // re-send the cover to a vent that has had no command
+#define PHONE_SETUP_SLOTS 8         // setup requests waiting for a new vent to report
+#define PHONE_NAME_MAX 64
+#define PHONE_TEMPERATURE_STEP 0.1f // smallest change worth a temperature update to the phone
+#define ZONE_METRICS_TICKS 10       // zone aggregates copied out for /metrics every second
+#define ZONE_LINE_MAX 4096
 
-class Vent{
+VentRegistry vents;
+
+// Per-vent controller state; vent_num (the registry's dense index) indexes its columns.
+// Only the control thread touches engine: readings reach it through each reactor's
+// telemetry queue and cover commands go back through the reactor's egress.
+ControlEngine engine;
+int control_mode = CONTROL_PID;
+vector<uint32_t> changed_vents;
+
+// Telemetry history for tuning and the phone app, also owned by the control thread
+TimeSeriesStore history;
+unsigned long control_ticks = 0;
+
+// Durable record of readings and decisions, written by the control thread. Disabled with
+// --no-log or if the directory cannot be used.
+const char *log_dir = "hub_log";
+TelemetryLog telemetry_log;
+bool logging = true;
+vector<LogVentState> checkpoint_state;
+
+// Registry and controller image for warm restart, captured by the control thread and
+// written by the snapshot writer's thread. Disabled with --no-snapshot.
+const char *snapshot_path = "hub_snapshot.bin";
+SnapshotWriter snapshots;
+bool snapshotting = true;
+
+// Where time goes between a reading arriving and the command it causes leaving, served on
+// 127.0.0.1:METRICS_PORT for Prometheus. Disabled with --no-metrics.
+MetricsRegistry metrics;
+MetricHistogram &recv_to_decode = metrics.histogram("hub_recv_to_decode_seconds",
+    "Socket read to decoded reading, on the I/O thread");
+MetricHistogram &decode_to_control = metrics.histogram("hub_decode_to_control_seconds",
+    "Reading queued to applied by the control thread");
+MetricHistogram &control_to_send = metrics.histogram("hub_control_to_send_seconds",
+    "Control tick committing a command to the command handed to the socket");
+MetricHistogram &packet_to_command = metrics.histogram("hub_packet_to_command_seconds",
+    "Reading queued to the cover command it caused handed to the socket");
+MetricHistogram &control_tick_time = metrics.histogram("hub_control_tick_seconds",
+    "Time spent in one control tick");
+MetricCounter &packets_total = metrics.counter("hub_packets_total", "Vent readings decoded");
+MetricCounter &malformed_total = metrics.counter("hub_malformed_packets_total",
+    "Frames or packets that failed to decode");
+MetricCounter &commands_total = metrics.counter("hub_commands_sent_total", "Cover commands handed to the socket");
+MetricCounter &heartbeats_total = metrics.counter("hub_heartbeats_total", "Covers re-sent to vents with no recent command");
+std::atomic<uint64_t> silent_vents(0);  // control thread writes
+bool serve_metrics = true;
+std::atomic<uint64_t> committed_ns(0);   // last tick that committed commands
+uint64_t drain_ns = 0;                   // control thread, when the current drain started
+vector<uint64_t> reading_ns;             // control thread, per vent: when its latest reading was queued
+
+int overflow_policy = OVERFLOW_DROP_OLDEST_PER_VENT;
+Reactor control_loop;
+
+// Per-vent deadlines, all on one timer wheel driven by the control loop, so nothing is
+// polled: a reading pushes its vent's silence timeout back, a command pushes its heartbeat
+// back, and a command too soon after the previous one waits in the scheduler's mailbox.
+void vent_silent(uint32_t vent_num);
+void send_heartbeat(uint32_t vent_num);
+
+class VentTimer : public WheelTimer{
     public:
-        unsigned ID;
-        float temperature;
-        float desired_temperature;
-        unsigned cover;
-        bool user_forced;
-        // Default constructor
-        Vent() : ID(0), temperature(0.0f), desired_temperature(23.0f), cover(0), user_forced(false) {
+        uint32_t vent;
+        void (*fire)(uint32_t);
+
+        VentTimer(uint32_t vent, void (*fire)(uint32_t)) : vent(vent), fire(fire) {}
+        void on_timer(){ fire(vent); }
+};
+
+struct VentTimers{
+    VentTimer silence;          // re-armed by every reading
+    VentTimer heartbeat;        // re-armed by every command
+    Backoff recheck;            // how long to wait before looking at a silent vent again
+    bool silent;
+
+    VentTimers(uint32_t vent)
+        : silence(vent, vent_silent), heartbeat(vent, send_heartbeat),
+          recheck(VENT_RECHECK_MS, VENT_RECHECK_MAX_MS, vent + 1), silent(false) {}
+};
+
+// Control thread. A deque so growing it never moves a linked timer.
+LoopTimers timers;
+deque<VentTimers> vent_timers;
+
+VentTimers &timers_for(uint32_t vent_num){
+    while(vent_timers.size() <= vent_num){
+        vent_timers.emplace_back((uint32_t)vent_timers.size());
     }
+    return vent_timers[vent_num];
+}
+
+// Commands leave through the scheduler, which keeps --command-gap between two commands to
+// the same vent, and from there through the vent's reactor
+class HubScheduler : public CommandScheduler{
+    public:
+        HubScheduler() : CommandScheduler(timers, COMMAND_MIN_GAP_MS) {}
+        void dispatch(uint32_t vent_num, int cover);
+        void flush();
 };
 
-class Packet{
+HubScheduler scheduler;
+
+// The phone app's UDP protocol (phone_gateway.h), served on the control loop so a setpoint
+// or a held cover goes straight into the engine. Disabled with --no-phone.
+class HubPhone : public PhoneGateway{
     public:
-        int pkt_type;
-        float temperature;
-        int motor_pos;
+        HubPhone() : setup_head(0), setup_count(0) {}
+
+        void on_setup(const char *name, size_t len);
+        void on_setpoint(uint32_t vent_num, float celsius);
+        void on_position(uint32_t vent_num, float percent);
+        void on_zone_setpoint(const char *zone, size_t len, float celsius);
+        void on_malformed(uint32_t type, const char *value, size_t len);
+        void on_subscribe(const struct sockaddr_in &addr, const Subscriber *subscriber);
+
+        // A vent reported for the first time; it answers the oldest waiting setup request
+        void vent_added(uint32_t vent_num);
+
+    private:
+        char setup_names[PHONE_SETUP_SLOTS][PHONE_NAME_MAX];   // NUL-terminated, oldest at setup_head
+        unsigned setup_head;
+        unsigned setup_count;
 };
 
-int server_fd, new_socket, valread;
-struct sockaddr_in address;
-int opt = 1;
-int addrlen = sizeof(address);
-vector<int> client_sockets;
-pthread_t vent_recv_threads[10];
-Vent vent_arr[10];
-void *args[10];
-
-double Kp = 1.5;  // Proportional gain
-double Ki = 0.5; // Integral gain
-double Kd = 0.05; // Derivative gain
-
-double integral = 0;
-double previous_error = 0;
-
-int update_cover(int curr_temp, int desired_temp){
-    double error = desired_temp - curr_temp;
-    
-    // Proportional term
-    double proportional = Kp * error;
-    
-    // Integral term
-    integral += error;
-    double integral_term = Ki * integral;
-    
-    // Derivative term
-    double derivative = Kd * (error - previous_error);
-    previous_error = error;
-    
-    // Calculate PID output
-    double output = proportional + integral_term + derivative;
-    
-    // Limit the output to the range [0, 10]
-    if (output > 10) {
-        output = 10;
-    } else if (output < 0) {
-        output = 0;
-    }
-    
-    return output;
-}
-
-
-bool parse_packet(char *recv_buffer, Packet &data) {
-    if(recv_buffer == NULL){
-        cout << "Buffer is NULL" << endl;
-        return false;
+HubPhone phone;
+bool serve_phone = true;
+vector<float> phone_temperature;         // control thread, per vent: last temperature sent to the phone
+
+// Rooms and floors from --zones, each with running aggregates over its vents (zones.h).
+// Vents the layout leaves out count towards the house only. Owned by the control thread;
+// the metrics thread gets a copy every ZONE_METRICS_TICKS.
+const char *zones_path = NULL;
+ZoneTree zones;
+vector<uint32_t> zone_vents;
+
+struct ZoneReport{
+    string label;
+    ZoneStats stats;
+};
+
+std::mutex zone_report_lock;
+vector<ZoneReport> zone_report;          // under zone_report_lock
+vector<ZoneReport> zone_staging;         // control thread
+
+void handle_packet(TelemetryQueue &telemetry, Connection &conn, const char *payload, size_t len, uint64_t recv_ns){
+    HLOG_DEBUG("Received: %zu", len);
+    Packet data;
+    if(!parse_packet(payload, len, data)){
+        HLOG_WARN("Packet parsing error");
+        malformed_total.add();
+        return;
+    }
+    HLOG_DEBUG("pkt type: %d", data.pkt_type);
+    if(data.pkt_type != DATA_PACKET){
+        HLOG_WARN("Not a data packet");
+        return;
     }
 
-    //Need to do error checking here
-    data.pkt_type = *recv_buffer;
-    recv_buffer += sizeof(int);
-    data.temperature = *((float *)recv_buffer);
+    HLOG_DEBUG("Temp recvd: %g", data.temperature);
 
-    return true;
+    Vent &vent = vents.at(conn.vent_num);
+    vent.temperature.store(data.temperature, memory_order_relaxed);
+    metrics_bump(vent.packets, 1);
+    packets_total.add();
+    recv_to_decode.record(telemetry_clock_ns() - recv_ns);
+
+    // The control thread picks the reading up on its next tick
+    telemetry.publish(vent, data.temperature);
+}
+
+// Commands for a whole tick leave together, one write per vent socket. Each reactor has its
+// own, and only sends to connections that reactor owns.
+class HubEgress : public CommandEgress{
+    public:
+        HubEgress(VentRegistry &registry, vector<Connection *> &conns)
+            : CommandEgress(registry), conns(conns), sending_ns(0) {}
+
+        Connection *connection(uint32_t index){
+            return index < conns.size() ? conns[index] : NULL;
+        }
+
+        void on_ring(){
+            sending_ns = telemetry_clock_ns();
+            CommandEgress::on_ring();
+        }
+
+        size_t encode(Vent &vent, int motor_pos, char *out){
+            Packet command;
+            command.pkt_type = CONTROL_PACKET;
+            // The setpoint the new position works towards
+            command.temperature = vent.desired_temperature.load(memory_order_relaxed);
+            command.motor_pos = motor_pos;
+            return encode_frame(out, &command, sizeof(command));
+        }
+
+        void on_sent(Vent &vent, int motor_pos, size_t bytes){
+            HLOG_DEBUG("Send: %zuMotor position: %d", bytes, motor_pos);
+            if(bytes > 0){
+                commands_total.add();
+                control_to_send.record(sending_ns - committed_ns.load(memory_order_relaxed));
+                packet_to_command.record(sending_ns - vent.reading_ns.load(memory_order_relaxed));
+            }
+        }
+
+    private:
+        vector<Connection *> &conns;
+        uint64_t sending_ns;
+};
+
+class HubHandler;
+
+// Vents that reconnected through another reactor, queued for the reactor that still holds
+// their old connection so it can close it on its own thread
+class TakeoverBell : public Doorbell{
+    public:
+        TakeoverBell(HubHandler &shard) : shard(shard), queue(TAKEOVER_QUEUE_SIZE) {}
+
+        // Any thread
+        void post(uint32_t vent_num){
+            while(!queue.try_push(vent_num)){
+                ring();
+                sched_yield();
+            }
+            ring();
+        }
+
+        void on_ring();
+
+    private:
+        HubHandler &shard;
+        MpscQueue<uint32_t> queue;
+};
+
+// A vent's connected flag and owning reactor change together under this, so an old
+// connection closing late cannot mark a vent that has moved on as disconnected
+std::mutex vent_owner_lock;
+
+// One reactor: its listening socket, backend, the vents connected to it, and its ends of the
+// telemetry and command queues. Everything here is touched only by the reactor's thread,
+// except the queues' other ends on the control thread.
+class HubHandler : public ConnectionHandler{
+    public:
+        int index;
+        int cpu;                        // -1 when not pinned
+        int listen_fd;
+        IoBackend *backend;
+        TelemetryQueue telemetry;
+        vector<Connection *> conns;     // by vent index
+        HubEgress egress;
+        TakeoverBell takeovers;
+        pthread_t thread;
+        std::atomic<uint64_t> accepted; // written by this reactor only
+        std::atomic<uint64_t> packets;
+
+        HubHandler(int index, int cpu)
+            : index(index), cpu(cpu), listen_fd(-1), backend(NULL),
+              telemetry(vents, overflow_policy), egress(vents, conns), takeovers(*this),
+              accepted(0), packets(0) {}
+
+        bool on_open(Connection &conn);
+        void on_data(Connection &conn, const char *buffer, size_t len);
+        void on_close(Connection &conn);
+        void close_stale(uint32_t vent_num);
+};
+
+vector<HubHandler *> shards;
+
+// Control thread. Vents are registered on the I/O thread, so the engine catches up with the
+// registry the first time the control thread hears of a vent.
+void engine_catch_up(uint32_t vent_num){
+    while(engine.size() <= vent_num){
+        uint32_t index = engine.add_vent(vents.at(engine.size()).desired_temperature.load(), control_mode);
+        zones.ensure(index);
+        zones.set_desired(index, engine.get_desired(index));
+    }
+}
+
+void apply_reading(const TelemetryEvent &event){
+    bool added = event.vent >= engine.size();
+    engine_catch_up(event.vent);
+    if(added){
+        phone.vent_added(event.vent);
+    }
+    if(vents.at(event.vent).user_forced.load(memory_order_relaxed)){
+        engine.observe(event.vent, event.temperature);
+    } else {
+        engine.set_temperature(event.vent, event.temperature);
+    }
+    zones.set_temperature(event.vent, event.temperature);
+    if(reading_ns.size() <= event.vent){
+        reading_ns.resize(engine.size(), 0);
+    }
+    reading_ns[event.vent] = event.enqueued_ns;
+    decode_to_control.record(drain_ns - event.enqueued_ns);
+    VentTimers &vent_timer = timers_for(event.vent);
+    timers.schedule(vent_timer.silence, VENT_SILENT_MS);
+    if(!vent_timer.heartbeat.armed()){
+        timers.schedule(vent_timer.heartbeat, HEARTBEAT_MS);
+    }
+    if(vent_timer.silent){
+        vent_timer.silent = false;
+        vent_timer.recheck.reset();
+        silent_vents.store(silent_vents.load(memory_order_relaxed) - 1, memory_order_relaxed);
+        HLOG_INFO("Vent %u reporting again", event.vent);
+    }
+    history.append(event.vent, time(NULL), event.temperature, engine.get_cover(event.vent));
+    if(phone.interested(event.vent)){
+        if(phone_temperature.size() <= event.vent){
+            phone_temperature.resize(engine.size(), NAN);
+        }
+        // NAN until the first update, which never compares as close
+        if(!(fabsf(event.temperature - phone_temperature[event.vent]) < PHONE_TEMPERATURE_STEP)){
+            phone_temperature[event.vent] = event.temperature;
+            phone.publish(event.vent, PHONE_TYPE_TEMPERATURE, "%u.%.1f", event.vent, event.temperature);
+        }
+    }
+    if(logging){
+        LogTelemetry record = {event.vent, event.temperature};
+        telemetry_log.append(LOG_TELEMETRY, &record, sizeof(record));
+    }
+}
+
+// Everything the controller knows per vent, so replay can start here
+void write_checkpoint(){
+    checkpoint_state.resize(engine.size());
+    for(uint32_t i = 0; i < engine.size(); i++){
+        checkpoint_state[i].temperature = engine.get_temperature(i);
+        checkpoint_state[i].desired_temperature = engine.get_desired(i);
+        checkpoint_state[i].cover = engine.get_cover(i);
+    }
+    telemetry_log.checkpoint(checkpoint_state.data(), (uint32_t)(checkpoint_state.size() * sizeof(LogVentState)));
+}
+
+// Startup: rebuild recent history from the log, starting at its newest checkpoint
+void replay_log(){
+    vector<int> covers;
+    uint64_t start = telemetry_clock_ns();
+    bool ok = telemetry_log.open(log_dir, [&covers](const LogRecord &record){
+        if(record.type == LOG_CHECKPOINT){
+            const LogVentState *state = (const LogVentState *)record.payload;
+            covers.resize(record.len / sizeof(LogVentState));
+            for(size_t i = 0; i < covers.size(); i++){
+                covers[i] = state[i].cover;
+            }
+        } else if(record.type == LOG_COMMAND && record.len >= sizeof(LogCommand)){
+            LogCommand command;
+            memcpy(&command, record.payload, sizeof(command));
+            if(command.vent >= covers.size()){
+                covers.resize(command.vent + 1, COVER_MIN);
+            }
+            covers[command.vent] = command.cover;
+        } else if(record.type == LOG_TELEMETRY && record.len >= sizeof(LogTelemetry)){
+            LogTelemetry reading;
+            memcpy(&reading, record.payload, sizeof(reading));
+            int cover = reading.vent < covers.size() ? covers[reading.vent] : COVER_MIN;
+            history.append(reading.vent, record.time_ns / 1000000000ull, reading.temperature, cover);
+        }
+    });
+    if(!ok){
+        HLOG_WARN("Telemetry log unavailable in %s, running without it", log_dir);
+        logging = false;
+        return;
+    }
+    telemetry_log.set_retention(LOG_KEEP_SEGMENTS);
+    HLOG_INFO("Telemetry log replayed %llu records in %g ms", telemetry_log.records_replayed,
+              (telemetry_clock_ns() - start) / 1000000.0);
+}
+
+// Startup: bring back every vent's setpoint, cover and PID memory from the last snapshot
+void restore_snapshot(){
+    uint64_t start = telemetry_clock_ns();
+    SnapshotImage image;
+    if(!image.open(snapshot_path)){
+        HLOG_INFO("No usable snapshot at %s, starting cold", snapshot_path);
+        return;
+    }
+    uint32_t restored = snapshot_restore(image, vents, engine, control_mode);
+    for(uint32_t i = 0; i < restored; i++){
+        unsigned int id = vents.at(i).ID;
+        if(id < VENT_ADDRESS_MIN && id >= vent_ID){
+            vent_ID = id + 1;
+        }
+    }
+    HLOG_INFO("Restored %u vents from snapshot in %g ms", restored, (telemetry_clock_ns() - start) / 1000000.0);
+}
+
+// Skipped while the previous snapshot is still being written
+void write_snapshot(){
+    if(snapshots.busy()){
+        snapshots.skipped.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+    snapshot_capture(vents, engine, snapshots.staging());
+    snapshots.publish();
+}
+
+// Runs every CONTROL_TICK_MS on the control thread: one batched controller pass over every
+// vent that reported since the last tick, then a command to each vent whose cover position
+// moved
+void drain_telemetry(){
+    drain_ns = telemetry_clock_ns();
+    timers.sync();
+    for(size_t s = 0; s < shards.size(); s++){
+        shards[s]->telemetry.drain(apply_reading);
+    }
+}
+
+// Control thread: hand a cover to the vent's reactor; the next commit() sends it
+void HubScheduler::dispatch(uint32_t vent_num, int cover){
+    Vent &vent = vents.at(vent_num);
+    vent.reading_ns.store(vent_num < reading_ns.size() ? reading_ns[vent_num] : drain_ns, memory_order_relaxed);
+    shards[vent.shard.load(memory_order_relaxed)]->egress.post(vent, cover);
+    if(logging){
+        LogCommand record = {vent_num, cover};
+        telemetry_log.append(LOG_COMMAND, &record, sizeof(record));
+    }
+    timers.schedule(timers_for(vent_num).heartbeat, HEARTBEAT_MS);
+    zones.set_open(vent_num, (float)(cover - COVER_MIN) / (COVER_MAX - COVER_MIN));
+    phone.publish(vent_num, PHONE_TYPE_POSITION, "%u.motor%.1f", vent_num,
+                  100.0f * (cover - COVER_MIN) / (COVER_MAX - COVER_MIN));
+}
+
+// Between ticks: a mailbox whose gap ran out, or a heartbeat
+void HubScheduler::flush(){
+    committed_ns.store(telemetry_clock_ns(), memory_order_relaxed);
+    for(size_t s = 0; s < shards.size(); s++){
+        shards[s]->egress.commit();
+    }
+    phone.flush();
+}
+
+// A connected vent that has gone HEARTBEAT_MS without a command gets its cover again, so a
+// lost command is repaired and the vent knows the hub is alive. Not re-armed while the vent
+// is away; its next reading arms it.
+void send_heartbeat(uint32_t vent_num){
+    if(!vents.at(vent_num).connected.load(memory_order_relaxed) || scheduler.waiting(vent_num)){
+        return;
+    }
+    heartbeats_total.add();
+    if(scheduler.submit(vent_num, engine.get_cover(vent_num))){
+        scheduler.flush();
+    }
+}
+
+// No reading for VENT_SILENT_MS, then again after each backoff interval until one arrives
+void vent_silent(uint32_t vent_num){
+    VentTimers &vent_timer = vent_timers[vent_num];
+    bool connected = vents.at(vent_num).connected.load(memory_order_relaxed);
+    if(!vent_timer.silent){
+        vent_timer.silent = true;
+        // Its last reading no longer speaks for the room
+        zones.forget_temperature(vent_num);
+        silent_vents.store(silent_vents.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        HLOG_WARN("Vent %u silent for %d s (%s)", vent_num, VENT_SILENT_MS / 1000,
+                  connected ? "connected" : "disconnected");
+    } else {
+        HLOG_INFO("Vent %u still silent, check %u (%s)", vent_num, vent_timer.recheck.attempts,
+                  connected ? "connected" : "disconnected");
+    }
+    timers.schedule(vent_timer.silence, vent_timer.recheck.next_ms());
+}
+
+// Control thread, from the phone gateway. Setup requests wait in a small ring until a new
+// vent reports; if more arrive than fit, the oldest is dropped.
+void HubPhone::on_setup(const char *name, size_t len){
+    if(len >= PHONE_NAME_MAX){
+        len = PHONE_NAME_MAX - 1;
+    }
+    if(setup_count == PHONE_SETUP_SLOTS){
+        HLOG_WARN("Phone setup queue full, dropping %s", setup_names[setup_head]);
+        setup_head = (setup_head + 1) % PHONE_SETUP_SLOTS;
+        setup_count--;
+    }
+    unsigned slot = (setup_head + setup_count) % PHONE_SETUP_SLOTS;
+    memcpy(setup_names[slot], name, len);
+    setup_names[slot][len] = '\0';
+    setup_count++;
+    HLOG_INFO("Phone asked to set up %s", setup_names[slot]);
+}
+
+void HubPhone::vent_added(uint32_t vent_num){
+    if(setup_count == 0){
+        return;
+    }
+    // Through the registry, which indexes the name and serialises with reactors adding vents
+    const char *name = setup_names[setup_head];
+    if(vents.set_name(vents.at(vent_num), name)){
+        HLOG_INFO("Vent %u set up as %s", vent_num, name);
+    } else {
+        HLOG_WARN("Vent %u already named, not renaming it %s", vent_num, name);
+    }
+    setup_head = (setup_head + 1) % PHONE_SETUP_SLOTS;
+    setup_count--;
+    publish(vent_num, PHONE_TYPE_SETUP, "%u", vent_num);
+}
+
+// A new setpoint also hands a held cover back to the controller. A vent that has reported
+// is evaluated again on the next tick rather than its next reading. The zones are left to
+// the caller.
+void set_vent_setpoint(uint32_t vent_num, float celsius){
+    engine_catch_up(vent_num);
+    Vent &vent = vents.at(vent_num);
+    vent.desired_temperature.store(celsius, memory_order_relaxed);
+    vent.user_forced.store(false, memory_order_relaxed);
+    engine.set_desired(vent_num, celsius);
+    if(vent_num < reading_ns.size() && reading_ns[vent_num] != 0){
+        engine.set_temperature(vent_num, engine.get_temperature(vent_num));
+    }
+}
+
+void HubPhone::on_setpoint(uint32_t vent_num, float celsius){
+    if(vent_num >= vents.size()){
+        HLOG_WARN("Phone setpoint for unknown vent %u", vent_num);
+        return;
+    }
+    set_vent_setpoint(vent_num, celsius);
+    zones.set_desired(vent_num, celsius);
+    HLOG_INFO("Phone set vent %u to %.1f C", vent_num, celsius);
 }
 
-void* recv_packets(void *args){
-    
-    int sockfd = *(int *)args;
-    unsigned int vent_num = *(unsigned int*)((char *)args + sizeof(int));
+// Every vent in the zone, however deep. Vents the layout names that have never connected
+// keep the zone's setpoint in the zones only, and start from their own when they appear.
+void HubPhone::on_zone_setpoint(const char *name, size_t len, float celsius){
+    string path(name, len);
+    uint32_t zone = zones.find(path.c_str());
+    if(zone == ZONE_NONE){
+        HLOG_WARN("Phone setpoint for unknown zone %s", path.c_str());
+        return;
+    }
+    zone_vents.clear();
+    zones.set_setpoint(zone, celsius, zone_vents);
+    for(size_t i = 0; i < zone_vents.size(); i++){
+        if(zone_vents[i] < vents.size()){
+            set_vent_setpoint(zone_vents[i], celsius);
+        }
+    }
+    HLOG_INFO("Phone set zone %s (%zu vents) to %.1f C", zone == ZONE_HOUSE ? zones.name(zone).c_str() : path.c_str(),
+              zone_vents.size(), celsius);
+}
 
-    char buffer[1024];
-    while(1){
+// The app sends a percentage; the vent holds the nearest cover position until the next
+// setpoint. The controller's memory is dropped so it starts clean when it takes over again.
+void HubPhone::on_position(uint32_t vent_num, float percent){
+    if(vent_num >= vents.size()){
+        HLOG_WARN("Phone position for unknown vent %u", vent_num);
+        return;
+    }
+    engine_catch_up(vent_num);
+    percent = percent < 0.0f ? 0.0f : (percent > 100.0f ? 100.0f : percent);
+    int cover = COVER_MIN + (int)(percent * (COVER_MAX - COVER_MIN) / 100.0f + 0.5f);
+    vents.at(vent_num).user_forced.store(true, memory_order_relaxed);
+    engine.reset(vent_num);
+    engine.set_cover(vent_num, cover);
+    HLOG_INFO("Phone holding vent %u at %d", vent_num, cover);
+    timers.sync();
+    if(scheduler.submit(vent_num, cover)){
+        scheduler.flush();
+    }
+}
+
+void HubPhone::on_malformed(uint32_t type, const char *value, size_t len){
+    HLOG_WARN("Malformed phone packet, type %u, %zu bytes", type, len);
+}
+
+void HubPhone::on_subscribe(const struct sockaddr_in &addr, const Subscriber *subscriber){
+    if(subscriber == NULL){
+        HLOG_INFO("Phone %s unsubscribed", inet_ntoa(addr.sin_addr));
+    } else if(subscriber->all){
+        HLOG_INFO("Phone %s subscribed to every vent at %u/s", inet_ntoa(addr.sin_addr), subscriber->rate);
+    } else {
+        HLOG_INFO("Phone %s subscribed to %zu vents at %u/s", inet_ntoa(addr.sin_addr), subscriber->vents.size(),
+                  subscriber->rate);
+    }
+}
 
-        // Receive data from the client
-        // cout << "Waiting to recieve data..." << endl;
-        valread = recv(sockfd, buffer, 1024, 0);
-        if (valread == 0) {
+// Startup, after the snapshot: "<path> <vent>[:<area>] ..." per line, e.g.
+//   Upstairs/Bedroom 3 4 7:0.5
+// with vents numbered as the phone sees them and '#' starting a comment. Every vent the
+// engine already knows joins the zones either way.
+bool load_zones(const char *path){
+    FILE *file = fopen(path, "r");
+    if(file == NULL){
+        return false;
+    }
+    char line[ZONE_LINE_MAX];
+    unsigned lineno = 0, placed = 0;
+    bool ok = true;
+    while(fgets(line, sizeof(line), file) != NULL){
+        lineno++;
+        char *comment = strchr(line, '#');
+        if(comment != NULL){
+            *comment = '\0';
+        }
+        char *save = NULL;
+        char *name = strtok_r(line, " \t\r\n", &save);
+        if(name == NULL){
             continue;
-        } else if (valread < 0) {
-            perror("recv failed");
-        } else {
-            std::cout << "Received: " << valread << std::endl;
-            Packet data;
-            if(!parse_packet(buffer, data)){
-                cout << "Packet parsing error" << endl;
-                continue;
+        }
+        uint32_t zone = zones.find(name, true);
+        for(char *token = strtok_r(NULL, " \t\r\n", &save); token != NULL; token = strtok_r(NULL, " \t\r\n", &save)){
+            char *end;
+            unsigned long vent_num = strtoul(token, &end, 10);
+            float area = ZONE_DEFAULT_AREA;
+            if(*end == ':'){
+                area = strtof(end + 1, &end);
             }
-            cout << "pkt type: " << (int)data.pkt_type << endl;
-            if(data.pkt_type != DATA_PACKET){
-                cout << "Not a data packet" << endl;
+            if(end == token || *end != '\0' || vent_num >= VENT_REGISTRY_MAX || !(area > 0.0f)){
+                HLOG_WARN("%s:%u: bad vent %s", path, lineno, token);
+                ok = false;
                 continue;
             }
+            zones.assign((uint32_t)vent_num, zone, area);
+            placed++;
+        }
+    }
+    fclose(file);
+    HLOG_INFO("Zones: %zu from %s, %u vents placed", zones.size() - 1, path, placed);
+    return ok;
+}
 
-            cout << "Temp recvd: " << data.temperature << endl;
-
-            vent_arr[vent_num].temperature = data.temperature;
-            
-            int new_cover = update_cover(data.temperature, DESIRED_TEMP);
+void sync_zones(){
+    for(uint32_t i = 0; i < engine.size(); i++){
+        zones.ensure(i);
+        zones.set_desired(i, engine.get_desired(i));
+        zones.set_open(i, (float)(engine.get_cover(i) - COVER_MIN) / (COVER_MAX - COVER_MIN));
+    }
+}
 
-            if(new_cover != vent_arr[vent_num].cover){
-                //send packet back
-                vent_arr[vent_num].cover = new_cover;
-                Packet command;
-                command.pkt_type = 0x2;
-                command.motor_pos = new_cover;
-                cout << "Send: " << send(sockfd, &command, sizeof(command), 0) << "Motor position: " << command.motor_pos << endl;
+// Control thread: every zone's aggregates, handed to the metrics thread in one swap
+void publish_zones(){
+    zone_staging.resize(zones.size());
+    for(uint32_t z = 0; z < zones.size(); z++){
+        if(zone_staging[z].label.empty()){
+            string label = z == ZONE_HOUSE ? zones.name(z) : zones.path(z);
+            for(size_t i = 0; i < label.size(); i++){
+                if(label[i] == '"' || label[i] == '\\'){
+                    zone_staging[z].label += '\\';
+                }
+                zone_staging[z].label += label[i];
             }
         }
+        zone_staging[z].stats = zones.read(z);
+    }
+    lock_guard<mutex> guard(zone_report_lock);
+    zone_report.swap(zone_staging);
+    zone_staging.resize(zone_report.size());
+    for(size_t z = 0; z < zone_report.size(); z++){
+        zone_staging[z].label = zone_report[z].label;
     }
-    return NULL;
 }
 
-void* connection_setup(void *args){
-    while(1){
-        //check for setup connections
-        cout << "Waiting for new connection..." << endl;
-        if ((new_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t*)&addrlen)) < 0) {
-            perror("accept");
-            exit(EXIT_FAILURE);
+void control_tick(){
+    uint64_t start = telemetry_clock_ns();
+    drain_telemetry();
+    changed_vents.clear();
+    engine.tick(changed_vents);
+    for(size_t i = 0; i < changed_vents.size(); i++){
+        scheduler.submit(changed_vents[i], engine.get_cover(changed_vents[i]));
+    }
+    if(!changed_vents.empty()){
+        committed_ns.store(telemetry_clock_ns(), memory_order_relaxed);
+    }
+    for(size_t s = 0; s < shards.size(); s++){
+        shards[s]->egress.commit();
+    }
+    // The tick's temperature and cover updates to the phone, in one batch
+    phone.flush();
+
+    // One group commit per tick
+    if(logging){
+        if(control_ticks % LOG_CHECKPOINT_TICKS == 0){
+            write_checkpoint();
         }
+        telemetry_log.commit();
+    }
 
-        // Add the new socket to our list of client sockets
-        client_sockets.push_back(new_socket);
+    if(snapshotting && control_ticks % SNAPSHOT_TICKS == SNAPSHOT_TICKS - 1){
+        write_snapshot();
+    }
 
-        // Print IP and Port of the connected client
-        std::cout << "New connection from " << inet_ntoa(address.sin_addr) << ":" << ntohs(address.sin_port) << std::endl;
+    if(serve_metrics && control_ticks % ZONE_METRICS_TICKS == 0){
+        publish_zones();
+    }
 
-        // Add the new socket to our list of client sockets
-        client_sockets.push_back(new_socket);
+    if(++control_ticks % HISTORY_PRUNE_TICKS == 0){
+        history.drop_before(time(NULL) - HISTORY_DAYS * 86400L);
+    }
+    control_tick_time.record(telemetry_clock_ns() - start);
+}
 
-        // Print IP and Port of the connected client
-        std::cout << "New connection from " << inet_ntoa(address.sin_addr) << ":" << ntohs(address.sin_port) << std::endl;
-        
-        std::unique_ptr<int> valuePtr(new int(15));
-        void * args = malloc(sizeof(new_socket) + sizeof(vent_ID));
-        memcpy(args, &new_socket, sizeof(int));
-        memcpy((char *)args + sizeof(int), &vent_ID, sizeof(int));
+class ControlTimer : public PeriodicTimer{
+    public:
+        void on_tick(){ control_tick(); }
+};
 
-        pthread_create(&vent_recv_threads[vent_ID], NULL, recv_packets, args);
+// Rung by an I/O thread blocked on a full telemetry queue (OVERFLOW_BLOCK)
+class IngestDoorbell : public Doorbell{
+    public:
+        void on_ring(){ drain_telemetry(); }
+};
 
-        vent_ID++;
+// SIGINT or SIGTERM, read on the control thread: stopping the first reactor returns main()
+// from its loop into the shutdown below, which stops everything else and flushes to disk
+class ShutdownSignals : public SignalWatcher{
+    public:
+        void on_signal(int signo){
+            HLOG_INFO("%s, shutting down", strsignal(signo));
+            shards[0]->backend->stop();
+        }
+};
 
-        // free(args);
-        // pthread_join(vent_recv_threads[vent_ID], NULL);
+void *control_thread(void *arg){
+    control_loop.run();
+    return NULL;
+}
 
-        //TODO: Collect this socket
+void *reactor_thread(void *arg){
+    HubHandler *shard = (HubHandler *)arg;
+    if(shard->cpu >= 0){
+        pin_to_cpu(shard->cpu);
     }
+    shard->backend->run();
     return NULL;
 }
 
-int main(void){
-    pthread_t setup_thread;
-    pthread_t consumer_thread;
-    // Creating socket file descriptor
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-        perror("socket failed");
-        exit(EXIT_FAILURE);
+// Sums of a per-reactor value, for metrics
+template <class F>
+double sum_shards(F value){
+    double total = 0;
+    for(size_t s = 0; s < shards.size(); s++){
+        total += (double)value(*shards[s]);
     }
+    return total;
+}
 
-    // Forcefully attaching socket to the port 8080
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
-        perror("setsockopt");
-        exit(EXIT_FAILURE);
+// A counter kept elsewhere, read when scraped
+void external_counter(const char *name, const char *help, double (*read)()){
+    string series = name;
+    metrics.family(name, help, "counter", [series, read](string &out){
+        char line[64];
+        snprintf(line, sizeof(line), " %.0f\n", read());
+        out += series + line;
+    });
+}
+
+// One series per zone from the control thread's last copy; zones with nothing reporting
+// are left out rather than exported as NaN
+void zone_gauge(const char *name, const char *help, float (*read)(const ZoneStats &)){
+    string series = name;
+    metrics.family(name, help, "gauge", [series, read](string &out){
+        char value[32];
+        lock_guard<mutex> guard(zone_report_lock);
+        for(size_t z = 0; z < zone_report.size(); z++){
+            float v = read(zone_report[z].stats);
+            if(v == v){
+                snprintf(value, sizeof(value), "\"} %g\n", v);
+                out += series + "{zone=\"" + zone_report[z].label + value;
+            }
+        }
+    });
+}
+
+// Values that already live elsewhere, read when scraped
+void register_queue_metrics(){
+    metrics.gauge("hub_telemetry_queue_depth", "Readings waiting for the control thread",
+                  [](){ return sum_shards([](HubHandler &s){ return s.telemetry.size(); }); });
+    metrics.gauge("hub_egress_queue_depth", "Vents with a command waiting for an I/O thread",
+                  [](){ return sum_shards([](HubHandler &s){ return s.egress.pending(); }); });
+    metrics.gauge("hub_connections_open", "Vent sockets open",
+                  [](){ return sum_shards([](HubHandler &s){ return s.backend->connections_open(); }); });
+    metrics.gauge("hub_connection_slots", "Connection objects allocated, open or pooled for reuse",
+                  [](){ return sum_shards([](HubHandler &s){ return s.backend->connection_slots(); }); });
+    external_counter("hub_telemetry_dropped_total", "Readings lost to a full telemetry queue",
+                     [](){ return sum_shards([](HubHandler &s){ return s.telemetry.dropped.load(); }); });
+    external_counter("hub_telemetry_superseded_total", "Readings replaced by a newer one before the control thread ran",
+                     [](){ return sum_shards([](HubHandler &s){ return s.telemetry.superseded.load(); }); });
+    external_counter("hub_commands_coalesced_total", "Commands replaced by a newer one before sending",
+                     [](){ return sum_shards([](HubHandler &s){ return s.egress.coalesced.load(); }); });
+    external_counter("hub_commands_held_total", "Commands that waited out the minimum gap to their vent",
+                     [](){ return (double)scheduler.held.load(memory_order_relaxed); });
+    external_counter("hub_commands_superseded_total", "Commands replaced by a newer cover while waiting out the gap",
+                     [](){ return (double)scheduler.superseded.load(memory_order_relaxed); });
+    external_counter("hub_log_dropped_total", "Log lines lost to a full logging ring",
+                     [](){ return (double)hub_logger().dropped(); });
+    external_counter("hub_phone_packets_total", "Datagrams received from the phone app",
+                     [](){ return (double)phone.received.load(memory_order_relaxed); });
+    external_counter("hub_phone_malformed_total", "Phone datagrams that failed to decode",
+                     [](){ return (double)phone.malformed.load(memory_order_relaxed); });
+    external_counter("hub_phone_sent_total", "Datagrams sent to the phone app",
+                     [](){ return (double)phone.sent.load(memory_order_relaxed); });
+    external_counter("hub_phone_dropped_total", "Datagrams to the phone app the kernel refused",
+                     [](){ return (double)phone.dropped.load(memory_order_relaxed); });
+    metrics.gauge("hub_phone_subscribers", "Phone and dashboard clients receiving updates",
+                  [](){ return (double)phone.subscribers.clients.load(memory_order_relaxed); });
+    external_counter("hub_phone_updates_total", "Vent updates encoded for the phone clients, once each",
+                     [](){ return (double)phone.subscribers.published.load(memory_order_relaxed); });
+    external_counter("hub_phone_conflated_total", "Updates to slow clients folded into a later latest-state send",
+                     [](){ return (double)phone.subscribers.conflated.load(memory_order_relaxed); });
+    external_counter("hub_phone_subscribers_expired_total", "Phone clients dropped after going quiet",
+                     [](){ return (double)phone.subscribers.expired.load(memory_order_relaxed); });
+    external_counter("hub_phone_syscalls_total", "recvmmsg and sendmmsg calls on the phone socket",
+                     [](){ return (double)phone.syscalls.load(memory_order_relaxed); });
+    zone_gauge("hub_zone_temperature_celsius", "Mean temperature of the vents reporting in a zone",
+               [](const ZoneStats &s){ return s.average; });
+    zone_gauge("hub_zone_temperature_min_celsius", "Coldest vent reporting in a zone",
+               [](const ZoneStats &s){ return s.minimum; });
+    zone_gauge("hub_zone_temperature_max_celsius", "Warmest vent reporting in a zone",
+               [](const ZoneStats &s){ return s.maximum; });
+    zone_gauge("hub_zone_setpoint_error_celsius", "Mean temperature minus setpoint in a zone; positive is too warm",
+               [](const ZoneStats &s){ return s.error; });
+    zone_gauge("hub_zone_open_fraction", "Open cover area over total vent area in a zone",
+               [](const ZoneStats &s){ return s.open_fraction; });
+    zone_gauge("hub_zone_vents_reporting", "Vents in a zone with a current reading",
+               [](const ZoneStats &s){ return (float)s.reporting; });
+    metrics.gauge("hub_vents_registered", "Vents in the registry", [](){ return (double)vents.size(); });
+    metrics.gauge("hub_vents_silent", "Vents with no reading for VENT_SILENT_MS",
+                  [](){ return (double)silent_vents.load(memory_order_relaxed); });
+
+    // How evenly SO_REUSEPORT spreads vents and load over the reactors
+    metrics.family("hub_reactor_connections_total", "Vents accepted per reactor", "counter", [](string &out){
+        char line[96];
+        for(size_t s = 0; s < shards.size(); s++){
+            snprintf(line, sizeof(line), "hub_reactor_connections_total{reactor=\"%zu\"} %llu\n", s,
+                     (unsigned long long)shards[s]->accepted.load(memory_order_relaxed));
+            out += line;
+        }
+    });
+    metrics.family("hub_reactor_packets_total", "Readings decoded per reactor", "counter", [](string &out){
+        char line[96];
+        for(size_t s = 0; s < shards.size(); s++){
+            snprintf(line, sizeof(line), "hub_reactor_packets_total{reactor=\"%zu\"} %llu\n", s,
+                     (unsigned long long)shards[s]->packets.load(memory_order_relaxed));
+            out += line;
+        }
+    });
+
+    // Per-vent totals; Prometheus' rate() turns them into packet rates
+    metrics.family("hub_vent_packets_total", "Readings decoded per vent", "counter", [](string &out){
+        char line[96];
+        for(uint32_t i = 0; i < vents.size(); i++){
+            const Vent &vent = vents.at(i);
+            if(vent.ID >= VENT_ADDRESS_MIN){
+                struct in_addr addr;
+                addr.s_addr = htonl(vent.ID);
+                char ip[INET_ADDRSTRLEN];
+                inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+                snprintf(line, sizeof(line), "hub_vent_packets_total{vent=\"%u\",address=\"%s\"} %llu\n", i, ip,
+                         (unsigned long long)vent.packets.load(memory_order_relaxed));
+            } else {
+                snprintf(line, sizeof(line), "hub_vent_packets_total{vent=\"%u\"} %llu\n", i,
+                         (unsigned long long)vent.packets.load(memory_order_relaxed));
+            }
+            out += line;
+        }
+    });
+}
+
+// Reactor threads. A vent is claimed by whichever reactor accepts it; the claim is the only
+// cross-reactor step, and it happens once per connection, not per packet.
+bool HubHandler::on_open(Connection &conn){
+    unsigned int id = ntohl(conn.peer.sin_addr.s_addr);
+    Vent *vent = vents.find(id);
+    if (vent == NULL) {
+        vent = vents.add(id);
+    }
+    bool taken_over = false;
+    uint32_t previous = index;
+    if (vent != NULL) {
+        lock_guard<mutex> guard(vent_owner_lock);
+        if (vent->connected.load() && !one_vent_per_address) {
+            // Still connected: another vent sharing the address
+            vent = vents.add(vent_ID.fetch_add(1) % VENT_ADDRESS_MIN);
+        }
+        if (vent != NULL) {
+            taken_over = vent->connected.exchange(true);
+            previous = vent->shard.exchange(index);
+        }
+    }
+    if (vent == NULL) {
+        HLOG_WARN("Vent registry full, refusing %s", inet_ntoa(conn.peer.sin_addr));
+        return false;
+    }
+    conn.vent_num = vent->index;
+    if (conns.size() <= vent->index) {
+        conns.resize(vent->index + 1, NULL);
+    }
+    // The vent is this connection's before the old one closes, so its on_close leaves it be
+    Connection *stale = conns[vent->index];
+    conns[vent->index] = &conn;
+    if (stale != NULL) {
+        HLOG_INFO("Vent %u reconnected, closing its old connection", vent->index);
+        backend->close(*stale);
+    }
+    if (taken_over && previous != (uint32_t)index) {
+        shards[previous]->takeovers.post(vent->index);
     }
+    vents.info(vent->index).peer = conn.peer;
+    metrics_bump(accepted, 1);
 
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(PORT);
+    // Print IP and Port of the connected client
+    HLOG_INFO("New connection from %s:%u", inet_ntoa(conn.peer.sin_addr), ntohs(conn.peer.sin_port));
+    return true;
+}
 
-    // Forcefully attaching socket to the port 8080
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
-        perror("bind failed");
-        exit(EXIT_FAILURE);
+// A recv() can carry any number of frames, or end partway through one
+void HubHandler::on_data(Connection &conn, const char *buffer, size_t len){
+    uint64_t recv_ns = telemetry_clock_ns();
+    bool ok = conn.decoder.feed(buffer, len, [this, &conn, recv_ns](const char *payload, size_t payload_len){
+        handle_packet(telemetry, conn, payload, payload_len, recv_ns);
+        metrics_bump(packets, 1);
+    });
+    if(!ok){
+        malformed_total.add();
+        HLOG_WARN("Malformed frame from vent %u, dropping connection", conn.vent_num);
+        backend->close(conn);
+    }
+}
+
+void HubHandler::on_close(Connection &conn){
+    // Refused, or replaced by the vent's newer connection
+    if(conn.vent_num >= conns.size() || conns[conn.vent_num] != &conn){
+        return;
+    }
+    HLOG_INFO("Vent %u disconnected", conn.vent_num);
+    conns[conn.vent_num] = NULL;
+    Vent &vent = vents.at(conn.vent_num);
+    lock_guard<mutex> guard(vent_owner_lock);
+    if(vent.shard.load() == (uint32_t)index){
+        vent.connected.store(false);
     }
-    if (listen(server_fd, 3) < 0) {
-        perror("listen");
+}
+
+// The vent reconnected through another reactor; close what is left of it here, unless it
+// has since come back to this one
+void HubHandler::close_stale(uint32_t vent_num){
+    if(vent_num < conns.size() && conns[vent_num] != NULL && vents.at(vent_num).shard.load() != (uint32_t)index){
+        HLOG_INFO("Vent %u reconnected through reactor %u, closing its old connection", vent_num,
+                  vents.at(vent_num).shard.load());
+        backend->close(*conns[vent_num]);
+    }
+}
+
+void TakeoverBell::on_ring(){
+    uint32_t vent_num;
+    while(queue.try_pop(vent_num)){
+        shard.close_stale(vent_num);
+    }
+}
+
+int main(int argc, char **argv){
+    // Before any thread starts, so that none of them takes the signal instead
+    ShutdownSignals shutdown_signals;
+    if (!shutdown_signals.block(SIGINT) || !shutdown_signals.block(SIGTERM)) {
         exit(EXIT_FAILURE);
     }
 
-    cout << "create setup thread " << endl;
-    pthread_create(&setup_thread, NULL, connection_setup, NULL);
+    // Console output goes through the logger's thread, off the packet path
+    hub_logger().start();
 
-    //TODO: Create signal handler for cleanup
+    bool want_uring = false;
+    int reactors = 1;
+    vector<int> cpus;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--io-uring") == 0) {
+            want_uring = true;
+        } else if (strcmp(argv[i], "--hysteresis") == 0) {
+            control_mode = CONTROL_HYSTERESIS;
+        } else if (strcmp(argv[i], "--mpc") == 0) {
+            control_mode = CONTROL_MPC;
+        } else if (strcmp(argv[i], "--bang-bang") == 0) {
+            control_mode = CONTROL_BANG_BANG;
+        } else if (strcmp(argv[i], "--scheduled-pid") == 0) {
+            control_mode = CONTROL_SCHEDULED_PID;
+        } else if (strncmp(argv[i], "--command-gap=", 14) == 0) {
+            scheduler.set_gap((unsigned)atoi(argv[i] + 14));
+        } else if (strcmp(argv[i], "--overflow=block") == 0) {
+            overflow_policy = OVERFLOW_BLOCK;
+        } else if (strcmp(argv[i], "--overflow=drop") == 0) {
+            overflow_policy = OVERFLOW_COUNT_AND_DROP;
+        } else if (strncmp(argv[i], "--log-dir=", 10) == 0) {
+            log_dir = argv[i] + 10;
+        } else if (strcmp(argv[i], "--no-log") == 0) {
+            logging = false;
+        } else if (strncmp(argv[i], "--snapshot=", 11) == 0) {
+            snapshot_path = argv[i] + 11;
+        } else if (strcmp(argv[i], "--no-snapshot") == 0) {
+            snapshotting = false;
+        } else if (strcmp(argv[i], "--no-metrics") == 0) {
+            serve_metrics = false;
+        } else if (strcmp(argv[i], "--no-phone") == 0) {
+            serve_phone = false;
+        } else if (strcmp(argv[i], "--one-vent-per-address") == 0) {
+            one_vent_per_address = true;
+        } else if (strncmp(argv[i], "--zones=", 8) == 0) {
+            zones_path = argv[i] + 8;
+        } else if (strncmp(argv[i], "--reactors=", 11) == 0) {
+            reactors = atoi(argv[i] + 11);
+            if (reactors < 1 || reactors > MAX_REACTORS) {
+                fprintf(stderr, "--reactors must be 1 to %d\n", MAX_REACTORS);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strncmp(argv[i], "--cpus=", 7) == 0) {
+            if (!parse_cpu_list(argv[i] + 7, cpus)) {
+                fprintf(stderr, "--cpus takes a list like 0,2,4-7\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    // Each reactor has its own listening socket on PORT (SO_REUSEPORT), its own event loop
+    // and thread, and owns the vents it accepts. Reactor i is pinned to the i-th CPU of
+    // --cpus, wrapping around, when given. Each loop is edge-triggered epoll by default, or
+    // io_uring with --io-uring when the kernel supports it.
+    for (int i = 0; i < reactors; i++) {
+        HubHandler *shard = new HubHandler(i, cpus.empty() ? -1 : cpus[i % cpus.size()]);
+        // Vents reconnect in bursts after a hub restart, so keep the accept queue deep
+        shard->listen_fd = reuseport_listen(INADDR_ANY, PORT, SOMAXCONN);
+        if (shard->listen_fd < 0) {
+            exit(EXIT_FAILURE);
+        }
+        shard->backend = create_backend(*shard, want_uring);
+        if (!shard->backend->listen(shard->listen_fd)) {
+            exit(EXIT_FAILURE);
+        }
+        shards.push_back(shard);
+    }
+
+    // Control runs on its own thread and loop so a slow tick never stalls socket I/O
+    if (snapshotting) {
+        restore_snapshot();
+        snapshots.start(snapshot_path);
+    }
+    if (logging) {
+        replay_log();
+    }
+    if (zones_path != NULL && !load_zones(zones_path)) {
+        HLOG_WARN("Zone layout %s unreadable or partly ignored", zones_path);
+    }
+    sync_zones();
+    IngestDoorbell ingest_bell;
+    ControlTimer control_timer;
+    if (!ingest_bell.start(control_loop) || !control_timer.start(control_loop, CONTROL_TICK_MS) ||
+        !timers.start(control_loop, TIMER_TICK_MS) || !shutdown_signals.start(control_loop)) {
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < shards.size(); i++) {
+        shards[i]->egress.attach(shards[i]->backend);
+        if (!shards[i]->egress.start(shards[i]->backend->reactor()) ||
+            !shards[i]->takeovers.start(shards[i]->backend->reactor())) {
+            exit(EXIT_FAILURE);
+        }
+        shards[i]->telemetry.set_consumer(&ingest_bell);
+    }
+    if (serve_phone && !phone.start(control_loop, PHONE_PORT)) {
+        HLOG_WARN("Phone gateway unavailable on UDP port %d", PHONE_PORT);
+    }
+    register_queue_metrics();
+    MetricsServer metrics_server(metrics);
+    if (serve_metrics && !metrics_server.start(METRICS_PORT)) {
+        HLOG_WARN("Metrics endpoint unavailable on port %d", METRICS_PORT);
+    }
+    pthread_t consumer_thread;
+    pthread_create(&consumer_thread, NULL, control_thread, NULL);
+
+    HLOG_INFO("Waiting for new connections on %s backend, %d reactor(s)...", shards[0]->backend->name(), reactors);
+    for (size_t i = 1; i < shards.size(); i++) {
+        pthread_create(&shards[i]->thread, NULL, reactor_thread, shards[i]);
+    }
+    shards[0]->thread = pthread_self();
+    reactor_thread(shards[0]);
 
     //Cleanup
-    pthread_join(setup_thread, NULL);
+    metrics_server.stop();
+    control_loop.stop();
+    pthread_join(consumer_thread, NULL);
+    for (size_t i = 1; i < shards.size(); i++) {
+        shards[i]->backend->stop();
+        pthread_join(shards[i]->thread, NULL);
+    }
+    if (snapshotting) {
+        write_snapshot();
+        snapshots.stop();
+    }
+    for (size_t i = 0; i < shards.size(); i++) {
+        delete shards[i]->backend;
+        close(shards[i]->listen_fd);
+        delete shards[i];
+    }
+    telemetry_log.close();
+    hub_logger().stop();
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,374 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Latency histograms and counters for the hub, served in Prometheus text format.
+//
+// Every metric keeps one shard per recording thread, each on its own cache lines, and a
+// shard is only ever written by its thread. Recording is therefore a bucket computation and
+// a few relaxed loads and stores: no locked instruction and no line shared with another
+// thread. A scrape sums the shards with relaxed loads, so it may see one recording half
+// applied (a bucket bumped before the count) but never blocks a recorder.
+//
+// Threads take a shard the first time they record. Past METRICS_MAX_THREADS they share the
+// last one and may lose the odd update.
+#define METRICS_MAX_THREADS 64
+#define METRICS_PORT 9464
+#define METRICS_SUB_BUCKETS 8        // per power of two, so about 12% resolution
+#define METRICS_BUCKETS (38 * METRICS_SUB_BUCKETS)   // up to 2^40 ns, about 18 minutes
+
+inline int metrics_thread_slot() {
+    static std::atomic<int> next(0);
+    static thread_local int slot = -1;
+    if (slot < 0) {
+        slot = next.fetch_add(1, std::memory_order_relaxed);
+        if (slot >= METRICS_MAX_THREADS) {
+            slot = METRICS_MAX_THREADS - 1;
+        }
+    }
+    return slot;
+}
+
+// Single-writer increment; the load and store are separate so no lock prefix is emitted
+inline void metrics_bump(std::atomic<uint64_t> &value, uint64_t n) {
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+class Metric{
+    public:
+        std::string name;
+        std::string help;
+
+        Metric(const char *name, const char *help) : name(name), help(help) {}
+        virtual ~Metric() {}
+
+        // Append this metric in Prometheus text format
+        virtual void render(std::string &out) const = 0;
+};
+
+class MetricCounter : public Metric{
+    public:
+        MetricCounter(const char *name, const char *help) : Metric(name, help) {
+            for (int i = 0; i < METRICS_MAX_THREADS; i++) {
+                shards[i].value.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        void add(uint64_t n = 1) { metrics_bump(shards[metrics_thread_slot()].value, n); }
+
+        uint64_t value() const {
+            uint64_t total = 0;
+            for (int i = 0; i < METRICS_MAX_THREADS; i++) {
+                total += shards[i].value.load(std::memory_order_relaxed);
+            }
+            return total;
+        }
+
+        void render(std::string &out) const {
+            char line[64];
+            out += "# HELP " + name + " " + help + "\n# TYPE " + name + " counter\n" + name;
+            snprintf(line, sizeof(line), " %llu\n", (unsigned long long)value());
+            out += line;
+        }
+
+    private:
+        struct alignas(64) Shard{
+            std::atomic<uint64_t> value;
+        };
+        Shard shards[METRICS_MAX_THREADS];
+};
+
+// Log-linear (HDR-style) histogram of nanosecond values, exported in seconds. Buckets are
+// exported at powers of two to keep a scrape short; the sum and count are exact.
+class MetricHistogram : public Metric{
+    public:
+        MetricHistogram(const char *name, const char *help) : Metric(name, help) {
+            shards = new Shard[METRICS_MAX_THREADS];
+            for (int i = 0; i < METRICS_MAX_THREADS; i++) {
+                for (int b = 0; b < METRICS_BUCKETS; b++) {
+                    shards[i].counts[b].store(0, std::memory_order_relaxed);
+                }
+                shards[i].sum.store(0, std::memory_order_relaxed);
+                shards[i].count.store(0, std::memory_order_relaxed);
+            }
+        }
+        ~MetricHistogram() { delete[] shards; }
+
+        void record(uint64_t ns) {
+            Shard &shard = shards[metrics_thread_slot()];
+            metrics_bump(shard.counts[bucket(ns)], 1);
+            metrics_bump(shard.sum, ns);
+            metrics_bump(shard.count, 1);
+        }
+
+        // Merged view of every shard
+        void snapshot(uint64_t *counts, uint64_t &sum, uint64_t &count) const {
+            memset(counts, 0, METRICS_BUCKETS * sizeof(uint64_t));
+            sum = 0;
+            count = 0;
+            for (int i = 0; i < METRICS_MAX_THREADS; i++) {
+                for (int b = 0; b < METRICS_BUCKETS; b++) {
+                    counts[b] += shards[i].counts[b].load(std::memory_order_relaxed);
+                }
+                sum += shards[i].sum.load(std::memory_order_relaxed);
+                count += shards[i].count.load(std::memory_order_relaxed);
+            }
+        }
+
+        // Upper bound of the bucket holding the q-th quantile, q in [0, 1]
+        uint64_t percentile(double q) const {
+            uint64_t counts[METRICS_BUCKETS];
+            uint64_t sum, count;
+            snapshot(counts, sum, count);
+            uint64_t rank = (uint64_t)(q * count);
+            uint64_t seen = 0;
+            for (int b = 0; b < METRICS_BUCKETS; b++) {
+                seen += counts[b];
+                if (seen > rank) {
+                    return upper_bound(b);
+                }
+            }
+            return 0;
+        }
+
+        void render(std::string &out) const {
+            uint64_t counts[METRICS_BUCKETS];
+            uint64_t sum, count;
+            snapshot(counts, sum, count);
+            out += "# HELP " + name + " " + help + "\n# TYPE " + name + " histogram\n";
+
+            // Cumulative counts at every power of two up to the highest non-empty bucket
+            int last = 0;
+            for (int b = 0; b < METRICS_BUCKETS; b++) {
+                if (counts[b] != 0) {
+                    last = b;
+                }
+            }
+            char line[160];
+            uint64_t cumulative = 0;
+            for (int b = 0; b < METRICS_BUCKETS; b++) {
+                cumulative += counts[b];
+                if (b % METRICS_SUB_BUCKETS == METRICS_SUB_BUCKETS - 1 && b <= last + METRICS_SUB_BUCKETS) {
+                    snprintf(line, sizeof(line), "%s_bucket{le=\"%.9g\"} %llu\n", name.c_str(),
+                             (upper_bound(b) + 1) / 1e9, (unsigned long long)cumulative);
+                    out += line;
+                }
+            }
+            snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.9g\n%s_count %llu\n",
+                     name.c_str(), (unsigned long long)count, name.c_str(), sum / 1e9, name.c_str(),
+                     (unsigned long long)count);
+            out += line;
+        }
+
+        static int bucket(uint64_t ns) {
+            if (ns < METRICS_SUB_BUCKETS) {
+                return (int)ns;
+            }
+            int msb = 63 - __builtin_clzll(ns);
+            int b = (msb - 2) * METRICS_SUB_BUCKETS + (int)((ns >> (msb - 3)) & (METRICS_SUB_BUCKETS - 1));
+            return b < METRICS_BUCKETS ? b : METRICS_BUCKETS - 1;
+        }
+
+        static uint64_t upper_bound(int b) {
+            if (b < METRICS_SUB_BUCKETS) {
+                return (uint64_t)b;
+            }
+            int msb = b / METRICS_SUB_BUCKETS + 2;
+            uint64_t base = 1ull << msb;
+            return base + ((uint64_t)(b % METRICS_SUB_BUCKETS + 1) << (msb - 3)) - 1;
+        }
+
+    private:
+        struct alignas(64) Shard{
+            std::atomic<uint64_t> counts[METRICS_BUCKETS];
+            std::atomic<uint64_t> sum;
+            std::atomic<uint64_t> count;
+        };
+        Shard *shards;
+
+        MetricHistogram(const MetricHistogram &);
+        MetricHistogram &operator=(const MetricHistogram &);
+};
+
+// A value read only when scraped: queue depths, counters kept elsewhere, or a whole family
+// of labelled series written by the callback itself
+class MetricCallback : public Metric{
+    public:
+        typedef std::function<void(std::string &)> Writer;
+
+        MetricCallback(const char *name, const char *help, const char *type, Writer write)
+            : Metric(name, help), type(type), write(write) {}
+
+        void render(std::string &out) const {
+            out += "# HELP " + name + " " + help + "\n# TYPE " + name + " " + type + "\n";
+            write(out);
+        }
+
+    private:
+        std::string type;
+        Writer write;
+};
+
+// Metrics in registration order. Register everything before the server starts.
+class MetricsRegistry{
+    public:
+        ~MetricsRegistry() {
+            for (size_t i = 0; i < owned.size(); i++) {
+                delete owned[i];
+            }
+        }
+
+        MetricCounter &counter(const char *name, const char *help) {
+            MetricCounter *metric = new MetricCounter(name, help);
+            owned.push_back(metric);
+            return *metric;
+        }
+
+        MetricHistogram &histogram(const char *name, const char *help) {
+            MetricHistogram *metric = new MetricHistogram(name, help);
+            owned.push_back(metric);
+            return *metric;
+        }
+
+        // A single unlabelled value
+        void gauge(const char *name, const char *help, std::function<double()> read) {
+            std::string series = name;
+            owned.push_back(new MetricCallback(name, help, "gauge", [series, read](std::string &out) {
+                char line[64];
+                snprintf(line, sizeof(line), " %.9g\n", read());
+                out += series + line;
+            }));
+        }
+
+        // Any series; write appends complete sample lines
+        void family(const char *name, const char *help, const char *type, MetricCallback::Writer write) {
+            owned.push_back(new MetricCallback(name, help, type, write));
+        }
+
+        std::string render() const {
+            std::string out;
+            for (size_t i = 0; i < owned.size(); i++) {
+                owned[i]->render(out);
+            }
+            return out;
+        }
+
+    private:
+        std::vector<Metric *> owned;
+};
+
+// Plain HTTP on localhost for a Prometheus scraper. GET /metrics returns every registered
+// metric; anything else is a 404. Runs on its own thread with blocking sockets, so a slow
+// scraper never touches the I/O or control threads.
+class MetricsServer{
+    public:
+        MetricsServer(const MetricsRegistry &registry) : registry(registry), listen_fd(-1), stopping(false) {}
+        ~MetricsServer() { stop(); }
+
+        bool start(uint16_t port) {
+            listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (listen_fd < 0) {
+                perror("metrics socket");
+                return false;
+            }
+            int opt = 1;
+            setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = htons(port);
+            if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || ::listen(listen_fd, 16) < 0) {
+                perror("metrics bind");
+                ::close(listen_fd);
+                listen_fd = -1;
+                return false;
+            }
+            server = std::thread(&MetricsServer::serve, this);
+            return true;
+        }
+
+        void stop() {
+            if (!server.joinable()) {
+                return;
+            }
+            stopping.store(true);
+            shutdown(listen_fd, SHUT_RDWR);
+            server.join();
+            ::close(listen_fd);
+            listen_fd = -1;
+        }
+
+    private:
+        void serve() {
+            while (!stopping.load()) {
+                int fd = accept(listen_fd, NULL, NULL);
+                if (fd < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return;
+                }
+                struct timeval timeout = {1, 0};
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                respond(fd);
+                ::close(fd);
+            }
+        }
+
+        // One request per connection; only the request line matters
+        void respond(int fd) {
+            char request[2048];
+            size_t got = 0;
+            while (got < sizeof(request) - 1) {
+                ssize_t n = recv(fd, request + got, sizeof(request) - 1 - got, 0);
+                if (n <= 0) {
+                    return;
+                }
+                got += n;
+                request[got] = '\0';
+                if (strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL) {
+                    break;
+                }
+            }
+            std::string body;
+            const char *status = "404 Not Found";
+            if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET /metrics?", 13) == 0) {
+                status = "200 OK";
+                body = registry.render();
+            }
+            char head[160];
+            int head_len = snprintf(head, sizeof(head),
+                                    "HTTP/1.1 %s\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                    "Content-Length: %zu\r\nConnection: close\r\n\r\n", status, body.size());
+            std::string response(head, head_len);
+            response += body;
+            size_t sent = 0;
+            while (sent < response.size()) {
+                ssize_t n = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+                if (n <= 0) {
+                    return;
+                }
+                sent += n;
+            }
+        }
+
+        const MetricsRegistry &registry;
+        int listen_fd;
+        std::atomic<bool> stopping;
+        std::thread server;
+};
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+// Model-predictive cover control, per vent, on a first-order-plus-dead-time room model.
+//
+// Every MPC_PERIOD_TICKS control ticks a vent is sampled: its latest temperature y and the
+// mean cover u it was given since the previous sample. The model is
+//
+//     y[k] = a y[k-1] + b u[k-1-d] + c
+//
+// i.e. a room relaxing with time constant -T/ln(a) towards (b u + c)/(1 - a), with the
+// cover acting after d samples of dead time (duct transport, sensor lag). a, b and c are
+// fitted by recursive least squares with slow forgetting, once for every candidate d up to
+// MPC_DEAD_MAX - 1, and the d whose one-step predictions have been best is used. Weather,
+// doors and sun shift c faster than the fit should follow (held near a setpoint, the room
+// cannot tell c from a), so a separate bias tracks the recent one-step error and is added
+// to c when predicting: the usual offset-free disturbance estimate.
+//
+// Held near one temperature the fit is poorly conditioned and can wander out of the
+// physically sensible range (a >= 1, an absurd gain) for a while. The solver therefore plans
+// with the last fit that passed the checks, and only a sustained prediction error, not a
+// wandering fit, takes a vent back to PID.
+//
+// With a trusted model, each sample solves a short-horizon problem: choose the cover to
+// hold for the next MPC_HORIZON samples minimising squared deviation from the setpoint plus
+// a cost for moving the motor at all and for moving it far. There are only
+// COVER_MAX - COVER_MIN + 1 positions, so every one is predicted and the cheapest taken:
+// the exact integer optimum, in a fixed number of steps. Until a model is trusted the vent
+// runs the PID kernel, which also gives the fit the excitation it needs.
+//
+// Vents are sampled on ticks spread by index, so each tick fits and solves about
+// 1/MPC_PERIOD_TICKS of the MPC vents, whatever their number.
+#define MPC_PERIOD_TICKS 100        // one sample every 10 s at CONTROL_TICK_MS 100
+#define MPC_DEAD_MAX 6              // dead time up to 50 s
+#define MPC_HORIZON 30              // samples ahead; 5 minutes
+#define MPC_CANDIDATES 16           // COVER_MAX - COVER_MIN + 1 rounded up for vector loads
+#define MPC_FORGET 0.999f           // about 1000 samples, nearly 3 hours, of memory
+#define MPC_P_INIT 100.0f
+#define MPC_P_MAX 1e4f              // stop forgetting while the input carries no information
+#define MPC_RESIDUAL_DECAY 0.05f
+#define MPC_BIAS_GAIN 0.2f          // disturbance estimate follows about 5 samples
+#define MPC_WARMUP_SAMPLES 30       // fit for 5 minutes before trusting it
+#define MPC_TRUST_RESIDUAL 0.05f    // one-step prediction error, C^2, to start trusting a model
+#define MPC_DISTRUST_RESIDUAL 0.5f  // and to stop: a disturbance is no reason to drop it
+#define MPC_MIN_GAIN 0.02f          // C per cover step at steady state; below it the cover does nothing
+#define MPC_MAX_GAIN 10.0f
+#define MPC_SWITCH_COST 2.0f        // C^2 samples: a move must save this much tracking error
+#define MPC_MOVE_WEIGHT 0.05f       // per cover step squared
+#define MPC_Y_OFFSET 20.0f          // temperatures are fitted about this, for conditioning
+
+// One vent's model. Around 300 bytes, touched once per sample.
+struct MpcModel{
+    float theta[MPC_DEAD_MAX][3];   // a, b, c for each dead time
+    float P[MPC_DEAD_MAX][6];       // symmetric covariance: 00 01 02 11 12 22
+    float residual[MPC_DEAD_MAX];   // smoothed squared one-step error
+    float inputs[MPC_DEAD_MAX + 1]; // mean cover over the last samples, newest first
+    float last_y;                   // offset temperature at the previous sample, NAN if none
+    float plan[3];                  // last fit that passed the checks; what the solver uses
+    float bias;                     // recent one-step error of plan
+    uint32_t samples;
+    uint32_t dead;                  // dead time with the best recent fit
+    uint32_t plan_dead;
+    bool trusted;                   // plan is usable
+
+    MpcModel() { reset(); }
+
+    void reset() {
+        for (int d = 0; d < MPC_DEAD_MAX; d++) {
+            theta[d][0] = 0.95f;
+            theta[d][1] = 0.0f;
+            theta[d][2] = 0.0f;
+            float init[6] = {MPC_P_INIT, 0, 0, MPC_P_INIT, 0, MPC_P_INIT};
+            memcpy(P[d], init, sizeof(init));
+            residual[d] = 1.0f;
+        }
+        for (int i = 0; i <= MPC_DEAD_MAX; i++) {
+            inputs[i] = 0.0f;
+        }
+        memcpy(plan, theta[0], sizeof(plan));
+        last_y = NAN;
+        bias = 0.0f;
+        samples = 0;
+        dead = 0;
+        plan_dead = 0;
+        trusted = false;
+    }
+
+    // Steady-state C per cover step of the plan
+    float gain() const {
+        return plan[1] / (1.0f - plan[0]);
+    }
+};
+
+// One RLS step: regressor phi, target y
+inline void mpc_rls(float *theta, float *P, float &residual, const float phi[3], float y) {
+    float e = y - (theta[0] * phi[0] + theta[1] * phi[1] + theta[2] * phi[2]);
+    float Pp0 = P[0] * phi[0] + P[1] * phi[1] + P[2] * phi[2];
+    float Pp1 = P[1] * phi[0] + P[3] * phi[1] + P[4] * phi[2];
+    float Pp2 = P[2] * phi[0] + P[4] * phi[1] + P[5] * phi[2];
+    float denom = MPC_FORGET + phi[0] * Pp0 + phi[1] * Pp1 + phi[2] * Pp2;
+    float g0 = Pp0 / denom, g1 = Pp1 / denom, g2 = Pp2 / denom;
+    theta[0] += g0 * e;
+    theta[1] += g1 * e;
+    theta[2] += g2 * e;
+    float forget = P[0] + P[3] + P[5] > MPC_P_MAX ? 1.0f : 1.0f / MPC_FORGET;
+    P[0] = (P[0] - g0 * Pp0) * forget;
+    P[1] = (P[1] - g0 * Pp1) * forget;
+    P[2] = (P[2] - g0 * Pp2) * forget;
+    P[3] = (P[3] - g1 * Pp1) * forget;
+    P[4] = (P[4] - g1 * Pp2) * forget;
+    P[5] = (P[5] - g2 * Pp2) * forget;
+    residual += MPC_RESIDUAL_DECAY * (e * e - residual);
+}
+
+// A new sample: temperature t and the mean cover since the last one. Refits every dead
+// time, picks the best and, if it passes the checks, plans with it from now on.
+inline void mpc_observe(MpcModel &m, float t, float mean_cover) {
+    float y = t - MPC_Y_OFFSET;
+    for (int i = MPC_DEAD_MAX; i > 0; i--) {
+        m.inputs[i] = m.inputs[i - 1];
+    }
+    m.inputs[0] = mean_cover;
+    if (m.last_y == m.last_y) {
+        // inputs[d] is u[k-1-d], the cover that reached the room over the last period
+        float predicted = m.plan[0] * m.last_y + m.plan[1] * m.inputs[m.plan_dead] + m.plan[2] + m.bias;
+        m.bias += MPC_BIAS_GAIN * (y - predicted);
+        for (int d = 0; d < MPC_DEAD_MAX; d++) {
+            float phi[3] = {m.last_y, m.inputs[d], 1.0f};
+            mpc_rls(m.theta[d], m.P[d], m.residual[d], phi, y);
+        }
+        m.samples++;
+    }
+    m.last_y = y;
+
+    uint32_t best = 0;
+    for (uint32_t d = 1; d < MPC_DEAD_MAX; d++) {
+        best = m.residual[d] < m.residual[best] ? d : best;
+    }
+    m.dead = best;
+    const float *fit = m.theta[best];
+    float gain = fabsf(fit[1] / (1.0f - fit[0]));
+    if (m.samples >= MPC_WARMUP_SAMPLES && fit[0] > 0.5f && fit[0] < 0.9999f &&
+        m.residual[best] < MPC_TRUST_RESIDUAL && gain > MPC_MIN_GAIN && gain < MPC_MAX_GAIN) {
+        // The bias was tracking the old plan's error; the new fit starts from its own
+        if (m.plan_dead != best || !m.trusted) {
+            m.bias = 0.0f;
+        }
+        memcpy(m.plan, fit, sizeof(m.plan));
+        m.plan_dead = best;
+        m.trusted = true;
+    } else if (m.residual[best] >= MPC_DISTRUST_RESIDUAL) {
+        m.trusted = false;
+    }
+}
+
+// The cover to hold from now, given the current temperature, setpoint and cover. Every
+// position is predicted over the horizon side by side, so the inner loop vectorises.
+inline int mpc_solve(const MpcModel &m, float t, float desired, int cover, int cover_min, int cover_max) {
+    const float a = m.plan[0], b = m.plan[1], c = m.plan[2] + m.bias;
+    const float r = desired - MPC_Y_OFFSET;
+    const int dead = (int)m.plan_dead;
+    float u[MPC_CANDIDATES], y[MPC_CANDIDATES], cost[MPC_CANDIDATES];
+    for (int i = 0; i < MPC_CANDIDATES; i++) {
+        u[i] = (float)(cover_min + i);
+        y[i] = t - MPC_Y_OFFSET;
+        float step = u[i] - (float)cover;
+        cost[i] = MPC_MOVE_WEIGHT * step * step + (step != 0.0f ? MPC_SWITCH_COST : 0.0f);
+    }
+    for (int k = 0; k < MPC_HORIZON; k++) {
+        // Inputs already on their way through the dead time are the same for every candidate.
+        // inputs[0] is the sample just closed; the new cover starts acting d samples on.
+        bool committed = k < dead;
+        float past = committed ? m.inputs[dead - 1 - k] : 0.0f;
+        for (int i = 0; i < MPC_CANDIDATES; i++) {
+            float applied = committed ? past : u[i];
+            y[i] = a * y[i] + b * applied + c;
+            float e = y[i] - r;
+            cost[i] += e * e;
+        }
+    }
+    int best = cover;
+    float best_cost = cost[cover - cover_min];
+    for (int i = 0; i <= cover_max - cover_min; i++) {
+        if (cost[i] < best_cost) {
+            best_cost = cost[i];
+            best = cover_min + i;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+
+// Bounded lock-free queue for any number of producers and exactly one consumer.
+//
+// Every cell carries a sequence number: a producer may fill cell i once its sequence equals
+// the producer's ticket, and the consumer may take it once it equals ticket + 1. Producers
+// claim tickets with one CAS on tail; the consumer owns head outright, so popping is two
+// loads and a store. T must be trivially copyable.
+template <class T>
+class MpscQueue{
+    public:
+        // capacity is rounded up to a power of two
+        explicit MpscQueue(size_t capacity) : head(0) {
+            size_t n = 2;
+            while (n < capacity) {
+                n <<= 1;
+            }
+            mask = n - 1;
+            cells = new Cell[n];
+            for (size_t i = 0; i < n; i++) {
+                cells[i].seq.store(i, std::memory_order_relaxed);
+            }
+            tail.store(0, std::memory_order_relaxed);
+        }
+
+        ~MpscQueue() { delete[] cells; }
+
+        // Any thread. Returns false if the queue is full.
+        bool try_push(const T &value) {
+            uint64_t pos = tail.load(std::memory_order_relaxed);
+            while (1) {
+                Cell &cell = cells[pos & mask];
+                uint64_t seq = cell.seq.load(std::memory_order_acquire);
+                int64_t diff = (int64_t)(seq - pos);
+                if (diff == 0) {
+                    if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        cell.value = value;
+                        cell.seq.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = tail.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // Consumer only. Returns false if the queue is empty.
+        bool try_pop(T &out) {
+            Cell &cell = cells[head & mask];
+            if (cell.seq.load(std::memory_order_acquire) != head + 1) {
+                return false;
+            }
+            out = cell.value;
+            cell.seq.store(head + mask + 1, std::memory_order_release);
+            head++;
+            return true;
+        }
+
+        // Approximate when producers are running
+        size_t size() const {
+            return (size_t)(tail.load(std::memory_order_relaxed) - head);
+        }
+
+        size_t capacity() const { return mask + 1; }
+
+    private:
+        struct Cell{
+            std::atomic<uint64_t> seq;
+            T value;
+        };
+
+        MpscQueue(const MpscQueue &);
+        MpscQueue &operator=(const MpscQueue &);
+
+        Cell *cells;
+        uint64_t mask;
+        alignas(64) std::atomic<uint64_t> tail;   // producers
+        alignas(64) uint64_t head;                // consumer
+};
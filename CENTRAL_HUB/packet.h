@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+#include "logger.h"
+
+// The message inside every vent frame (framing.h). Vents send readings (pkt_type 1) and the
+// hub answers with cover positions (pkt_type 2); older vents omit motor_pos.
+class Packet{
+    public:
+        int pkt_type;
+        float temperature;
+        int motor_pos;
+};
+
+// payload is one de-framed message; the Packet fields sit at fixed offsets
+inline bool parse_packet(const char *payload, size_t len, Packet &data) {
+    if(payload == NULL){
+        HLOG_WARN("Buffer is NULL");
+        return false;
+    }
+    if(len < sizeof(data.pkt_type) + sizeof(data.temperature)){
+        HLOG_WARN("Packet too short: %zu", len);
+        return false;
+    }
+
+    memcpy(&data.pkt_type, payload, sizeof(data.pkt_type));
+    memcpy(&data.temperature, payload + sizeof(int), sizeof(data.temperature));
+    data.motor_pos = 0;
+    if(len >= sizeof(Packet)){
+        memcpy(&data.motor_pos, payload + 2 * sizeof(int), sizeof(data.motor_pos));
+    }
+
+    return true;
+}
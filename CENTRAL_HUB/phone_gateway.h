@@ -0,0 +1,388 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <vector>
+#include "reactor.h"
+#include "subscriptions.h"
+
+// The phone app's UDP protocol: a little-endian uint32 packet type followed by a UTF-8
+// value, one message per datagram. Clients send to PHONE_PORT and listen on PHONE_REPLY_PORT
+// at the address they send from. Any number of phones and dashboards may listen; a client
+// is subscribed to every vent at a trickle the first time it sends anything, and asks for
+// more (or fewer vents) with 4. A client silent for SUBSCRIBER_IDLE_MS is dropped, so one
+// that only listens re-sends its 4 every minute or two as a keepalive.
+//
+//   client -> hub  1  "<ble name>"          set up a new vent
+//                  2  "<vent>.<celsius>"    setpoint; the vent goes back under control
+//                  3  "<vent>.<percent>"    hold the cover at a position (app sends 0 or 100)
+//                  4  "<vents>[@<rate>]"    subscribe: "" or "*" for all, or "3,7,10-19";
+//                                           rate caps datagrams a second to this client,
+//                                           up to SUBSCRIBER_RATE (also the default)
+//                  5  ""                    unsubscribe, until the client next sends
+//                  6  "<zone>=<celsius>"    setpoint for every vent in a zone, e.g.
+//                                           "Upstairs/Bedroom=21.5"; "=<celsius>" is the house
+//   hub -> client  1  "<vent>"              set-up vent is connected
+//                  2  "<vent>.<celsius>"    temperature update
+//                  3  "<vent>.motor<pos>"   cover moved
+#define PHONE_PORT 5001
+#define PHONE_REPLY_PORT 3001
+#define PHONE_TYPE_SETUP 1
+#define PHONE_TYPE_TEMPERATURE 2
+#define PHONE_TYPE_POSITION 3
+#define PHONE_TYPE_SUBSCRIBE 4
+#define PHONE_TYPE_UNSUBSCRIBE 5
+#define PHONE_TYPE_ZONE_SETPOINT 6
+#define PHONE_MAX_DATAGRAM 1024
+#define PHONE_SUBSCRIBE_MAX_VENT (1u << 20)   // highest vent index a subscription may name
+
+// Parsers over [p, end) that never allocate or need a terminator. Each advances p past what
+// it consumed and returns false if nothing valid was there.
+inline bool phone_parse_uint(const char *&p, const char *end, uint32_t &out) {
+    uint64_t value = 0;
+    const char *start = p;
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = value * 10 + (uint64_t)(*p - '0');
+        if (value > 0xffffffffull) {
+            return false;
+        }
+        p++;
+    }
+    out = (uint32_t)value;
+    return p > start;
+}
+
+// [-]digits[.digits], which is all the app sends
+inline bool phone_parse_decimal(const char *&p, const char *end, float &out) {
+    bool negative = p < end && *p == '-';
+    if (negative) {
+        p++;
+    }
+    uint32_t whole;
+    if (!phone_parse_uint(p, end, whole)) {
+        return false;
+    }
+    double value = whole;
+    if (p < end && *p == '.') {
+        p++;
+        double scale = 0.1;
+        while (p < end && *p >= '0' && *p <= '9') {
+            value += (*p - '0') * scale;
+            scale *= 0.1;
+            p++;
+        }
+    }
+    out = (float)(negative ? -value : value);
+    return true;
+}
+
+// "<vent>.<decimal>" and nothing after it
+inline bool phone_parse_vent_value(const char *p, const char *end, uint32_t &vent, float &value) {
+    return phone_parse_uint(p, end, vent) && p < end && *p++ == '.' &&
+           phone_parse_decimal(p, end, value) && p == end;
+}
+
+// Non-blocking UDP socket on a Reactor, with datagrams moved in batches both ways. A
+// readable socket is drained PHONE_RECV_BATCH datagrams per recvmmsg() into preallocated
+// buffers and each is decoded in place; subclasses get the fields. publish() encodes an
+// update once and queues it to every interested subscriber (subscriptions.h); flush() sends
+// the queues PHONE_SEND_BATCH datagrams per sendmmsg(), each pointing straight at the shared
+// buffer, so a tick's worth of updates costs a system call or two per batch of clients.
+#define PHONE_RECV_BATCH 32
+#define PHONE_SEND_BATCH 256
+#define PHONE_RCVBUF (1 << 20)     // room for a burst of setpoints while the loop is in a tick
+
+class PhoneGateway : public EventHandler{
+    public:
+        std::atomic<uint64_t> received;    // loop thread writes, anyone reads
+        std::atomic<uint64_t> malformed;
+        std::atomic<uint64_t> sent;
+        std::atomic<uint64_t> dropped;     // sends the kernel refused
+        std::atomic<uint64_t> syscalls;    // recvmmsg() and sendmmsg() calls
+        SubscriberRegistry subscribers;
+
+        PhoneGateway() : received(0), malformed(0), sent(0), dropped(0), syscalls(0), fd(-1) {
+            memset(in_msgs, 0, sizeof(in_msgs));
+            memset(out_msgs, 0, sizeof(out_msgs));
+            for (int i = 0; i < PHONE_RECV_BATCH; i++) {
+                in_iov[i].iov_base = in_buffers[i];
+                in_iov[i].iov_len = PHONE_MAX_DATAGRAM;
+                in_msgs[i].msg_hdr.msg_iov = &in_iov[i];
+                in_msgs[i].msg_hdr.msg_iovlen = 1;
+                in_msgs[i].msg_hdr.msg_name = &in_from[i];
+                in_msgs[i].msg_hdr.msg_namelen = sizeof(in_from[i]);
+            }
+            for (int i = 0; i < PHONE_SEND_BATCH; i++) {
+                out_msgs[i].msg_hdr.msg_iov = &out_iov[i];
+                out_msgs[i].msg_hdr.msg_iovlen = 1;
+                out_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            }
+        }
+        virtual ~PhoneGateway() {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+
+        bool start(Reactor &loop, uint16_t port) {
+            fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd < 0) {
+                perror("phone socket");
+                return false;
+            }
+            int one = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            int rcvbuf = PHONE_RCVBUF;
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_ANY);
+            addr.sin_port = htons(port);
+            if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+                perror("phone bind");
+                close(fd);
+                fd = -1;
+                return false;
+            }
+            return loop.add(fd, this, EPOLLIN);
+        }
+
+        // A batch shorter than PHONE_RECV_BATCH means the socket was empty; anything arriving
+        // after that raises a new edge. Replies made while decoding leave in one flush.
+        void handle_event(uint32_t events) {
+            while (1) {
+                int n = recvmmsg(fd, in_msgs, PHONE_RECV_BATCH, MSG_DONTWAIT, NULL);
+                bump(syscalls, 1);
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        perror("phone recvmmsg");
+                    }
+                    break;
+                }
+                bump(received, n);
+                for (int i = 0; i < n; i++) {
+                    // Clients listen on their own fixed port
+                    in_from[i].sin_port = htons(PHONE_REPLY_PORT);
+                    dispatch(in_from[i], in_buffers[i], in_msgs[i].msg_len);
+                    in_msgs[i].msg_hdr.msg_namelen = sizeof(in_from[i]);
+                }
+                if (n < PHONE_RECV_BATCH) {
+                    break;
+                }
+            }
+            flush();
+        }
+
+        // Owned by whoever started it, not by the reactor
+        void release() {}
+
+        bool has_phone() const { return subscribers.size() > 0; }
+
+        // Some client wants updates about the vent; cheap, so callers can skip formatting
+        bool interested(uint32_t vent) const { return subscribers.interested(vent); }
+
+        // One update about a vent, value printf-formatted once for every subscriber to it.
+        // Leaves on the next flush().
+        bool publish(uint32_t vent, uint32_t type, const char *format, ...) __attribute__((format(printf, 4, 5))) {
+            if (!subscribers.interested(vent) || type < 1 || type > UPDATE_KINDS) {
+                return false;
+            }
+            UpdateBuffer *buffer = subscribers.encode_buffer();
+            char *packet = buffer->data;
+            packet[0] = (char)(type & 0xff);
+            packet[1] = (char)((type >> 8) & 0xff);
+            packet[2] = (char)((type >> 16) & 0xff);
+            packet[3] = (char)((type >> 24) & 0xff);
+            va_list args;
+            va_start(args, format);
+            int len = vsnprintf(packet + 4, UPDATE_MAX_BYTES - 4, format, args);
+            va_end(args);
+            if (len < 0) {
+                len = 0;
+            }
+            buffer->len = (uint16_t)(4 + (len < UPDATE_MAX_BYTES - 4 ? len : UPDATE_MAX_BYTES - 5));
+            buffer->vent = vent;
+            buffer->kind = (uint16_t)(type - 1);
+            subscribers.publish(buffer);
+            return true;
+        }
+
+        // Send what every subscriber's rate allows. sendmmsg() may take only part of a batch;
+        // the rest goes in further calls, and whatever the kernel refuses is handed back to
+        // the registry, which sends those vents' latest state later instead.
+        void flush() {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+            subscribers.begin((uint64_t)ts.tv_sec * 1000ull + ts.tv_nsec / 1000000);
+            unsigned count;
+            while ((count = subscribers.collect(out_refs, out_to, PHONE_SEND_BATCH)) > 0) {
+                for (unsigned i = 0; i < count; i++) {
+                    out_iov[i].iov_base = out_refs[i]->data;
+                    out_iov[i].iov_len = out_refs[i]->len;
+                    out_msgs[i].msg_hdr.msg_name = (void *)out_to[i];
+                }
+                unsigned done = 0;
+                while (done < count) {
+                    int n = sendmmsg(fd, out_msgs + done, count - done, MSG_DONTWAIT);
+                    bump(syscalls, 1);
+                    if (n < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        break;
+                    }
+                    done += n;
+                }
+                bump(sent, done);
+                subscribers.sent(out_refs, done);
+                if (done < count) {
+                    bump(dropped, count - done);
+                    subscribers.lost(out_refs + done, out_to + done, count - done);
+                    break;
+                }
+            }
+        }
+
+        // A client subscribed, re-subscribed or unsubscribed (subscriber is then NULL)
+        virtual void on_subscribe(const struct sockaddr_in &addr, const Subscriber *subscriber) {}
+
+        virtual void on_setup(const char *name, size_t len) = 0;
+        virtual void on_setpoint(uint32_t vent, float celsius) = 0;
+        virtual void on_position(uint32_t vent, float percent) = 0;
+        virtual void on_zone_setpoint(const char *zone, size_t len, float celsius) = 0;
+        virtual void on_malformed(uint32_t type, const char *value, size_t len) = 0;
+
+    private:
+        static void bump(std::atomic<uint64_t> &counter, uint64_t n) {
+            counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+        void dispatch(const struct sockaddr_in &from, const char *data, size_t len) {
+            if (len < 4) {
+                bump(malformed, 1);
+                on_malformed(0, data, 0);
+                return;
+            }
+            const unsigned char *b = (const unsigned char *)data;
+            uint32_t type = (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+            const char *value = data + 4;
+            const char *end = data + len;
+            uint32_t vent;
+            float number;
+            if (type == PHONE_TYPE_SUBSCRIBE) {
+                subscribe(from, value, end);
+                return;
+            }
+            if (type == PHONE_TYPE_UNSUBSCRIBE) {
+                subscribers.unsubscribe(from);
+                on_subscribe(from, NULL);
+                return;
+            }
+            subscribers.heard(from);
+            if (type == PHONE_TYPE_SETUP && end > value) {
+                on_setup(value, (size_t)(end - value));
+            } else if (type == PHONE_TYPE_TEMPERATURE && phone_parse_vent_value(value, end, vent, number)) {
+                on_setpoint(vent, number);
+            } else if (type == PHONE_TYPE_POSITION && phone_parse_vent_value(value, end, vent, number)) {
+                on_position(vent, number);
+            } else if (type == PHONE_TYPE_ZONE_SETPOINT && zone_setpoint(value, end)) {
+                return;
+            } else {
+                bump(malformed, 1);
+                on_malformed(type, value, (size_t)(end - value));
+            }
+        }
+
+        // "<zone>=<celsius>"; zone names may hold anything but '='
+        bool zone_setpoint(const char *p, const char *end) {
+            const char *equals = (const char *)memrchr(p, '=', end - p);
+            float celsius;
+            if (equals == NULL) {
+                return false;
+            }
+            const char *number = equals + 1;
+            if (!phone_parse_decimal(number, end, celsius) || number != end) {
+                return false;
+            }
+            on_zone_setpoint(p, (size_t)(equals - p), celsius);
+            return true;
+        }
+
+        // "<vents>[@<rate>]" with <vents> empty, "*", or a comma list of IDs and ranges
+        void subscribe(const struct sockaddr_in &from, const char *p, const char *end) {
+            const char *at = (const char *)memchr(p, '@', end - p);
+            uint32_t rate = SUBSCRIBER_RATE;
+            if (at != NULL) {
+                const char *r = at + 1;
+                if (!phone_parse_uint(r, end, rate) || r != end || rate == 0) {
+                    bad_subscription(p, end);
+                    return;
+                }
+                if (rate > SUBSCRIBER_RATE) {
+                    rate = SUBSCRIBER_RATE;
+                }
+                end = at;
+            }
+            bool all = p == end || (end - p == 1 && *p == '*');
+            spec_vents.clear();
+            while (!all && p < end) {
+                uint32_t first, last;
+                if (!phone_parse_uint(p, end, first)) {
+                    bad_subscription(p, end);
+                    return;
+                }
+                last = first;
+                if (p < end && *p == '-') {
+                    p++;
+                    if (!phone_parse_uint(p, end, last) || last < first) {
+                        bad_subscription(p, end);
+                        return;
+                    }
+                }
+                if (last >= PHONE_SUBSCRIBE_MAX_VENT || (p < end && *p++ != ',')) {
+                    bad_subscription(p, end);
+                    return;
+                }
+                for (uint32_t v = first; v <= last; v++) {
+                    spec_vents.push_back(v);
+                }
+            }
+            on_subscribe(from, subscribers.subscribe(from, all, spec_vents, rate));
+        }
+
+        void bad_subscription(const char *p, const char *end) {
+            bump(malformed, 1);
+            on_malformed(PHONE_TYPE_SUBSCRIBE, p, (size_t)(end - p));
+        }
+
+        int fd;
+        std::vector<uint32_t> spec_vents;
+
+        char in_buffers[PHONE_RECV_BATCH][PHONE_MAX_DATAGRAM];
+        struct iovec in_iov[PHONE_RECV_BATCH];
+        struct sockaddr_in in_from[PHONE_RECV_BATCH];
+        struct mmsghdr in_msgs[PHONE_RECV_BATCH];
+
+        UpdateBuffer *out_refs[PHONE_SEND_BATCH];
+        const struct sockaddr_in *out_to[PHONE_SEND_BATCH];
+        struct iovec out_iov[PHONE_SEND_BATCH];
+        struct mmsghdr out_msgs[PHONE_SEND_BATCH];
+
+        PhoneGateway(const PhoneGateway &);
+        PhoneGateway &operator=(const PhoneGateway &);
+};
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+#define REACTOR_MAX_EVENTS 256
+
+// Anything that owns a file descriptor registered with a Reactor
+class EventHandler{
+    public:
+        virtual ~EventHandler() {}
+
+        // Called with the ready epoll mask (EPOLLIN, EPOLLOUT, EPOLLHUP, ...)
+        virtual void handle_event(uint32_t events) = 0;
+
+        // Called once the reactor is sure no queued event still points at this handler
+        virtual void release() { delete this; }
+};
+
+// Edge-triggered epoll event loop. Every descriptor is registered with EPOLLET, so handlers
+// must drain their fd until EAGAIN. A Reactor is driven by exactly one thread; only stop()
+// may be called from elsewhere.
+class Reactor{
+    public:
+        Reactor() : running(false) {
+            epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            if (epoll_fd < 0) {
+                perror("epoll_create1");
+            }
+            wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            epoll_event ev = {};
+            ev.events = EPOLLIN;
+            ev.data.ptr = NULL;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+        }
+
+        ~Reactor() {
+            release_retired();
+            close(wake_fd);
+            close(epoll_fd);
+        }
+
+        bool add(int fd, EventHandler *handler, uint32_t events = EPOLLIN) {
+            epoll_event ev = {};
+            ev.events = events | EPOLLET;
+            ev.data.ptr = handler;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                perror("epoll_ctl add");
+                return false;
+            }
+            return true;
+        }
+
+        bool modify(int fd, EventHandler *handler, uint32_t events) {
+            epoll_event ev = {};
+            ev.events = events | EPOLLET;
+            ev.data.ptr = handler;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+                perror("epoll_ctl mod");
+                return false;
+            }
+            return true;
+        }
+
+        void remove(int fd) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+        }
+
+        // Events for the handler may still be queued in the current batch, so it is only
+        // released after the batch has been dispatched
+        void retire(EventHandler *handler) {
+            retired.push_back(handler);
+        }
+
+        // Wait up to timeout_ms and dispatch whatever is ready. Returns the number of events
+        // dispatched, or -1 on error.
+        int run_once(int timeout_ms) {
+            int n = epoll_wait(epoll_fd, events, REACTOR_MAX_EVENTS, timeout_ms);
+            if (n < 0) {
+                if (errno != EINTR) {
+                    perror("epoll_wait");
+                    return -1;
+                }
+                return 0;
+            }
+            for (int i = 0; i < n; i++) {
+                EventHandler *handler = (EventHandler *)events[i].data.ptr;
+                if (handler == NULL) {
+                    uint64_t value;
+                    while (read(wake_fd, &value, sizeof(value)) > 0) {}
+                    continue;
+                }
+                handler->handle_event(events[i].events);
+            }
+            release_retired();
+            return n;
+        }
+
+        void run() {
+            running.store(true);
+            while (running.load(std::memory_order_relaxed)) {
+                if (run_once(-1) < 0) {
+                    break;
+                }
+            }
+        }
+
+        // Safe to call from any thread
+        void stop() {
+            running.store(false);
+            wakeup();
+        }
+
+        void wakeup() {
+            uint64_t one = 1;
+            if (write(wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+                perror("eventfd write");
+            }
+        }
+
+        int fd() const { return epoll_fd; }
+
+    private:
+        void release_retired() {
+            for (size_t i = 0; i < retired.size(); i++) {
+                retired[i]->release();
+            }
+            retired.clear();
+        }
+
+        int epoll_fd;
+        int wake_fd;
+        std::atomic<bool> running;
+        epoll_event events[REACTOR_MAX_EVENTS];
+        std::vector<EventHandler *> retired;
+};
+
+// timerfd that calls on_tick() every period_ms once started on a Reactor
+class PeriodicTimer : public EventHandler{
+    public:
+        PeriodicTimer() : fd(-1) {}
+        virtual ~PeriodicTimer() {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+
+        bool start(Reactor &loop, unsigned period_ms) {
+            fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            if (fd < 0) {
+                perror("timerfd_create");
+                return false;
+            }
+            struct itimerspec spec;
+            spec.it_interval.tv_sec = period_ms / 1000;
+            spec.it_interval.tv_nsec = (long)(period_ms % 1000) * 1000000;
+            spec.it_value = spec.it_interval;
+            if (timerfd_settime(fd, 0, &spec, NULL) < 0) {
+                perror("timerfd_settime");
+                return false;
+            }
+            return loop.add(fd, this, EPOLLIN);
+        }
+
+        void handle_event(uint32_t events) {
+            uint64_t expirations;
+            if (read(fd, &expirations, sizeof(expirations)) == (ssize_t)sizeof(expirations)) {
+                on_tick();
+            }
+        }
+
+        // Owned by whoever started it, not by the reactor
+        void release() {}
+
+        virtual void on_tick() = 0;
+
+    protected:
+        int fd;
+};
+
+// eventfd another thread rings to have on_ring() run on the loop thread. Rings that arrive
+// before the loop gets round to it collapse into one call.
+class Doorbell : public EventHandler{
+    public:
+        Doorbell() : fd(-1) {}
+        virtual ~Doorbell() {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+
+        bool start(Reactor &loop) {
+            fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (fd < 0) {
+                perror("eventfd");
+                return false;
+            }
+            return loop.add(fd, this, EPOLLIN);
+        }
+
+        // Safe to call from any thread
+        void ring() {
+            uint64_t one = 1;
+            if (write(fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+                perror("doorbell write");
+            }
+        }
+
+        void handle_event(uint32_t events) {
+            uint64_t value;
+            if (read(fd, &value, sizeof(value)) == (ssize_t)sizeof(value)) {
+                on_ring();
+            }
+        }
+
+        // Owned by whoever started it, not by the reactor
+        void release() {}
+
+        virtual void on_ring() = 0;
+
+    protected:
+        int fd;
+};
+
+// signalfd that calls on_signal() on the loop thread. block() has to run before any other
+// thread is created, so that every thread inherits the mask and the signals are only ever
+// read here instead of killing the process.
+class SignalWatcher : public EventHandler{
+    public:
+        SignalWatcher() : fd(-1) {
+            sigemptyset(&mask);
+        }
+        virtual ~SignalWatcher() {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+
+        bool block(int signo) {
+            sigaddset(&mask, signo);
+            return pthread_sigmask(SIG_BLOCK, &mask, NULL) == 0;
+        }
+
+        bool start(Reactor &loop) {
+            fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+            if (fd < 0) {
+                perror("signalfd");
+                return false;
+            }
+            return loop.add(fd, this, EPOLLIN);
+        }
+
+        void handle_event(uint32_t events) {
+            struct signalfd_siginfo info;
+            while (read(fd, &info, sizeof(info)) == (ssize_t)sizeof(info)) {
+                on_signal((int)info.ssi_signo);
+            }
+        }
+
+        // Owned by whoever started it, not by the reactor
+        void release() {}
+
+        virtual void on_signal(int signo) = 0;
+
+    protected:
+        int fd;
+        sigset_t mask;
+};
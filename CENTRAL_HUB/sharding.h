@@ -0,0 +1,93 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// Helpers for running several reactors side by side. Each reactor gets its own listening
+// socket on the same port with SO_REUSEPORT, so the kernel spreads incoming connections
+// across them by hashing the 4-tuple and no accept lock is shared; a connection then stays
+// on the reactor that accepted it.
+#define MAX_REACTORS 32
+
+// Bound and listening TCP socket on port with SO_REUSEADDR and SO_REUSEPORT, or -1
+inline int reuseport_listen(in_addr_t addr, uint16_t port, int backlog) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket failed");
+        return -1;
+    }
+    int one = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+        perror("setsockopt");
+        close(fd);
+        return -1;
+    }
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = addr;
+    address.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("bind failed");
+        close(fd);
+        return -1;
+    }
+    if (listen(fd, backlog) < 0) {
+        perror("listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// "0,2,4-7" into {0, 2, 4, 5, 6, 7}. False on a malformed list.
+inline bool parse_cpu_list(const char *text, std::vector<int> &cpus) {
+    cpus.clear();
+    const char *p = text;
+    while (*p != '\0') {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0) {
+            return false;
+        }
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first) {
+                return false;
+            }
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            cpus.push_back((int)cpu);
+        }
+        if (*p == ',') {
+            p++;
+        } else if (*p != '\0') {
+            return false;
+        }
+    }
+    return !cpus.empty();
+}
+
+// Pin the calling thread to one CPU
+inline bool pin_to_cpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0) {
+        fprintf(stderr, "pin to cpu %d: %s\n", cpu, strerror(err));
+        return false;
+    }
+    return true;
+}
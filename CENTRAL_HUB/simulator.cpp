@@ -0,0 +1,615 @@
+// Building simulator: thousands of virtual vents, each heating a room with its own thermal
+// response, driving a running hub over its real sockets faster than real time.
+//
+//   g++ -O2 -o simulator simulator.cpp
+//   ./hub --no-log --no-snapshot &
+//   ./simulator [--vents=1000] [--hours=6] [--speed=100] [--report=10] [--noise=0.02]
+//               [--seed=1] [--cooling] [--host=127.0.0.1] [--source=127.1.0.0/16]
+//
+// Each room follows
+//
+//     dT/dt = (outside - T) / loss + flow * open * (supply - T)
+//
+// where open is the cover (motor_pos / 10) that left the hub a duct dead time ago. Loss is
+// 30-90 minutes, the dead time 10-45 s, and the flow would hold the room at 26-34 C fully
+// open. Between events the equation is solved exactly, so the simulation is discrete-event:
+// a room is only touched when its sensor reports, when a cover change reaches it, or when
+// the setpoint or the weather changes.
+//
+// Every vent is its own TCP connection from its own source address out of --source
+// (source_range.h, 127.1.0.0/16 against a hub on loopback), so the hub registers each as a
+// separate vent and a rerun maps each one to the same vent again. A remote hub needs a
+// range of this machine's addresses: rooms sharing one would be scored against a hub that
+// may see them as one vent, so the simulator refuses to run that way. Each vent sends its temperature plus sensor noise
+// every --report simulated seconds and applies whatever motor_pos comes back. A reading the
+// socket cannot take at once waits in the room's output buffer for EPOLLOUT, so it is late
+// rather than lost or split. Setpoints go to the whole house through the phone gateway's
+// zone setpoint (type 6, "=<celsius>"). The hub only puts a vent in the house once it has
+// reported, so the first setpoint waits until every vent has sent a reading, plus
+// SETPOINT_SETTLE_MS of wall clock for the hub to take them in; until then the hub works
+// towards its default 23 C.
+//
+// Simulated time runs --speed times faster than the wall clock. The hub's control laws are
+// driven by readings and its 100 ms tick, not by elapsed time, so at 100x with --report=10
+// the hub sees one reading per vent per tick, as it would with vents reporting every 100 ms;
+// the room sees a controller acting every 10 s. Anything timed in wall clock on the hub
+// (command pacing, MPC sampling every 100 ticks) is stretched by the same factor.
+//
+// The run starts cold (17 C) towards 21 C, steps to 23 C at 40% of the run and back to 21 C
+// at 70%, when the outside also drops from 5 C to -5 C. --cooling runs the same setpoints on
+// 13 C supply air from 27 C, with 30 C then 35 C outside, for the hysteresis law's sense.
+// Settling is the time until a room stays within 0.5 C of the setpoint for the rest of its
+// segment; overshoot is the furthest past the setpoint in the direction of travel. The
+// report also gives the hub's command count and how far the simulation fell behind its
+// schedule, which says whether the hub (or this box) kept up.
+
+#include <algorithm>
+#include <queue>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "framing.h"
+#include "source_range.h"
+
+#define HUB_PORT 8080
+#define HUB_PHONE_PORT 5001
+#define PHONE_ZONE_SETPOINT 6
+#define READING_PACKET 1
+#define CONTROL_PACKET 2
+#define SIM_COVER_MAX 10
+#define SIM_SOURCE_DEFAULT "127.1.0.0/16"
+#define SETTLE_BAND 0.5f
+#define SEGMENTS 3
+#define POLL_EVENTS 256              // events handled between socket polls when behind
+#define SETPOINT_SETTLE_MS 300       // after the last first reading, before the first setpoint
+
+struct Packet{
+    int pkt_type;
+    float temperature;
+    int motor_pos;
+};
+
+enum EventKind{
+    EVENT_READING,      // the room's sensor reports
+    EVENT_AIRFLOW,      // a cover change reaches the room
+    EVENT_SEGMENT,      // setpoint, and perhaps the weather, change for every room
+    EVENT_SETPOINT      // the segment's setpoint, held back until every vent has reported
+};
+
+struct Event{
+    double time;        // simulated seconds
+    uint32_t room;
+    uint32_t kind;
+    float value;
+
+    bool operator>(const Event &other) const { return time > other.time; }
+};
+
+struct Room{
+    double time;            // simulated second temperature is at
+    float temperature;
+    float loss;             // s
+    float flow;             // 1/s fully open
+    float dead;             // s
+    float open;             // airflow now reaching the room, 0-1
+    int cover;              // last motor_pos from the hub
+    int fd;
+    FrameDecoder decoder;
+    std::string out;        // readings the socket has not taken yet
+    bool writing;           // waiting for EPOLLOUT
+    bool closed;
+    bool reported;          // first reading sent
+    uint64_t commands;
+    double last_outside[SEGMENTS];  // last reading outside the band, per segment
+    float overshoot[SEGMENTS];
+    double abs_error;               // |T - setpoint| integrated over readings
+};
+
+struct Settings{
+    size_t vents;
+    double hours;
+    double speed;
+    double report;
+    float noise;
+    uint64_t seed;
+    bool cooling;
+    const char *host;
+    SourceRange source;     // count 0: the one vent uses this machine's address
+};
+
+static uint64_t rng_state = 88172645463325252ull;
+
+static inline uint64_t next_random() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static inline float uniform(float lo, float hi) {
+    return lo + (hi - lo) * (float)(next_random() >> 40) / (float)(1 << 24);
+}
+
+// Sum of uniforms, near enough to normal for sensor noise
+static inline float noise(float sigma) {
+    float s = 0;
+    for (int i = 0; i < 4; i++) {
+        s += uniform(-1.0f, 1.0f);
+    }
+    return s * sigma * 0.866f;
+}
+
+static double wall_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+class Simulation{
+    public:
+        explicit Simulation(const Settings &settings)
+            : settings(settings), epoll_fd(epoll_create1(0)), phone_fd(-1), segment(0),
+              clock(0), reported(0), readings(0), commands(0), failed_sends(0), worst_lag(0),
+              start_wall(0) {
+            double seconds = settings.hours * 3600.0;
+            segment_start[0] = 0;
+            segment_start[1] = seconds * 0.4;
+            segment_start[2] = seconds * 0.7;
+            segment_start[3] = seconds;
+            setpoint[0] = 21.0f;
+            setpoint[1] = 23.0f;
+            setpoint[2] = 21.0f;
+            supply = settings.cooling ? 13.0f : 45.0f;
+            outside[0] = outside[1] = settings.cooling ? 30.0f : 5.0f;
+            outside[2] = settings.cooling ? 35.0f : -5.0f;
+            start_temperature = settings.cooling ? 27.0f : 17.0f;
+        }
+
+        ~Simulation() {
+            for (size_t i = 0; i < rooms.size(); i++) {
+                close(rooms[i].fd);
+            }
+            if (phone_fd >= 0) {
+                close(phone_fd);
+            }
+            close(epoll_fd);
+        }
+
+        bool setup() {
+            memset(&hub, 0, sizeof(hub));
+            hub.sin_family = AF_INET;
+            if (inet_pton(AF_INET, settings.host, &hub.sin_addr) != 1) {
+                fprintf(stderr, "Bad hub address %s\n", settings.host);
+                return false;
+            }
+            phone = hub;
+            hub.sin_port = htons(HUB_PORT);
+            phone.sin_port = htons(HUB_PHONE_PORT);
+            phone_fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+            rng_state = settings.seed * 0x9e3779b97f4a7c15ull | 1;
+            rooms.resize(settings.vents);
+            for (size_t i = 0; i < rooms.size(); i++) {
+                Room &r = rooms[i];
+                r.time = 0;
+                r.temperature = start_temperature;
+                r.loss = uniform(1800.0f, 5400.0f);
+                float open_steady = settings.cooling ? uniform(15.0f, 19.0f) : uniform(26.0f, 34.0f);
+                // open_steady = (outside/loss + flow supply) / (1/loss + flow)
+                r.flow = (open_steady - outside[0]) / (r.loss * (supply - open_steady));
+                r.dead = uniform(10.0f, 45.0f);
+                r.open = 0;
+                r.cover = 0;
+                r.writing = false;
+                r.closed = false;
+                r.reported = false;
+                r.commands = 0;
+                r.abs_error = 0;
+                for (int g = 0; g < SEGMENTS; g++) {
+                    r.last_outside[g] = segment_start[g];
+                    r.overshoot[g] = 0;
+                }
+                r.fd = -1;
+            }
+            return connect_all();
+        }
+
+        void run() {
+            for (size_t i = 0; i < rooms.size(); i++) {
+                Event first = {uniform(0.0f, (float)settings.report), (uint32_t)i, EVENT_READING, 0};
+                events.push(first);
+            }
+            for (int g = 0; g < SEGMENTS; g++) {
+                Event change = {segment_start[g], 0, EVENT_SEGMENT, (float)g};
+                events.push(change);
+            }
+            start_wall = wall_seconds();
+            double end = segment_start[SEGMENTS];
+            size_t handled = 0;
+            while (!events.empty() && events.top().time < end) {
+                double now = (wall_seconds() - start_wall) * settings.speed;
+                const Event next = events.top();
+                if (next.time > now) {
+                    int wait_ms = (int)ceil((next.time - now) / settings.speed * 1000.0);
+                    poll(wait_ms);
+                    continue;
+                }
+                events.pop();
+                clock = next.time;
+                worst_lag = std::max(worst_lag, now - next.time);
+                handle(next);
+                if (++handled % POLL_EVENTS == 0) {
+                    poll(0);
+                }
+            }
+            finish_wall = wall_seconds();
+        }
+
+        void report() const {
+            double seconds = segment_start[SEGMENTS];
+            double wall = finish_wall - start_wall;
+            printf("%zu vents, %.1f h simulated in %.1f s (%.0fx, asked %.0fx); fell behind by at most %.2f s "
+                   "simulated\n", rooms.size(), settings.hours, wall, seconds / wall, settings.speed, worst_lag);
+            printf("readings sent %llu (%llu failed), commands received %llu, %.1f per vent per hour\n",
+                   (unsigned long long)readings, (unsigned long long)failed_sends,
+                   (unsigned long long)commands, commands / (double)rooms.size() / settings.hours);
+            double abs_error = 0;
+            for (size_t i = 0; i < rooms.size(); i++) {
+                abs_error += rooms[i].abs_error;
+            }
+            printf("mean |error| %.2f C over the run\n", abs_error / rooms.size() / seconds);
+            for (int g = 0; g < SEGMENTS; g++) {
+                std::vector<double> settle;
+                std::vector<double> over;
+                size_t never = 0;
+                for (size_t i = 0; i < rooms.size(); i++) {
+                    const Room &r = rooms[i];
+                    if (r.last_outside[g] >= segment_start[g + 1] - settings.report) {
+                        never++;
+                    } else {
+                        settle.push_back((r.last_outside[g] - segment_start[g]) / 60.0);
+                    }
+                    over.push_back(r.overshoot[g]);
+                }
+                printf("  %5.1f C (outside %5.1f C): settled p50 %6.1f min  p90 %6.1f min  never %4zu | "
+                       "overshoot p50 %.2f C  p90 %.2f C\n", setpoint[g], outside[g], percentile(settle, 0.5),
+                       percentile(settle, 0.9), never, percentile(over, 0.5), percentile(over, 0.9));
+            }
+        }
+
+    private:
+        static double percentile(std::vector<double> v, double p) {
+            if (v.empty()) {
+                return NAN;
+            }
+            std::sort(v.begin(), v.end());
+            return v[(size_t)(p * (v.size() - 1))];
+        }
+
+        // Every vent connecting at once, each from its own source address
+        bool connect_all() {
+            size_t pending = 0;
+            for (size_t i = 0; i < rooms.size(); i++) {
+                int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+                if (fd < 0) {
+                    perror("socket");
+                    return false;
+                }
+                rooms[i].fd = fd;
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                struct sockaddr_in source;
+                memset(&source, 0, sizeof(source));
+                source.sin_family = AF_INET;
+                source.sin_addr.s_addr = htonl(source_address(settings.source, i));
+                if (settings.source.count > 0 && bind(fd, (struct sockaddr *)&source, sizeof(source)) < 0) {
+                    fprintf(stderr, "Cannot bind source %s: %s\n", inet_ntoa(source.sin_addr), strerror(errno));
+                    return false;
+                }
+                if (connect(fd, (struct sockaddr *)&hub, sizeof(hub)) < 0 && errno != EINPROGRESS) {
+                    perror("connect");
+                    return false;
+                }
+                epoll_event ev = {};
+                ev.events = EPOLLOUT | EPOLLONESHOT;
+                ev.data.u64 = i;
+                epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+                pending++;
+            }
+            epoll_event ready[POLL_EVENTS];
+            while (pending > 0) {
+                int n = epoll_wait(epoll_fd, ready, POLL_EVENTS, 5000);
+                if (n <= 0) {
+                    fprintf(stderr, "Connecting timed out with %zu vents pending\n", pending);
+                    return false;
+                }
+                for (int e = 0; e < n; e++) {
+                    int err = 0;
+                    socklen_t len = sizeof(err);
+                    getsockopt(rooms[ready[e].data.u64].fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                    if (err != 0) {
+                        fprintf(stderr, "Vent %llu could not connect: %s\n",
+                                (unsigned long long)ready[e].data.u64, strerror(err));
+                        return false;
+                    }
+                }
+                pending -= n;
+            }
+            for (size_t i = 0; i < rooms.size(); i++) {
+                epoll_event ev = {};
+                ev.events = EPOLLIN;
+                ev.data.u64 = i;
+                epoll_ctl(epoll_fd, EPOLL_CTL_MOD, rooms[i].fd, &ev);
+            }
+            return true;
+        }
+
+        // Bring the room's temperature up to time t, exactly: with the airflow and weather
+        // fixed since the last event, T relaxes exponentially towards its equilibrium
+        void advance(Room &r, double t) {
+            double dt = t - r.time;
+            if (dt <= 0) {
+                return;
+            }
+            double rate = 1.0 / r.loss + r.flow * r.open;
+            double equilibrium = (outside[segment] / r.loss + r.flow * r.open * supply) / rate;
+            r.temperature = (float)(equilibrium + (r.temperature - equilibrium) * exp(-rate * dt));
+            r.time = t;
+        }
+
+        void handle(const Event &e) {
+            if (e.kind == EVENT_SEGMENT) {
+                // The weather changes for every room at once, so bring them all up to now
+                for (size_t i = 0; i < rooms.size(); i++) {
+                    advance(rooms[i], e.time);
+                }
+                segment = (int)e.value;
+                if (reported == rooms.size()) {
+                    send_setpoint(setpoint[segment]);
+                }
+                return;
+            }
+            if (e.kind == EVENT_SETPOINT) {
+                send_setpoint(setpoint[segment]);
+                return;
+            }
+            Room &r = rooms[e.room];
+            advance(r, e.time);
+            if (e.kind == EVENT_AIRFLOW) {
+                r.open = e.value;
+                return;
+            }
+            // A reading: score it, send it, and schedule the next
+            float error = r.temperature - setpoint[segment];
+            float from = segment == 0 ? start_temperature : setpoint[segment - 1];
+            float direction = setpoint[segment] > from ? 1.0f : -1.0f;
+            r.overshoot[segment] = std::max(r.overshoot[segment], error * direction);
+            if (fabsf(error) > SETTLE_BAND) {
+                r.last_outside[segment] = e.time;
+            }
+            r.abs_error += fabsf(error) * settings.report;
+
+            Packet data;
+            data.pkt_type = READING_PACKET;
+            data.temperature = r.temperature + noise(settings.noise);
+            data.motor_pos = r.cover;
+            char frame[FRAME_HEADER_SIZE + sizeof(data)];
+            size_t len = encode_frame(frame, &data, sizeof(data));
+            if (!r.closed) {
+                r.out.append(frame, len);
+            }
+            if (!r.closed && flush(e.room)) {
+                readings++;
+            } else {
+                failed_sends++;
+            }
+            if (!r.reported) {
+                r.reported = true;
+                if (++reported == rooms.size()) {
+                    Event settle = {e.time + SETPOINT_SETTLE_MS / 1000.0 * settings.speed, 0, EVENT_SETPOINT, 0};
+                    events.push(settle);
+                }
+            }
+            Event next = {e.time + settings.report, e.room, EVENT_READING, 0};
+            events.push(next);
+        }
+
+        // Write out what the room has queued. Whatever the socket will not take now waits
+        // for EPOLLOUT. Returns false if the connection is gone.
+        bool flush(uint32_t index) {
+            Room &r = rooms[index];
+            while (!r.out.empty()) {
+                ssize_t n = send(r.fd, r.out.data(), r.out.size(), MSG_NOSIGNAL);
+                if (n > 0) {
+                    r.out.erase(0, (size_t)n);
+                } else if (n < 0 && errno == EINTR) {
+                    continue;
+                } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    watch(index, true);
+                    return true;
+                } else {
+                    r.closed = true;
+                    r.out.clear();
+                    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, r.fd, NULL);
+                    return false;
+                }
+            }
+            watch(index, false);
+            return true;
+        }
+
+        void watch(uint32_t index, bool writing) {
+            Room &r = rooms[index];
+            if (r.writing == writing) {
+                return;
+            }
+            r.writing = writing;
+            epoll_event ev = {};
+            ev.events = EPOLLIN | (writing ? EPOLLOUT : 0);
+            ev.data.u64 = index;
+            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, r.fd, &ev);
+        }
+
+        void send_setpoint(float celsius) {
+            char datagram[64];
+            uint32_t type = PHONE_ZONE_SETPOINT;
+            memcpy(datagram, &type, sizeof(type));
+            int len = snprintf(datagram + sizeof(type), sizeof(datagram) - sizeof(type), "=%.1f", celsius);
+            sendto(phone_fd, datagram, sizeof(type) + len, 0, (struct sockaddr *)&phone, sizeof(phone));
+        }
+
+        // Commands from the hub; each cover change reaches its room a dead time later. Behind
+        // schedule, a command still lands at the simulated time reached so far, so falling
+        // behind slows the run down but does not lengthen the loop the rooms see.
+        void poll(int timeout_ms) {
+            epoll_event ready[POLL_EVENTS];
+            int n = epoll_wait(epoll_fd, ready, POLL_EVENTS, timeout_ms);
+            double now = std::max(clock, std::min((wall_seconds() - start_wall) * settings.speed,
+                                                  events.empty() ? clock : events.top().time));
+            char buffer[4096];
+            for (int e = 0; e < n; e++) {
+                uint32_t index = (uint32_t)ready[e].data.u64;
+                Room &r = rooms[index];
+                if ((ready[e].events & EPOLLOUT) && !flush(index)) {
+                    fprintf(stderr, "Vent %u could not send: %s\n", index, strerror(errno));
+                    continue;
+                }
+                ssize_t got;
+                while ((got = recv(r.fd, buffer, sizeof(buffer), 0)) > 0) {
+                    r.decoder.feed(buffer, (size_t)got, [&](const char *payload, size_t len) {
+                        Packet command;
+                        if (len < sizeof(command)) {
+                            return;
+                        }
+                        memcpy(&command, payload, sizeof(command));
+                        if (command.pkt_type != CONTROL_PACKET) {
+                            return;
+                        }
+                        commands++;
+                        r.commands++;
+                        r.cover = std::max(0, std::min(SIM_COVER_MAX, command.motor_pos));
+                        Event arrive = {now + r.dead, index, EVENT_AIRFLOW, r.cover / (float)SIM_COVER_MAX};
+                        events.push(arrive);
+                    });
+                }
+                if (got == 0 && !r.closed) {
+                    fprintf(stderr, "Hub closed vent %u\n", index);
+                    r.closed = true;
+                    r.out.clear();
+                    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, r.fd, NULL);
+                }
+            }
+        }
+
+        Settings settings;
+        int epoll_fd;
+        int phone_fd;
+        struct sockaddr_in hub;
+        struct sockaddr_in phone;
+        std::vector<Room> rooms;
+        std::priority_queue<Event, std::vector<Event>, std::greater<Event> > events;
+        double segment_start[SEGMENTS + 1];
+        float setpoint[SEGMENTS];
+        float outside[SEGMENTS];
+        float supply;
+        float start_temperature;
+        int segment;
+        double clock;                   // simulated time of the last event handled
+        size_t reported;                // rooms that have sent their first reading
+        uint64_t readings;
+        uint64_t commands;
+        uint64_t failed_sends;
+        double worst_lag;
+        double start_wall;
+        double finish_wall;
+};
+
+int main(int argc, char **argv) {
+    Settings settings;
+    settings.vents = 1000;
+    settings.hours = 6;
+    settings.speed = 100;
+    settings.report = 10;
+    settings.noise = 0.02f;
+    settings.seed = 1;
+    settings.cooling = false;
+    settings.host = "127.0.0.1";
+    const char *source = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--vents=", 8) == 0) {
+            settings.vents = strtoul(argv[i] + 8, NULL, 10);
+        } else if (strncmp(argv[i], "--hours=", 8) == 0) {
+            settings.hours = atof(argv[i] + 8);
+        } else if (strncmp(argv[i], "--speed=", 8) == 0) {
+            settings.speed = atof(argv[i] + 8);
+        } else if (strncmp(argv[i], "--report=", 9) == 0) {
+            settings.report = atof(argv[i] + 9);
+        } else if (strncmp(argv[i], "--noise=", 8) == 0) {
+            settings.noise = (float)atof(argv[i] + 8);
+        } else if (strncmp(argv[i], "--seed=", 7) == 0) {
+            settings.seed = strtoull(argv[i] + 7, NULL, 10);
+        } else if (strcmp(argv[i], "--cooling") == 0) {
+            settings.cooling = true;
+        } else if (strncmp(argv[i], "--host=", 7) == 0) {
+            settings.host = argv[i] + 7;
+        } else if (strncmp(argv[i], "--source=", 9) == 0) {
+            source = argv[i] + 9;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (settings.vents == 0 || settings.vents > 0xfffe || settings.speed <= 0 || settings.report <= 0) {
+        fprintf(stderr, "--vents must be 1 to 65534, --speed and --report positive\n");
+        return 1;
+    }
+    struct in_addr hub_addr;
+    bool loopback = inet_pton(AF_INET, settings.host, &hub_addr) == 1 && (ntohl(hub_addr.s_addr) >> 24) == 127;
+    settings.source.base = 0;
+    settings.source.count = 0;
+    if (source == NULL && loopback) {
+        source = SIM_SOURCE_DEFAULT;
+    }
+    if (source == NULL && settings.vents > 1) {
+        fprintf(stderr, "A hub at %s would see every room from this machine's one address; give --source "
+                "with a range of local addresses, one per vent\n", settings.host);
+        return 1;
+    }
+    if (source != NULL && !parse_source_range(source, settings.source)) {
+        fprintf(stderr, "--source takes a range like 10.0.0.0/24\n");
+        return 1;
+    }
+    if (source != NULL && settings.vents > settings.source.count) {
+        fprintf(stderr, "--source %s has %u addresses for %zu vents\n", source, settings.source.count,
+                settings.vents);
+        return 1;
+    }
+
+    // One socket per vent
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+
+    Simulation sim(settings);
+    if (!sim.setup()) {
+        return 1;
+    }
+    sim.run();
+    sim.report();
+    return 0;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <atomic>
+#include <new>
+#include <utility>
+#include <vector>
+
+#define SLAB_POOL_OBJECTS 64    // objects carved from each allocation
+
+// Fixed-size object pool owned by one thread, for objects that come and go at the rate
+// vents reconnect. Storage is taken from the heap SLAB_POOL_OBJECTS at a time and never
+// given back; destroyed objects go on a free list and the most recently freed is reused
+// first, so a vent that reconnects lands in memory that is still in cache. The heap sees one
+// allocation per slab however many connections churn, and the pool only grows to the peak
+// number of objects alive at once.
+//
+// create() and destroy() must be called from the owning thread. The counters are atomics
+// so metrics may read them from elsewhere.
+template <class T>
+class SlabPool{
+    public:
+        SlabPool() : free_list(NULL), in_use(0), slots(0) {}
+
+        // Objects still alive here are not destroyed; their storage simply goes away
+        ~SlabPool() {
+            for (size_t i = 0; i < slabs.size(); i++) {
+                free(slabs[i]);
+            }
+        }
+
+        template <class... Args>
+        T *create(Args &&... args) {
+            if (free_list == NULL) {
+                grow();
+            }
+            Slot *slot = free_list;
+            free_list = slot->next;
+            in_use.store(in_use.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return new (slot->storage) T(std::forward<Args>(args)...);
+        }
+
+        void destroy(T *object) {
+            object->~T();
+            Slot *slot = reinterpret_cast<Slot *>(object);
+            slot->next = free_list;
+            free_list = slot;
+            in_use.store(in_use.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+        }
+
+        // Objects alive now
+        size_t live() const { return in_use.load(std::memory_order_relaxed); }
+
+        // Objects the slabs hold, alive or free
+        size_t capacity() const { return slots.load(std::memory_order_relaxed); }
+
+    private:
+        union Slot{
+            Slot *next;
+            alignas(T) unsigned char storage[sizeof(T)];
+        };
+
+        void grow() {
+            void *memory = NULL;
+            size_t align = alignof(Slot) < sizeof(void *) ? sizeof(void *) : alignof(Slot);
+            if (posix_memalign(&memory, align, sizeof(Slot) * SLAB_POOL_OBJECTS) != 0) {
+                perror("posix_memalign");
+                abort();
+            }
+            Slot *slab = (Slot *)memory;
+            slabs.push_back(slab);
+            for (int i = SLAB_POOL_OBJECTS - 1; i >= 0; i--) {
+                slab[i].next = free_list;
+                free_list = &slab[i];
+            }
+            slots.store(slots.load(std::memory_order_relaxed) + SLAB_POOL_OBJECTS, std::memory_order_relaxed);
+        }
+
+        Slot *free_list;
+        std::vector<Slot *> slabs;
+        std::atomic<size_t> in_use;
+        std::atomic<size_t> slots;
+
+        SlabPool(const SlabPool &);
+        SlabPool &operator=(const SlabPool &);
+};
@@ -0,0 +1,290 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "control_engine.h"
+#include "telemetry_log.h"
+#include "vent_registry.h"
+
+// Binary image of the vent registry and the controller state, so a restarted hub picks up
+// every vent's cover, setpoint and PID memory instead of starting cold.
+//
+// The control thread copies the state into one of two buffers; a writer thread persists the
+// other to a temporary file and renames it over the previous snapshot, so the file on disk
+// is always complete. A snapshot that comes due while the last one is still being written
+// is skipped. Restore maps the file read-only and rebuilds the registry and engine from it.
+#define SNAPSHOT_MAGIC 0x5350414e53544e56ull     // "VNTSNAPS"
+#define SNAPSHOT_VERSION 1
+
+struct SnapshotHeader{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t entry_size;       // sizeof(SnapshotVent) when written
+    uint32_t count;
+    uint32_t crc;              // CRC32C of the entries
+    uint64_t time_ns;          // CLOCK_REALTIME when captured
+    char reserved[32];
+};
+
+// One vent, in registry order. Vents with controller state come first, since the engine
+// shares the registry's indices.
+struct SnapshotVent{
+    uint32_t id;
+    float temperature;
+    float desired_temperature;
+    int32_t cover;
+    float integral;
+    float previous_error;
+    uint8_t controlled;        // has a ControlEngine entry
+    uint8_t user_forced;
+    uint8_t reserved[6];
+};
+
+static_assert(sizeof(SnapshotHeader) == 64, "snapshot header layout");
+static_assert(sizeof(SnapshotVent) == 32, "snapshot entry layout");
+
+// Control thread: copy every vent's state into out
+inline void snapshot_capture(const VentRegistry &registry, const ControlEngine &engine,
+                             std::vector<SnapshotVent> &out) {
+    uint32_t n = registry.size();
+    out.resize(n);
+    for (uint32_t i = 0; i < n; i++) {
+        const Vent &vent = registry.at(i);
+        SnapshotVent &entry = out[i];
+        memset(&entry, 0, sizeof(entry));
+        entry.id = vent.ID;
+        entry.desired_temperature = vent.desired_temperature.load(std::memory_order_relaxed);
+        entry.user_forced = vent.user_forced.load(std::memory_order_relaxed);
+        if (i < engine.size()) {
+            entry.controlled = 1;
+            entry.temperature = engine.get_temperature(i);
+            entry.desired_temperature = engine.get_desired(i);
+            entry.cover = engine.get_cover(i);
+            entry.integral = engine.get_integral(i);
+            entry.previous_error = engine.get_previous_error(i);
+        } else {
+            entry.temperature = vent.temperature.load(std::memory_order_relaxed);
+            entry.cover = (int32_t)vent.cover.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+// Read-only view of a snapshot file
+class SnapshotImage{
+    public:
+        const SnapshotHeader *header;
+        const SnapshotVent *entries;
+
+        SnapshotImage() : header(NULL), entries(NULL), base(NULL), length(0) {}
+        ~SnapshotImage() {
+            if (base != NULL) {
+                munmap(base, length);
+            }
+        }
+
+        // False if there is no snapshot or it fails validation
+        bool open(const char *path) {
+            int fd = ::open(path, O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat st;
+            if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+                ::close(fd);
+                return false;
+            }
+            length = st.st_size;
+            base = mmap(NULL, length, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+            ::close(fd);
+            if (base == MAP_FAILED) {
+                base = NULL;
+                return false;
+            }
+            const SnapshotHeader *h = (const SnapshotHeader *)base;
+            const SnapshotVent *body = (const SnapshotVent *)((const char *)base + sizeof(SnapshotHeader));
+            if (h->magic != SNAPSHOT_MAGIC || h->version != SNAPSHOT_VERSION ||
+                h->entry_size != sizeof(SnapshotVent) ||
+                length < sizeof(SnapshotHeader) + (size_t)h->count * sizeof(SnapshotVent) ||
+                crc32c(0, body, (size_t)h->count * sizeof(SnapshotVent)) != h->crc) {
+                return false;
+            }
+            header = h;
+            entries = body;
+            return true;
+        }
+
+    private:
+        void *base;
+        size_t length;
+
+        SnapshotImage(const SnapshotImage &);
+        SnapshotImage &operator=(const SnapshotImage &);
+};
+
+// Startup, before any thread touches registry or engine. New engine entries take mode;
+// returns the number of vents restored.
+inline uint32_t snapshot_restore(const SnapshotImage &image, VentRegistry &registry,
+                                 ControlEngine &engine, int mode) {
+    uint32_t restored = 0;
+    for (uint32_t i = 0; i < image.header->count; i++) {
+        const SnapshotVent &entry = image.entries[i];
+        Vent *vent = registry.add(entry.id);
+        if (vent == NULL) {
+            break;
+        }
+        vent->temperature.store(entry.temperature, std::memory_order_relaxed);
+        vent->desired_temperature.store(entry.desired_temperature, std::memory_order_relaxed);
+        vent->cover.store((unsigned)entry.cover, std::memory_order_relaxed);
+        vent->user_forced.store(entry.user_forced != 0, std::memory_order_relaxed);
+        if (entry.controlled && engine.size() == vent->index) {
+            engine.add_vent(entry.desired_temperature, mode);
+            engine.restore(vent->index, entry.temperature, entry.integral, entry.previous_error,
+                           entry.cover);
+        }
+        restored++;
+    }
+    return restored;
+}
+
+class SnapshotWriter{
+    public:
+        std::atomic<uint64_t> written;
+        std::atomic<uint64_t> skipped;
+        std::atomic<uint64_t> failed;
+
+        SnapshotWriter() : written(0), skipped(0), failed(0), back(0), front(1), pending(false), stopping(false) {}
+        ~SnapshotWriter() { stop(); }
+
+        bool start(const char *snapshot_path) {
+            path = snapshot_path;
+            writer = std::thread(&SnapshotWriter::write_loop, this);
+            return true;
+        }
+
+        // Control thread: the buffer to capture into. The writer never touches it.
+        std::vector<SnapshotVent> &staging() { return buffers[back]; }
+
+        // The previous snapshot is still being written; capturing now would be wasted
+        bool busy() const { return pending.load(std::memory_order_acquire); }
+
+        // Control thread: hand the staged image to the writer. Returns false, dropping it,
+        // if the writer is still busy with the last one.
+        bool publish() {
+            std::lock_guard<std::mutex> guard(lock);
+            if (pending.load(std::memory_order_relaxed)) {
+                skipped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            front = back;
+            back ^= 1;
+            pending.store(true, std::memory_order_release);
+            wake.notify_one();
+            return true;
+        }
+
+        // Writes anything still pending, then stops the writer
+        void stop() {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (!writer.joinable()) {
+                    return;
+                }
+                stopping = true;
+                wake.notify_one();
+            }
+            writer.join();
+        }
+
+    private:
+        void write_loop() {
+            std::unique_lock<std::mutex> guard(lock);
+            while (1) {
+                wake.wait(guard, [this]() { return pending.load(std::memory_order_relaxed) || stopping; });
+                if (!pending.load(std::memory_order_relaxed)) {
+                    return;
+                }
+                guard.unlock();
+                if (write_file(buffers[front])) {
+                    written.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    failed.fetch_add(1, std::memory_order_relaxed);
+                }
+                guard.lock();
+                pending.store(false, std::memory_order_release);
+            }
+        }
+
+        // Write to path.tmp, sync, then rename over the old snapshot
+        bool write_file(const std::vector<SnapshotVent> &image) {
+            SnapshotHeader header;
+            memset(&header, 0, sizeof(header));
+            header.magic = SNAPSHOT_MAGIC;
+            header.version = SNAPSHOT_VERSION;
+            header.entry_size = sizeof(SnapshotVent);
+            header.count = (uint32_t)image.size();
+            header.crc = crc32c(0, image.data(), image.size() * sizeof(SnapshotVent));
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            header.time_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+
+            std::string tmp = path + ".tmp";
+            int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) {
+                perror("snapshot open");
+                return false;
+            }
+            struct iovec parts[2];
+            parts[0].iov_base = &header;
+            parts[0].iov_len = sizeof(header);
+            parts[1].iov_base = (void *)image.data();
+            parts[1].iov_len = image.size() * sizeof(SnapshotVent);
+            size_t total = parts[0].iov_len + parts[1].iov_len;
+            ssize_t n = writev(fd, parts, 2);
+            if (n != (ssize_t)total || fdatasync(fd) < 0) {
+                perror("snapshot write");
+                ::close(fd);
+                unlink(tmp.c_str());
+                return false;
+            }
+            ::close(fd);
+            if (rename(tmp.c_str(), path.c_str()) < 0) {
+                perror("snapshot rename");
+                unlink(tmp.c_str());
+                return false;
+            }
+            // Make the rename itself durable
+            std::string dir = path.find('/') == std::string::npos ? "." : path.substr(0, path.rfind('/'));
+            int dir_fd = ::open(dir.empty() ? "/" : dir.c_str(), O_RDONLY | O_DIRECTORY);
+            if (dir_fd >= 0) {
+                fsync(dir_fd);
+                ::close(dir_fd);
+            }
+            return true;
+        }
+
+        std::string path;
+        std::vector<SnapshotVent> buffers[2];
+        int back;                  // control thread's buffer
+        int front;                 // writer's buffer, valid while pending
+        std::atomic<bool> pending;
+        bool stopping;
+        std::mutex lock;
+        std::condition_variable wake;
+        std::thread writer;
+
+        SnapshotWriter(const SnapshotWriter &);
+        SnapshotWriter &operator=(const SnapshotWriter &);
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <arpa/inet.h>
+
+// Source addresses for the load tools (client.cpp, simulator.cpp). Connection i binds the
+// (i + 1)-th address of the range, so a hub keying vents by address sees each connection as
+// a vent of its own, the same one on every run. Against a hub on loopback any 127/8 address
+// will do; against a remote hub the range has to be addresses this machine owns (aliases on
+// the interface facing the hub). Host byte order throughout.
+struct SourceRange{
+    uint32_t base;      // network address; never bound itself
+    uint32_t count;     // usable addresses after it, 0 for none (bind nothing)
+};
+
+// "a.b.c.d/n" with n from 8 to 30; the network and broadcast addresses are left out
+inline bool parse_source_range(const char *text, SourceRange &range) {
+    char address[32];
+    int prefix = 0;
+    struct in_addr addr;
+    if (sscanf(text, "%31[0-9.]/%d", address, &prefix) != 2 || prefix < 8 || prefix > 30 ||
+        inet_pton(AF_INET, address, &addr) != 1) {
+        return false;
+    }
+    uint32_t mask = ~0u << (32 - prefix);
+    range.base = ntohl(addr.s_addr) & mask;
+    range.count = ~mask - 1;
+    return true;
+}
+
+inline uint32_t source_address(const SourceRange &range, size_t i) {
+    return range.base + 1 + (uint32_t)i;
+}
@@ -0,0 +1,469 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <deque>
+#include <vector>
+
+// Fan-out of vent updates to any number of phone and dashboard clients.
+//
+// An update is encoded once into a pooled, reference-counted UpdateBuffer; every interested
+// subscriber's queue holds a reference to that same buffer, and the datagram is sent straight
+// from it, so a thousand subscribers cost a thousand pointers, not a thousand copies. Each
+// subscriber has a bounded queue and a send rate. When its queue is full the update is not
+// queued; the subscriber is marked dirty for that vent and kind instead, and once it drains
+// it is sent the vent's latest buffer of that kind. A slow client therefore sees fewer,
+// newer updates and the hub never waits for it. A subscriber not heard from for
+// SUBSCRIBER_IDLE_MS is dropped, so a client that went away (or moved to a new address) stops
+// costing sends; one that stays should re-send its subscription as a keepalive. One thread
+// (the control thread) only.
+#define SUBSCRIBER_QUEUE 256           // updates waiting per subscriber
+#define SUBSCRIBER_RATE 1000           // cap on the rate a subscription may ask for, and its default
+#define SUBSCRIBER_IMPLICIT_RATE 10    // for a client subscribed by sending something else
+#define SUBSCRIBER_IDLE_MS 300000      // dropped after this long without a datagram
+#define SUBSCRIBER_SWEEP_MS 1000       // how often begin() looks for idle subscribers
+#define SUBSCRIBER_BURST_MS 100        // how much unused rate a subscriber may save up
+#define SUBSCRIBERS_MAX 4096           // beyond this the least recently heard is dropped
+#define UPDATE_KINDS 3                 // setup complete, temperature, cover position
+#define UPDATE_MAX_BYTES 64
+
+struct UpdateBuffer{
+    uint32_t refs;
+    uint32_t vent;
+    uint16_t kind;                     // 0 .. UPDATE_KINDS - 1
+    uint16_t len;
+    UpdateBuffer *next_free;
+    char data[UPDATE_MAX_BYTES];
+};
+
+// Buffers are never freed, only returned here, so steady-state fan-out does not allocate
+class UpdatePool{
+    public:
+        UpdatePool() : free_list(NULL), live(0) {}
+
+        // Comes back with one reference, the caller's
+        UpdateBuffer *acquire() {
+            UpdateBuffer *buffer = free_list;
+            if (buffer != NULL) {
+                free_list = buffer->next_free;
+            } else {
+                storage.emplace_back();
+                buffer = &storage.back();
+            }
+            buffer->refs = 1;
+            live++;
+            return buffer;
+        }
+
+        void retain(UpdateBuffer *buffer) { buffer->refs++; }
+
+        void release(UpdateBuffer *buffer) {
+            if (--buffer->refs == 0) {
+                buffer->next_free = free_list;
+                free_list = buffer;
+                live--;
+            }
+        }
+
+        size_t in_use() const { return live; }
+        size_t allocated() const { return storage.size(); }
+
+    private:
+        std::deque<UpdateBuffer> storage;   // a deque so growing it never moves a buffer
+        UpdateBuffer *free_list;
+        size_t live;
+};
+
+class Subscriber{
+    public:
+        struct sockaddr_in addr;
+        bool all;                        // every vent, including ones not yet set up
+        std::vector<uint32_t> vents;     // otherwise these
+        unsigned rate;                   // datagrams a second
+        double tokens;
+        uint64_t refill_ms;
+        uint64_t heard_ms;               // last datagram from it, for eviction
+        bool ready;                      // on the registry's ready list
+
+        Subscriber() : all(true), rate(SUBSCRIBER_RATE), tokens(0), refill_ms(0), heard_ms(0), ready(false),
+                       head(0), count(0) {
+            memset(&addr, 0, sizeof(addr));
+        }
+
+        size_t queued() const { return count; }
+        bool has_work() const { return count > 0 || !dirty_list.empty(); }
+
+    private:
+        friend class SubscriberRegistry;
+        UpdateBuffer *queue[SUBSCRIBER_QUEUE];
+        unsigned head;
+        unsigned count;
+        std::vector<uint8_t> dirty;          // per vent, a bit per kind; sized on first overflow
+        std::vector<uint32_t> dirty_list;    // vents with a dirty bit set
+
+        Subscriber(const Subscriber &);
+        Subscriber &operator=(const Subscriber &);
+};
+
+// Owns the subscribers, the per-vent interest lists and each vent's latest buffer of every
+// kind. The transport asks collect() for the next datagrams to send and hands the buffers
+// back through sent() or lost().
+class SubscriberRegistry{
+    public:
+        std::atomic<uint64_t> published;     // updates encoded, once each
+        std::atomic<uint64_t> queued;        // references queued to subscribers
+        std::atomic<uint64_t> conflated;     // updates folded into a later latest-state send
+        std::atomic<uint64_t> evicted;       // dropped for a new one at SUBSCRIBERS_MAX
+        std::atomic<uint64_t> expired;       // dropped after SUBSCRIBER_IDLE_MS unheard
+        std::atomic<uint64_t> clients;       // subscribers, for readers on other threads
+
+        SubscriberRegistry() : published(0), queued(0), conflated(0), evicted(0), expired(0), clients(0), cursor(0),
+                               now_ms(0), sweep_ms(0) {}
+        ~SubscriberRegistry() {
+            while (!subscribers.empty()) {
+                remove(subscribers.back());
+            }
+            for (size_t v = 0; v < latest.size(); v++) {
+                for (int k = 0; k < UPDATE_KINDS; k++) {
+                    if (latest[v].kind[k] != NULL) {
+                        pool.release(latest[v].kind[k]);
+                    }
+                }
+            }
+        }
+
+        size_t size() const { return subscribers.size(); }
+        const UpdatePool &buffers() const { return pool; }
+        const std::vector<Subscriber *> &all_subscribers() const { return subscribers; }
+
+        Subscriber *find(const struct sockaddr_in &addr) {
+            for (size_t i = 0; i < subscribers.size(); i++) {
+                if (subscribers[i]->addr.sin_addr.s_addr == addr.sin_addr.s_addr &&
+                    subscribers[i]->addr.sin_port == addr.sin_port) {
+                    return subscribers[i];
+                }
+            }
+            return NULL;
+        }
+
+        // Subscribe, or change what an existing subscriber wants: every vent when all is set,
+        // else the listed ones (which are taken, leaving vents empty), at rate datagrams a second
+        Subscriber *subscribe(const struct sockaddr_in &addr, bool all, std::vector<uint32_t> &vents, unsigned rate) {
+            Subscriber *subscriber = find(addr);
+            if (subscriber == NULL) {
+                if (subscribers.size() >= SUBSCRIBERS_MAX) {
+                    evict_oldest();
+                }
+                subscriber = new Subscriber();
+                subscriber->addr = addr;
+                subscriber->refill_ms = now_ms;
+                subscribers.push_back(subscriber);
+                clients.store(subscribers.size(), std::memory_order_relaxed);
+            } else {
+                drop_interest(subscriber);
+            }
+            subscriber->all = all;
+            subscriber->vents.swap(vents);
+            vents.clear();
+            subscriber->rate = rate > 0 ? rate : 1;
+            subscriber->heard_ms = now_ms;
+            subscriber->tokens = burst(*subscriber);
+            add_interest(subscriber);
+            return subscriber;
+        }
+
+        // Any datagram: a client never seen before is subscribed to everything, which is what
+        // the phone app expects, but only at SUBSCRIBER_IMPLICIT_RATE; asking for more takes a
+        // subscription of its own. Either way it keeps the subscriber from expiring.
+        Subscriber *heard(const struct sockaddr_in &addr) {
+            Subscriber *subscriber = find(addr);
+            if (subscriber == NULL) {
+                std::vector<uint32_t> none;
+                return subscribe(addr, true, none, SUBSCRIBER_IMPLICIT_RATE);
+            }
+            subscriber->heard_ms = now_ms;
+            return subscriber;
+        }
+
+        bool unsubscribe(const struct sockaddr_in &addr) {
+            Subscriber *subscriber = find(addr);
+            if (subscriber == NULL) {
+                return false;
+            }
+            remove(subscriber);
+            return true;
+        }
+
+        // Anyone wants updates about this vent
+        bool interested(uint32_t vent) const {
+            return !everything.empty() || (vent < by_vent.size() && !by_vent[vent].empty());
+        }
+
+        // An empty buffer for the caller to encode into, then pass to publish()
+        UpdateBuffer *encode_buffer() { return pool.acquire(); }
+
+        // Queue buffer to every interested subscriber; takes over the caller's reference.
+        // The buffer becomes the vent's latest of its kind, for subscribers that fall behind.
+        void publish(UpdateBuffer *buffer) {
+            published.store(published.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            if (!interested(buffer->vent)) {
+                pool.release(buffer);
+                return;
+            }
+            if (latest.size() <= buffer->vent) {
+                latest.resize(buffer->vent + 1);
+            }
+            UpdateBuffer *&slot = latest[buffer->vent].kind[buffer->kind];
+            if (slot != NULL) {
+                pool.release(slot);
+            }
+            slot = buffer;   // the caller's reference now belongs to latest
+            for (size_t i = 0; i < everything.size(); i++) {
+                offer(everything[i], buffer);
+            }
+            if (buffer->vent < by_vent.size()) {
+                std::vector<Subscriber *> &list = by_vent[buffer->vent];
+                for (size_t i = 0; i < list.size(); i++) {
+                    offer(list[i], buffer);
+                }
+            }
+        }
+
+        // Start a send pass at time now; every subscriber gets its rate's worth of tokens.
+        // About once a SUBSCRIBER_SWEEP_MS the idle ones are dropped first.
+        void begin(uint64_t now) {
+            now_ms = now;
+            cursor = 0;
+            if (now >= sweep_ms) {
+                expire_idle();
+                sweep_ms = now + SUBSCRIBER_SWEEP_MS;
+            }
+        }
+
+        // Fill up to max datagrams, subscriber by subscriber, each within its rate. out[i] is
+        // the buffer for to[i]; both stay valid until sent() or lost(). Returns 0 when the
+        // pass has nothing more to send.
+        unsigned collect(UpdateBuffer **out, const struct sockaddr_in **to, unsigned max) {
+            unsigned n = 0;
+            while (n < max && cursor < ready.size()) {
+                Subscriber *subscriber = ready[cursor];
+                refill(*subscriber);
+                while (n < max && subscriber->tokens >= 1.0) {
+                    UpdateBuffer *buffer = next(*subscriber);
+                    if (buffer == NULL) {
+                        break;
+                    }
+                    out[n] = buffer;
+                    to[n] = &subscriber->addr;
+                    n++;
+                    subscriber->tokens -= 1.0;
+                }
+                if (!subscriber->has_work()) {
+                    subscriber->ready = false;
+                    ready[cursor] = ready.back();
+                    ready.pop_back();
+                } else if (subscriber->tokens < 1.0) {
+                    cursor++;          // out of rate; it stays ready for a later pass
+                }
+            }
+            return n;
+        }
+
+        void sent(UpdateBuffer **buffers, unsigned n) {
+            for (unsigned i = 0; i < n; i++) {
+                pool.release(buffers[i]);
+            }
+        }
+
+        // The transport could not send these; the subscriber gets the latest state later
+        void lost(UpdateBuffer **buffers, const struct sockaddr_in **to, unsigned n) {
+            for (unsigned i = 0; i < n; i++) {
+                Subscriber *subscriber = find(*to[i]);
+                if (subscriber != NULL) {
+                    mark_dirty(subscriber, buffers[i]);
+                }
+                pool.release(buffers[i]);
+            }
+        }
+
+    private:
+        struct Latest{
+            UpdateBuffer *kind[UPDATE_KINDS];
+            Latest() { memset(kind, 0, sizeof(kind)); }
+        };
+
+        static double burst(const Subscriber &subscriber) {
+            double tokens = (double)subscriber.rate * SUBSCRIBER_BURST_MS / 1000.0;
+            return tokens < 1.0 ? 1.0 : tokens;
+        }
+
+        void refill(Subscriber &subscriber) {
+            if (now_ms > subscriber.refill_ms) {
+                subscriber.tokens += (double)(now_ms - subscriber.refill_ms) * subscriber.rate / 1000.0;
+                subscriber.refill_ms = now_ms;
+                double cap = burst(subscriber);
+                if (subscriber.tokens > cap) {
+                    subscriber.tokens = cap;
+                }
+            }
+        }
+
+        void offer(Subscriber *subscriber, UpdateBuffer *buffer) {
+            if (subscriber->count == SUBSCRIBER_QUEUE) {
+                mark_dirty(subscriber, buffer);
+                conflated.store(conflated.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            } else {
+                pool.retain(buffer);
+                subscriber->queue[(subscriber->head + subscriber->count) % SUBSCRIBER_QUEUE] = buffer;
+                subscriber->count++;
+                queued.store(queued.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+            make_ready(subscriber);
+        }
+
+        void mark_dirty(Subscriber *subscriber, const UpdateBuffer *buffer) {
+            if (subscriber->dirty.size() <= buffer->vent) {
+                subscriber->dirty.resize(buffer->vent + 1, 0);
+            }
+            uint8_t &bits = subscriber->dirty[buffer->vent];
+            if (bits == 0) {
+                subscriber->dirty_list.push_back(buffer->vent);
+            }
+            bits |= (uint8_t)(1u << buffer->kind);
+            make_ready(subscriber);
+        }
+
+        void make_ready(Subscriber *subscriber) {
+            if (!subscriber->ready) {
+                subscriber->ready = true;
+                ready.push_back(subscriber);
+            }
+        }
+
+        // Queued updates first, oldest first, then the latest state of anything conflated. A
+        // queued update whose vent and kind are also marked dirty is skipped: the latest
+        // state will follow it anyway.
+        UpdateBuffer *next(Subscriber &subscriber) {
+            while (subscriber.count > 0) {
+                UpdateBuffer *buffer = subscriber.queue[subscriber.head];
+                subscriber.head = (subscriber.head + 1) % SUBSCRIBER_QUEUE;
+                subscriber.count--;
+                if (buffer->vent < subscriber.dirty.size() && (subscriber.dirty[buffer->vent] >> buffer->kind & 1)) {
+                    pool.release(buffer);
+                    continue;
+                }
+                return buffer;
+            }
+            while (!subscriber.dirty_list.empty()) {
+                uint32_t vent = subscriber.dirty_list.back();
+                uint8_t &bits = subscriber.dirty[vent];
+                int kind = __builtin_ctz(bits);
+                bits &= (uint8_t)~(1u << kind);
+                if (bits == 0) {
+                    subscriber.dirty_list.pop_back();
+                }
+                UpdateBuffer *buffer = vent < latest.size() ? latest[vent].kind[kind] : NULL;
+                if (buffer != NULL) {
+                    pool.retain(buffer);
+                    return buffer;
+                }
+            }
+            return NULL;
+        }
+
+        void add_interest(Subscriber *subscriber) {
+            if (subscriber->all) {
+                everything.push_back(subscriber);
+                return;
+            }
+            for (size_t i = 0; i < subscriber->vents.size(); i++) {
+                uint32_t vent = subscriber->vents[i];
+                if (by_vent.size() <= vent) {
+                    by_vent.resize(vent + 1);
+                }
+                by_vent[vent].push_back(subscriber);
+            }
+        }
+
+        static void erase_from(std::vector<Subscriber *> &list, Subscriber *subscriber) {
+            for (size_t i = 0; i < list.size(); i++) {
+                if (list[i] == subscriber) {
+                    list[i] = list.back();
+                    list.pop_back();
+                    return;
+                }
+            }
+        }
+
+        void drop_interest(Subscriber *subscriber) {
+            if (subscriber->all) {
+                erase_from(everything, subscriber);
+            } else {
+                for (size_t i = 0; i < subscriber->vents.size(); i++) {
+                    erase_from(by_vent[subscriber->vents[i]], subscriber);
+                }
+            }
+        }
+
+        void remove(Subscriber *subscriber) {
+            drop_interest(subscriber);
+            while (subscriber->count > 0) {
+                pool.release(subscriber->queue[subscriber->head]);
+                subscriber->head = (subscriber->head + 1) % SUBSCRIBER_QUEUE;
+                subscriber->count--;
+            }
+            if (subscriber->ready) {
+                for (size_t i = 0; i < ready.size(); i++) {
+                    if (ready[i] == subscriber) {
+                        // Keep the order the pass has not reached yet
+                        ready.erase(ready.begin() + i);
+                        if (i < cursor) {
+                            cursor--;
+                        }
+                        break;
+                    }
+                }
+            }
+            erase_from(subscribers, subscriber);
+            clients.store(subscribers.size(), std::memory_order_relaxed);
+            delete subscriber;
+        }
+
+        void evict_oldest() {
+            Subscriber *oldest = subscribers[0];
+            for (size_t i = 1; i < subscribers.size(); i++) {
+                if (subscribers[i]->heard_ms < oldest->heard_ms) {
+                    oldest = subscribers[i];
+                }
+            }
+            remove(oldest);
+            evicted.store(evicted.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        void expire_idle() {
+            for (size_t i = subscribers.size(); i-- > 0; ) {
+                Subscriber *subscriber = subscribers[i];
+                if (subscriber->heard_ms == 0) {
+                    subscriber->heard_ms = now_ms;     // came in before the first pass had a time
+                } else if (now_ms - subscriber->heard_ms > SUBSCRIBER_IDLE_MS) {
+                    remove(subscriber);
+                    expired.store(expired.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        UpdatePool pool;
+        std::vector<Subscriber *> subscribers;
+        std::vector<Subscriber *> everything;               // subscribed to all vents
+        std::vector<std::vector<Subscriber *> > by_vent;    // subscribed to a subset
+        std::vector<Latest> latest;                         // by vent
+        std::vector<Subscriber *> ready;                    // something to send
+        size_t cursor;
+        uint64_t now_ms;
+        uint64_t sweep_ms;                                  // next expire_idle()
+
+        SubscriberRegistry(const SubscriberRegistry &);
+        SubscriberRegistry &operator=(const SubscriberRegistry &);
+};
@@ -0,0 +1,560 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
+
+// Append-only on-disk log of telemetry and control decisions.
+//
+// The log is a directory of fixed-size segment files (seg-00000000.log, ...), each
+// preallocated and mmap'd, so appending a record is a memcpy with no syscall. One writer
+// thread appends; commit() hands everything appended so far to a flusher thread, which
+// msyncs it, so a control tick costs one group commit instead of a write() per packet.
+// The flusher also unmaps finished segments and preallocates the next one ahead of time.
+//
+// Every record carries a CRC32C and a sequence number. Replay stops at the first record
+// that fails either check, which is where a crash tore the tail, and writing resumes there.
+// A checkpoint record holds whatever state the caller needs to start from; each segment's
+// header points at its newest checkpoint so open() can skip straight to it.
+#define LOG_SEGMENT_SIZE (64u << 20)
+#define LOG_MAGIC 0x474f4c5456454842ull      // "BHEVTLOG"
+#define LOG_VERSION 1
+#define LOG_HEADER_SIZE 64
+#define LOG_RECORD_ALIGN 8
+
+#define LOG_TELEMETRY 1
+#define LOG_COMMAND 2
+#define LOG_CHECKPOINT 3
+
+struct LogSegmentHeader{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t index;
+    uint64_t first_seq;
+    uint64_t checkpoint;       // offset of the newest checkpoint record, 0 if none
+    char reserved[LOG_HEADER_SIZE - 32];
+};
+
+struct LogRecordHeader{
+    uint32_t crc;              // CRC32C of everything after this field, payload included
+    uint32_t len;              // payload bytes
+    uint64_t seq;
+    uint64_t time_ns;          // CLOCK_REALTIME at append
+    uint32_t type;
+    uint32_t reserved;
+};
+
+// Payloads the hub writes
+struct LogTelemetry{
+    uint32_t vent;
+    float temperature;
+};
+
+struct LogCommand{
+    uint32_t vent;
+    int32_t cover;
+};
+
+// One entry per vent index in a checkpoint
+struct LogVentState{
+    float temperature;
+    float desired_temperature;
+    int32_t cover;
+};
+
+struct LogRecord{
+    uint32_t type;
+    uint64_t seq;
+    uint64_t time_ns;
+    const char *payload;
+    uint32_t len;
+};
+
+#ifndef __SSE4_2__
+// Byte-at-a-time lookup table for the software crc32c, built once by a function-local
+// static so the first callers on different threads (the log and the snapshot writer) wait
+// for it rather than racing
+struct Crc32cTable{
+    uint32_t entries[256];
+
+    Crc32cTable() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+            }
+            entries[i] = c;
+        }
+    }
+};
+#endif
+
+inline uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    crc = ~crc;
+#ifdef __SSE4_2__
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc = (uint32_t)_mm_crc32_u64(crc, word);
+        p += 8;
+        len -= 8;
+    }
+    while (len > 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+        len--;
+    }
+#else
+    static const Crc32cTable table;
+    while (len > 0) {
+        crc = table.entries[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        len--;
+    }
+#endif
+    return ~crc;
+}
+
+inline size_t log_record_size(uint32_t len) {
+    return (sizeof(LogRecordHeader) + len + LOG_RECORD_ALIGN - 1) & ~(size_t)(LOG_RECORD_ALIGN - 1);
+}
+
+struct LogSegment{
+    uint32_t index;
+    int fd;
+    char *base;
+
+    LogSegment() : index(0), fd(-1), base(NULL) {}
+    LogSegmentHeader *header() const { return (LogSegmentHeader *)base; }
+};
+
+class TelemetryLog{
+    public:
+        uint64_t records_replayed;
+        uint64_t bytes_replayed;
+
+        TelemetryLog() : records_replayed(0), bytes_replayed(0), offset(0), committed(0),
+                         next_seq(1), checkpoint_pending(false), stopping(false), has_spare(false),
+                         preparing(false), spare_failed(false), writer_index(0), keep_segments(0) {}
+
+        ~TelemetryLog() { close(); }
+
+        // Open or create the log in dir and pass every record from the newest checkpoint on
+        // (or from the very start if full) to on_record(const LogRecord &), oldest first.
+        // Starts the flusher. Returns false if the directory cannot be used.
+        template <class F>
+        bool open(const char *path, F on_record, bool full = false) {
+            dir = path;
+            mkdir(path, 0755);
+            std::vector<uint32_t> indices;
+            if (!list_segments(indices)) {
+                return false;
+            }
+
+            // Newest segment whose header names a checkpoint
+            size_t start = 0;
+            uint64_t start_offset = LOG_HEADER_SIZE;
+            if (!full) {
+                for (size_t i = indices.size(); i > 0; i--) {
+                    LogSegmentHeader header;
+                    if (read_header(indices[i - 1], header) && header.checkpoint != 0) {
+                        start = i - 1;
+                        start_offset = header.checkpoint;
+                        break;
+                    }
+                }
+            }
+
+            bool have_seq = false;
+            for (size_t i = start; i < indices.size(); i++) {
+                LogSegment segment;
+                if (!map_segment(indices[i], false, segment)) {
+                    break;
+                }
+                if (segment.header()->magic != LOG_MAGIC || segment.header()->index != indices[i]) {
+                    unmap(segment);
+                    break;
+                }
+                if (have_seq && segment.header()->first_seq != next_seq) {
+                    unmap(segment);                   // left over from before a torn tail
+                    break;
+                }
+                size_t pos = i == start ? start_offset : LOG_HEADER_SIZE;
+                pos = replay_segment(segment, pos, have_seq, on_record);
+                if (current.base != NULL) {
+                    unmap(current);
+                }
+                current = segment;
+                offset = pos;
+            }
+
+            if (current.base == NULL) {
+                uint32_t index = indices.empty() ? 0 : indices.back() + 1;
+                if (!create_segment(index, current)) {
+                    return false;
+                }
+                offset = LOG_HEADER_SIZE;
+                committed = offset;
+            } else {
+                // Pages past the replayed end may hold records of the previous run that
+                // reached the disk out of order. Writing on there could splice them into
+                // the sequence, so start a fresh segment instead.
+                committed = offset;
+                if (!roll()) {
+                    return false;
+                }
+            }
+            writer_index = current.index;
+            flusher = std::thread(&TelemetryLog::flush_loop, this);
+            return true;
+        }
+
+        // Keep only the newest count segments, deleting older ones as the log rolls over.
+        // 0 keeps everything.
+        void set_retention(uint32_t count) { keep_segments = count; }
+
+        // Writer thread. Returns false if the record could not be stored.
+        bool append(uint32_t type, const void *payload, uint32_t len) {
+            size_t size = log_record_size(len);
+            if (size > LOG_SEGMENT_SIZE - LOG_HEADER_SIZE) {
+                return false;
+            }
+            if (offset + size > LOG_SEGMENT_SIZE && !roll()) {
+                return false;
+            }
+            LogRecordHeader *record = (LogRecordHeader *)(current.base + offset);
+            record->len = len;
+            record->seq = next_seq++;
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            record->time_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+            record->type = type;
+            record->reserved = 0;
+            memcpy(record + 1, payload, len);
+            record->crc = crc32c(0, (const char *)record + sizeof(record->crc),
+                                 sizeof(LogRecordHeader) - sizeof(record->crc) + len);
+            offset += size;
+            return true;
+        }
+
+        // Writer thread: a record replay can start from. Committed with the next commit().
+        bool checkpoint(const void *state, uint32_t len) {
+            if (offset + log_record_size(len) > LOG_SEGMENT_SIZE && !roll()) {
+                return false;
+            }
+            uint64_t at = offset;
+            if (!append(LOG_CHECKPOINT, state, len)) {
+                return false;
+            }
+            current.header()->checkpoint = at;
+            checkpoint_pending = true;
+            return true;
+        }
+
+        // Writer thread: make everything appended so far durable in the background
+        void commit() {
+            if (offset == committed && !checkpoint_pending) {
+                return;
+            }
+            SyncJob job;
+            job.segment = current;
+            job.from = committed;
+            job.to = offset;
+            job.header = checkpoint_pending;
+            job.retire = false;
+            committed = offset;
+            checkpoint_pending = false;
+            std::lock_guard<std::mutex> guard(lock);
+            jobs.push_back(job);
+            wake.notify_one();
+        }
+
+        // Commit, wait for the flusher to finish and unmap everything
+        void close() {
+            if (!flusher.joinable()) {
+                return;
+            }
+            commit();
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopping = true;
+                wake.notify_one();
+            }
+            flusher.join();
+            unmap(current);
+            if (has_spare) {
+                unmap(spare);
+                unlink(segment_path(spare.index).c_str());
+                has_spare = false;
+            }
+        }
+
+        uint64_t last_seq() const { return next_seq - 1; }
+
+    private:
+        struct SyncJob{
+            LogSegment segment;
+            size_t from;
+            size_t to;
+            bool header;     // the segment header changed too
+            bool retire;     // unmap and close once synced
+        };
+
+        std::string segment_path(uint32_t index) const {
+            char name[32];
+            snprintf(name, sizeof(name), "/seg-%08u.log", index);
+            return dir + name;
+        }
+
+        bool list_segments(std::vector<uint32_t> &indices) {
+            DIR *d = opendir(dir.c_str());
+            if (d == NULL) {
+                perror("log opendir");
+                return false;
+            }
+            struct dirent *entry;
+            while ((entry = readdir(d)) != NULL) {
+                unsigned index;
+                if (sscanf(entry->d_name, "seg-%8u.log", &index) == 1) {
+                    indices.push_back(index);
+                }
+            }
+            closedir(d);
+            std::sort(indices.begin(), indices.end());
+            return true;
+        }
+
+        bool read_header(uint32_t index, LogSegmentHeader &header) {
+            int fd = ::open(segment_path(index).c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                return false;
+            }
+            bool ok = pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) && header.magic == LOG_MAGIC;
+            ::close(fd);
+            return ok;
+        }
+
+        bool map_segment(uint32_t index, bool create, LogSegment &segment) {
+            int flags = O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_TRUNC : 0);
+            int fd = ::open(segment_path(index).c_str(), flags, 0644);
+            if (fd < 0) {
+                perror("log segment open");
+                return false;
+            }
+            if (create) {
+                int err = posix_fallocate(fd, 0, LOG_SEGMENT_SIZE);
+                if (err != 0) {
+                    fprintf(stderr, "log segment fallocate: %s\n", strerror(err));
+                    ::close(fd);
+                    return false;
+                }
+            } else {
+                struct stat st;
+                if (fstat(fd, &st) < 0 || st.st_size != LOG_SEGMENT_SIZE) {
+                    ::close(fd);
+                    return false;
+                }
+            }
+            void *base = mmap(NULL, LOG_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (base == MAP_FAILED) {
+                perror("log segment mmap");
+                ::close(fd);
+                return false;
+            }
+            segment.index = index;
+            segment.fd = fd;
+            segment.base = (char *)base;
+            return true;
+        }
+
+        // Header is filled in by whoever starts writing the segment, since first_seq is
+        // only known then
+        bool create_segment(uint32_t index, LogSegment &segment) {
+            if (!map_segment(index, true, segment)) {
+                return false;
+            }
+            start_segment(segment, index);
+            return true;
+        }
+
+        void start_segment(LogSegment &segment, uint32_t index) {
+            LogSegmentHeader *header = segment.header();
+            memset(header, 0, sizeof(*header));
+            header->version = LOG_VERSION;
+            header->index = index;
+            header->first_seq = next_seq;
+            header->checkpoint = 0;
+            header->magic = LOG_MAGIC;
+        }
+
+        static void unmap(LogSegment &segment) {
+            if (segment.base != NULL) {
+                munmap(segment.base, LOG_SEGMENT_SIZE);
+                ::close(segment.fd);
+                segment.base = NULL;
+                segment.fd = -1;
+            }
+        }
+
+        // Switch to the next segment, using the preallocated spare when the flusher has one
+        bool roll() {
+            SyncJob job;
+            job.segment = current;
+            job.from = committed;
+            job.to = offset;
+            job.header = true;
+            job.retire = true;
+
+            uint32_t index = current.index + 1;
+            LogSegment next;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                // Never race the flusher creating the same file
+                while (preparing) {
+                    spare_ready.wait(guard);
+                }
+                if (has_spare && spare.index == index) {
+                    next = spare;
+                    has_spare = false;
+                }
+                writer_index = index;
+                jobs.push_back(job);
+                wake.notify_one();
+            }
+            if (next.base == NULL) {
+                if (!map_segment(index, true, next)) {
+                    return false;
+                }
+            }
+            start_segment(next, index);
+            current = next;
+            offset = LOG_HEADER_SIZE;
+            committed = offset;
+            checkpoint_pending = true;          // the new header has to reach the disk too
+            return true;
+        }
+
+        template <class F>
+        size_t replay_segment(LogSegment &segment, size_t pos, bool &have_seq, F &on_record) {
+            while (pos + sizeof(LogRecordHeader) <= LOG_SEGMENT_SIZE) {
+                const LogRecordHeader *header = (const LogRecordHeader *)(segment.base + pos);
+                if (header->len == 0 && header->seq == 0) {
+                    break;
+                }
+                size_t size = log_record_size(header->len);
+                if (header->len > LOG_SEGMENT_SIZE || pos + size > LOG_SEGMENT_SIZE) {
+                    break;
+                }
+                if (have_seq && header->seq != next_seq) {
+                    break;
+                }
+                uint32_t crc = crc32c(0, (const char *)header + sizeof(header->crc),
+                                      sizeof(LogRecordHeader) - sizeof(header->crc) + header->len);
+                if (crc != header->crc) {
+                    break;
+                }
+                LogRecord record;
+                record.type = header->type;
+                record.seq = header->seq;
+                record.time_ns = header->time_ns;
+                record.payload = (const char *)(header + 1);
+                record.len = header->len;
+                on_record(record);
+                records_replayed++;
+                bytes_replayed += size;
+                next_seq = header->seq + 1;
+                have_seq = true;
+                pos += size;
+            }
+            return pos;
+        }
+
+        void flush_loop() {
+            std::unique_lock<std::mutex> guard(lock);
+            while (1) {
+                if (jobs.empty()) {
+                    if (stopping) {
+                        return;
+                    }
+                    // Keep a spare ready so a rollover never waits on the filesystem
+                    if (!has_spare && !spare_failed) {
+                        uint32_t index = writer_index + 1;
+                        preparing = true;
+                        guard.unlock();
+                        LogSegment segment;
+                        bool ok = map_segment(index, true, segment);
+                        guard.lock();
+                        preparing = false;
+                        spare_failed = !ok;
+                        if (ok) {
+                            spare = segment;
+                            has_spare = true;
+                        }
+                        spare_ready.notify_all();
+                        continue;
+                    }
+                    wake.wait(guard);
+                    continue;
+                }
+                SyncJob job = jobs.front();
+                jobs.pop_front();
+                guard.unlock();
+                sync(job);
+                guard.lock();
+            }
+        }
+
+        void sync(const SyncJob &job) {
+            long page = sysconf(_SC_PAGESIZE);
+            if (job.to > job.from) {
+                size_t from = job.from & ~(size_t)(page - 1);
+                msync(job.segment.base + from, job.to - from, MS_SYNC);
+            }
+            if (job.header) {
+                msync(job.segment.base, LOG_HEADER_SIZE, MS_SYNC);
+            }
+            if (job.retire) {
+                LogSegment segment = job.segment;
+                unmap(segment);
+                if (keep_segments > 0 && segment.index + 1 >= keep_segments) {
+                    unlink(segment_path(segment.index + 1 - keep_segments).c_str());
+                }
+            }
+        }
+
+        std::string dir;
+        LogSegment current;
+        size_t offset;                  // next append position in current
+        size_t committed;               // handed to the flusher up to here
+        uint64_t next_seq;
+        bool checkpoint_pending;
+
+        std::mutex lock;                // guards everything below
+        std::condition_variable wake;
+        std::deque<SyncJob> jobs;
+        bool stopping;
+        std::condition_variable spare_ready;
+        LogSegment spare;
+        bool has_spare;
+        bool preparing;                 // flusher is creating the spare
+        bool spare_failed;
+        uint32_t writer_index;
+        uint32_t keep_segments;
+        std::thread flusher;
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <sched.h>
+#include <time.h>
+#include <atomic>
+#include "mpsc_queue.h"
+#include "reactor.h"
+#include "vent_registry.h"
+
+// What to do with a reading when the control thread has fallen behind
+#define OVERFLOW_DROP_OLDEST_PER_VENT 0   // a vent has at most one queued reading; newer ones replace it
+#define OVERFLOW_BLOCK 1                  // the producer waits for the control thread
+#define OVERFLOW_COUNT_AND_DROP 2         // the new reading is dropped and counted
+
+#define TELEMETRY_QUEUE_SIZE 65536
+
+inline uint64_t telemetry_clock_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+struct TelemetryEvent{
+    uint32_t vent;            // registry index
+    float temperature;
+    uint64_t enqueued_ns;     // CLOCK_MONOTONIC when first queued
+};
+
+// Decoded readings on their way from the I/O threads to the control thread.
+//
+// With OVERFLOW_DROP_OLDEST_PER_VENT the reading itself lives in the vent's registry slot and
+// only the vent index is queued, once, until the control thread picks it up; the consumer
+// then reads whatever is newest. The queue therefore never holds more entries than there are
+// vents, and a chatty vent cannot crowd out the rest. Readings that still find the ring full
+// are dropped and counted.
+class TelemetryQueue{
+    public:
+        std::atomic<uint64_t> dropped;      // readings lost to a full ring
+        std::atomic<uint64_t> superseded;   // readings replaced by a newer one before the consumer ran
+        std::atomic<uint64_t> blocked;      // times a producer had to wait
+
+        TelemetryQueue(VentRegistry &registry, int policy, size_t capacity = TELEMETRY_QUEUE_SIZE)
+            : dropped(0), superseded(0), blocked(0), registry(registry), policy(policy),
+              ring(capacity), consumer(NULL) {}
+
+        // Rung when a blocked producer needs the consumer to drain now rather than on its
+        // next tick
+        void set_consumer(Doorbell *doorbell) { consumer = doorbell; }
+
+        int overflow_policy() const { return policy; }
+
+        // Producer side; vent.temperature must already hold the reading. Returns false if the
+        // reading was dropped.
+        bool publish(Vent &vent, float temperature) {
+            TelemetryEvent event;
+            event.vent = vent.index;
+            event.temperature = temperature;
+            event.enqueued_ns = telemetry_clock_ns();
+
+            if (policy == OVERFLOW_DROP_OLDEST_PER_VENT) {
+                if (vent.queued.exchange(true, std::memory_order_acq_rel)) {
+                    superseded.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+                if (!ring.try_push(event)) {
+                    vent.queued.store(false, std::memory_order_release);
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                return true;
+            }
+
+            if (ring.try_push(event)) {
+                return true;
+            }
+            if (policy == OVERFLOW_COUNT_AND_DROP) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            blocked.fetch_add(1, std::memory_order_relaxed);
+            do {
+                if (consumer != NULL) {
+                    consumer->ring();
+                }
+                sched_yield();
+            } while (!ring.try_push(event));
+            return true;
+        }
+
+        // Consumer side: hand every queued reading to on_event(const TelemetryEvent &).
+        // Returns the number handed over.
+        template <class F>
+        size_t drain(F on_event) {
+            TelemetryEvent event;
+            size_t n = 0;
+            while (ring.try_pop(event)) {
+                if (policy == OVERFLOW_DROP_OLDEST_PER_VENT) {
+                    // Clear first: a reading stored after this is queued afresh rather than lost
+                    Vent &vent = registry.at(event.vent);
+                    vent.queued.exchange(false, std::memory_order_acq_rel);
+                    event.temperature = vent.temperature.load(std::memory_order_relaxed);
+                }
+                on_event(event);
+                n++;
+            }
+            return n;
+        }
+
+        size_t size() const { return ring.size(); }
+
+    private:
+        VentRegistry &registry;
+        int policy;
+        MpscQueue<TelemetryEvent> ring;
+        Doorbell *consumer;
+};
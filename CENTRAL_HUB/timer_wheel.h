@@ -0,0 +1,352 @@
+#pragma once
+
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "reactor.h"
+
+// Hierarchical timing wheel. TIMER_LEVELS wheels of TIMER_SLOTS slots each; a timer due
+// within TIMER_SLOTS ticks sits in level 0 at its exact tick, later ones sit in a coarser
+// level and are moved down when the wheel turns over to their slot. Timers are intrusive
+// doubly-linked nodes, so schedule() and cancel() are O(1) with no allocation, and a vent
+// can re-arm its timeout on every reading without the wheel ever looking at timers that are
+// not due. With 10 ms ticks the four levels reach 2.56 s, 11 minutes, 46 hours and 497 days;
+// anything later is clamped to the far end.
+#define TIMER_SLOT_BITS 8
+#define TIMER_SLOTS (1 << TIMER_SLOT_BITS)
+#define TIMER_LEVELS 4
+#define TIMER_MAX_TICKS ((1ull << (TIMER_SLOT_BITS * TIMER_LEVELS)) - 1)
+
+struct TimerLink{
+    TimerLink *prev;
+    TimerLink *next;
+};
+
+class TimerWheel;
+
+// Subclass and implement on_timer(). A timer may be re-scheduled or cancelled from inside
+// any on_timer(), including its own. It must be cancelled before it is destroyed.
+class WheelTimer : private TimerLink{
+    public:
+        WheelTimer() : expires(0), level(0), slot(0) { prev = next = NULL; }
+        virtual ~WheelTimer() {}
+
+        bool armed() const { return prev != NULL; }
+
+        virtual void on_timer() = 0;
+
+    private:
+        friend class TimerWheel;
+        uint64_t expires;      // in ticks
+        uint16_t level;
+        uint16_t slot;
+
+        WheelTimer(const WheelTimer &);
+        WheelTimer &operator=(const WheelTimer &);
+};
+
+// Time is whatever the caller advances it to; LoopTimers ties it to a Reactor. One thread.
+class TimerWheel{
+    public:
+        uint64_t fired;
+
+        TimerWheel() : fired(0), now(0), count(0) {
+            for (int l = 0; l < TIMER_LEVELS; l++) {
+                for (int s = 0; s < TIMER_SLOTS; s++) {
+                    slots[l][s].prev = slots[l][s].next = &slots[l][s];
+                }
+                for (int w = 0; w < TIMER_SLOTS / 64; w++) {
+                    occupied[l][w] = 0;
+                }
+            }
+        }
+
+        uint64_t current() const { return now; }
+        size_t size() const { return count; }
+
+        // Fire timer `ticks` ticks from now, at least one. Re-scheduling an armed timer moves it.
+        void schedule(WheelTimer &timer, uint64_t ticks) {
+            if (timer.armed()) {
+                unlink(timer);
+            }
+            if (ticks == 0) {
+                ticks = 1;
+            } else if (ticks > TIMER_MAX_TICKS) {
+                ticks = TIMER_MAX_TICKS;
+            }
+            timer.expires = now + ticks;
+            insert(timer);
+        }
+
+        void cancel(WheelTimer &timer) {
+            if (timer.armed()) {
+                unlink(timer);
+            }
+        }
+
+        // The tick on which the wheel next touches an armed timer: when it fires, or when its
+        // coarse slot is moved down
+        uint64_t visit_tick(const WheelTimer &timer) const {
+            int shift = timer.level * TIMER_SLOT_BITS;
+            return (timer.expires >> shift) << shift;
+        }
+
+        // Ticks until the timer fires, 0 if it is not armed
+        uint64_t remaining(const WheelTimer &timer) const {
+            return timer.armed() ? timer.expires - now : 0;
+        }
+
+        // Run every timer due up to and including tick `to`, in tick order. Idle stretches are
+        // skipped in one jump, not walked tick by tick.
+        void advance(uint64_t to) {
+            while (now < to) {
+                uint64_t due = next_tick();
+                if (due > to) {
+                    now = to;
+                    return;
+                }
+                now = due - 1;
+                step();
+            }
+        }
+
+        // The next tick at which advance() has work: a level 0 timer firing or a coarser slot
+        // to move down. ~0 when the wheel is empty.
+        uint64_t next_tick() const {
+            if (count == 0) {
+                return ~0ull;
+            }
+            uint64_t best = ~0ull;
+            for (int l = 0; l < TIMER_LEVELS; l++) {
+                int shift = l * TIMER_SLOT_BITS;
+                uint64_t base = now >> shift;
+                int d = next_occupied(l, (int)((base + 1) & (TIMER_SLOTS - 1)));
+                if (d < 0) {
+                    continue;
+                }
+                // A level l slot is visited on the first tick it covers
+                uint64_t tick = (base + 1 + d) << shift;
+                if (tick < best) {
+                    best = tick;
+                }
+            }
+            return best;
+        }
+
+    private:
+        void insert(WheelTimer &timer) {
+            uint64_t delta = timer.expires - now;
+            int level = 0;
+            while (level < TIMER_LEVELS - 1 && delta >= (1ull << ((level + 1) * TIMER_SLOT_BITS))) {
+                level++;
+            }
+            int slot = (int)((timer.expires >> (level * TIMER_SLOT_BITS)) & (TIMER_SLOTS - 1));
+            TimerLink &head = slots[level][slot];
+            timer.prev = head.prev;
+            timer.next = &head;
+            head.prev->next = &timer;
+            head.prev = &timer;
+            timer.level = (uint16_t)level;
+            timer.slot = (uint16_t)slot;
+            occupied[level][slot >> 6] |= 1ull << (slot & 63);
+            count++;
+        }
+
+        void unlink(WheelTimer &timer) {
+            timer.prev->next = timer.next;
+            timer.next->prev = timer.prev;
+            TimerLink &head = slots[timer.level][timer.slot];
+            if (head.next == &head) {
+                occupied[timer.level][timer.slot >> 6] &= ~(1ull << (timer.slot & 63));
+            }
+            timer.prev = timer.next = NULL;
+            count--;
+        }
+
+        // Slots from `from` to the first occupied one of a level, wrapping; -1 if none
+        int next_occupied(int level, int from) const {
+            const int words = TIMER_SLOTS / 64;
+            for (int i = 0; i <= words; i++) {
+                int w = ((from >> 6) + i) % words;
+                uint64_t bits = occupied[level][w];
+                if (i == 0) {
+                    bits &= ~0ull << (from & 63);
+                } else if (i == words) {
+                    // Back at the starting word: only the slots before `from`
+                    bits &= (1ull << (from & 63)) - 1;
+                }
+                if (bits != 0) {
+                    int slot = w * 64 + __builtin_ctzll(bits);
+                    return (slot - from + TIMER_SLOTS) % TIMER_SLOTS;
+                }
+            }
+            return -1;
+        }
+
+        // One tick: move down the coarser slots that start here, then fire level 0
+        void step() {
+            now++;
+            for (int l = TIMER_LEVELS - 1; l > 0; l--) {
+                int shift = l * TIMER_SLOT_BITS;
+                if ((now & ((1ull << shift) - 1)) == 0) {
+                    cascade(l, (int)((now >> shift) & (TIMER_SLOTS - 1)));
+                }
+            }
+            TimerLink &head = slots[0][now & (TIMER_SLOTS - 1)];
+            while (head.next != &head) {
+                WheelTimer *timer = static_cast<WheelTimer *>(head.next);
+                unlink(*timer);
+                fired++;
+                timer->on_timer();
+            }
+        }
+
+        void cascade(int level, int slot) {
+            TimerLink &head = slots[level][slot];
+            while (head.next != &head) {
+                WheelTimer *timer = static_cast<WheelTimer *>(head.next);
+                unlink(*timer);
+                insert(*timer);
+            }
+        }
+
+        uint64_t now;
+        size_t count;
+        TimerLink slots[TIMER_LEVELS][TIMER_SLOTS];
+        uint64_t occupied[TIMER_LEVELS][TIMER_SLOTS / 64];
+};
+
+// A TimerWheel driven by one Reactor. A one-shot timerfd is armed for the wheel's next
+// tick with work, so an idle wheel costs no wakeups and a busy one at most one per tick;
+// pushing a timer back (a vent's timeout moved by a fresh reading) makes no system call.
+// Delays count from the wheel's time, which handle_event() and sync() bring up to the
+// clock; a loop thread that schedules from some other event calls sync() first, once per
+// batch. Loop thread only.
+class LoopTimers : public EventHandler{
+    public:
+        LoopTimers() : fd(-1), tick_ms(1), origin_ms(0), armed_tick(~0ull), advancing(false) {}
+        virtual ~LoopTimers() {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+
+        bool start(Reactor &loop, unsigned tick) {
+            tick_ms = tick > 0 ? tick : 1;
+            origin_ms = clock_ms();
+            fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            if (fd < 0) {
+                perror("timerfd_create");
+                return false;
+            }
+            return loop.add(fd, this, EPOLLIN);
+        }
+
+        void schedule(WheelTimer &timer, uint64_t delay_ms) {
+            wheel.schedule(timer, (delay_ms + tick_ms - 1) / tick_ms);
+            // Inside on_timer() handle_event() re-arms once at the end
+            if (!advancing && wheel.visit_tick(timer) < armed_tick) {
+                arm(wheel.visit_tick(timer));
+            }
+        }
+
+        void cancel(WheelTimer &timer) { wheel.cancel(timer); }
+
+        // Run whatever is due by now; timers firing here may schedule others
+        void sync() {
+            if (advancing) {
+                return;
+            }
+            advancing = true;
+            wheel.advance((clock_ms() - origin_ms) / tick_ms);
+            advancing = false;
+            rearm();
+        }
+
+        uint64_t remaining_ms(const WheelTimer &timer) const { return wheel.remaining(timer) * tick_ms; }
+
+        // Milliseconds since start(), as of the last sync()
+        uint64_t now_ms() const { return wheel.current() * tick_ms; }
+
+        size_t size() const { return wheel.size(); }
+        uint64_t fired() const { return wheel.fired; }
+
+        void handle_event(uint32_t events) {
+            uint64_t expirations;
+            if (read(fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+                perror("timerfd read");
+            }
+            armed_tick = ~0ull;
+            sync();
+        }
+
+        // Owned by whoever started it, not by the reactor
+        void release() {}
+
+    private:
+        static uint64_t clock_ms() {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return (uint64_t)ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+        }
+
+        void rearm() {
+            uint64_t due = wheel.next_tick();
+            if (due < armed_tick) {
+                arm(due);
+            }
+        }
+
+        void arm(uint64_t due) {
+            if (fd < 0) {
+                return;
+            }
+            armed_tick = due;
+            uint64_t at_ms = origin_ms + due * tick_ms;
+            struct itimerspec spec = {};
+            spec.it_value.tv_sec = at_ms / 1000;
+            spec.it_value.tv_nsec = (long)(at_ms % 1000) * 1000000;
+            if (timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+                perror("timerfd_settime");
+            }
+        }
+
+        TimerWheel wheel;
+        int fd;
+        unsigned tick_ms;
+        uint64_t origin_ms;
+        uint64_t armed_tick;   // tick the timerfd is set for, ~0 when disarmed
+        bool advancing;
+};
+
+// Exponential backoff with jitter: the n-th delay is drawn from [d/2, d] with
+// d = min(cap, base * 2^n), so a crowd of vents that went quiet together is re-checked
+// spread over time rather than in lockstep.
+class Backoff{
+    public:
+        unsigned attempts;
+
+        Backoff(uint64_t base_ms, uint64_t cap_ms, uint64_t seed)
+            : attempts(0), base_ms(base_ms), cap_ms(cap_ms), state(seed * 0x9e3779b97f4a7c15ull | 1) {}
+
+        uint64_t next_ms() {
+            uint64_t d = cap_ms;
+            if (attempts < 32 && (base_ms << attempts) < cap_ms) {
+                d = base_ms << attempts;
+            }
+            attempts++;
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return d / 2 + state % (d / 2 + 1);
+        }
+
+        void reset() { attempts = 0; }
+
+    private:
+        uint64_t base_ms;
+        uint64_t cap_ms;
+        uint64_t state;
+};
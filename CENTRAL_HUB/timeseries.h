@@ -0,0 +1,425 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+// Compressed per-vent telemetry history.
+//
+// Samples are (timestamp, temperature, cover). Each vent's samples sit in a list of fixed
+// 1 KiB chunks taken from a shared pool. Inside a chunk the first sample is kept in the
+// header and every later one is a bit stream. A sample that repeats the previous one
+// exactly (same interval, temperature and cover) joins a run:
+//   0 + 6 bits             1-64 repeated samples
+// anything else is 1 followed by
+//   timestamp    delta-of-delta, zigzagged:  0 | 10+7 | 110+9 | 1110+12 | 1111+32 bits
+//   temperature  quantised delta, zigzagged:  0 | 10+1 | 110+5 | 1110+10 | 1111+32 absolute
+//   cover        0 if unchanged, else 1+8
+// A steady vent reporting once a second costs about 0.1 bit per sample; a changing
+// reading 4-15 bits. Temperatures are quantised to the store's resolution (0.1 degree by
+// default, the sensors' own resolution) with a deadband: the stored value only moves once
+// a reading is more than TSDB_TEMP_DEADBAND steps away from it, so a sensor flickering
+// between neighbouring steps costs a run instead of a new sample each second. Readings come
+// back within TSDB_TEMP_DEADBAND steps of what was appended.
+//
+// Each vent keeps at most vent_max_bytes of chunks; past that its oldest chunk is reused,
+// so a vent too noisy to compress loses the far end of its history rather than growing
+// the hub without bound.
+//
+// Not thread-safe: the hub appends and scans from the control thread.
+#define TSDB_CHUNK_BYTES 1024
+#define TSDB_SLAB_CHUNKS 1024
+#define TSDB_TEMP_RESOLUTION 0.1f
+#define TSDB_TEMP_DEADBAND 1.0f      // quantisation steps
+#define TSDB_VENT_MAX_BYTES 262144   // 256 chunks, 90 days of a steady vent
+#define TSDB_CLOCK_SLACK 60          // seconds the clock may step back before history is cut
+#define TSDB_MAX_SAMPLE_BITS 82
+#define TSDB_RUN_BITS 6
+
+struct TimeSample{
+    int64_t timestamp;     // Unix seconds
+    float temperature;
+    int cover;
+};
+
+struct TsChunk{
+    int64_t first_ts;
+    int64_t last_ts;
+    int64_t last_delta;
+    int32_t first_temp;    // quantised
+    int32_t last_temp;
+    uint32_t bits;         // used bits of data
+    uint32_t count;        // samples, including the header one
+    uint32_t run_pos;      // bit offset of the open run's length field, 0 if none
+    uint8_t first_cover;
+    uint8_t last_cover;
+    uint8_t run_len;       // samples in the open run
+    uint8_t data[TSDB_CHUNK_BYTES - 48];
+};
+
+// Fixed-size chunks carved out of large slabs. Freed chunks are reused before a new slab
+// is allocated; slabs are only returned when the pool is destroyed.
+class TsChunkPool{
+    public:
+        TsChunkPool() {}
+        ~TsChunkPool() {
+            for (size_t i = 0; i < slabs.size(); i++) {
+                free(slabs[i]);
+            }
+        }
+
+        TsChunk *alloc() {
+            if (free_list.empty()) {
+                TsChunk *slab = (TsChunk *)malloc(sizeof(TsChunk) * TSDB_SLAB_CHUNKS);
+                if (slab == NULL) {
+                    return NULL;
+                }
+                slabs.push_back(slab);
+                for (size_t i = TSDB_SLAB_CHUNKS; i > 0; i--) {
+                    free_list.push_back(&slab[i - 1]);
+                }
+            }
+            TsChunk *chunk = free_list.back();
+            free_list.pop_back();
+            memset(chunk, 0, sizeof(TsChunk));
+            return chunk;
+        }
+
+        void release(TsChunk *chunk) { free_list.push_back(chunk); }
+
+        size_t chunks_in_use() const { return slabs.size() * TSDB_SLAB_CHUNKS - free_list.size(); }
+        size_t bytes_reserved() const { return slabs.size() * TSDB_SLAB_CHUNKS * sizeof(TsChunk); }
+
+    private:
+        TsChunkPool(const TsChunkPool &);
+        TsChunkPool &operator=(const TsChunkPool &);
+
+        std::vector<TsChunk *> slabs;
+        std::vector<TsChunk *> free_list;
+};
+
+inline uint64_t ts_zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+inline int64_t ts_unzigzag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+// MSB-first bit packing; overwrites whatever was at pos
+inline void ts_put_bits(uint8_t *buf, uint32_t &pos, uint64_t value, unsigned n) {
+    while (n > 0) {
+        unsigned room = 8 - (pos & 7);
+        unsigned take = n < room ? n : room;
+        uint8_t mask = (uint8_t)((1u << take) - 1);
+        uint8_t bits = (uint8_t)(value >> (n - take)) & mask;
+        buf[pos >> 3] = (uint8_t)((buf[pos >> 3] & ~(mask << (room - take))) | (bits << (room - take)));
+        pos += take;
+        n -= take;
+    }
+}
+
+inline uint64_t ts_get_bits(const uint8_t *buf, uint32_t &pos, unsigned n) {
+    uint64_t value = 0;
+    while (n > 0) {
+        unsigned room = 8 - (pos & 7);
+        unsigned take = n < room ? n : room;
+        uint8_t bits = (uint8_t)(buf[pos >> 3] >> (room - take)) & (uint8_t)((1u << take) - 1);
+        value = (value << take) | bits;
+        pos += take;
+        n -= take;
+    }
+    return value;
+}
+
+// Count leading 1 bits, up to max
+inline unsigned ts_get_prefix(const uint8_t *buf, uint32_t &pos, unsigned max) {
+    unsigned n = 0;
+    while (n < max && ts_get_bits(buf, pos, 1)) {
+        n++;
+    }
+    return n;
+}
+
+class TimeSeriesStore{
+    public:
+        explicit TimeSeriesStore(float resolution = TSDB_TEMP_RESOLUTION,
+                                 size_t vent_max_bytes = TSDB_VENT_MAX_BYTES)
+            : scale(1.0f / resolution),
+              vent_max_chunks(vent_max_bytes < sizeof(TsChunk) ? 1 : vent_max_bytes / sizeof(TsChunk)),
+              samples(0), evicted(0), rewinds(0) {}
+        ~TimeSeriesStore() {
+            for (size_t v = 0; v < series.size(); v++) {
+                for (size_t c = 0; c < series[v].size(); c++) {
+                    pool.release(series[v][c]);
+                }
+            }
+        }
+
+        // A timestamp up to TSDB_CLOCK_SLACK seconds behind the vent's last one is stored at
+        // the last one. Further back means the wall clock was stepped: the vent's samples
+        // from timestamp on are dropped, since they can no longer be kept in order, and the
+        // new one goes after what is left. Returns false if the temperature is not a finite
+        // number the store can hold or the pool could not grow.
+        bool append(uint32_t vent, int64_t timestamp, float temperature, int cover) {
+            float raw = temperature * scale;
+            if (!(fabsf(raw) < (float)INT32_MAX)) {
+                return false;
+            }
+            if (vent >= series.size()) {
+                series.resize(vent + 1);
+            }
+            std::vector<TsChunk *> &chunks = series[vent];
+            uint8_t position = (uint8_t)cover;
+            TsChunk *chunk = chunks.empty() ? NULL : chunks.back();
+            if (chunk != NULL && timestamp < chunk->last_ts) {
+                if (chunk->last_ts - timestamp <= TSDB_CLOCK_SLACK) {
+                    timestamp = chunk->last_ts;
+                } else {
+                    rewind(chunks, timestamp);
+                    rewinds++;
+                    chunk = chunks.empty() ? NULL : chunks.back();
+                }
+            }
+            int32_t temp = (int32_t)lrintf(raw);
+            if (chunk != NULL && fabsf(raw - (float)chunk->last_temp) <= TSDB_TEMP_DEADBAND) {
+                temp = chunk->last_temp;
+            }
+            if (chunk != NULL && fits(*chunk, timestamp)) {
+                encode(*chunk, timestamp, temp, position);
+                samples++;
+                return true;
+            }
+
+            if (chunks.size() >= vent_max_chunks) {
+                chunk = chunks.front();
+                chunks.erase(chunks.begin());
+                memset(chunk, 0, sizeof(TsChunk));
+                evicted++;
+            } else {
+                chunk = pool.alloc();
+                if (chunk == NULL) {
+                    return false;
+                }
+            }
+            start(*chunk, timestamp, temp, position);
+            chunks.push_back(chunk);
+            samples++;
+            return true;
+        }
+
+        // Calls on_sample(const TimeSample &) for every sample of vent with
+        // from <= timestamp < to, oldest first. Returns the number of samples visited.
+        template <class F>
+        size_t scan(uint32_t vent, int64_t from, int64_t to, F on_sample) const {
+            if (vent >= series.size()) {
+                return 0;
+            }
+            const std::vector<TsChunk *> &chunks = series[vent];
+            // First chunk that ends at or after from
+            size_t lo = 0;
+            size_t hi = chunks.size();
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                if (chunks[mid]->last_ts < from) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            size_t visited = 0;
+            for (size_t c = lo; c < chunks.size() && chunks[c]->first_ts < to; c++) {
+                visited += decode(*chunks[c], from, to, on_sample);
+            }
+            return visited;
+        }
+
+        // Release every chunk of every vent that ends before cutoff
+        void drop_before(int64_t cutoff) {
+            for (size_t v = 0; v < series.size(); v++) {
+                std::vector<TsChunk *> &chunks = series[v];
+                size_t n = 0;
+                while (n < chunks.size() && chunks[n]->last_ts < cutoff) {
+                    pool.release(chunks[n]);
+                    n++;
+                }
+                chunks.erase(chunks.begin(), chunks.begin() + n);
+            }
+        }
+
+        uint64_t sample_count() const { return samples; }
+        uint64_t chunks_evicted() const { return evicted; }
+        uint64_t clock_rewinds() const { return rewinds; }
+        size_t bytes_used() const { return pool.chunks_in_use() * sizeof(TsChunk); }
+        size_t bytes_reserved() const { return pool.bytes_reserved(); }
+
+    private:
+        static void start(TsChunk &chunk, int64_t timestamp, int32_t temp, uint8_t cover) {
+            chunk.first_ts = chunk.last_ts = timestamp;
+            chunk.first_temp = chunk.last_temp = temp;
+            chunk.first_cover = chunk.last_cover = cover;
+            chunk.count = 1;
+        }
+
+        // Drop the samples at or after timestamp. The chunk that straddles it is
+        // re-encoded in place from the samples it keeps.
+        void rewind(std::vector<TsChunk *> &chunks, int64_t timestamp) {
+            while (!chunks.empty() && chunks.back()->first_ts >= timestamp) {
+                pool.release(chunks.back());
+                chunks.pop_back();
+            }
+            if (chunks.empty() || chunks.back()->last_ts < timestamp) {
+                return;
+            }
+            TsChunk &chunk = *chunks.back();
+            std::vector<TimeSample> kept;
+            auto keep = [&kept](const TimeSample &sample) { kept.push_back(sample); };
+            decode(chunk, INT64_MIN, timestamp, keep);
+            memset(&chunk, 0, sizeof(TsChunk));
+            for (size_t i = 0; i < kept.size(); i++) {
+                int32_t temp = (int32_t)lrintf(kept[i].temperature * scale);
+                if (i == 0) {
+                    start(chunk, kept[i].timestamp, temp, (uint8_t)kept[i].cover);
+                } else {
+                    encode(chunk, kept[i].timestamp, temp, (uint8_t)kept[i].cover);
+                }
+            }
+        }
+
+        // Room for a worst-case sample, and a timestamp step the 32-bit escape can hold
+        static bool fits(const TsChunk &chunk, int64_t timestamp) {
+            int64_t dod = (timestamp - chunk.last_ts) - chunk.last_delta;
+            return chunk.count < UINT32_MAX && chunk.bits + TSDB_MAX_SAMPLE_BITS <= sizeof(chunk.data) * 8 &&
+                   dod >= INT32_MIN && dod <= INT32_MAX;
+        }
+
+        static void encode(TsChunk &chunk, int64_t timestamp, int32_t temp, uint8_t cover) {
+            uint32_t pos = chunk.bits;
+            int64_t delta = timestamp - chunk.last_ts;
+            if (delta == chunk.last_delta && temp == chunk.last_temp && cover == chunk.last_cover &&
+                chunk.count > 1) {
+                if (chunk.run_pos != 0 && chunk.run_len < (1u << TSDB_RUN_BITS)) {
+                    uint32_t at = chunk.run_pos;
+                    ts_put_bits(chunk.data, at, chunk.run_len, TSDB_RUN_BITS);
+                    chunk.run_len++;
+                } else {
+                    ts_put_bits(chunk.data, pos, 0, 1);
+                    chunk.run_pos = pos;
+                    ts_put_bits(chunk.data, pos, 0, TSDB_RUN_BITS);
+                    chunk.run_len = 1;
+                }
+                chunk.bits = pos;
+                chunk.last_ts = timestamp;
+                chunk.count++;
+                return;
+            }
+            chunk.run_pos = 0;
+            ts_put_bits(chunk.data, pos, 1, 1);
+
+            uint64_t dod = ts_zigzag(delta - chunk.last_delta);
+            if (dod == 0) {
+                ts_put_bits(chunk.data, pos, 0, 1);
+            } else if (dod < (1u << 7)) {
+                ts_put_bits(chunk.data, pos, 0x2, 2);
+                ts_put_bits(chunk.data, pos, dod, 7);
+            } else if (dod < (1u << 9)) {
+                ts_put_bits(chunk.data, pos, 0x6, 3);
+                ts_put_bits(chunk.data, pos, dod, 9);
+            } else if (dod < (1u << 12)) {
+                ts_put_bits(chunk.data, pos, 0xe, 4);
+                ts_put_bits(chunk.data, pos, dod, 12);
+            } else {
+                ts_put_bits(chunk.data, pos, 0xf, 4);
+                ts_put_bits(chunk.data, pos, dod, 32);
+            }
+
+            uint64_t dt = ts_zigzag((int64_t)temp - chunk.last_temp);
+            if (dt == 0) {
+                ts_put_bits(chunk.data, pos, 0, 1);
+            } else if (dt <= 2) {
+                ts_put_bits(chunk.data, pos, 0x2, 2);
+                ts_put_bits(chunk.data, pos, dt - 1, 1);
+            } else if (dt < (1u << 5)) {
+                ts_put_bits(chunk.data, pos, 0x6, 3);
+                ts_put_bits(chunk.data, pos, dt, 5);
+            } else if (dt < (1u << 10)) {
+                ts_put_bits(chunk.data, pos, 0xe, 4);
+                ts_put_bits(chunk.data, pos, dt, 10);
+            } else {
+                ts_put_bits(chunk.data, pos, 0xf, 4);
+                ts_put_bits(chunk.data, pos, (uint32_t)temp, 32);
+            }
+
+            if (cover == chunk.last_cover) {
+                ts_put_bits(chunk.data, pos, 0, 1);
+            } else {
+                ts_put_bits(chunk.data, pos, 1, 1);
+                ts_put_bits(chunk.data, pos, cover, 8);
+            }
+
+            chunk.bits = pos;
+            chunk.last_delta = delta;
+            chunk.last_ts = timestamp;
+            chunk.last_temp = temp;
+            chunk.last_cover = cover;
+            chunk.count++;
+        }
+
+        template <class F>
+        size_t decode(const TsChunk &chunk, int64_t from, int64_t to, F &on_sample) const {
+            static const unsigned ts_widths[] = {0, 7, 9, 12, 32};
+            static const unsigned temp_widths[] = {0, 1, 5, 10};
+            int64_t ts = chunk.first_ts;
+            int64_t delta = 0;
+            int32_t temp = chunk.first_temp;
+            int cover = chunk.first_cover;
+            uint32_t pos = 0;
+            unsigned repeats = 0;
+            size_t visited = 0;
+            for (uint32_t i = 0; i < chunk.count; i++) {
+                if (repeats > 0) {
+                    repeats--;
+                    ts += delta;
+                } else if (i > 0) {
+                    if (!ts_get_bits(chunk.data, pos, 1)) {
+                        repeats = (unsigned)ts_get_bits(chunk.data, pos, TSDB_RUN_BITS);
+                        ts += delta;
+                    } else {
+                        unsigned code = ts_get_prefix(chunk.data, pos, 4);
+                        delta += code == 0 ? 0 : ts_unzigzag(ts_get_bits(chunk.data, pos, ts_widths[code]));
+                        ts += delta;
+
+                        code = ts_get_prefix(chunk.data, pos, 4);
+                        if (code == 4) {
+                            temp = (int32_t)ts_get_bits(chunk.data, pos, 32);
+                        } else if (code == 1) {
+                            temp += (int32_t)ts_unzigzag(1 + ts_get_bits(chunk.data, pos, 1));
+                        } else if (code > 0) {
+                            temp += (int32_t)ts_unzigzag(ts_get_bits(chunk.data, pos, temp_widths[code]));
+                        }
+
+                        if (ts_get_bits(chunk.data, pos, 1)) {
+                            cover = (int)ts_get_bits(chunk.data, pos, 8);
+                        }
+                    }
+                }
+                if (ts >= to) {
+                    break;
+                }
+                if (ts >= from) {
+                    TimeSample sample;
+                    sample.timestamp = ts;
+                    sample.temperature = temp / scale;
+                    sample.cover = cover;
+                    on_sample(sample);
+                    visited++;
+                }
+            }
+            return visited;
+        }
+
+        float scale;
+        size_t vent_max_chunks;
+        TsChunkPool pool;
+        std::vector<std::vector<TsChunk *> > series;
+        uint64_t samples;
+        uint64_t evicted;
+        uint64_t rewinds;
+};
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define VENT_SEGMENT_SIZE 1024
+#define VENT_MAX_SEGMENTS 1024
+#define VENT_REGISTRY_MAX (VENT_SEGMENT_SIZE * VENT_MAX_SEGMENTS)
+#define VENT_INDEX_EMPTY (~0ull)
+
+class Connection;
+
+// Hot per-vent state, one cache line per vent so I/O threads updating neighbouring vents
+// never share a line. Fields are atomics because any thread may read them.
+class alignas(64) Vent{
+    public:
+        unsigned ID;
+        uint32_t index;                  // dense position, shared with ControlEngine
+        std::atomic<float> temperature;
+        std::atomic<float> desired_temperature;
+        std::atomic<unsigned> cover;
+        std::atomic<bool> user_forced;   // cover held from the phone until it sends a setpoint
+        std::atomic<bool> connected;
+        std::atomic<bool> queued;        // a reading is waiting in the TelemetryQueue
+        std::atomic<bool> command_queued; // a cover position is waiting in CommandEgress
+        std::atomic<uint64_t> packets;   // readings decoded, written by the vent's I/O thread only
+        std::atomic<uint64_t> reading_ns; // when the reading behind the latest command was queued
+        std::atomic<uint32_t> shard;     // reactor that owns its current connection
+
+        // Default constructor
+        Vent() : ID(0), index(0), temperature(0.0f), desired_temperature(23.0f), cover(0),
+                 user_forced(false), connected(false), queued(false),
+                 command_queued(false), packets(0), reading_ns(0), shard(0) {}
+};
+
+// Cold metadata, touched on connect/disconnect and by the phone path, never per packet
+class VentInfo{
+    public:
+        std::string ble_name;
+        struct sockaddr_in peer;
+
+        VentInfo() {
+            memset(&peer, 0, sizeof(peer));
+        }
+};
+
+// Open-addressed index from a 32-bit key to a dense vent index. Key and index share one
+// 64-bit word so a reader never sees half an entry. Linear probing, load factor <= 1/2.
+class VentIndexTable{
+    public:
+        uint32_t mask;
+        std::atomic<uint64_t> *slots;
+
+        VentIndexTable(uint32_t capacity) : mask(capacity - 1) {
+            slots = new std::atomic<uint64_t>[capacity];
+            for (uint32_t i = 0; i < capacity; i++) {
+                slots[i].store(VENT_INDEX_EMPTY, std::memory_order_relaxed);
+            }
+        }
+        ~VentIndexTable() { delete[] slots; }
+
+        static uint32_t home(uint32_t key, uint32_t mask) {
+            return (uint32_t)(((uint64_t)key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+        }
+
+        // Writer only; the key must not be present
+        void insert(uint32_t key, uint32_t index) {
+            uint32_t slot = home(key, mask);
+            while (slots[slot].load(std::memory_order_relaxed) != VENT_INDEX_EMPTY) {
+                slot = (slot + 1) & mask;
+            }
+            slots[slot].store(((uint64_t)key << 32) | index, std::memory_order_release);
+        }
+
+    private:
+        VentIndexTable(const VentIndexTable &);
+        VentIndexTable &operator=(const VentIndexTable &);
+};
+
+// Growable vent table keyed by vent ID and by BLE name.
+//
+// Readers (find, find_by_name, at) are lock-free and may run on any thread. Writers (add)
+// serialise on a mutex. Vents live in fixed segments that never move, so a Vent pointer
+// stays valid for the registry's lifetime; index tables are rebuilt at twice the size when
+// half full and the old ones are kept until destruction, since a reader may still be
+// probing them.
+class VentRegistry{
+    public:
+        VentRegistry() : count(0) {
+            for (int i = 0; i < VENT_MAX_SEGMENTS; i++) {
+                hot[i].store(NULL, std::memory_order_relaxed);
+                cold[i] = NULL;
+            }
+            by_id.store(new VentIndexTable(64), std::memory_order_relaxed);
+            by_name.store(new VentIndexTable(64), std::memory_order_relaxed);
+        }
+
+        ~VentRegistry() {
+            for (int i = 0; i < VENT_MAX_SEGMENTS; i++) {
+                delete[] hot[i].load(std::memory_order_relaxed);
+                delete[] cold[i];
+            }
+            delete by_id.load(std::memory_order_relaxed);
+            delete by_name.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < retired.size(); i++) {
+                delete retired[i];
+            }
+        }
+
+        // Register a vent, or return the existing one with this ID. ble_name may be NULL.
+        // Returns NULL once VENT_REGISTRY_MAX vents exist.
+        Vent *add(unsigned id, const char *ble_name = NULL) {
+            std::lock_guard<std::mutex> guard(writer);
+            Vent *existing = find(id);
+            if (existing != NULL) {
+                return existing;
+            }
+            uint32_t index = count.load(std::memory_order_relaxed);
+            if (index >= VENT_REGISTRY_MAX) {
+                return NULL;
+            }
+
+            uint32_t segment = index / VENT_SEGMENT_SIZE;
+            if (hot[segment].load(std::memory_order_relaxed) == NULL) {
+                cold[segment] = new VentInfo[VENT_SEGMENT_SIZE];
+                hot[segment].store(new Vent[VENT_SEGMENT_SIZE], std::memory_order_release);
+            }
+            Vent &vent = hot[segment].load(std::memory_order_relaxed)[index % VENT_SEGMENT_SIZE];
+            vent.ID = id;
+            vent.index = index;
+            if (ble_name != NULL) {
+                cold[segment][index % VENT_SEGMENT_SIZE].ble_name = ble_name;
+            }
+
+            // Grow before the table passes half full
+            if ((index + 1) * 2 > by_id.load(std::memory_order_relaxed)->mask + 1) {
+                rebuild((by_id.load(std::memory_order_relaxed)->mask + 1) * 2);
+            }
+            by_id.load(std::memory_order_relaxed)->insert(id, index);
+            if (ble_name != NULL) {
+                by_name.load(std::memory_order_relaxed)->insert(name_hash(ble_name, strlen(ble_name)), index);
+            }
+            count.store(index + 1, std::memory_order_release);
+            return &vent;
+        }
+
+        Vent *find(unsigned id) const {
+            const VentIndexTable *table = by_id.load(std::memory_order_acquire);
+            uint32_t slot = VentIndexTable::home(id, table->mask);
+            while (1) {
+                uint64_t entry = table->slots[slot].load(std::memory_order_acquire);
+                if (entry == VENT_INDEX_EMPTY) {
+                    return NULL;
+                }
+                if ((uint32_t)(entry >> 32) == id) {
+                    return &at((uint32_t)entry);
+                }
+                slot = (slot + 1) & table->mask;
+            }
+        }
+
+        // Hashes collide, so every candidate's stored name is compared
+        Vent *find_by_name(const char *name, size_t len) const {
+            const VentIndexTable *table = by_name.load(std::memory_order_acquire);
+            uint32_t key = name_hash(name, len);
+            uint32_t slot = VentIndexTable::home(key, table->mask);
+            while (1) {
+                uint64_t entry = table->slots[slot].load(std::memory_order_acquire);
+                if (entry == VENT_INDEX_EMPTY) {
+                    return NULL;
+                }
+                if ((uint32_t)(entry >> 32) == key) {
+                    const std::string &stored = info((uint32_t)entry).ble_name;
+                    if (stored.size() == len && memcmp(stored.data(), name, len) == 0) {
+                        return &at((uint32_t)entry);
+                    }
+                }
+                slot = (slot + 1) & table->mask;
+            }
+        }
+
+        // Give an already registered vent a BLE name (phone setup names vents after the fact)
+        bool set_name(Vent &vent, const char *ble_name) {
+            std::lock_guard<std::mutex> guard(writer);
+            VentInfo &meta = info(vent.index);
+            if (!meta.ble_name.empty()) {
+                return meta.ble_name == ble_name;
+            }
+            meta.ble_name = ble_name;
+            by_name.load(std::memory_order_relaxed)->insert(name_hash(ble_name, strlen(ble_name)), vent.index);
+            return true;
+        }
+
+        Vent &at(uint32_t index) const {
+            return hot[index / VENT_SEGMENT_SIZE].load(std::memory_order_acquire)[index % VENT_SEGMENT_SIZE];
+        }
+
+        VentInfo &info(uint32_t index) const {
+            return cold[index / VENT_SEGMENT_SIZE][index % VENT_SEGMENT_SIZE];
+        }
+
+        uint32_t size() const { return count.load(std::memory_order_acquire); }
+
+        // FNV-1a, folded to 32 bits
+        static uint32_t name_hash(const char *name, size_t len) {
+            uint64_t h = 14695981039346656037ull;
+            for (size_t i = 0; i < len; i++) {
+                h ^= (unsigned char)name[i];
+                h *= 1099511628211ull;
+            }
+            return (uint32_t)(h ^ (h >> 32));
+        }
+
+    private:
+        // Writer only. Both tables are rebuilt together so they always share a capacity.
+        void rebuild(uint32_t capacity) {
+            uint32_t n = count.load(std::memory_order_relaxed);
+            VentIndexTable *ids = new VentIndexTable(capacity);
+            VentIndexTable *names = new VentIndexTable(capacity);
+            for (uint32_t i = 0; i < n; i++) {
+                ids->insert(at(i).ID, i);
+                const std::string &name = info(i).ble_name;
+                if (!name.empty()) {
+                    names->insert(name_hash(name.data(), name.size()), i);
+                }
+            }
+            retired.push_back(by_id.exchange(ids, std::memory_order_acq_rel));
+            retired.push_back(by_name.exchange(names, std::memory_order_acq_rel));
+        }
+
+        std::atomic<Vent *> hot[VENT_MAX_SEGMENTS];
+        VentInfo *cold[VENT_MAX_SEGMENTS];
+        std::atomic<VentIndexTable *> by_id;
+        std::atomic<VentIndexTable *> by_name;
+        std::atomic<uint32_t> count;
+        std::mutex writer;
+        std::vector<VentIndexTable *> retired;
+};
@@ -0,0 +1,373 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+
+#define ZONE_HOUSE 0            // the root; every other zone hangs below it
+#define ZONE_NONE (~0u)
+#define ZONE_DEFAULT_AREA 1.0f  // vents of unknown size count alike
+
+// What a zone reports about the vents below it, at any depth
+struct ZoneStats{
+    uint32_t vents;             // assigned, reporting or not
+    uint32_t reporting;         // have a temperature
+    float average;              // temperatures; NAN until a vent reports
+    float minimum;
+    float maximum;
+    float error;                // mean temperature minus setpoint; positive is too warm
+    float abs_error;            // mean |temperature - setpoint|
+    float open_fraction;        // open cover area over total vent area
+    float setpoint;             // last zone setpoint, NAN if never set for this zone
+};
+
+// One vent's contribution, as last folded into its zones. 16 bytes, so a large house's
+// vents stay cache resident.
+struct ZoneSample{
+    uint32_t zone;              // ZONE_NONE until assigned
+    float temperature;          // NAN until the vent reports
+    float desired;
+    float open_area;            // cover open fraction times the vent's area
+
+    bool reporting() const { return temperature == temperature; }
+};
+
+// Vent -> room -> floor -> house, or any other depth. Each zone keeps running sums over
+// every vent in its subtree, so a reading, setpoint or cover change walks once from the
+// vent's zone to the root adjusting them: O(depth), however large the house.
+//
+// Minimum and maximum cannot be undone from a sum. A new extreme is taken as it arrives;
+// when the vent holding a zone's extreme moves away from it, the zone marks that extreme
+// stale instead of searching, and read() repairs it from the zone's members and children,
+// recursing only into children that are stale too. Sums are doubles so millions of deltas
+// do not drift a reading's worth.
+//
+// A zone's running totals fill one cache line, apart from its name and lists, so a reading
+// touches one line per level. Single-threaded: the hub keeps it on the control thread next
+// to ControlEngine.
+class ZoneTree{
+    public:
+        ZoneTree() { add_zone("house", ZONE_NONE); }
+
+        // Returns the new zone's index; parent must already exist
+        uint32_t add_zone(const std::string &name, uint32_t parent) {
+            uint32_t index = (uint32_t)totals.size();
+            totals.push_back(ZoneTotals());
+            totals.back().parent = parent;
+            info.push_back(ZoneInfo());
+            info.back().name = name;
+            info.back().depth = parent == ZONE_NONE ? 0 : info[parent].depth + 1;
+            if (parent != ZONE_NONE) {
+                info[parent].children.push_back(index);
+            }
+            return index;
+        }
+
+        // "Upstairs/Bedroom", relative to the house. Missing zones are created when create
+        // is set, otherwise ZONE_NONE.
+        uint32_t find(const char *path, bool create = false) {
+            uint32_t zone = ZONE_HOUSE;
+            while (*path != '\0') {
+                const char *slash = strchr(path, '/');
+                size_t len = slash != NULL ? (size_t)(slash - path) : strlen(path);
+                if (len > 0) {
+                    uint32_t next = child(zone, path, len);
+                    if (next == ZONE_NONE) {
+                        if (!create) {
+                            return ZONE_NONE;
+                        }
+                        next = add_zone(std::string(path, len), zone);
+                    }
+                    zone = next;
+                }
+                path += len;
+                if (*path == '/') {
+                    path++;
+                }
+            }
+            return zone;
+        }
+
+        // Place a vent in a zone, moving it and its contribution if it was elsewhere
+        void assign(uint32_t vent, uint32_t zone, float area = ZONE_DEFAULT_AREA) {
+            grow(vent);
+            ZoneSample &sample = samples[vent];
+            ZoneSample none = sample;
+            none.temperature = NAN;
+            none.open_area = 0.0f;
+            if (sample.zone != ZONE_NONE) {
+                fold(sample.zone, sample, none, -1, -areas[vent]);
+                remove_member(sample.zone, vent);
+            }
+            float open = areas[vent] > 0.0f ? sample.open_area / areas[vent] : 0.0f;
+            sample.zone = zone;
+            sample.open_area = open * area;
+            areas[vent] = area;
+            info[zone].members.push_back(vent);
+            fold(zone, none, sample, 1, area);
+        }
+
+        // Vents the layout never named report to the house itself
+        uint32_t ensure(uint32_t vent) {
+            if (zone_of(vent) == ZONE_NONE) {
+                assign(vent, ZONE_HOUSE);
+            }
+            return samples[vent].zone;
+        }
+
+        void set_temperature(uint32_t vent, float t) {
+            ZoneSample next = samples[vent];
+            next.temperature = t;
+            update(vent, next);
+        }
+
+        void set_desired(uint32_t vent, float d) {
+            ZoneSample next = samples[vent];
+            next.desired = d;
+            update(vent, next);
+        }
+
+        // 0 closed to 1 open
+        void set_open(uint32_t vent, float open) {
+            ZoneSample next = samples[vent];
+            next.open_area = open * areas[vent];
+            update(vent, next);
+        }
+
+        // The vent stops counting towards temperatures (silent, or its reading is stale)
+        void forget_temperature(uint32_t vent) {
+            ZoneSample next = samples[vent];
+            next.temperature = NAN;
+            update(vent, next);
+        }
+
+        // Every vent below zone gets the setpoint; their indices are appended to changed so
+        // the caller can hand them to the controller. O(vents below zone + depth): the
+        // subtree's error sums are rebuilt once and the difference walked to the root.
+        void set_setpoint(uint32_t zone, float celsius, std::vector<uint32_t> &changed) {
+            ZoneTotals &top = totals[zone];
+            double error = top.error, abs_error = top.abs_error;
+            apply_setpoint(zone, celsius, changed);
+            double d_error = top.error - error, d_abs = top.abs_error - abs_error;
+            for (uint32_t z = top.parent; z != ZONE_NONE; z = totals[z].parent) {
+                totals[z].error += d_error;
+                totals[z].abs_error += d_abs;
+            }
+        }
+
+        ZoneStats read(uint32_t zone) {
+            repair(zone);
+            const ZoneTotals &z = totals[zone];
+            ZoneStats stats;
+            stats.vents = z.vents;
+            stats.reporting = z.reporting;
+            if (z.reporting > 0) {
+                stats.average = (float)(z.temperature / z.reporting);
+                stats.error = (float)(z.error / z.reporting);
+                stats.abs_error = (float)(z.abs_error / z.reporting);
+                stats.minimum = z.minimum;
+                stats.maximum = z.maximum;
+            } else {
+                stats.average = stats.error = stats.abs_error = NAN;
+                stats.minimum = stats.maximum = NAN;
+            }
+            stats.open_fraction = z.area > 0 ? (float)(z.open_area / z.area) : NAN;
+            stats.setpoint = z.setpoint;
+            return stats;
+        }
+
+        uint32_t zone_of(uint32_t vent) const { return vent < samples.size() ? samples[vent].zone : ZONE_NONE; }
+        uint32_t parent(uint32_t zone) const { return totals[zone].parent; }
+        uint32_t depth(uint32_t zone) const { return info[zone].depth; }
+        const std::string &name(uint32_t zone) const { return info[zone].name; }
+        const std::vector<uint32_t> &children(uint32_t zone) const { return info[zone].children; }
+        size_t size() const { return totals.size(); }
+
+        // "Upstairs/Bedroom", the inverse of find()
+        std::string path(uint32_t zone) const {
+            if (zone == ZONE_HOUSE) {
+                return "";
+            }
+            std::string above = path(totals[zone].parent);
+            return above.empty() ? info[zone].name : above + "/" + info[zone].name;
+        }
+
+    private:
+        // Over every vent in the subtree. 64 bytes.
+        struct alignas(64) ZoneTotals{
+            double temperature;
+            double error;
+            double abs_error;
+            double open_area;
+            float area;
+            float minimum;
+            float maximum;
+            float setpoint;
+            uint32_t parent;
+            uint32_t vents;
+            uint32_t reporting;
+            bool minimum_stale;
+            bool maximum_stale;
+
+            ZoneTotals() : temperature(0), error(0), abs_error(0), open_area(0), area(0),
+                           minimum(INFINITY), maximum(-INFINITY), setpoint(NAN), parent(ZONE_NONE),
+                           vents(0), reporting(0), minimum_stale(false), maximum_stale(false) {}
+        };
+
+        struct ZoneInfo{
+            std::string name;
+            uint32_t depth;
+            std::vector<uint32_t> children;
+            std::vector<uint32_t> members;  // vents placed directly in this zone
+        };
+
+        uint32_t child(uint32_t zone, const char *name, size_t len) const {
+            const std::vector<uint32_t> &kids = info[zone].children;
+            for (size_t i = 0; i < kids.size(); i++) {
+                const std::string &n = info[kids[i]].name;
+                if (n.size() == len && memcmp(n.data(), name, len) == 0) {
+                    return kids[i];
+                }
+            }
+            return ZONE_NONE;
+        }
+
+        void grow(uint32_t vent) {
+            if (vent < samples.size()) {
+                return;
+            }
+            ZoneSample empty = {ZONE_NONE, NAN, 0.0f, 0.0f};
+            samples.resize(vent + 1, empty);
+            areas.resize(vent + 1, 0.0f);
+        }
+
+        void remove_member(uint32_t zone, uint32_t vent) {
+            std::vector<uint32_t> &members = info[zone].members;
+            for (size_t i = 0; i < members.size(); i++) {
+                if (members[i] == vent) {
+                    members[i] = members.back();
+                    members.pop_back();
+                    return;
+                }
+            }
+        }
+
+        void update(uint32_t vent, const ZoneSample &next) {
+            if (next.zone != ZONE_NONE) {
+                fold(next.zone, samples[vent], next, 0, 0.0f);
+            }
+            samples[vent] = next;
+        }
+
+        // Replace a vent's contribution `before` by `after` in zone and every zone above it.
+        // joined is +1 or -1 when the vent enters or leaves, with its area, else 0.
+        void fold(uint32_t zone, const ZoneSample &before, const ZoneSample &after, int joined, float d_area) {
+            bool was = before.reporting(), is = after.reporting();
+            int d_reporting = (int)is - (int)was;
+            double d_temperature = 0, d_error = 0, d_abs = 0;
+            if (was) {
+                double e = before.temperature - before.desired;
+                d_temperature -= before.temperature;
+                d_error -= e;
+                d_abs -= fabs(e);
+            }
+            if (is) {
+                double e = after.temperature - after.desired;
+                d_temperature += after.temperature;
+                d_error += e;
+                d_abs += fabs(e);
+            }
+            double d_open = (double)after.open_area - before.open_area;
+            // Leaving an extreme, by moving or by no longer reporting
+            bool left = was && (!is || after.temperature != before.temperature);
+
+            for (uint32_t z = zone; z != ZONE_NONE; z = totals[z].parent) {
+                ZoneTotals &n = totals[z];
+                n.vents += joined;
+                n.reporting += d_reporting;
+                n.temperature += d_temperature;
+                n.error += d_error;
+                n.abs_error += d_abs;
+                n.area += d_area;
+                n.open_area += d_open;
+                if (!n.minimum_stale) {
+                    if (is && after.temperature <= n.minimum) {
+                        n.minimum = after.temperature;
+                    } else if (left && before.temperature == n.minimum) {
+                        n.minimum_stale = true;
+                    }
+                }
+                if (!n.maximum_stale) {
+                    if (is && after.temperature >= n.maximum) {
+                        n.maximum = after.temperature;
+                    } else if (left && before.temperature == n.maximum) {
+                        n.maximum_stale = true;
+                    }
+                }
+                if (n.reporting == 0) {
+                    n.minimum = INFINITY;
+                    n.maximum = -INFINITY;
+                    n.minimum_stale = n.maximum_stale = false;
+                }
+            }
+        }
+
+        // Recompute stale extremes from members and children, repairing stale children first
+        void repair(uint32_t zone) {
+            ZoneTotals &n = totals[zone];
+            if (!n.minimum_stale && !n.maximum_stale) {
+                return;
+            }
+            const ZoneInfo &z = info[zone];
+            float lo = INFINITY, hi = -INFINITY;
+            for (size_t i = 0; i < z.members.size(); i++) {
+                const ZoneSample &s = samples[z.members[i]];
+                if (s.reporting()) {
+                    lo = s.temperature < lo ? s.temperature : lo;
+                    hi = s.temperature > hi ? s.temperature : hi;
+                }
+            }
+            for (size_t i = 0; i < z.children.size(); i++) {
+                repair(z.children[i]);
+                const ZoneTotals &c = totals[z.children[i]];
+                lo = c.minimum < lo ? c.minimum : lo;
+                hi = c.maximum > hi ? c.maximum : hi;
+            }
+            n.minimum = lo;
+            n.maximum = hi;
+            n.minimum_stale = n.maximum_stale = false;
+        }
+
+        void apply_setpoint(uint32_t zone, float celsius, std::vector<uint32_t> &changed) {
+            ZoneTotals &n = totals[zone];
+            const ZoneInfo &z = info[zone];
+            n.setpoint = celsius;
+            n.error = n.abs_error = 0;
+            for (size_t i = 0; i < z.members.size(); i++) {
+                ZoneSample &s = samples[z.members[i]];
+                s.desired = celsius;
+                if (s.reporting()) {
+                    double e = s.temperature - celsius;
+                    n.error += e;
+                    n.abs_error += fabs(e);
+                }
+                changed.push_back(z.members[i]);
+            }
+            for (size_t i = 0; i < z.children.size(); i++) {
+                apply_setpoint(z.children[i], celsius, changed);
+                n.error += totals[z.children[i]].error;
+                n.abs_error += totals[z.children[i]].abs_error;
+            }
+        }
+
+        std::vector<ZoneTotals> totals;     // by zone, hot
+        std::vector<ZoneInfo> info;         // by zone, cold
+        std::vector<ZoneSample> samples;    // by vent index
+        std::vector<float> areas;           // by vent index, only read when a vent moves
+
+        ZoneTree(const ZoneTree &);
+        ZoneTree &operator=(const ZoneTree &);
+};
@@ -3,37 +3,51 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <string>
+#include <chrono>
+#include <sys/socket.h>
+
+// Listens where the phone app does, UDP port 3001, and prints what the hub sends it: a
+// little-endian uint32 type followed by a UTF-8 value. Datagrams are read up to BATCH at a
+// time with recvmmsg(). With --count nothing is printed per packet; the datagrams received
+// each second are.
+#define PHONE_PORT 3001
+#define MAX_DATAGRAM 1024
+#define BATCH 64
 
 class Packet {
 public:
     uint32_t pkt_type;
-    float valueBits;
+    std::string value;
 };
 
 void printPacket(const Packet& packet) {
     std::cout << "Received packet:" << std::endl;
     std::string type = "";
     switch (packet.pkt_type) {
-        case 2: 
-            type = "Temperature Control Packet";
+        case 1:
+            type = "Vent Setup Complete Packet";
             break;
-        
-        case 3: 
-            type = "Motor Control Packet";
+
+        case 2:
+            type = "Temperature Packet";
             break;
-        
-        case 4: 
-            type = "Vent Shutoff Packet";
+
+        case 3:
+            type = "Motor Position Packet";
+            break;
+
+        default:
+            type = "Unknown (" + std::to_string(packet.pkt_type) + ")";
             break;
     }
     std::cout << "Packet Type: " << type << std::endl;
-    float value = packet.valueBits;
-    std::cout << "Value: " << value << std::endl;
+    std::cout << "Value: " << packet.value << std::endl;
 }
 
-int main() {
+int main(int argc, char **argv) {
+    bool countOnly = argc > 1 && strcmp(argv[1], "--count") == 0;
     int sockfd;
-    struct sockaddr_in servaddr, cliaddr;
+    struct sockaddr_in servaddr;
 
     if ((sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
         std::cerr << "Socket creation failed" << std::endl;
@@ -41,11 +55,10 @@ int main() {
     }
 
     memset(&servaddr, 0, sizeof(servaddr));
-    memset(&cliaddr, 0, sizeof(cliaddr));
 
     servaddr.sin_family = AF_INET;
     servaddr.sin_addr.s_addr = INADDR_ANY;
-    servaddr.sin_port = htons(1234);
+    servaddr.sin_port = htons(PHONE_PORT);
 
     if (bind(sockfd, (const struct sockaddr *)&servaddr, sizeof(servaddr)) < 0) {
         std::cerr << "Bind failed" << std::endl;
@@ -53,27 +66,61 @@ int main() {
         return -1;
     }
 
-    std::cout << "Listening on port 1234..." << std::endl;
+    std::cout << "Listening on port " << PHONE_PORT << "..." << std::endl;
 
-    char buffer[sizeof(Packet)];
-    socklen_t len;
-    int n;
+    // Set up once; recvmmsg() fills them in place
+    static char buffers[BATCH][MAX_DATAGRAM];
+    struct iovec iov[BATCH];
+    struct mmsghdr msgs[BATCH];
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < BATCH; i++) {
+        iov[i].iov_base = buffers[i];
+        iov[i].iov_len = MAX_DATAGRAM;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    Packet packet;
+    uint64_t count = 0;
+    uint64_t calls = 0;
+    auto lastReport = std::chrono::steady_clock::now();
 
     while (true) {
-        n = recvfrom(sockfd, buffer, sizeof(buffer), MSG_WAITALL, (struct sockaddr *)&cliaddr, &len);
+        // Blocks for the first datagram, then takes whatever else is already queued
+        int n = recvmmsg(sockfd, msgs, BATCH, MSG_WAITFORONE, NULL);
         if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
             std::cerr << "Receive failed" << std::endl;
             close(sockfd);
             return -1;
         }
+        calls++;
+        count += n;
 
-        Packet packet;
-        std::memcpy(&packet.pkt_type, buffer, sizeof(packet.pkt_type));
-        std::memcpy(&packet.valueBits, buffer + sizeof(packet.pkt_type), sizeof(packet.valueBits));
+        for (int i = 0; !countOnly && i < n; i++) {
+            unsigned int len = msgs[i].msg_len;
+            if (len < sizeof(uint32_t)) {
+                std::cerr << "Short packet: " << len << " bytes" << std::endl;
+                continue;
+            }
+            const unsigned char *bytes = (const unsigned char *)buffers[i];
+            packet.pkt_type = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+            packet.value.assign(buffers[i] + sizeof(uint32_t), len - sizeof(uint32_t));
+            printPacket(packet);
+        }
 
-        printPacket(packet);
+        auto now = std::chrono::steady_clock::now();
+        if (countOnly && now - lastReport >= std::chrono::seconds(1)) {
+            double seconds = std::chrono::duration<double>(now - lastReport).count();
+            std::cout << count / seconds << " datagrams/s in " << calls / seconds << " recvmmsg/s" << std::endl;
+            count = 0;
+            calls = 0;
+            lastReport = now;
+        }
     }
 
     close(sockfd);
     return 0;
-}
\ No newline at end of file
+}
@@ -1,50 +1,75 @@
 #include <iostream>
 #include <cstring>
+#include <cstdlib>
+#include <string>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <thread>
 #include <chrono>
 #include <random>
 
+// Plays the phone app against the hub: packets are a little-endian uint32 type followed by
+// a UTF-8 value, sent to the hub's UDP port 5001. Replies come back to port 3001, where
+// app_packet_receiver listens.
+//
+//   ./packet_sender <hub ip> 1 <ble name>         set up a vent
+//   ./packet_sender <hub ip> 2 <vent>.<celsius>   setpoint
+//   ./packet_sender <hub ip> 3 <vent>.<percent>   hold the cover (0 or 100 from the app)
+//   ./packet_sender <hub ip> 4 '3,7,10-19@50'     only these vents, at most 50 updates a second
+//   ./packet_sender <hub ip> 5 ''                 stop updates until the next packet
+//   ./packet_sender <hub ip> 6 Upstairs=21.5      setpoint for every vent in a zone (hub --zones)
+//   ./packet_sender <hub ip> 2 <vent>             random setpoints, one a second
+#define HUB_PHONE_PORT 5001
+#define MAX_VALUE 1020
+
 class Packet {
 public:
     uint32_t pkt_type;
-    float temperatureBitPattern;
+    std::string value;
 
-    Packet(uint32_t pktType, float temperature) {
+    Packet(uint32_t pktType, const std::string &packetValue) {
         pkt_type = pktType;
-        temperatureBitPattern = temperature;
+        value = packetValue;
     }
 
-    void toBytes(char* buffer) const {
-        memcpy(buffer, &pkt_type, sizeof(pkt_type));
-        memcpy(buffer + sizeof(pkt_type), &temperatureBitPattern, sizeof(temperatureBitPattern));
+    size_t toBytes(char* buffer) const {
+        buffer[0] = pkt_type & 0xff;
+        buffer[1] = (pkt_type >> 8) & 0xff;
+        buffer[2] = (pkt_type >> 16) & 0xff;
+        buffer[3] = (pkt_type >> 24) & 0xff;
+        size_t len = value.size() < MAX_VALUE ? value.size() : MAX_VALUE;
+        memcpy(buffer + sizeof(pkt_type), value.data(), len);
+        return sizeof(pkt_type) + len;
     }
 };
 
 void sendPacket(int sockfd, const sockaddr_in& servaddr, const Packet& packet) {
-    char buffer[sizeof(Packet)];
-    packet.toBytes(buffer);
+    char buffer[sizeof(uint32_t) + MAX_VALUE];
+    size_t len = packet.toBytes(buffer);
 
-    ssize_t sentBytes = sendto(sockfd, buffer, sizeof(buffer), 0, (const struct sockaddr*)&servaddr, sizeof(servaddr));
+    ssize_t sentBytes = sendto(sockfd, buffer, len, 0, (const struct sockaddr*)&servaddr, sizeof(servaddr));
     if (sentBytes < 0) {
         std::cerr << "Error sending packet: " << strerror(errno) << std::endl;
     } else {
         std::cout << "Packet sent: " << std::endl;
         std::cout << "  Packet Type: " << packet.pkt_type << std::endl;
-        float temperature = *reinterpret_cast<const float*>(&packet.temperatureBitPattern);
-        std::cout << "  Temperature: " << temperature << std::endl;
+        std::cout << "  Value: " << packet.value << std::endl;
     }
 }
 
 float generateRandomTemperature() {
     static std::random_device rd;
     static std::mt19937 gen(rd());
-    static std::uniform_real_distribution<> dis(-50.0, 50.0);  // Example temperature range from -50.0 to 50.0
+    static std::uniform_real_distribution<> dis(18.0, 28.0);  // Setpoints the app allows
     return dis(gen);
 }
 
-int main() {
+int main(int argc, char **argv) {
+    if (argc < 4 && !(argc == 3 && strcmp(argv[2], "5") == 0)) {
+        std::cerr << "usage: " << argv[0] << " <hub ip> <type> <value>" << std::endl;
+        return -1;
+    }
+
     int sockfd;
     struct sockaddr_in servaddr;
 
@@ -55,18 +80,23 @@ int main() {
 
     memset(&servaddr, 0, sizeof(servaddr));
     servaddr.sin_family = AF_INET;
-    servaddr.sin_port = htons(3001);
-    servaddr.sin_addr.s_addr = inet_addr("192.168.0.19");  // Change this to the target IP address
+    servaddr.sin_port = htons(HUB_PHONE_PORT);
+    servaddr.sin_addr.s_addr = inet_addr(argv[1]);
 
-    uint32_t pktType = 1;  // Example packet type
+    uint32_t pktType = (uint32_t)strtoul(argv[2], NULL, 10);
+    std::string value = argc > 3 ? argv[3] : "";
 
-    while (true) {
-        float temperature = generateRandomTemperature();
-        Packet packet(pktType, temperature);
-        sendPacket(sockfd, servaddr, packet);
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+    if (pktType == 2 && value.find('.') == std::string::npos) {
+        // Just a vent ID: keep sending it new setpoints
+        while (true) {
+            char setpoint[32];
+            snprintf(setpoint, sizeof(setpoint), "%.1f", generateRandomTemperature());
+            sendPacket(sockfd, servaddr, Packet(pktType, value + "." + setpoint));
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
     }
+    sendPacket(sockfd, servaddr, Packet(pktType, value));
 
     close(sockfd);
     return 0;
-}
\ No newline at end of file
+}
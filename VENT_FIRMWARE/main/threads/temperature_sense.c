@@ -594,6 +594,18 @@ uint16_t voltageToADC(double voltage, uint16_t adcMaxValue) {
     return (uint16_t)((voltage / V_REF) * adcMaxValue);
 }
 
+// Raw 12-bit ADC reading to degrees C: pad the voltage, then look it up
+float adc_to_temperature(uint32_t raw_adc) {
+    double voltage = adcToVoltage(raw_adc, 4095U);
+
+    // slightly pad the voltage and adc
+    if (voltage < 2.65f) voltage += VOLTAGE_PADDING;
+
+    uint32_t padded_adc = voltageToADC(voltage, 4095U);
+
+    return ADC_TO_TEMP_LUT[padded_adc];
+}
+
  
  // Function declarations
  void temp_sense_task_entry(void *pvParameter);
@@ -618,18 +630,10 @@ uint16_t voltageToADC(double voltage, uint16_t adcMaxValue) {
 
         uint32_t raw_adc =  adc1_get_raw(ADC1_CHANNEL_4);
 
-        double voltage = adcToVoltage(raw_adc, 4095U);
-
-        // slightly pad the voltage and adc
-        if (voltage < 2.65f) voltage += VOLTAGE_PADDING;
-
-        uint32_t padded_adc = voltageToADC(voltage, 4095U);
-
-
-        float temp = ADC_TO_TEMP_LUT[padded_adc];
+        float temp = adc_to_temperature(raw_adc);
         insert_temp(&temp_data, temp);
 
-        // ESP_LOGI(TEMP_SENSE_TAG, "raw_adc read %lu, padded_adc read %lu, voltage: %.5f, temp: %f", raw_adc, padded_adc, voltage, temp);
+        // ESP_LOGI(TEMP_SENSE_TAG, "raw_adc read %lu, temp: %f", raw_adc, temp);
 
     }
  }
\ No newline at end of file